@@ -31,6 +31,7 @@
 #endif
 
 struct Client;
+struct StatDesc;
 struct irc_in_addr;
 
 /*
@@ -43,5 +44,7 @@ extern void IPcheck_connect_succeeded(struct Client *cptr);
 extern int IPcheck_remote_connect(struct Client *cptr, int is_burst);
 extern void IPcheck_disconnect(struct Client *cptr);
 extern unsigned short IPcheck_nr(struct Client* cptr);
+extern void IPcheck_report(struct Client *to, const struct StatDesc *sd,
+                           char *param);
 
 #endif /* INCLUDED_ipcheck_h */
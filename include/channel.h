@@ -38,6 +38,7 @@
 
 struct SLink;
 struct Client;
+struct ListSnapshot;
 
 /*
  * General defines
@@ -273,6 +274,14 @@ struct Ban {
   char banstr[NICKLEN+USERLEN+HOSTLEN+3];  /**< hostmask that the ban matches */
 };
 
+/** Local members of a channel, cached while a net.split is exited. */
+struct SplitLocals {
+  struct SplitLocals* next;       /**< Next channel with cached members */
+  struct Channel*     channel;    /**< Channel, NULL once destructed */
+  unsigned int        count;      /**< Number of entries in \a members */
+  struct Client*      members[1]; /**< Local members of the channel */
+};
+
 /** Information about a channel */
 struct Channel {
   struct Channel*    next;	/**< next channel in the global channel list */
@@ -286,6 +295,7 @@ struct Channel {
   struct SLink*      invites;	   /**< List of invites on this channel */
   struct Ban*        banlist;      /**< List of bans on this channel */
   struct Mode        mode;	   /**< This channels mode */
+  struct SplitLocals* split_locals; /**< Local members during a net.split */
   char               topic[TOPICLEN + 1]; /**< Channels topic */
   char               topic_nick[NICKLEN + 1]; /**< Nick of the person who set
 						*  The topic
@@ -304,7 +314,8 @@ struct ListingArgs {
   unsigned int flags;
   time_t max_topic_time;
   time_t min_topic_time;
-  unsigned int bucket;
+  struct ListSnapshot *snapshot; /**< Channels being listed. */
+  unsigned int pos;              /**< Next entry of \a snapshot. */
   char wildcard[CHANNELLEN];
 };
 
@@ -408,6 +419,9 @@ extern int client_can_send_to_channel(struct Client *cptr, struct Channel *chptr
 
 extern void remove_user_from_channel(struct Client *sptr, struct Channel *chptr);
 extern void remove_user_from_all_channels(struct Client* cptr);
+extern void split_start(void);
+extern void split_end(void);
+extern struct SplitLocals* split_locals(struct Channel* chptr);
 
 extern int is_chan_op(struct Client *cptr, struct Channel *chptr);
 extern int is_zombie(struct Client *cptr, struct Channel *chptr);
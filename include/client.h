@@ -56,6 +56,9 @@
 struct ConfItem;
 struct Listener;
 struct ListingArgs;
+#if defined(DDB)
+struct DdbBurst;
+#endif
 struct SLink;
 struct Server;
 struct User;
@@ -63,6 +66,7 @@ struct Whowas;
 struct hostent;
 struct Privs;
 struct AuthRequest;
+struct RadixNode;
 
 /*
  * Structures
@@ -245,6 +249,17 @@ struct Connection
   HandlerType         con_handler;   /**< Message index into command table
                                         for parsing. */
   struct ListingArgs* con_listing;   /**< Current LIST status. */
+#if defined(DDB)
+  struct DdbBurst*    con_ddbburst;  /**< Current DDB tables burst status. */
+#endif
+  struct Client*      con_ipnext;    /**< Next local user with our IP */
+  struct Client**     con_ipprev_p;  /**< What points to us in the IP index */
+  struct RadixNode*   con_ipnode;    /**< Our IP in the index of local users */
+  struct Client*      con_hostnext;  /**< Next local user in our host bucket */
+  struct Client**     con_hostprev_p;/**< What points to us in the host index */
+  struct Connection*  con_pingnext;  /**< Next connection in our ping slot */
+  struct Connection** con_pingprev_p;/**< What points to us in the ping wheel */
+  time_t              con_pingdue;   /**< Next time to check our pings */
   unsigned int        con_max_sendq; /**< cached max send queue for client */
   unsigned int        con_ping_freq; /**< cached ping freq */
   unsigned short      con_lastsq;    /**< # 2k blocks when sendqueued
@@ -359,6 +374,8 @@ struct Client {
 #define cli_name(cli)		((cli)->cli_name)
 /** Get client username (ident). */
 #define cli_username(cli)	((cli)->cli_username)
+/** Forget the cached nick!user@host of a user after changing any part. */
+#define cli_clearprefix(cli)	((cli)->cli_user ? (cli)->cli_user->prefix_len = 0 : 0)
 /** Get client realname (information field). */
 #define cli_info(cli)		((cli)->cli_info)
 /** Get client account string. */
@@ -404,6 +421,22 @@ struct Client {
 #define cli_handler(cli)	con_handler(cli_connect(cli))
 /** Get LIST status for client. */
 #define cli_listing(cli)	con_listing(cli_connect(cli))
+#if defined(DDB)
+/** Get DDB burst status for client. */
+#define cli_ddbburst(cli)	con_ddbburst(cli_connect(cli))
+#endif
+/** Get next local user with the same IP address. */
+#define cli_ipnext(cli)		con_ipnext(cli_connect(cli))
+/** Get the pointer to the client in the IP index of local users. */
+#define cli_ipprev_p(cli)	con_ipprev_p(cli_connect(cli))
+/** Get the node of the client in the IP index of local users. */
+#define cli_ipnode(cli)		con_ipnode(cli_connect(cli))
+/** Get next local user in the same host bucket. */
+#define cli_hostnext(cli)	con_hostnext(cli_connect(cli))
+/** Get the pointer to the client in the host index of local users. */
+#define cli_hostprev_p(cli)	con_hostprev_p(cli_connect(cli))
+/** Get the next time to check the pings of the client. */
+#define cli_pingdue(cli)	con_pingdue(cli_connect(cli))
 /** Get cached max SendQ for client. */
 #define cli_max_sendq(cli)	con_max_sendq(cli_connect(cli))
 /** Get ping frequency for client. */
@@ -489,6 +522,26 @@ struct Client {
 #define con_handler(con)	((con)->con_handler)
 /** Get the LIST status for the connection. */
 #define con_listing(con)	((con)->con_listing)
+#if defined(DDB)
+/** Get the DDB burst status for the connection. */
+#define con_ddbburst(con)	((con)->con_ddbburst)
+#endif
+/** Get next local user with the same IP address. */
+#define con_ipnext(con)		((con)->con_ipnext)
+/** Get the pointer to the connection's client in the IP index. */
+#define con_ipprev_p(con)	((con)->con_ipprev_p)
+/** Get the node of the connection's client in the IP index. */
+#define con_ipnode(con)		((con)->con_ipnode)
+/** Get next local user in the same host bucket. */
+#define con_hostnext(con)	((con)->con_hostnext)
+/** Get the pointer to the connection's client in the host index. */
+#define con_hostprev_p(con)	((con)->con_hostprev_p)
+/** Get next connection in the same slot of the ping wheel. */
+#define con_pingnext(con)	((con)->con_pingnext)
+/** Get the pointer to the connection in the ping wheel. */
+#define con_pingprev_p(con)	((con)->con_pingprev_p)
+/** Get the next time to check the pings of the connection. */
+#define con_pingdue(con)	((con)->con_pingdue)
 /** Get the maximum permitted SendQ size for the connection. */
 #define con_max_sendq(con)	((con)->con_max_sendq)
 /** Get the ping frequency for the connection. */
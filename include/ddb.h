@@ -40,6 +40,8 @@
 #define DDB_TABLE_MAX      256
 /** Number of keys is caching */
 #define DDB_BUF_CACHE  32
+/** Number of registers of each hash segment of a table */
+#define DDB_SEGMENT_SIZE 1024
 
 /*
  * Distributed DataBases Tables
@@ -84,6 +86,8 @@
 #define DDB_WEBIRCDB       'w'
 /** Last table of %DDB Distributed Databases. */
 #define DDB_END            'z'
+/** Number of tables of %DDB Distributed Databases. */
+#define DDB_TABLES         (DDB_END - DDB_INIT + 1)
 
 /*
  * PseudoBots
@@ -119,6 +123,35 @@ struct ddb_stat {
 };
 
 
+/** Checkpoint of the hash of a table.
+ * The hash of a table is a chain over all its registers, so the hash
+ * saved every DDB_SEGMENT_SIZE registers tells which segment of the
+ * table differs from the one written, and the registers before it can
+ * be kept.
+ */
+struct DdbSegment {
+  unsigned long first;  /**< First id of the segment */
+  unsigned long last;   /**< Last id of the segment */
+  unsigned int  hi;     /**< Hi hash of the table after the segment */
+  unsigned int  lo;     /**< Lo hash of the table after the segment */
+};
+
+/** Tables being bursted to a server link.
+ * The registers are sent while the sendQ of the link is below a
+ * watermark, and the burst is resumed from the last id sent when the
+ * sendQ drains.
+ */
+struct DdbBurst {
+  unsigned int  pending;                /**< Tables with registers to send, one bit per table */
+  unsigned long id[DDB_TABLES];         /**< Last id sent of each table */
+  size_t        remaining[DDB_TABLES];  /**< Bytes of each table still to send */
+};
+
+/** Secondary index on a word of the content of the registers. */
+#define DDB_INDEX_CONTENT  1
+/** Secondary index on the keys which are IP addresses or masks. */
+#define DDB_INDEX_IP       2
+
 /** DDB Macro for allocations. */
 #define DdbMalloc(x)	MyMalloc(x)
 /** DDB Macro for freeing memory. */
@@ -177,10 +210,18 @@ extern void ddb_drop_memory(unsigned char table, int events);
 extern void ddb_compact(unsigned char table, unsigned long id, char *content);
 extern void ddb_burst(struct Client *cptr);
 extern int ddb_table_burst(struct Client *cptr, unsigned char table, unsigned long id);
+extern void ddb_burst_next(struct Client *cptr);
+extern void ddb_burst_free(struct Client *cptr);
 
 extern struct Ddb *ddb_iterator_first(unsigned char table);
 extern struct Ddb *ddb_iterator_next(void);
 extern struct Ddb *ddb_find_key(unsigned char table, char *key);
+extern int ddb_index_type(unsigned char table);
+extern struct Ddb *ddb_index_first(unsigned char table, const char *value);
+extern struct Ddb *ddb_index_next(void);
+extern struct Ddb *ddb_find_ip(unsigned char table, const struct irc_in_addr *addr);
+extern int ddb_walk_ip(unsigned char table, const struct irc_in_addr *addr, unsigned char bits,
+                       int (*fn)(struct Ddb *, void *), void *data);
 extern char *ddb_get_botname(char *botname);
 
 extern void ddb_splithubs(struct Client *cptr, unsigned char table, char *exitmsg);
@@ -193,11 +234,15 @@ extern void ddb_count_memory(size_t* count_out, size_t* bytes_out);
 extern void ddb_db_init(void);
 extern int ddb_db_cache(void);
 extern int ddb_db_read(struct Client *cptr, unsigned char table, unsigned long id, int count);
+extern int ddb_db_burst(struct Client *cptr, unsigned char table, unsigned long *id, unsigned int limit, size_t *remaining);
 extern void ddb_db_write(unsigned char table, unsigned long id, char *mask, char *key, char *content);
 extern void ddb_db_drop(unsigned char table);
 extern void ddb_db_compact(unsigned char table);
 extern void ddb_db_hash_read(unsigned char table, unsigned int *hi, unsigned int *lo);
 extern void ddb_db_hash_write(unsigned char table);
+extern unsigned int ddb_db_segment_read(unsigned char table, struct DdbSegment **segments);
+extern void ddb_db_segment_write(unsigned char table, struct DdbSegment *segments, unsigned int count, int append);
+extern int ddb_db_truncate(unsigned char table, unsigned long id);
 extern void ddb_db_end(void);
 
 /* ddb_tools externs */
@@ -31,10 +31,17 @@
 #include <sys/types.h>
 #define INCLUDED_sys_types_h
 #endif
+#ifndef INCLUDED_stdio_h
+#include <stdio.h>          /* FILE */
+#define INCLUDED_stdio_h
+#endif
 
 #ifndef INCLUDED_res_h
 #include "res.h"
 #endif
+#ifndef INCLUDED_ircd_maskidx_h
+#include "ircd_maskidx.h"
+#endif
 
 struct Client;
 struct StatDesc;
@@ -62,6 +69,7 @@ struct Gline {
   unsigned char gl_bits;	/**< Bits in gl_addr used in the mask. */
   unsigned int	gl_flags;	/**< G-line status flags. */
   enum GlineLocalState gl_state;/**< G-line local state. */
+  struct MaskEntry gl_index;	/**< Entry in the index of G-lines. */
 };
 
 /** Action to perform on a G-line. */
@@ -141,10 +149,14 @@ extern struct Gline *gline_find(char *userhost, unsigned int flags);
 extern struct Gline *gline_lookup(struct Client *cptr, unsigned int flags);
 extern void gline_free(struct Gline *gline);
 extern void gline_burst(struct Client *cptr);
+extern void gline_burst_done(struct Client *cptr);
+extern void gline_burst_lost(struct Client *cptr);
 extern int gline_resend(struct Client *cptr, struct Gline *gline);
 extern int gline_list(struct Client *sptr, char *userhost);
 extern void gline_stats(struct Client *sptr, const struct StatDesc *sd,
                         char *param);
 extern int gline_memory_count(size_t *gl_size);
+extern void gline_save(FILE *file);
+extern int gline_restore(int parc, char *parv[]);
 
 #endif /* INCLUDED_gline_h */
@@ -30,6 +30,7 @@ struct Client;
 struct Channel;
 struct Monitor;
 struct StatDesc;
+struct irc_in_addr;
 
 /*
  * general defines
@@ -93,6 +94,25 @@ extern struct Client *hSeekClient(const char *name, int TMask);
 extern struct Channel *hSeekChannel(const char *name);
 extern struct Monitor *hSeekMonitor(const char *name);
 
+extern void hAddLocalUser(struct Client *cptr);
+extern void hRemLocalUser(struct Client *cptr);
+extern int hWalkLocalUsersIP(const struct irc_in_addr *addr, unsigned char bits,
+                             int (*fn)(struct Client *, void *), void *data);
+extern int hWalkLocalUsersHost(const char *mask,
+                               int (*fn)(struct Client *, void *), void *data);
+extern int hAddUser(struct Client *cptr);
+extern int hRemUser(struct Client *cptr);
+extern int hUsersHostKeyed(const char *mask);
+extern int hUsersInfoKeyed(const char *mask);
+extern int hWalkUsersIP(const struct irc_in_addr *addr, unsigned char bits,
+                        int (*fn)(struct Client *, void *), void *data);
+extern int hWalkUsersHost(const char *mask,
+                          int (*fn)(struct Client *, void *), void *data);
+extern int hWalkUsersAccount(const char *account,
+                             int (*fn)(struct Client *, void *), void *data);
+extern int hWalkUsersInfo(const char *mask,
+                          int (*fn)(struct Client *, void *), void *data);
+
 extern int m_hash(struct Client *cptr, struct Client *sptr, int parc, char *parv[]);
 
 extern int isNickJuped(const char *nick);
@@ -101,6 +121,7 @@ extern void clearNickJupes(void);
 extern void stats_nickjupes(struct Client* to, const struct StatDesc* sd,
 			    char* param);
 extern void list_next_channels(struct Client *cptr);
+extern void list_stop_channels(struct Client *cptr);
 
 #if defined(DDB)
 extern int ddb_hash_register(char *key, int hash_size);
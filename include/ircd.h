@@ -64,6 +64,9 @@ struct Daemon
 extern void server_die(const char* message);
 extern void server_panic(const char* message);
 extern void server_restart(const char* message);
+extern void server_upgrade(const char* message);
+extern void ping_schedule(struct Client* cptr, time_t when);
+extern void ping_unschedule(struct Client* cptr);
 
 extern struct Client  me;
 extern time_t         CurrentTime;
@@ -53,6 +53,7 @@ enum Feature {
   FEAT_NOIDENT,
   FEAT_RANDOM_SEED,
   FEAT_DEFAULT_LIST_PARAM,
+  FEAT_LIST_SNAPSHOT_TIME,
   FEAT_NICKNAMEHISTORYLENGTH,
   FEAT_HOST_HIDING,
   FEAT_HIDDEN_HOST,
@@ -87,14 +88,20 @@ enum Feature {
   FEAT_IPCHECK_48_CLONE_LIMIT,
   FEAT_IPCHECK_48_CLONE_PERIOD,
   FEAT_IPCHECK_CLONE_DELAY,
+  FEAT_ACCEPT_THROTTLE_32,
+  FEAT_ACCEPT_THROTTLE_24,
+  FEAT_ACCEPT_THROTTLE_64,
+  FEAT_ACCEPT_THROTTLE_PERIOD,
   FEAT_CHANNELLEN,
 
   /* Some misc. default paths */
   FEAT_MPATH,
   FEAT_RPATH,
   FEAT_PPATH,
+  FEAT_UPGRADE_PATH,
 #if defined(DDB)
   FEAT_DDBPATH,
+  FEAT_DDB_LOAD_THREADS,
 #endif
 
   /* Networking features */
@@ -103,6 +110,10 @@ enum Feature {
   FEAT_POLLS_PER_LOOP,
   FEAT_IRCD_RES_RETRIES,
   FEAT_IRCD_RES_TIMEOUT,
+  FEAT_IRCD_RES_CACHE_SIZE,
+  FEAT_IRCD_RES_CACHE_MINTTL,
+  FEAT_IRCD_RES_CACHE_MAXTTL,
+  FEAT_IRCD_RES_CACHE_NEGTTL,
   FEAT_AUTH_TIMEOUT,
   FEAT_ANNOUNCE_INVITES,
 
@@ -150,6 +161,7 @@ enum Feature {
   FEAT_HIS_STATS_y,
   FEAT_HIS_STATS_z,
   FEAT_HIS_STATS_IAUTH,
+  FEAT_HIS_STATS_LOGS,
   FEAT_HIS_WEBIRC,
   FEAT_HIS_WHOIS_SERVERNAME,
   FEAT_HIS_WHOIS_IDLETIME,
@@ -35,6 +35,7 @@
 #endif
 
 struct Client;
+struct StatDesc;
 
 /* WARNING WARNING WARNING -- Order is important; these enums are
  * used as indexes into arrays.
@@ -120,6 +121,8 @@ extern char *log_get_default(void);
 extern void log_feature_unmark(void);
 extern int log_feature_mark(int flag);
 extern void log_feature_report(struct Client *to, int flag);
+extern void log_report(struct Client *to, const struct StatDesc *sd,
+		       char *param);
 
 extern int log_inassert;
 
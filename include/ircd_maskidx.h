@@ -0,0 +1,91 @@
+/*
+ * IRC-Hispano IRC Daemon, include/ircd_maskidx.h
+ *
+ * Copyright (C) 1997-2019 IRC-Hispano Development Team <toni@tonigarcia.es>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/** @file
+ * @brief Index of host masks.
+ */
+#ifndef INCLUDED_ircd_maskidx_h
+#define INCLUDED_ircd_maskidx_h
+
+#ifndef INCLUDED_ircd_radix_h
+#include "ircd_radix.h"
+#endif
+
+/** Kinds of mask in a MaskIndex. */
+enum MaskKind {
+  MASK_KIND_IP,       /**< IP address or CIDR mask, in the radix tree. */
+  MASK_KIND_EXACT,    /**< Host without wildcards, hashed by the host. */
+  MASK_KIND_SUFFIX,   /**< Wildcard host, hashed by its literal domain suffix. */
+  MASK_KIND_OTHER     /**< Any other mask, checked on every lookup. */
+};
+
+/** Entry of a MaskIndex.
+ * The entry is usually embedded in the structure owning the mask, so
+ * the index does not allocate memory for it.
+ */
+struct MaskEntry {
+  struct MaskEntry  *next;    /**< Next entry with the same key. */
+  struct MaskEntry **prev_p;  /**< Previous pointer to this entry, NULL if not indexed. */
+  struct RadixNode  *node;    /**< Prefix of an IP mask. */
+  const char        *mask;    /**< Host mask (not copied). */
+  unsigned int       hashv;   /**< Hash of the key of the mask. */
+  unsigned int       seq;     /**< Order of insertion, may be set by the owner after maskidx_add(). */
+  enum MaskKind      kind;    /**< Kind of mask. */
+  void              *data;    /**< Owner of the entry. */
+};
+
+/** Index of host masks.
+ * Lookups only visit the masks that may match the host: IP masks
+ * containing the address, exact hosts equal to it, wildcard hosts
+ * whose literal suffix is a domain suffix of the host, and the masks
+ * that could not be indexed.
+ */
+struct MaskIndex {
+  struct RadixTree   ip;       /**< IP masks. */
+  struct MaskEntry **hash;     /**< Exact and suffix masks. */
+  unsigned int       hash_len; /**< Length of \a hash, a power of 2. */
+  struct MaskEntry  *other;    /**< Masks not indexed. */
+  unsigned int       count;    /**< Number of entries. */
+  unsigned int       hashed;   /**< Entries in \a hash. */
+  unsigned int       others;   /**< Entries in \a other. */
+  unsigned int       seq;      /**< Last sequence number given. */
+  unsigned long      lookups;  /**< Lookups done. */
+  unsigned long      checks;   /**< Masks compared in the lookups. */
+};
+
+/** Callback for the entries found in a MaskIndex.
+ * The callback must not add or delete entries of the index; a non-zero
+ * return stops the lookup.
+ */
+typedef int (*maskidx_f)(struct MaskEntry *entry, void *data);
+
+extern void maskidx_add(struct MaskIndex *idx, struct MaskEntry *entry,
+                        const char *mask, const struct irc_in_addr *addr,
+                        unsigned char bits, void *data);
+extern void maskidx_del(struct MaskIndex *idx, struct MaskEntry *entry);
+extern int maskidx_match(struct MaskIndex *idx, const char *host,
+                         const struct irc_in_addr *addr,
+                         maskidx_f fn, void *data);
+extern int maskidx_exact(struct MaskIndex *idx, const char *mask,
+                         const struct irc_in_addr *addr, unsigned char bits,
+                         maskidx_f fn, void *data);
+extern void maskidx_clear(struct MaskIndex *idx);
+
+#endif /* INCLUDED_ircd_maskidx_h */
@@ -0,0 +1,86 @@
+/*
+ * IRC-Hispano IRC Daemon, include/ircd_radix.h
+ *
+ * Copyright (C) 1997-2019 IRC-Hispano Development Team <toni@tonigarcia.es>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/** @file
+ * @brief Radix tree of IP address prefixes.
+ */
+#ifndef INCLUDED_ircd_radix_h
+#define INCLUDED_ircd_radix_h
+
+#ifndef INCLUDED_res_h
+#include "res.h"
+#endif
+
+/** A node of a radix tree.
+ * Nodes without RADIX_USED are only branch points of the tree; their
+ * prefix is still valid, so the walks may use it to prune.
+ */
+struct RadixNode {
+  struct irc_in_addr prefix;      /**< Address of the prefix, masked to \a bits. */
+  unsigned char      bits;        /**< Length of the prefix (0 to 128). */
+  unsigned char      flags;       /**< RADIX_USED if the node holds a prefix. */
+  struct RadixNode  *parent;      /**< Parent node, NULL for the head. */
+  struct RadixNode  *child[2];    /**< Children selected by the next bit. */
+  void              *data;        /**< Data of the owner of the prefix. */
+};
+
+/** Node holds a prefix inserted by radix_insert(). */
+#define RADIX_USED 0x01
+
+/** A radix tree of IP address prefixes.
+ * IPv4 addresses are kept in their ::ffff:a.b.c.d form, as returned
+ * by ipmask_parse(), so IPv4 prefixes have 96 bits more than usual.
+ */
+struct RadixTree {
+  struct RadixNode *head;         /**< Root of the tree. */
+  unsigned int      count;        /**< Number of prefixes in the tree. */
+  unsigned int      nodes;        /**< Number of nodes, branch points included. */
+};
+
+/** Callback for the walks of a radix tree.
+ * The callback must not insert or remove prefixes of the tree.
+ * A non-zero return stops the walk.
+ */
+typedef int (*radix_walk_f)(struct RadixNode *node, void *data);
+
+/** Get the data of the node. */
+#define radix_data(node)       ((node)->data)
+/** Get the length of the prefix of the node. */
+#define radix_bits(node)       ((node)->bits)
+
+extern struct RadixNode *radix_insert(struct RadixTree *tree,
+                                      const struct irc_in_addr *addr,
+                                      unsigned char bits);
+extern struct RadixNode *radix_find(struct RadixTree *tree,
+                                    const struct irc_in_addr *addr,
+                                    unsigned char bits);
+extern struct RadixNode *radix_best(struct RadixTree *tree,
+                                    const struct irc_in_addr *addr);
+extern int radix_walk_covering(struct RadixTree *tree,
+                               const struct irc_in_addr *addr,
+                               radix_walk_f fn, void *data);
+extern int radix_walk_within(struct RadixTree *tree,
+                             const struct irc_in_addr *addr,
+                             unsigned char bits,
+                             radix_walk_f fn, void *data);
+extern void radix_remove(struct RadixTree *tree, struct RadixNode *node);
+extern void radix_clear(struct RadixTree *tree);
+
+#endif /* INCLUDED_ircd_radix_h */
@@ -26,10 +26,14 @@
 #define INCLUDED_ircd_reply_h
 
 struct Client;
+struct MsgBuf;
 
 extern int protocol_violation(struct Client* cptr, const char* pattern, ...);
 extern int need_more_params(struct Client* cptr, const char* cmd);
 extern int send_reply(struct Client* to, int reply, ...);
+extern struct MsgBuf *reply_body(int reply, ...);
+extern int send_reply_shared(struct Client *to, int reply,
+                             struct MsgBuf * const *bodies, int count);
 
 #define SND_EXPLICIT	0x40000000	/**< first arg is a pattern to use */
 
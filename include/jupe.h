@@ -29,6 +29,10 @@
 #include <sys/types.h>
 #define INCLUDED_sys_types_h
 #endif
+#ifndef INCLUDED_stdio_h
+#include <stdio.h>          /* FILE */
+#define INCLUDED_stdio_h
+#endif
 
 
 struct Client;
@@ -84,5 +88,7 @@ extern void jupe_burst(struct Client *cptr);
 extern int jupe_resend(struct Client *cptr, struct Jupe *jupe);
 extern int jupe_list(struct Client *sptr, char *server);
 extern int jupe_memory_count(size_t *ju_size);
+extern void jupe_save(FILE *file);
+extern int jupe_restore(int parc, char *parv[]);
 
 #endif /* INCLUDED_jupe_h */
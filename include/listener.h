@@ -41,6 +41,10 @@
 #include <sys/types.h>       /* size_t, broken BSD system headers */
 #define INCLUDED_sys_types_h
 #endif
+#ifndef INCLUDED_stdio_h
+#include <stdio.h>           /* FILE */
+#define INCLUDED_stdio_h
+#endif
 
 struct Client;
 struct StatDesc;
@@ -99,11 +103,14 @@ extern void        add_listener(int port, const char* vaddr_ip,
 extern void        close_listener(struct Listener* listener);
 extern void        close_listeners(void);
 extern void        count_listener_memory(int* count_out, size_t* size_out);
+extern struct Listener* find_listener(int port,
+                                      const struct irc_in_addr *addr);
 extern const char* get_listener_name(const struct Listener* listener);
 extern void        mark_listeners_closing(void);
 extern void show_ports(struct Client* client, const struct StatDesc* sd,
                        char* param);
 extern void        release_listener(struct Listener* listener);
+extern void        listener_save(FILE *file);
 
 #endif /* INCLUDED_listener_h */
 
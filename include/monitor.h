@@ -61,6 +61,9 @@ struct Monitor {
  * Proto types
  */
 extern void monitor_notify(struct Client *sptr, int raw);
+extern void monitor_batch_start(void);
+extern void monitor_batch_end(void);
+extern void monitor_flush(void);
 extern int monitor_add_nick(struct Client *sptr, char *nick);
 extern int monitor_del_nick(struct Client *sptr, char *nick);
 extern int monitor_list_clean(struct Client *sptr);
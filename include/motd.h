@@ -39,6 +39,7 @@
 #endif
 
 struct Client;
+struct MsgBuf;
 struct TRecord;
 struct StatDesc;
 
@@ -79,6 +80,9 @@ struct MotdCache {
   char*			path;     /**< Pathname of file. */
   int			maxcount; /**< Number of lines allocated for message. */
   struct tm		modtime;  /**< Last modification time from file. */
+  struct MsgBuf**	lines;    /**< Lines of the MOTD as sent, made by reply_body(). */
+  int			nlines;   /**< Number of entries in MotdCache::lines. */
+  unsigned long		serial;   /**< Update of the %DDB MOTD table \a lines were made from. */
   int			count;    /**< Actual number of lines used in message. */
   char			motd[1][MOTD_LINESIZE]; /**< Message body. */
 };
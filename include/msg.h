@@ -444,6 +444,19 @@ struct Client;
  * Structures
  */
 
+/** Number of buckets in MessageTiming::hist. */
+#define MSG_TIMING_BUCKETS 16
+
+/** Time spent in the handler of a message for one kind of client. */
+struct MessageTiming {
+  unsigned long calls;        /**< number of handler calls */
+  unsigned long long nsec;    /**< total time in the handler */
+  unsigned long max;          /**< longest call, in microseconds */
+  unsigned long hist[MSG_TIMING_BUCKETS]; /**< calls by duration: under
+                                           * 1us, then doubling up to
+                                           * 16ms and over */
+};
+
 /** Information on how to parse a message. */
 struct Message {
   char *cmd;                  /**< command string */
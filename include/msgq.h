@@ -79,6 +79,9 @@ extern int msgq_mapiov(const struct MsgQ *mq, struct iovec *iov, int count,
 extern struct MsgBuf *msgq_make(struct Client *dest, const char *format, ...);
 extern struct MsgBuf *msgq_vmake(struct Client *dest, const char *format,
 				 va_list args);
+extern struct MsgBuf *msgq_make_body(struct Client *dest,
+				     const struct MsgBuf *body,
+				     const char *format, ...);
 extern void msgq_append(struct Client *dest, struct MsgBuf *mb,
 			const char *format, ...);
 extern void msgq_clean(struct MsgBuf *mb);
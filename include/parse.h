@@ -26,6 +26,8 @@
 #define INCLUDED_parse_h
 
 struct Client;
+struct Message;
+struct MessageTiming;
 struct s_map;
 
 /*
@@ -35,6 +37,7 @@ struct s_map;
 extern int parse_client(struct Client *cptr, char *buffer, char *bufend);
 extern int parse_server(struct Client *cptr, char *buffer, char *bufend);
 extern void initmsgtree(void);
+extern struct MessageTiming *msg_timing(const struct Message *mptr);
 
 extern int register_mapping(struct s_map *map);
 extern int unregister_mapping(struct s_map *map);
@@ -89,6 +89,9 @@ extern void add_connection(struct Listener* listener, int fd, void *ssl);
 #else
 extern void add_connection(struct Listener* listener, int fd);
 #endif /* USE_SSL */
+extern int  adopt_connection(struct Client *cptr, int fd);
+extern int  restore_recvq(struct Client *cptr, const char *buf,
+                          unsigned int length);
 extern int  read_message(time_t delay);
 extern void init_server_identity(void);
 extern void close_connections(int close_stderr);
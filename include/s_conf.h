@@ -34,10 +34,14 @@
 #define INCLUDED_sys_types_h
 #endif
 #include "client.h"
+#ifndef INCLUDED_ircd_maskidx_h
+#include "ircd_maskidx.h"
+#endif
 
 struct Client;
 struct SLink;
 struct Message;
+struct StatDesc;
 
 /*
  * General defines
@@ -95,6 +99,7 @@ struct ConfItem
   struct Privs privs; /**< Privileges for opers. */
   /** Used to detect if a privilege has been set by this ConfItem. */
   struct Privs privs_dirty;
+  struct MaskEntry index;   /**< Entry in the compiled Client blocks. */
 };
 
 /** Channel quarantine structure. */
@@ -135,6 +140,7 @@ struct DenyConf {
   struct irc_in_addr  address;  /**< Address for IP-based denies. */
   unsigned int        flags;    /**< Interpretation flags for the above.  */
   unsigned char       bits;     /**< Number of bits for ipkills */
+  struct MaskEntry    index;    /**< Entry in the compiled Kill blocks. */
 };
 
 #define DENY_FLAGS_FILE     0x0001 /**< Comment is a filename */
@@ -148,6 +154,7 @@ struct ExceptConf {
  struct irc_in_addr  address;  /**< Address for IP-based excepts. */
  unsigned char       bits;     /**< Number of bits for ipexcepts */
  int                 port;     /**< Number for port */
+ struct MaskEntry    index;    /**< Entry in the compiled Except blocks. */
 };
 
 /** Local server configuration. */
@@ -227,6 +234,8 @@ extern const struct DenyConf*  conf_get_deny_list(void);
 extern const struct ExceptConf* conf_get_except_list(void);
 extern const struct ProxyConf* conf_get_proxy_list(void);
 
+extern void conf_report_access_index(struct Client *to,
+                                     const struct StatDesc *sd, char *param);
 extern const char* conf_eval_crule(const char* name, int mask);
 
 extern struct ConfItem* attach_confs_byhost(struct Client* cptr, const char* host, int statmask);
@@ -237,6 +246,7 @@ extern struct ConfItem* conf_find_server(const char* name);
 extern void det_confs_butmask(struct Client *cptr, int mask);
 extern enum AuthorizationCheckResult attach_conf(struct Client *cptr, struct ConfItem *aconf);
 extern struct ConfItem* find_conf_exact(const char* name, struct Client *cptr, int statmask);
+extern enum AuthorizationCheckResult attach_iline(struct Client *cptr);
 extern enum AuthorizationCheckResult conf_check_client(struct Client *cptr);
 extern int  conf_check_server(struct Client *cptr);
 extern int rehash(struct Client *cptr, int sig);
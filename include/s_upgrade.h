@@ -0,0 +1,45 @@
+/*
+ * IRC-Hispano IRC Daemon, include/s_upgrade.h
+ *
+ * Copyright (C) 1997-2019 IRC-Hispano Development Team <toni@tonigarcia.es>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/** @file
+ * @brief Interface to restart the server keeping its connections.
+ */
+#ifndef INCLUDED_s_upgrade_h
+#define INCLUDED_s_upgrade_h
+
+struct irc_in_addr;
+struct irc_sockaddr;
+
+/** Length of an IP address written by upgrade_iptohex(). */
+#define UPGRADE_IPLEN 32
+
+/*
+ * Prototypes
+ */
+extern const char *upgrade_check(void);
+extern int upgrade_save(const char *path);
+extern int upgrade_init(const char *path);
+extern int upgrade_listener(const struct irc_sockaddr *addr, int family);
+extern void upgrade_restore(void);
+extern int upgrade_keep_fd(int fd);
+extern char *upgrade_iptohex(char *buf, const struct irc_in_addr *addr);
+extern int upgrade_hextoip(const char *hex, struct irc_in_addr *addr);
+
+#endif /* INCLUDED_s_upgrade_h */
@@ -38,6 +38,8 @@ struct DLink;
 struct Client;
 struct User;
 struct Membership;
+struct RadixNode;
+struct MonitorBatch;
 struct SLink;
 
 /** Describes a server on the network. */
@@ -61,6 +63,8 @@ struct Server {
   int            asll_from;     /**< AsLL downstream lag */
   time_t         asll_last;     /**< Last time we sent or received an AsLL ping */
 
+  unsigned int   glines_pending; /**< G-lines of its net.burst not applied yet */
+
 #if defined(DDB)
   unsigned long  ddb_open;      /**< DDB database open */
 #endif
@@ -69,6 +73,13 @@ struct Server {
   char by[NICKLEN + 1];         /**< Numnick of client who requested the link */
 };
 
+/** Link of a user in one of the indexes used by WHO (see hash.c). */
+struct WhoLink {
+  struct WhoLink*    next;           /**< Next user with the same key */
+  struct WhoLink**   prev_p;         /**< Previous pointer to this link, NULL if not indexed */
+  struct Client*     client;         /**< Indexed user */
+};
+
 /** Describes a user on the network. */
 struct User {
   struct Client*     server;         /**< client structure of server */
@@ -76,6 +87,7 @@ struct User {
   struct SLink*      invited;        /**< chain of invite pointer blocks */
   struct Ban*        silence;        /**< chain of silence pointer blocks */
   struct SLink*      monitor;        /**< chain of monitor pointer blocks */
+  struct MonitorBatch* monitor_batch; /**< MONITOR notifications not sent yet */
   char*              away;           /**< pointer to away message */
   time_t             last;           /**< last time user sent a message */
   unsigned int       refcnt;         /**< Number of times this block is referenced */
@@ -92,6 +104,16 @@ struct User {
   char               realhost[HOSTLEN + 1];   /**< actual hostname */
   char               account[ACCOUNTLEN + 1]; /**< IRC account name */
   time_t	     acc_create;              /**< IRC account timestamp */
+  struct RadixNode*  ip_node;        /**< Address in the IP index */
+  struct WhoLink     ip_link;        /**< Link in the IP index */
+  struct WhoLink     host_link;      /**< Link of host in the host index */
+  struct WhoLink     realhost_link;  /**< Link of realhost in the host index */
+  struct WhoLink     username_link;  /**< Link of username in the host index */
+  struct WhoLink     account_link;   /**< Link in the account index */
+  struct WhoLink     info_link;      /**< Link in the realname index */
+  unsigned short     prefix_len;     /**< Length of \a prefix, 0 if not built */
+  /** nick!user@host as sent in message prefixes, built by ircd_snprintf() */
+  char               prefix[NICKLEN + USERLEN + HOSTLEN + 3];
 };
 
 #endif /* INCLUDED_struct_h */
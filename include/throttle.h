@@ -0,0 +1,39 @@
+/*
+ * IRC-Hispano IRC Daemon, include/throttle.h
+ *
+ * Copyright (C) 1997-2019 IRC-Hispano Development Team <toni@tonigarcia.es>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/** @file
+ * @brief Interface to limit the rate of accepted connections by network.
+ */
+#ifndef INCLUDED_throttle_h
+#define INCLUDED_throttle_h
+
+struct Client;
+struct StatDesc;
+struct irc_in_addr;
+
+/*
+ * Prototypes
+ */
+extern void throttle_init(void);
+extern int throttle_accept(const struct irc_in_addr *addr);
+extern void throttle_report(struct Client *to, const struct StatDesc *sd,
+                            char *param);
+
+#endif /* INCLUDED_throttle_h */
@@ -29,12 +29,15 @@
 #include "ircd.h"
 #include "match.h"
 #include "msg.h"
+#include "numeric.h"
 #include "ircd_alloc.h"
 #include "ircd_events.h"
 #include "ircd_features.h"
 #include "ircd_log.h"
+#include "ircd_reply.h"
 #include "ircd_string.h"    /* ircd_ntoa */
 #include "s_debug.h"        /* Debug */
+#include "random.h"         /* ircrandom */
 #include "s_user.h"         /* TARGET_DELAY */
 #include "send.h"
 
@@ -50,8 +53,12 @@ struct IPTargetEntry {
 /** Stores recent information about a particular IP address. */
 struct IPRegistryEntry {
   struct IPRegistryEntry*  next;   /**< Next entry in the hash chain. */
+  struct IPRegistryEntry*  idle_next;   /**< Next entry in the idle list. */
+  struct IPRegistryEntry** idle_prev_p; /**< Previous pointer to this entry in the idle list. */
+  struct IPIdleList*       idle;   /**< Idle list holding the entry, if any. */
   struct IPTargetEntry*    target; /**< Recent targets, if any. */
   struct irc_in_addr       addr;   /**< IP address for this user. */
+  unsigned int             hashv;  /**< Hash value of \a addr. */
   int		           last_connect; /**< Last connection attempt timestamp. */
   unsigned short           connected; /**< Number of currently connected clients. */
   unsigned char            attempts; /**< Number of recent connection attempts. */
@@ -60,17 +67,34 @@ struct IPRegistryEntry {
 /** Stores information about an IPv6/48 block's recent connections. */
 struct IPRegistry48 {
   struct IPRegistry48* next;     /**< Next entry in the hash chain. */
+  struct IPRegistry48* lru_next; /**< Next entry in #lru48. */
+  struct IPRegistry48** lru_prev_p; /**< Previous pointer to this entry in #lru48. */
+  unsigned int         hashv;    /**< Hash value of \a addr. */
   int              last_connect; /**< Last connection attempt timestamp. */
   uint16_t             addr[3];  /**< 48 MSBs of IP address. */
   unsigned short       attempts; /**< Number of recent connection attempts. */
 };
 
-/** Size of hash table (must be a power of two). */
-#define IP_REGISTRY_TABLE_SIZE 0x10000
+/** List of registry entries without clients, oldest first.
+ * Entries are appended when their last client goes away, so the
+ * entries due to expire are always at the head of the list.
+ */
+struct IPIdleList {
+  struct IPRegistryEntry*  head;   /**< Entry idle for longest. */
+  struct IPRegistryEntry** tail_p; /**< Next pointer of the last entry. */
+  unsigned int             count;  /**< Number of entries. */
+};
+
+/** Initial size of the hash tables (must be a power of two). */
+#define IP_REGISTRY_TABLE_SIZE 0x400
 /** Report current time for tracking in IPRegistryEntry::last_connect. */
 #define NOW ((unsigned short)(CurrentTime & 0xffff))
-/** Time from \a x until now, in seconds. */
-#define CONNECTED_SINCE(x) (NOW - (x))
+/** Time from \a x until now, in seconds, modulo 65536 like the stamps. */
+#define CONNECTED_SINCE(x) ((unsigned short)(NOW - (x)))
+/** Seconds without clients after which an entry is released. */
+#define IP_REGISTRY_EXPIRE 600
+/** Seconds without clients after which the targets of an entry are released. */
+#define IP_REGISTRY_EXPIRE_TARGETS 120
 
 /** Macro for easy access to configured IPcheck clone limit. */
 #define IPCHECK_CLONE_LIMIT feature_int(FEAT_IPCHECK_CLONE_LIMIT)
@@ -84,9 +108,27 @@ struct IPRegistry48 {
 #define IPCHECK_CLONE_DELAY feature_int(FEAT_IPCHECK_CLONE_DELAY)
 
 /** Hash table for storing IPRegistryEntry entries. */
-static struct IPRegistryEntry* hashTable[IP_REGISTRY_TABLE_SIZE];
+static struct IPRegistryEntry** hashTable;
+/** Number of buckets in #hashTable (a power of two). */
+static unsigned int hashSize;
+/** Number of entries in #hashTable. */
+static unsigned int hashCount;
 /** Hash table for storing IPRegistry48 entries. */
-static struct IPRegistry48* hashTable48[IP_REGISTRY_TABLE_SIZE];
+static struct IPRegistry48** hashTable48;
+/** Number of buckets in #hashTable48 (a power of two). */
+static unsigned int hashSize48;
+/** Number of entries in #hashTable48. */
+static unsigned int hashCount48;
+/** Idle entries that still keep their targets. */
+static struct IPIdleList idleRecent = { NULL, &idleRecent.head, 0 };
+/** Idle entries waiting to be released. */
+static struct IPIdleList idleStale = { NULL, &idleStale.head, 0 };
+/** IPRegistry48 entries, least recently used first. */
+static struct IPRegistry48* lru48;
+/** Next pointer of the most recently used entry in #lru48. */
+static struct IPRegistry48** lru48_tail_p = &lru48;
+/** Random key of the hash function. */
+static unsigned int hashKey;
 /** List of allocated but unused IPRegistryEntry structs. */
 static struct IPRegistryEntry* freeList;
 /** List of allocated but unused IPRegistry48 structs. */
@@ -119,17 +161,73 @@ static void ip_registry_canonicalize(struct irc_in_addr *out, const struct irc_i
     out->in6_16[6] = out->in6_16[7] = 0;
 }
 
+/** Mix the bits of a 32-bit value (finalizer of MurmurHash3).
+ * @param[in] h Value to mix.
+ * @return Mixed value.
+ */
+static unsigned int ip_registry_mix(unsigned int h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+  return h;
+}
+
+/** Calculate a keyed hash value from 16-bit words of an address.
+ * Every word goes through the mixer, so addresses differing in a
+ * single bit, like consecutive IPv4 addresses in 6to4 form or the
+ * /64s of a provider, spread over the whole table.
+ * @param[in] words Words of the address, in network order.
+ * @param[in] count Number of words.
+ * @return Hash value for address.
+ */
+static unsigned int ip_registry_hash_words(const unsigned short *words,
+                                           unsigned int count)
+{
+  unsigned int res = hashKey, ii;
+
+  for (ii = 0; ii < count; ii++)
+    res = ip_registry_mix(res ^ ((ii << 16) | ntohs(words[ii])));
+  return res;
+}
+
 /** Calculate hash value for an IP address.
  * @param[in] ip Address to hash; must be in canonical form.
  * @return Hash value for address.
  */
 static unsigned int ip_registry_hash(const struct irc_in_addr *ip)
 {
-  unsigned int res;
   /* Only use the first 64 bits of address, since the last 64 bits
    * tend to be under user control. */
-  res = ip->in6_16[0] ^ ip->in6_16[1] ^ ip->in6_16[2] ^ ip->in6_16[3];
-  return res & (IP_REGISTRY_TABLE_SIZE - 1);
+  return ip_registry_hash_words(ip->in6_16, 4);
+}
+
+/** Double the size of #hashTable when it holds two entries per bucket.
+ * The entries keep their hash values, so they are not hashed again.
+ */
+static void ip_registry_grow(void)
+{
+  struct IPRegistryEntry **table, *entry, *next;
+  unsigned int size, ii;
+
+  if (hashCount < hashSize * 2)
+    return;
+
+  size = hashSize * 2;
+  table = (struct IPRegistryEntry**) MyCalloc(size, sizeof(*table));
+  for (ii = 0; ii < hashSize; ii++) {
+    for (entry = hashTable[ii]; entry; entry = next) {
+      next = entry->next;
+      entry->next = table[entry->hashv & (size - 1)];
+      table[entry->hashv & (size - 1)] = entry;
+    }
+  }
+  MyFree(hashTable);
+  hashTable = table;
+  hashSize = size;
+  Debug((DEBUG_DEBUG, "IPcheck registry grown to %u buckets", size));
 }
 
 /** Find an IP registry entry if one exists for the IP address.
@@ -142,11 +240,13 @@ static struct IPRegistryEntry* ip_registry_find(const struct irc_in_addr *ip)
 {
   struct irc_in_addr canon;
   struct IPRegistryEntry* entry;
+  unsigned int hashv;
   ip_registry_canonicalize(&canon, ip);
-  entry = hashTable[ip_registry_hash(&canon)];
+  hashv = ip_registry_hash(&canon);
+  entry = hashTable[hashv & (hashSize - 1)];
   for ( ; entry; entry = entry->next) {
     int bits = (canon.in6_16[0] == htons(0x2002)) ? 48 : 64;
-    if (ipmask_check(&canon, &entry->addr, bits))
+    if (entry->hashv == hashv && ipmask_check(&canon, &entry->addr, bits))
       break;
   }
   return entry;
@@ -157,7 +257,12 @@ static struct IPRegistryEntry* ip_registry_find(const struct irc_in_addr *ip)
  */
 static void ip_registry_add(struct IPRegistryEntry* entry)
 {
-  unsigned int bucket = ip_registry_hash(&entry->addr);
+  unsigned int bucket;
+
+  hashCount++;
+  ip_registry_grow();
+  entry->hashv = ip_registry_hash(&entry->addr);
+  bucket = entry->hashv & (hashSize - 1);
   entry->next = hashTable[bucket];
   hashTable[bucket] = entry;
 }
@@ -167,20 +272,61 @@ static void ip_registry_add(struct IPRegistryEntry* entry)
  */
 static void ip_registry_remove(struct IPRegistryEntry* entry)
 {
-  unsigned int bucket = ip_registry_hash(&entry->addr);
-  if (hashTable[bucket] == entry)
-    hashTable[bucket] = entry->next;
-  else {
-    struct IPRegistryEntry* prev = hashTable[bucket];
-    for ( ; prev; prev = prev->next) {
-      if (prev->next == entry) {
-        prev->next = entry->next;
-        break;
-      }
+  struct IPRegistryEntry** prev_p;
+
+  prev_p = &hashTable[entry->hashv & (hashSize - 1)];
+  for ( ; *prev_p; prev_p = &(*prev_p)->next) {
+    if (*prev_p == entry) {
+      *prev_p = entry->next;
+      hashCount--;
+      break;
     }
   }
 }
 
+/** Take an entry out of its idle list, if it is in one.
+ * @param[in] entry Registry entry that got a client.
+ */
+static void ip_registry_busy(struct IPRegistryEntry* entry)
+{
+  struct IPIdleList* list = entry->idle;
+
+  if (!list)
+    return;
+  *entry->idle_prev_p = entry->idle_next;
+  if (entry->idle_next)
+    entry->idle_next->idle_prev_p = entry->idle_prev_p;
+  else
+    list->tail_p = entry->idle_prev_p;
+  list->count--;
+  entry->idle = NULL;
+}
+
+/** Append an entry to the tail of an idle list.
+ * @param[in] entry Registry entry.
+ * @param[in] list List to append it to.
+ */
+static void ip_registry_append(struct IPRegistryEntry* entry,
+                               struct IPIdleList* list)
+{
+  ip_registry_busy(entry);
+  entry->idle = list;
+  entry->idle_next = NULL;
+  entry->idle_prev_p = list->tail_p;
+  *list->tail_p = entry;
+  list->tail_p = &entry->idle_next;
+  list->count++;
+}
+
+/** Start the expiry of an entry if its last client went away.
+ * @param[in] entry Registry entry that lost a client.
+ */
+static void ip_registry_idle(struct IPRegistryEntry* entry)
+{
+  if (0 == entry->connected)
+    ip_registry_append(entry, &idleRecent);
+}
+
 /** Allocate a new IP registry entry.
  * For members that have a sensible default value, that is used.
  * @return Newly allocated registry entry.
@@ -207,6 +353,7 @@ static struct IPRegistryEntry* ip_registry_new_entry(void)
  */
 static void ip_registry_delete_entry(struct IPRegistryEntry* entry)
 {
+  ip_registry_busy(entry);
   if (entry->target)
     MyFree(entry->target);
   entry->next = freeList;
@@ -229,56 +376,69 @@ static unsigned int ip_registry_update_free_targets(struct IPRegistryEntry* entr
   return free_targets;
 }
 
-/** Check whether all or part of \a entry needs to be expired.
- * If the entry is at least 600 seconds stale, free the entire thing.
- * If it is at least 120 seconds stale, expire its free targets list.
- * @param[in] entry Registry entry to check for expiration.
+/** Calculate hash value for an IP address's /48 block.
+ * @param[in] ip Address to hash; must be an IPv6 address.
+ * @return Hash value for address.
  */
-static void ip_registry_expire_entry(struct IPRegistryEntry* entry)
+static unsigned int ip_48_hash(const struct irc_in_addr *ip)
 {
-  /*
-   * Don't touch this number, it has statistical significance
-   * XXX - blah blah blah
-   */
-  if (CONNECTED_SINCE(entry->last_connect) > 600) {
-    /*
-     * expired
-     */
-    Debug((DEBUG_DNS, "IPcheck expiring registry for %s (no clients connected).", ircd_ntoa(&entry->addr)));
-    ip_registry_remove(entry);
-    ip_registry_delete_entry(entry);
-  }
-  else if (CONNECTED_SINCE(entry->last_connect) > 120 && 0 != entry->target) {
-    /*
-     * Expire storage of targets
-     */
-    MyFree(entry->target);
-    entry->target = 0;
+  return ip_registry_hash_words(ip->in6_16, 3);
+}
+
+/** Double the size of #hashTable48 when it holds two entries per bucket. */
+static void ip_48_grow(void)
+{
+  struct IPRegistry48 **table, *entry, *next;
+  unsigned int size, ii;
+
+  if (hashCount48 < hashSize48 * 2)
+    return;
+
+  size = hashSize48 * 2;
+  table = (struct IPRegistry48**) MyCalloc(size, sizeof(*table));
+  for (ii = 0; ii < hashSize48; ii++) {
+    for (entry = hashTable48[ii]; entry; entry = next) {
+      next = entry->next;
+      entry->next = table[entry->hashv & (size - 1)];
+      table[entry->hashv & (size - 1)] = entry;
+    }
   }
+  MyFree(hashTable48);
+  hashTable48 = table;
+  hashSize48 = size;
 }
 
-/** Calculate hash value for an IP address's /48 block.
- * @param[in] ip Address to hash; must be an IPv6 address.
- * @return Hash value for address.
+/** Move an IPv6 /48 entry to the tail of #lru48.
+ * @param[in] entry Entry just used.
  */
-static unsigned int ip_48_hash(const struct irc_in_addr *ip)
+static void ip_48_touch(struct IPRegistry48* entry)
 {
-  unsigned int res;
-  res = ip->in6_16[0] ^ ip->in6_16[1] ^ ip->in6_16[2];
-  return res & (IP_REGISTRY_TABLE_SIZE - 1);
+  if (entry->lru_prev_p) {
+    *entry->lru_prev_p = entry->lru_next;
+    if (entry->lru_next)
+      entry->lru_next->lru_prev_p = entry->lru_prev_p;
+    else
+      lru48_tail_p = entry->lru_prev_p;
+  }
+  entry->lru_next = NULL;
+  entry->lru_prev_p = lru48_tail_p;
+  *lru48_tail_p = entry;
+  lru48_tail_p = &entry->lru_next;
 }
 
 /** Find or create an IPv6 /48 entry for the IP address.
+ * The entry becomes the most recently used one.
  * @param[in] ip IPv6 address to search for.
  * @return Matching registry entry (possibly newly created).
  */
 static struct IPRegistry48* ip_48_find(const struct irc_in_addr *ip)
 {
   struct IPRegistry48* entry;
-  unsigned int idx;
+  unsigned int hashv, idx;
 
   /* Does it exist in the chain? */
-  idx = ip_48_hash(ip);
+  hashv = ip_48_hash(ip);
+  idx = hashv & (hashSize48 - 1);
   for (entry = hashTable48[idx]; entry; entry = entry->next) {
     if ((ip->in6_16[0] == entry->addr[0])
         && (ip->in6_16[1] == entry->addr[1])
@@ -299,53 +459,96 @@ static struct IPRegistry48* ip_48_find(const struct irc_in_addr *ip)
   entry->addr[1]  = ip->in6_16[1];
   entry->addr[2]  = ip->in6_16[2];
   entry->attempts = 0;
+  entry->hashv    = hashv;
+  entry->lru_prev_p = NULL;
 
   /* Link it into the hash table. */
+  hashCount48++;
+  ip_48_grow();
+  idx = hashv & (hashSize48 - 1);
   entry->next = hashTable48[idx];
   hashTable48[idx] = entry;
 
 done:
+  ip_48_touch(entry);
   return entry;
 }
 
+/** Release an IPv6 /48 entry.
+ * @param[in] entry Entry to release.
+ */
+static void ip_48_delete(struct IPRegistry48* entry)
+{
+  struct IPRegistry48** prev_p;
+
+  prev_p = &hashTable48[entry->hashv & (hashSize48 - 1)];
+  for ( ; *prev_p; prev_p = &(*prev_p)->next) {
+    if (*prev_p == entry) {
+      *prev_p = entry->next;
+      break;
+    }
+  }
+  hashCount48--;
+
+  *entry->lru_prev_p = entry->lru_next;
+  if (entry->lru_next)
+    entry->lru_next->lru_prev_p = entry->lru_prev_p;
+  else
+    lru48_tail_p = entry->lru_prev_p;
+
+  entry->next = freeList48;
+  freeList48 = entry;
+}
+
 /** Periodic timer callback to check for expired registry entries.
+ * Only the heads of the idle lists are visited: entries idle for
+ * more than IP_REGISTRY_EXPIRE_TARGETS seconds lose their targets and
+ * move to the stale list, stale entries idle for more than
+ * IP_REGISTRY_EXPIRE seconds are released.
  * @param[in] ev Timer event (ignored).
  */
 static void ip_registry_expire(struct Event* ev)
 {
-  int i;
   struct IPRegistryEntry* entry;
-  struct IPRegistryEntry* entry_next;
+  struct IPRegistry48* entry_48;
 
   assert(ET_EXPIRE == ev_type(ev));
   assert(0 != ev_timer(ev));
 
-  for (i = 0; i < IP_REGISTRY_TABLE_SIZE; ++i) {
-    for (entry = hashTable[i]; entry; entry = entry_next) {
-      entry_next = entry->next;
-      if (0 == entry->connected)
-        ip_registry_expire_entry(entry);
+  while ((entry = idleRecent.head)
+         && CONNECTED_SINCE(entry->last_connect) > IP_REGISTRY_EXPIRE_TARGETS) {
+    if (entry->target) {
+      /*
+       * Expire storage of targets
+       */
+      MyFree(entry->target);
+      entry->target = 0;
     }
+    ip_registry_append(entry, &idleStale);
   }
 
-  for (i = 0; i < IP_REGISTRY_TABLE_SIZE; ++i) {
-    struct IPRegistry48** prev_p;
-    struct IPRegistry48* entry;
-
-    for (prev_p = &hashTable48[i]; (entry = *prev_p); ) {
-      if (CONNECTED_SINCE(entry->last_connect) > 600) {
-        *prev_p = entry->next;
-        entry->next = freeList48;
-        freeList48 = entry;
-      } else
-        prev_p = &entry->next;
-    }
+  while ((entry = idleStale.head)
+         && CONNECTED_SINCE(entry->last_connect) > IP_REGISTRY_EXPIRE) {
+    /*
+     * expired
+     */
+    Debug((DEBUG_DNS, "IPcheck expiring registry for %s (no clients connected).", ircd_ntoa(&entry->addr)));
+    ip_registry_remove(entry);
+    ip_registry_delete_entry(entry);
   }
+
+  while ((entry_48 = lru48)
+         && CONNECTED_SINCE(entry_48->last_connect) > IP_REGISTRY_EXPIRE)
+    ip_48_delete(entry_48);
 }
 
 /** Initialize the IPcheck subsystem. */
 void IPcheck_init(void)
 {
+  hashKey = ircrandom();
+  hashSize = hashSize48 = IP_REGISTRY_TABLE_SIZE;
+  hashTable = (struct IPRegistryEntry**) MyCalloc(hashSize, sizeof(*hashTable));
+  hashTable48 = (struct IPRegistry48**) MyCalloc(hashSize48, sizeof(*hashTable48));
   timer_add(timer_init(&expireTimer), ip_registry_expire, 0, TT_PERIODIC, 60);
 }
 
@@ -384,6 +587,8 @@ int ip_registry_check_local(const struct irc_in_addr *addr, time_t* next_target_
           entry->connected--;
           entry = NULL;
         }
+        else
+          ip_registry_busy(entry);
       }
       goto reject;
     }
@@ -407,6 +612,7 @@ int ip_registry_check_local(const struct irc_in_addr *addr, time_t* next_target_
     Debug((DEBUG_DNS, "IPcheck refusing local connection from %s: counter overflow.", ircd_ntoa(&entry->addr)));
     return 0;
   }
+  ip_registry_busy(entry);
 
   if (CONNECTED_SINCE(entry->last_connect) > IPCHECK_CLONE_PERIOD)
     entry->attempts = 0;
@@ -431,6 +637,7 @@ reject:
     {
       assert(entry->connected > 0);
       --entry->connected;
+      ip_registry_idle(entry);
     }
     Debug((DEBUG_DNS, "IPcheck refusing local connection from %s: too fast.", ircd_ntoa(addr)));
     return 0;
@@ -485,6 +692,7 @@ int ip_registry_check_remote(struct Client* cptr, int is_burst)
     Debug((DEBUG_DNS, "IPcheck refusing remote connection from %s: counter overflow.", ircd_ntoa(&entry->addr)));
     return 0;
   }
+  ip_registry_busy(entry);
   if (CONNECTED_SINCE(entry->last_connect) > IPCHECK_CLONE_PERIOD)
     entry->attempts = 0;
   if (!is_burst) {
@@ -525,6 +733,7 @@ void ip_registry_connect_fail(const struct irc_in_addr *addr, int disconnect)
     if (disconnect) {
       assert(entry->connected > 0);
       entry->connected--;
+      ip_registry_idle(entry);
     }
   }
 }
@@ -580,6 +789,7 @@ void ip_registry_disconnect(struct Client *cptr)
     }
     ip_registry_update_free_targets(entry);
     entry->last_connect = NOW;
+    ip_registry_idle(entry);
   }
   if (MyConnect(cptr)) {
     unsigned int free_targets;
@@ -709,3 +919,61 @@ unsigned short IPcheck_nr(struct Client *cptr)
   assert(0 != cptr);
   return ip_registry_count(&cli_ip(cptr));
 }
+
+/** Number of chain lengths shown by IPcheck_report(). */
+#define IP_REGISTRY_CHAINS 5
+
+/** Report the occupancy of a hash table of the registry.
+ * @param[in] to Client requesting statistics.
+ * @param[in] name Name of the table.
+ * @param[in] count Number of entries.
+ * @param[in] size Number of buckets.
+ * @param[in] chains Buckets by chain length, the last one counting
+ *   the longer chains too.
+ * @param[in] longest Length of the longest chain.
+ */
+static void ip_registry_report_table(struct Client *to, const char *name,
+                                     unsigned int count, unsigned int size,
+                                     const unsigned int *chains,
+                                     unsigned int longest)
+{
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":%s Entries=%u Buckets=%u Chains=%u/%u/%u/%u/%u+ Longest=%u",
+             name, count, size, chains[0], chains[1], chains[2], chains[3],
+             chains[4], longest);
+}
+
+/** Report the IP registry to a client.
+ * @param[in] to Client requesting statistics.
+ * @param[in] sd Stats descriptor for request (ignored).
+ * @param[in] param Extra parameter from user (ignored).
+ */
+void IPcheck_report(struct Client *to, const struct StatDesc *sd, char *param)
+{
+  unsigned int chains[IP_REGISTRY_CHAINS], longest, len, ii;
+  struct IPRegistryEntry *entry;
+  struct IPRegistry48 *entry_48;
+
+  memset(chains, 0, sizeof(chains));
+  for (ii = longest = 0; ii < hashSize; ii++) {
+    for (len = 0, entry = hashTable[ii]; entry; entry = entry->next)
+      len++;
+    chains[len < IP_REGISTRY_CHAINS ? len : IP_REGISTRY_CHAINS - 1]++;
+    if (len > longest)
+      longest = len;
+  }
+  ip_registry_report_table(to, "Registry", hashCount, hashSize, chains, longest);
+
+  memset(chains, 0, sizeof(chains));
+  for (ii = longest = 0; ii < hashSize48; ii++) {
+    for (len = 0, entry_48 = hashTable48[ii]; entry_48; entry_48 = entry_48->next)
+      len++;
+    chains[len < IP_REGISTRY_CHAINS ? len : IP_REGISTRY_CHAINS - 1]++;
+    if (len > longest)
+      longest = len;
+  }
+  ip_registry_report_table(to, "Registry48", hashCount48, hashSize48, chains, longest);
+
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Idle Recent=%u Stale=%u", idleRecent.count, idleStale.count);
+}
@@ -72,6 +72,10 @@ static struct Ban* free_bans;
 static size_t bans_alloc;
 /** Number of ban structures in use. */
 static size_t bans_inuse;
+/** Channels whose local members are cached by split_locals(). */
+static struct SplitLocals* splitLocalsList;
+/** Nesting depth of split_start() calls. */
+static unsigned int splitDepth;
 
 #if !defined(NDEBUG)
 /** return the length (>=0) of a chain of links.
@@ -338,6 +342,8 @@ int destruct_channel(struct Channel* chptr)
   if (chptr->next)
     chptr->next->prev = chptr->prev;
   hRemChannel(chptr);
+  if (chptr->split_locals)
+    chptr->split_locals->channel = 0;
   --UserStats.channels;
   /*
    * make sure that channel actually got removed from hash table
@@ -557,6 +563,26 @@ static int channel_all_zombies(struct Channel* chptr)
 }
       
 
+/** Remove a membership from its channel, and destroy the channel if
+ * only zombies are left on it.
+ * @param member	The membership to remove.
+ */
+static void remove_membership(struct Membership* member)
+{
+  struct Channel* chptr = member->channel;
+
+  if (remove_member_from_channel(member)) {
+    if (channel_all_zombies(chptr)) {
+      /*
+       * XXX - this looks dangerous but isn't if we got the referential
+       * integrity right for channels
+       */
+      while (remove_member_from_channel(chptr->members))
+        ;
+    }
+  }
+}
+
 /** Remove a user from a channel
  * This is the generic entry point for removing a user from a channel, this
  * function will remove the client from the channel, and destroy the channel
@@ -571,18 +597,8 @@ void remove_user_from_channel(struct Client* cptr, struct Channel* chptr)
   struct Membership* member;
   assert(0 != chptr);
 
-  if ((member = find_member_link(chptr, cptr))) {
-    if (remove_member_from_channel(member)) {
-      if (channel_all_zombies(chptr)) {
-        /*
-         * XXX - this looks dangerous but isn't if we got the referential
-         * integrity right for channels
-         */
-        while (remove_member_from_channel(chptr->members))
-          ;
-      }
-    }
-  }
+  if ((member = find_member_link(chptr, cptr)))
+    remove_membership(member);
 }
 
 /** Remove a user from all channels they are on.
@@ -597,8 +613,72 @@ void remove_user_from_all_channels(struct Client* cptr)
   assert(0 != cptr);
   assert(0 != cli_user(cptr));
 
+  /* No need to look the membership up, it is at hand. */
   while ((chan = (cli_user(cptr))->channel))
-    remove_user_from_channel(cptr, chan->channel);
+    remove_membership(chan);
+}
+
+/** Start exiting a net.split.
+ * Until the matching split_end(), split_locals() caches the local
+ * members of the channels, so the QUITs of the users leaving do not
+ * walk the whole member list of their channels again and again.
+ * Calls may be nested.
+ */
+void split_start(void)
+{
+  splitDepth++;
+}
+
+/** Finish exiting a net.split and release the members cached since
+ * the outermost split_start().
+ */
+void split_end(void)
+{
+  struct SplitLocals* sl;
+
+  assert(splitDepth > 0);
+  if (--splitDepth)
+    return;
+  while ((sl = splitLocalsList)) {
+    splitLocalsList = sl->next;
+    if (sl->channel)
+      sl->channel->split_locals = 0;
+    MyFree(sl);
+  }
+}
+
+/** Get the local members of a channel while exiting a net.split.
+ * The members are collected on the first call for the channel; local
+ * clients cannot join or part until the split has been processed.
+ * @param chptr	The channel.
+ * @returns The cached local members, or NULL if no split is being
+ *          exited.
+ */
+struct SplitLocals* split_locals(struct Channel* chptr)
+{
+  struct SplitLocals* sl;
+  struct Membership* member;
+  unsigned int count = 0;
+
+  if (!splitDepth)
+    return 0;
+  if (chptr->split_locals)
+    return chptr->split_locals;
+
+  for (member = chptr->members; member; member = member->next_member)
+    if (MyConnect(member->user))
+      count++;
+  sl = (struct SplitLocals*) MyMalloc(sizeof(struct SplitLocals)
+                                      + count * sizeof(struct Client*));
+  sl->channel = chptr;
+  sl->count = 0;
+  for (member = chptr->members; member; member = member->next_member)
+    if (MyConnect(member->user))
+      sl->members[sl->count++] = member->user;
+  sl->next = splitLocalsList;
+  splitLocalsList = sl;
+  chptr->split_locals = sl;
+  return sl;
 }
 
 /** Check if this user is a legitimate chanop
@@ -31,7 +31,9 @@
 #include "ircd.h"
 #include "ircd_alloc.h"
 #include "ircd_chattr.h"
+#include "ircd_features.h"
 #include "ircd_log.h"
+#include "ircd_radix.h"
 #include "ircd_reply.h"
 #include "ircd_snprintf.h"
 #include "ircd_string.h"
@@ -49,16 +51,122 @@
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 //#include <stdarg.h>
 //#include <stdio.h>
+#include <errno.h>
+#include <stddef.h>
 #include <string.h>
 //#include <time.h>
+#include <sys/time.h>
+
+/* Debug() and the MDEBUG allocator are not thread safe. */
+#if defined(USE_PTHREADS) && !defined(MDEBUG) && !defined(DEBUGMODE)
+#define DDB_THREADED_LOAD
+#include <pthread.h>
+#include <signal.h>
+#endif
 
 /** @page ddb Distributed DataBase
  *
  *
  * TODO, explicacion del sistema
  */
-/** Count of allocated Ddb structures. */
-static int ddbCount = 0;
+/** Size of each block of a %DDB table arena. */
+#define DDB_ARENA_BLOCK  65536
+/** Contents up to this length are interned. */
+#define DDB_INTERN_MAXLEN   64
+/** Round \a x up to the alignment of the arena allocations. */
+#define DDB_ARENA_ALIGN(x) (((x) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+/** Block of memory of a %DDB table arena. */
+struct DdbArenaBlock {
+  struct DdbArenaBlock* next;   /**< Next (older) block of the arena */
+  size_t                size;   /**< Usable bytes of the block */
+  size_t                used;   /**< Bytes already handed out */
+};
+
+/** Content shared by the records with the same value. */
+struct DdbIntern {
+  struct DdbIntern* next;       /**< Next entry on the intern bucket */
+  unsigned int      refs;       /**< Number of records using the content */
+  unsigned int      hashv;      /**< Hash of the content */
+  char              text[1];    /**< The content */
+};
+
+/** Storage of the records of a resident table. */
+struct DdbArena {
+  struct DdbArenaBlock* blocks; /**< Blocks of the arena, newest first */
+  size_t                size;   /**< Bytes reserved in the blocks */
+  size_t                used;   /**< Bytes handed out from the blocks */
+  size_t                wasted; /**< Bytes of released records still in the blocks */
+  struct DdbIntern**    intern; /**< Hash of interned contents */
+  unsigned int          intern_len;   /**< Length of the intern hash */
+  unsigned int          intern_count; /**< Interned contents */
+  unsigned int          intern_hits;  /**< Records sharing an interned content */
+  unsigned int          compactions;  /**< Number of compactions done */
+};
+
+/** Arenas of the resident %DDB tables. */
+static struct DdbArena ddb_arena_table[DDB_TABLE_MAX];
+
+/** Entry of a secondary index of a table. */
+struct DdbIndexEntry {
+  struct DdbIndexEntry* next;   /**< Next entry on the bucket or prefix */
+  struct Ddb*           ddb;    /**< Indexed register */
+  unsigned int          hashv;  /**< Hash of the indexed word */
+};
+
+/** Secondary index of a resident table.
+ * DDB_INDEX_CONTENT indexes a word of the content in a hash, and
+ * DDB_INDEX_IP indexes the keys which are IP addresses or CIDR masks
+ * in a radix tree.  The entries point to the registers, so the index
+ * is rebuilt when the arena of the table is compacted.
+ */
+struct DdbIndex {
+  unsigned char          type;     /**< DDB_INDEX_CONTENT or DDB_INDEX_IP, 0 if none */
+  unsigned char          field;    /**< Word of the content indexed */
+  struct DdbIndexEntry** hash;     /**< Buckets of a content index */
+  unsigned int           hash_len; /**< Length of the buckets */
+  struct RadixTree       radix;    /**< Prefixes of an IP index */
+  unsigned int           entries;  /**< Indexed registers */
+  unsigned long          lookups;  /**< Lookups done on the index */
+  unsigned long          hits;     /**< Lookups with a register found */
+};
+
+/** Hash segments of a table. */
+struct DdbSegments {
+  struct DdbSegment* seg;       /**< Complete segments of the table */
+  unsigned int       count;     /**< Number of complete segments */
+  unsigned int       size;      /**< Allocated segments */
+  unsigned int       fill;      /**< Registers after the last complete segment */
+  unsigned long      first;     /**< First id after the last complete segment */
+  struct DdbSegment* stored;    /**< Segments saved, while loading the table */
+  unsigned int       nstored;   /**< Number of segments saved */
+  unsigned int       good;      /**< Leading segments equal to the saved ones */
+};
+
+/** Hash segments of the %DDB tables. */
+static struct DdbSegments ddb_segments_table[DDB_TABLE_MAX];
+
+/** Secondary indexes of the %DDB tables. */
+static struct DdbIndex ddb_index_table[DDB_TABLE_MAX];
+/** Entry of the last register returned by ddb_index_first(). */
+static struct DdbIndexEntry *ddb_index_iterator;
+/** Hash of the word being iterated by ddb_index_first(). */
+static unsigned int ddb_index_iterator_hashv;
+/** Word being iterated by ddb_index_first(). */
+static char ddb_index_iterator_word[BUFSIZE];
+/** Table being iterated by ddb_index_first(). */
+static unsigned char ddb_index_iterator_table;
+/** Microseconds spent reading each table at startup. */
+static unsigned long ddb_load_usec[DDB_TABLE_MAX];
+/** errno of the error reading each table at startup, or 0. */
+static int ddb_load_errno[DDB_TABLE_MAX];
+
+#if defined(DDB_THREADED_LOAD)
+/** Protects ddb_load_next. */
+static pthread_mutex_t ddb_load_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Next table to be read by the loading threads. */
+static unsigned char ddb_load_next;
+#endif
 /** DDB registers cache. */
 static struct Ddb ddb_buf_cache[DDB_BUF_CACHE];
 /** Buffer cache. */
@@ -88,9 +196,11 @@ static int ddb_iterator_hash_pos = 0;
 /** Length of hash on iterator. */
 static int ddb_iterator_hash_len = 0;
 
+static void ddb_load_tables(void);
 static void ddb_table_init(unsigned char table);
 static int ddb_add_key(unsigned char table, char *key, char *content);
 static int ddb_del_key(unsigned char table, char *key);
+static void ddb_index_rebuild(unsigned char table);
 
 /** Verify if a table is resident.
  * @param[in] table Table of the %DDB Distributed DataBase.
@@ -136,6 +246,446 @@ DdbCopyMalloc(char *buf, int len, char **p)
   p2[len] = '\0';
 }
 
+/** Allocate memory from the arena of a table.
+ * @param[in] arena Arena of the table.
+ * @param[in] len Number of bytes requested.
+ * @return Pointer to the memory.
+ */
+static void *
+ddb_arena_alloc(struct DdbArena *arena, size_t len)
+{
+  struct DdbArenaBlock *block = arena->blocks;
+  void *ptr;
+
+  len = DDB_ARENA_ALIGN(len);
+  if (!block || (block->size - block->used < len))
+  {
+    size_t size = (len > DDB_ARENA_BLOCK) ? len : DDB_ARENA_BLOCK;
+
+    block = DdbMalloc(DDB_ARENA_ALIGN(sizeof(struct DdbArenaBlock)) + size);
+    assert(0 != block);
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->size += size;
+  }
+
+  ptr = (char *)block + DDB_ARENA_ALIGN(sizeof(struct DdbArenaBlock)) + block->used;
+  block->used += len;
+  arena->used += len;
+
+  return ptr;
+}
+
+/** Release a list of arena blocks.
+ * @param[in] blocks First block to release.
+ */
+static void
+ddb_arena_free(struct DdbArenaBlock *blocks)
+{
+  struct DdbArenaBlock *block;
+
+  while ((block = blocks))
+  {
+    blocks = block->next;
+    DdbFree(block);
+  }
+}
+
+/** Reset the counters and the intern hash of an arena.
+ * @param[in] arena Arena of the table.
+ */
+static void
+ddb_arena_reset(struct DdbArena *arena)
+{
+  arena->blocks = NULL;
+  arena->size = 0;
+  arena->used = 0;
+  arena->wasted = 0;
+  arena->intern_count = 0;
+  arena->intern_hits = 0;
+  if (arena->intern)
+    memset(arena->intern, 0, arena->intern_len * sizeof(struct DdbIntern *));
+}
+
+/** Intern a content in the arena of a table.
+ * @param[in] arena Arena of the table.
+ * @param[in] content Content of the key.
+ * @param[in] len Length of \a content.
+ * @return Shared copy of the content.
+ */
+static char *
+ddb_intern(struct DdbArena *arena, const char *content, size_t len)
+{
+  struct DdbIntern *in;
+  unsigned int hashv = 2166136261u;
+  const char *p;
+
+  /* FNV-1a, the contents are case sensitive */
+  for (p = content; *p; p++)
+    hashv = (hashv ^ (unsigned char)*p) * 16777619u;
+
+  for (in = arena->intern[hashv & (arena->intern_len - 1)]; in; in = in->next)
+  {
+    if ((in->hashv == hashv) && !strcmp(in->text, content))
+    {
+      in->refs++;
+      arena->intern_hits++;
+      return in->text;
+    }
+  }
+
+  in = ddb_arena_alloc(arena, sizeof(struct DdbIntern) + len);
+  memcpy(in->text, content, len + 1);
+  in->refs = 1;
+  in->hashv = hashv;
+  in->next = arena->intern[hashv & (arena->intern_len - 1)];
+  arena->intern[hashv & (arena->intern_len - 1)] = in;
+  arena->intern_count++;
+
+  return in->text;
+}
+
+/** Drop a reference to an interned content.
+ * @param[in] arena Arena of the table.
+ * @param[in] text Interned content.
+ */
+static void
+ddb_intern_release(struct DdbArena *arena, char *text)
+{
+  struct DdbIntern *in, **inp;
+
+  in = (struct DdbIntern *)(text - offsetof(struct DdbIntern, text));
+  if (--in->refs)
+  {
+    arena->intern_hits--;
+    return;
+  }
+
+  for (inp = &arena->intern[in->hashv & (arena->intern_len - 1)]; *inp; inp = &(*inp)->next)
+  {
+    if (*inp == in)
+    {
+      *inp = in->next;
+      break;
+    }
+  }
+  arena->intern_count--;
+  arena->wasted += DDB_ARENA_ALIGN(sizeof(struct DdbIntern) + strlen(text));
+}
+
+/** Build a register in the arena of a table.
+ * @param[in] arena Arena of the table.
+ * @param[in] key Key of the register.
+ * @param[in] content Content of the key.
+ * @return The new register, not linked on the table.
+ */
+static struct Ddb *
+ddb_arena_key(struct DdbArena *arena, const char *key, const char *content)
+{
+  struct Ddb *ddb;
+  size_t klen = strlen(key);
+  size_t clen = strlen(content);
+  int intern = (arena->intern && (clen <= DDB_INTERN_MAXLEN));
+
+  ddb = ddb_arena_alloc(arena, sizeof(struct Ddb) + klen + 1 + (intern ? 0 : clen + 1));
+
+  ddb_key(ddb) = (char *)ddb + sizeof(struct Ddb);
+  memcpy(ddb_key(ddb), key, klen + 1);
+
+  if (intern)
+    ddb_content(ddb) = ddb_intern(arena, content, clen);
+  else
+  {
+    ddb_content(ddb) = ddb_key(ddb) + klen + 1;
+    memcpy(ddb_content(ddb), content, clen + 1);
+  }
+  ddb_next(ddb) = NULL;
+
+  return ddb;
+}
+
+/** Release a register of the arena of a table.
+ * The memory is reclaimed when the table is compacted or dropped.
+ * @param[in] arena Arena of the table.
+ * @param[in] ddb Register to release.
+ */
+static void
+ddb_arena_release(struct DdbArena *arena, struct Ddb *ddb)
+{
+  size_t len = sizeof(struct Ddb) + strlen(ddb_key(ddb)) + 1;
+
+  /* The content is stored after the key unless it is interned */
+  if (ddb_content(ddb) == ddb_key(ddb) + len - sizeof(struct Ddb))
+    len += strlen(ddb_content(ddb)) + 1;
+  else
+    ddb_intern_release(arena, ddb_content(ddb));
+
+  arena->wasted += DDB_ARENA_ALIGN(len);
+}
+
+/** Compact the arena of a table if it is too fragmented.
+ * The registers are copied to new blocks keeping the order of the
+ * hash chains, and the old blocks are released.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ */
+static void
+ddb_arena_compact(unsigned char table)
+{
+  struct DdbArena *arena = &ddb_arena_table[table];
+  struct DdbArenaBlock *old;
+  struct Ddb *ddb, *copy, **link;
+  size_t wasted = arena->wasted;
+  unsigned int i;
+
+  if ((wasted < DDB_ARENA_BLOCK) || (wasted * 2 < arena->used))
+    return;
+
+  ddb_iterator_key = NULL;
+
+  old = arena->blocks;
+  ddb_arena_reset(arena);
+
+  for (i = 0; i < ddb_resident_table[table]; i++)
+  {
+    link = &ddb_data_table[table][i];
+    for (ddb = *link; ddb; ddb = ddb_next(ddb))
+    {
+      copy = ddb_arena_key(arena, ddb_key(ddb), ddb_content(ddb));
+      *link = copy;
+      link = &ddb_next(copy);
+    }
+  }
+
+  ddb_arena_free(old);
+  arena->compactions++;
+
+  /* The registers have moved */
+  ddb_index_rebuild(table);
+
+  log_write(LS_DDB, L_INFO, 0, "Compacted table '%c': %zu bytes reclaimed",
+            table, wasted);
+}
+
+/** Find a word of the content of a register.
+ * @param[in] content Content of the register.
+ * @param[in] field Number of the word, starting from 0.
+ * @param[out] len Length of the word.
+ * @return Start of the word, or NULL if the content is shorter.
+ */
+static const char *
+ddb_index_word(const char *content, unsigned char field, size_t *len)
+{
+  const char *end;
+
+  for (;;)
+  {
+    while (*content == ' ')
+      content++;
+    if (!*content)
+      return NULL;
+    for (end = content; *end && *end != ' '; end++)
+      ;
+    if (!field--)
+    {
+      *len = end - content;
+      return content;
+    }
+    content = end;
+  }
+}
+
+/** Hash a word of a content index, ignoring case.
+ * @param[in] word Word to hash.
+ * @param[in] len Length of the word.
+ * @return Hash value.
+ */
+static unsigned int
+ddb_index_hash(const char *word, size_t len)
+{
+  unsigned int hashv = 2166136261u;
+
+  while (len--)
+    hashv = (hashv ^ (unsigned char)ToLower(*word++)) * 16777619u;
+  return hashv;
+}
+
+/** Parse the key of a register of an IP index.
+ * @param[in] key Key of the register.
+ * @param[out] addr Address of the mask.
+ * @param[out] bits Length of the mask.
+ * @return Non-zero if the whole key is an IP address or CIDR mask.
+ */
+static int
+ddb_index_parse_ip(const char *key, struct irc_in_addr *addr, unsigned char *bits)
+{
+  int len = ipmask_parse(key, addr, bits);
+
+  return len && !key[len];
+}
+
+/** Add a register to the secondary index of its table.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ * @param[in] ddb Register to index.
+ */
+static void
+ddb_index_add(unsigned char table, struct Ddb *ddb)
+{
+  struct DdbIndex *index = &ddb_index_table[table];
+  struct DdbIndexEntry *entry;
+  struct RadixNode *node;
+  struct irc_in_addr addr;
+  unsigned char bits;
+  const char *word;
+  size_t len;
+
+  if (index->type == DDB_INDEX_CONTENT)
+  {
+    if (!index->hash || !(word = ddb_index_word(ddb_content(ddb), index->field, &len)))
+      return;
+    entry = (struct DdbIndexEntry *) DdbMalloc(sizeof(struct DdbIndexEntry));
+    entry->ddb = ddb;
+    entry->hashv = ddb_index_hash(word, len);
+    entry->next = index->hash[entry->hashv & (index->hash_len - 1)];
+    index->hash[entry->hashv & (index->hash_len - 1)] = entry;
+  }
+  else if (index->type == DDB_INDEX_IP)
+  {
+    if (!ddb_index_parse_ip(ddb_key(ddb), &addr, &bits))
+      return;
+    entry = (struct DdbIndexEntry *) DdbMalloc(sizeof(struct DdbIndexEntry));
+    entry->ddb = ddb;
+    entry->hashv = 0;
+    node = radix_insert(&index->radix, &addr, bits);
+    entry->next = radix_data(node);
+    radix_data(node) = entry;
+  }
+  else
+    return;
+
+  index->entries++;
+}
+
+/** Remove a register from the secondary index of its table.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ * @param[in] ddb Register to remove.
+ */
+static void
+ddb_index_del(unsigned char table, struct Ddb *ddb)
+{
+  struct DdbIndex *index = &ddb_index_table[table];
+  struct DdbIndexEntry *entry, **link;
+  struct RadixNode *node;
+  struct irc_in_addr addr;
+  unsigned char bits;
+  const char *word;
+  size_t len;
+
+  if (index->type == DDB_INDEX_CONTENT)
+  {
+    if (!index->hash || !(word = ddb_index_word(ddb_content(ddb), index->field, &len)))
+      return;
+    link = &index->hash[ddb_index_hash(word, len) & (index->hash_len - 1)];
+    node = NULL;
+  }
+  else if (index->type == DDB_INDEX_IP)
+  {
+    if (!ddb_index_parse_ip(ddb_key(ddb), &addr, &bits)
+        || !(node = radix_find(&index->radix, &addr, bits)))
+      return;
+    link = (struct DdbIndexEntry **) &radix_data(node);
+  }
+  else
+    return;
+
+  for (; (entry = *link); link = &entry->next)
+  {
+    if (entry->ddb == ddb)
+    {
+      *link = entry->next;
+      DdbFree(entry);
+      index->entries--;
+      if (ddb_index_iterator == entry)
+        ddb_index_iterator = NULL;
+      break;
+    }
+  }
+
+  if (node && !radix_data(node))
+    radix_remove(&index->radix, node);
+}
+
+/** Release the entries of an IP index prefix.
+ * @param[in] node Prefix of the index.
+ * @param[in] data Unused.
+ * @return Zero to keep walking.
+ */
+static int
+ddb_index_free_node(struct RadixNode *node, void *data)
+{
+  struct DdbIndexEntry *entry, *next;
+
+  for (entry = radix_data(node); entry; entry = next)
+  {
+    next = entry->next;
+    DdbFree(entry);
+  }
+  return 0;
+}
+
+/** Empty the secondary index of a table.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ */
+static void
+ddb_index_clear(unsigned char table)
+{
+  struct DdbIndex *index = &ddb_index_table[table];
+  struct DdbIndexEntry *entry, *next;
+  unsigned int i;
+
+  if (index->type == DDB_INDEX_CONTENT && index->hash)
+  {
+    for (i = 0; i < index->hash_len; i++)
+    {
+      for (entry = index->hash[i]; entry; entry = next)
+      {
+        next = entry->next;
+        DdbFree(entry);
+      }
+      index->hash[i] = NULL;
+    }
+  }
+  else if (index->type == DDB_INDEX_IP && index->radix.head)
+  {
+    radix_walk_within(&index->radix, &index->radix.head->prefix, 0,
+                      ddb_index_free_node, NULL);
+    radix_clear(&index->radix);
+  }
+
+  index->entries = 0;
+  if (ddb_index_iterator_table == table)
+    ddb_index_iterator = NULL;
+}
+
+/** Build again the secondary index of a table.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ */
+static void
+ddb_index_rebuild(unsigned char table)
+{
+  struct Ddb *ddb;
+  unsigned int i;
+
+  if (!ddb_index_table[table].type)
+    return;
+
+  ddb_index_clear(table);
+  for (i = 0; i < ddb_resident_table[table]; i++)
+    for (ddb = ddb_data_table[table][i]; ddb; ddb = ddb_next(ddb))
+      ddb_index_add(table, ddb);
+}
+
 /** Calculates the hash.
  * @param[in] line buffer line reading the tables.
  * @param[in] table Table of the %DDB Distributed DataBase.
@@ -171,6 +721,214 @@ ddb_hash_calculate(char *line, unsigned char table)
   ddb_hashtable_lo[table] = x[1];
 }
 
+/** Read a table from file or database into memory.
+ * It only touches the data of \a table, so several tables may be
+ * read at once by different threads.  The events of the table are
+ * run later by ddb_table_init().  It does not log nor die; the
+ * errors are left in ddb_load_errno[] for the main thread.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ */
+static void
+ddb_table_load(unsigned char table)
+{
+  struct timeval start, end;
+
+  gettimeofday(&start, NULL);
+
+  /* First drop table */
+  ddb_drop_memory(table, 0);
+
+  /* Segments to verify the table while reading it */
+  MyFree(ddb_segments_table[table].stored);
+  ddb_segments_table[table].nstored =
+    ddb_db_segment_read(table, &ddb_segments_table[table].stored);
+
+  /* Read the table on file or database */
+  ddb_load_errno[table] = 0;
+  if (ddb_db_read(NULL, table, 0, 0) == -2)
+    ddb_load_errno[table] = errno;
+
+  gettimeofday(&end, NULL);
+  ddb_load_usec[table] = (end.tv_sec - start.tv_sec) * 1000000 +
+                         (end.tv_usec - start.tv_usec);
+}
+
+/** Die if a table could not be read by ddb_table_load().
+ * It must run in the main thread.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ */
+static void
+ddb_load_check(unsigned char table)
+{
+  if (ddb_load_errno[table])
+    ddb_die("Error when reading table '%c' (%s)", table,
+            strerror(ddb_load_errno[table]));
+}
+
+/** Account a new register in the hash segments of its table.
+ * Must be called after ddb_hash_calculate() of the register.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ * @param[in] id Identify number of the register.
+ * @param[in] save Non-zero to save the segment when it is complete.
+ */
+static void
+ddb_segment_add(unsigned char table, unsigned long id, int save)
+{
+  struct DdbSegments *segs = &ddb_segments_table[table];
+  struct DdbSegment *seg, *stored;
+
+  if (!segs->fill++)
+    segs->first = id;
+  if (segs->fill < DDB_SEGMENT_SIZE)
+    return;
+
+  if (segs->count == segs->size)
+  {
+    segs->size = segs->size ? segs->size * 2 : 64;
+    segs->seg = MyRealloc(segs->seg, segs->size * sizeof(struct DdbSegment));
+  }
+
+  seg = &segs->seg[segs->count++];
+  seg->first = segs->first;
+  seg->last = id;
+  seg->hi = ddb_hashtable_hi[table];
+  seg->lo = ddb_hashtable_lo[table];
+  segs->fill = 0;
+
+  if (save)
+    ddb_db_segment_write(table, seg, 1, 1);
+  else if (segs->good == segs->count - 1 && segs->good < segs->nstored)
+  {
+    /* Loading: compare with the segment saved */
+    stored = &segs->stored[segs->good];
+    if (stored->first == seg->first && stored->last == seg->last
+        && stored->hi == seg->hi && stored->lo == seg->lo)
+      segs->good++;
+  }
+}
+
+/** Forget the hash segments of a table.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ */
+static void
+ddb_segment_reset(unsigned char table)
+{
+  struct DdbSegments *segs = &ddb_segments_table[table];
+
+  segs->count = 0;
+  segs->fill = 0;
+  segs->good = 0;
+}
+
+/** Keep the part of a corrupt table before the first segment that
+ * differs from the saved ones.  The registers after it are asked to
+ * the hubs with the normal burst, which starts from the last id.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ * @return 1 if the table was repaired, 0 if it must be dropped.
+ */
+static int
+ddb_table_repair(unsigned char table)
+{
+  struct DdbSegments *segs = &ddb_segments_table[table];
+  struct DdbSegment good;
+
+  if (!segs->good)
+    return 0;
+
+  good = segs->stored[segs->good - 1];
+
+  log_write(LS_DDB, L_INFO, 0, "WARNING - Table '%c' is corrupt after register %lu "
+            "(segment %u of %u). Truncating table...",
+            table, good.last, segs->good + 1, segs->nstored);
+
+  if (!ddb_db_truncate(table, good.last))
+    return 0;
+
+  ddb_table_load(table);
+  ddb_load_check(table);
+  if ((ddb_hashtable_hi[table] != good.hi) || (ddb_hashtable_lo[table] != good.lo))
+    return 0;
+
+  sendto_opmask_butone(0, SNO_OLDSNO, "Table '%c' is corrupt after register %lu, "
+                       "solicit DDB update of the rest", table, good.last);
+  return 1;
+}
+
+#if defined(DDB_THREADED_LOAD)
+/** Body of the threads loading the tables.
+ * @param[in] arg Unused.
+ * @return NULL.
+ */
+static void *
+ddb_load_thread(void *arg)
+{
+  unsigned char table;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&ddb_load_lock);
+    table = ddb_load_next;
+    if (table <= DDB_END)
+      ddb_load_next++;
+    pthread_mutex_unlock(&ddb_load_lock);
+
+    if (table > DDB_END)
+      break;
+    ddb_table_load(table);
+  }
+
+  return NULL;
+}
+#endif
+
+/** Read all the tables, in parallel if DDB_LOAD_THREADS allows it.
+ */
+static void
+ddb_load_tables(void)
+{
+  unsigned char table;
+#if defined(DDB_THREADED_LOAD)
+  pthread_t threads[DDB_END - DDB_INIT + 1];
+  sigset_t sigs, oldsigs;
+  int nthreads = feature_int(FEAT_DDB_LOAD_THREADS);
+  int i, started = 0;
+
+  if (nthreads > DDB_END - DDB_INIT + 1)
+    nthreads = DDB_END - DDB_INIT + 1;
+
+  if (nthreads > 1)
+  {
+    ddb_load_next = DDB_INIT;
+
+    /* The signals must be delivered to the main thread */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+    for (i = 0; i < nthreads; i++)
+    {
+      if (pthread_create(&threads[started], NULL, ddb_load_thread, NULL))
+        break;
+      started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+    /* If some thread could not be started, help with the pending tables */
+    if (started < nthreads)
+      ddb_load_thread(NULL);
+
+    for (i = 0; i < started; i++)
+      pthread_join(threads[i], NULL);
+
+    log_write(LS_DDB, L_INFO, 0, "Tables read by %d threads", started);
+  }
+  else
+#endif
+  for (table = DDB_INIT; table <= DDB_END; table++)
+    ddb_table_load(table);
+
+  for (table = DDB_INIT; table <= DDB_END; table++)
+    ddb_load_check(table);
+}
+
 /** Initialize %DDB Distributed DataBases.
  */
 void
@@ -205,7 +963,17 @@ ddb_init(void)
   ddb_resident_table[DDB_VHOSTDB]        =  4096;
   ddb_resident_table[DDB_WEBIRCDB]       =   256;
 
+  /*
+   * Secondary indexes: vhosts are looked up by host,
+   * ilines and webirc by the IP of the client.
+   */
+  ddb_index_table[DDB_VHOSTDB].type      = DDB_INDEX_CONTENT;
+  ddb_index_table[DDB_VHOSTDB].field     = 0;
+  ddb_index_table[DDB_ILINEDB].type      = DDB_INDEX_IP;
+  ddb_index_table[DDB_WEBIRCDB].type     = DDB_INDEX_IP;
+
   if (!ddb_db_cache()) {
+    ddb_load_tables();
     for (table = DDB_INIT; table <= DDB_END; table++)
       ddb_table_init(table);
   }
@@ -217,18 +985,16 @@ ddb_init(void)
   CurrentTime = time(NULL);
 }
 
-/** Initialize a table of %DDB.
+/** Initialize a table of %DDB already read by ddb_table_load().
+ * Verifies the hash of the table and runs the events of its registers.
  * @param[in] table
  */
 static void ddb_table_init(unsigned char table)
 {
+  struct DdbSegments *segs = &ddb_segments_table[table];
+  struct Ddb *ddb;
   unsigned int hi, lo;
-
-  /* First drop table */
-  ddb_drop_memory(table, 0);
-
-  /* Read the table on file or database */
-  ddb_db_read(NULL, table, 0, 0);
+  unsigned int i;
 
   /* Read hashes */
   ddb_db_hash_read(table, &hi, &lo);
@@ -237,7 +1003,8 @@ static void ddb_table_init(unsigned char table)
   sendto_opmask_butone(0, SNO_OLDSNO, "Lo: %d Hashtable_Lo: %d Hi: %d Hashtable_Hi %d",
                 lo, ddb_hashtable_lo[table], hi, ddb_hashtable_hi[table]);
 
-  if ((ddb_hashtable_hi[table] != hi) || (ddb_hashtable_lo[table] != lo))
+  if (((ddb_hashtable_hi[table] != hi) || (ddb_hashtable_lo[table] != lo))
+      && !ddb_table_repair(table))
   {
     struct DLink *lp;
     char buf[1024];
@@ -281,6 +1048,13 @@ static void ddb_table_init(unsigned char table)
 
   ddb_db_hash_write(table);
 
+  /* Save the segments again if they were missing or wrong */
+  if ((segs->good != segs->nstored) || (segs->count != segs->nstored))
+    ddb_db_segment_write(table, segs->seg, segs->count, 0);
+  MyFree(segs->stored);
+  segs->stored = NULL;
+  segs->nstored = 0;
+
   /*
    * Si hemos leido algun registro de compactado,
    * sencillamente nos lo cargamos en memoria, para
@@ -290,23 +1064,37 @@ static void ddb_table_init(unsigned char table)
   if (ddb_resident_table[table])
   {
     ddb_del_key(table, "*");
-    log_write(LS_DDB, L_INFO, 0, "Loading Table '%c' finished: S=%u R=%u",
-              table, ddb_id_table[table], ddb_count_table[table]);
+    ddb_arena_compact(table);
+
+    /* The registers were read without events, run them now */
+    if (ddb_events_table[table])
+    {
+      for (i = 0; i < ddb_resident_table[table]; i++)
+        for (ddb = ddb_data_table[table][i]; ddb; ddb = ddb_next(ddb))
+          ddb_events_table[table](ddb_key(ddb), ddb_content(ddb), 0);
+    }
+
+    log_write(LS_DDB, L_INFO, 0, "Loading Table '%c' finished: S=%u R=%u (%lu.%03lu ms)",
+              table, ddb_id_table[table], ddb_count_table[table],
+              ddb_load_usec[table] / 1000, ddb_load_usec[table] % 1000);
   }
   else if (ddb_count_table[table])
-    log_write(LS_DDB, L_INFO, 0, "Loading Table '%c' finished: S=%u NoResident",
-              table, ddb_id_table[table]);
+    log_write(LS_DDB, L_INFO, 0, "Loading Table '%c' finished: S=%u NoResident (%lu.%03lu ms)",
+              table, ddb_id_table[table],
+              ddb_load_usec[table] / 1000, ddb_load_usec[table] % 1000);
 }
 
 /** Add a new register from the network or reading when ircd is starting.
+ * During the start the tables may be read by several threads, so
+ * this function must only touch the data of \a table when \a cptr
+ * is NULL; the events are run by ddb_table_init().
  * @param[in] cptr %Server sending a new register. If is NULL, it is own server during ircd start.
  * @param[in] table Table of the %DDB Distributed DataBases.
  */
 void
 ddb_new_register(struct Client *cptr, unsigned char table, unsigned long id, char *mask, char *key, char *content)
 {
-  static char *keytemp = NULL;
-  static int key_len = 0;
+  char keytemp[BUFSIZE];
   char db_buf[1024];
 
   assert(0 != table);
@@ -319,6 +1107,7 @@ ddb_new_register(struct Client *cptr, unsigned char table, unsigned long id, cha
     ircd_snprintf(0, db_buf, sizeof(db_buf), "%lu %s %c %s\n", id, mask, table, key);
 
   ddb_hash_calculate(db_buf, table);
+  ddb_segment_add(table, id, cptr != NULL);
 
   /* In the ircd starting, cptr is NULL and it not writing on file or database */
   if (cptr)
@@ -340,16 +1129,7 @@ ddb_new_register(struct Client *cptr, unsigned char table, unsigned long id, cha
   {
     int update = 0, i = 0;
 
-    if ((strlen(key) + 1 > key_len) || (!keytemp))
-    {
-      key_len = strlen(key) + 1;
-      if (keytemp)
-        MyFree(keytemp);
-      keytemp = MyMalloc(key_len);
-
-      assert(0 != keytemp);
-    }
-    strcpy(keytemp, key);
+    ircd_strncpy(keytemp, key, sizeof(keytemp) - 1);
 
     while (keytemp[i])
     {
@@ -362,8 +1142,15 @@ ddb_new_register(struct Client *cptr, unsigned char table, unsigned long id, cha
     else
       ddb_del_key(table, keytemp);
 
+    if (!cptr)
+      return;
+
+    ddb_iterator_key = NULL;
+
     if (ddb_events_table[table])
       ddb_events_table[table](key, content, update);
+
+    ddb_arena_compact(table);
   }
 }
 
@@ -377,26 +1164,12 @@ static int
 ddb_add_key(unsigned char table, char *key, char *content)
 {
   struct Ddb *ddb;
-  char *k, *c;
   int hashi;
   int delete = 0;
 
-  ddb_iterator_key = NULL;
-
   delete = ddb_del_key(table, key);
 
-  ddb = DdbMalloc(sizeof(struct Ddb) + strlen(key) + strlen(content) + 2);
-  assert(0 != ddb);
-
-  k = (char *)ddb + sizeof(struct Ddb);
-  c = k + strlen(key) + 1;
-
-  strcpy(k, key);
-  strcpy(c, content);
-
-  ddb_key(ddb) = k;
-  ddb_content(ddb) = c;
-  ddb_next(ddb) = NULL;
+  ddb = ddb_arena_key(&ddb_arena_table[table], key, content);
 
   hashi = ddb_hash_register(ddb_key(ddb), ddb_resident_table[table]);
 
@@ -405,7 +1178,8 @@ ddb_add_key(unsigned char table, char *key, char *content)
   ddb_next(ddb) = ddb_data_table[table][hashi];
   ddb_data_table[table][hashi] = ddb;
   ddb_count_table[table]++;
-  ddbCount++;
+
+  ddb_index_add(table, ddb);
 
   return delete;
 }
@@ -422,8 +1196,6 @@ ddb_del_key(unsigned char table, char *key)
   int hashi;
   int delete = 0;
 
-  ddb_iterator_key = NULL;
-
   hashi = ddb_hash_register(key, ddb_resident_table[table]);
   ddb3 = &ddb_data_table[table][hashi];
 
@@ -434,9 +1206,9 @@ ddb_del_key(unsigned char table, char *key)
     {
       *ddb3 = ddb2;
       delete = 1;
-      DdbFree(ddb);
+      ddb_index_del(table, ddb);
+      ddb_arena_release(&ddb_arena_table[table], ddb);
       ddb_count_table[table]--;
-      ddbCount--;
       break;
     }
     ddb3 = &(ddb_next(ddb));
@@ -450,6 +1222,21 @@ ddb_del_key(unsigned char table, char *key)
 void
 ddb_drop(unsigned char table)
 {
+  struct DLink *lp;
+  struct DdbBurst *burst;
+
+  ddb_iterator_key = NULL;
+
+  /* Cancel the bursts of the table in progress */
+  for (lp = cli_serv(&me)->down; lp; lp = lp->next)
+  {
+    if ((burst = cli_ddbburst(lp->value.cptr)))
+    {
+      burst->pending &= ~(((unsigned int)1) << (table - DDB_INIT));
+      if (!burst->pending)
+        ddb_burst_free(lp->value.cptr);
+    }
+  }
 
   /* Delete file or database of the table */
   ddb_db_drop(table);
@@ -462,19 +1249,23 @@ ddb_drop(unsigned char table)
 }
 
 /** Deletes a table from memory.
+ * The registers live in the arena of the table, so they are released
+ * all at once.
  * @param[in] table Table of the %DDB Distributed DataBases.
  * @param[in] events Non-zero impliques events.
  */
 void
 ddb_drop_memory(unsigned char table, int events)
 {
-  struct Ddb *ddb, *ddb2;
+  struct DdbArena *arena = &ddb_arena_table[table];
+  struct Ddb *ddb;
   int i, n;
 
   ddb_id_table[table] = 0;
   ddb_count_table[table] = 0;
   ddb_hashtable_hi[table] = 0;
   ddb_hashtable_lo[table] = 0;
+  ddb_segment_reset(table);
 
   n = ddb_resident_table[table];
   if (!n)
@@ -482,25 +1273,37 @@ ddb_drop_memory(unsigned char table, int events)
 
   if (ddb_data_table[table])
   {
-    for (i = 0; i < n; i++)
+    if (events && ddb_events_table[table])
     {
-      for (ddb = ddb_data_table[table][i]; ddb; ddb = ddb2)
+      for (i = 0; i < n; i++)
       {
-        ddb2 = ddb_next(ddb);
-
-        if (events && ddb_events_table[table])
+        for (ddb = ddb_data_table[table][i]; ddb; ddb = ddb_next(ddb))
           ddb_events_table[table](ddb_key(ddb), NULL, 0);
-
-        DdbFree(ddb);
       }
     }
+    ddb_arena_free(arena->blocks);
+    ddb_index_clear(table);
   }
   else
   {                             /* NO tenemos memoria para esa tabla, asi que la pedimos */
     ddb_data_table[table] = DdbMalloc(n * sizeof(struct Ddb *));
     assert(ddb_data_table[table]);
+
+    arena->intern_len = n / 4;
+    arena->intern = DdbMalloc(arena->intern_len * sizeof(struct DdbIntern *));
+    assert(arena->intern);
+
+    if (ddb_index_table[table].type == DDB_INDEX_CONTENT)
+    {
+      ddb_index_table[table].hash_len = n;
+      ddb_index_table[table].hash = DdbMalloc(n * sizeof(struct DdbIndexEntry *));
+      assert(ddb_index_table[table].hash);
+      memset(ddb_index_table[table].hash, 0, n * sizeof(struct DdbIndexEntry *));
+    }
   }
 
+  ddb_arena_reset(arena);
+
   for (i = 0; i < n; i++)
     ddb_data_table[table][i] = NULL;
 
@@ -547,6 +1350,107 @@ ddb_burst(struct Client *cptr)
 /* TODO: zlib_microburst */
 }
 
+/** Finish the burst of a table to a server.
+ * @param[in] cptr %Server receiving the burst.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ */
+static void
+ddb_burst_done(struct Client *cptr, unsigned char table)
+{
+  char buf[16];
+
+  cli_serv(cptr)->ddb_open |= ((unsigned int)1) << (table - DDB_INIT);
+
+  /* The automatic HASH verification is due to do to leafs, NEVER to
+   * HUBS, since if a HUB has the corrupt DB, all the network is down
+   * by wind with a massive erasure.
+   */
+  if (IsHub(cptr))
+    return;
+
+  inttobase64(buf, ddb_hashtable_hi[table], 6);
+  inttobase64(buf + 6, ddb_hashtable_lo[table], 6);
+
+  sendcmdto_one(&me, CMD_DB, cptr, "%s 0 H %s %c", cli_name(cptr), buf, table);
+}
+
+/** Start the burst of a table to a server.
+ * The registers newer than \a id are sent while the sendQ of the
+ * server is below half of its maximum; the rest is sent by
+ * ddb_burst_next() when the sendQ drains.
+ * @param[in] cptr %Server receiving the burst.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ * @param[in] id Last ID number of the table known by \a cptr.
+ * @return 1 if the whole table was sent, 0 if there are data pending.
+ */
+int
+ddb_table_burst(struct Client *cptr, unsigned char table, unsigned long id)
+{
+  struct DdbBurst *burst;
+  unsigned int mask = ((unsigned int)1) << (table - DDB_INIT);
+
+  assert(MyConnect(cptr) && IsServer(cptr));
+
+  if (!(burst = cli_ddbburst(cptr)))
+  {
+    burst = cli_ddbburst(cptr) = (struct DdbBurst *) MyCalloc(1, sizeof(struct DdbBurst));
+    assert(0 != burst);
+  }
+
+  burst->pending |= mask;
+  burst->id[table - DDB_INIT] = id;
+  burst->remaining[table - DDB_INIT] = 0;
+
+  ddb_burst_next(cptr);
+
+  return (cli_ddbburst(cptr) && (cli_ddbburst(cptr)->pending & mask)) ? 0 : 1;
+}
+
+/** Send more registers to a server in mid-burst of tables.
+ * @param[in] cptr %Server receiving the burst.
+ */
+void
+ddb_burst_next(struct Client *cptr)
+{
+  struct DdbBurst *burst = cli_ddbburst(cptr);
+  unsigned int limit = cli_max_sendq(cptr) / 2;
+  unsigned char table;
+  int i;
+
+  assert(0 != burst);
+
+  for (table = DDB_INIT; table <= DDB_END; table++)
+  {
+    i = table - DDB_INIT;
+    if (!(burst->pending & (((unsigned int)1) << i)))
+      continue;
+
+    if (!ddb_db_burst(cptr, table, &burst->id[i], limit, &burst->remaining[i]))
+      break;
+
+    burst->pending &= ~(((unsigned int)1) << i);
+    ddb_burst_done(cptr, table);
+  }
+
+  if (!burst->pending)
+    ddb_burst_free(cptr);
+
+  update_write(cptr);
+}
+
+/** Stop all the bursts of tables to a server.
+ * @param[in] cptr %Server receiving the burst.
+ */
+void
+ddb_burst_free(struct Client *cptr)
+{
+  if (cli_ddbburst(cptr))
+  {
+    MyFree(cli_ddbburst(cptr));
+    cli_ddbburst(cptr) = NULL;
+  }
+}
+
 /** Initializes %DDB iterator.
  *
  * @return ddb_iterator_key pointer.
@@ -695,6 +1599,154 @@ struct Ddb *ddb_find_key(unsigned char table, char *key)
   return ddb;
 }
 
+/** Get the kind of secondary index of a table.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ * @return DDB_INDEX_CONTENT, DDB_INDEX_IP or 0 if the table has no index.
+ */
+int
+ddb_index_type(unsigned char table)
+{
+  return ddb_resident_table[table] ? ddb_index_table[table].type : 0;
+}
+
+/** Find the next register of the content index matching the word
+ * being iterated.
+ * @param[in] entry First entry to check.
+ * @return Register found, or NULL.
+ */
+static struct Ddb *
+ddb_index_scan(struct DdbIndexEntry *entry)
+{
+  struct DdbIndex *index = &ddb_index_table[ddb_index_iterator_table];
+  const char *word;
+  size_t len;
+
+  for (; entry; entry = entry->next)
+  {
+    if (entry->hashv != ddb_index_iterator_hashv)
+      continue;
+    word = ddb_index_word(ddb_content(entry->ddb), index->field, &len);
+    if (word && !ircd_strncmp(word, ddb_index_iterator_word, len)
+        && !ddb_index_iterator_word[len])
+      break;
+  }
+
+  ddb_index_iterator = entry;
+  return entry ? entry->ddb : NULL;
+}
+
+/** Find the first register of a table whose indexed word of the
+ * content is \a value.  Use ddb_index_next() for the rest.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ * @param[in] value Word to look up, case is ignored.
+ * @return First register found, or NULL.
+ */
+struct Ddb *
+ddb_index_first(unsigned char table, const char *value)
+{
+  struct DdbIndex *index = &ddb_index_table[table];
+  unsigned int hashv;
+  struct Ddb *ddb;
+
+  ddb_index_iterator = NULL;
+  if (!ddb_resident_table[table] || index->type != DDB_INDEX_CONTENT || !index->hash)
+    return NULL;
+
+  ircd_strncpy(ddb_index_iterator_word, value, sizeof(ddb_index_iterator_word) - 1);
+  hashv = ddb_index_hash(ddb_index_iterator_word, strlen(ddb_index_iterator_word));
+  ddb_index_iterator_hashv = hashv;
+  ddb_index_iterator_table = table;
+
+  index->lookups++;
+  ddb = ddb_index_scan(index->hash[hashv & (index->hash_len - 1)]);
+  if (ddb)
+    index->hits++;
+  return ddb;
+}
+
+/** Find the next register matching the word of ddb_index_first().
+ * @return Next register found, or NULL.
+ */
+struct Ddb *
+ddb_index_next(void)
+{
+  if (!ddb_index_iterator)
+    return NULL;
+  return ddb_index_scan(ddb_index_iterator->next);
+}
+
+/** Find the register of a table with the most specific IP mask
+ * matching an address.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ * @param[in] addr IP address to look up.
+ * @return Register found, or NULL.
+ */
+struct Ddb *
+ddb_find_ip(unsigned char table, const struct irc_in_addr *addr)
+{
+  struct DdbIndex *index = &ddb_index_table[table];
+  struct RadixNode *node;
+
+  if (!ddb_resident_table[table] || index->type != DDB_INDEX_IP)
+    return NULL;
+
+  index->lookups++;
+  if (!(node = radix_best(&index->radix, addr)))
+    return NULL;
+
+  index->hits++;
+  return ((struct DdbIndexEntry *) radix_data(node))->ddb;
+}
+
+/** State of a walk of ddb_walk_ip(). */
+struct DdbIndexWalk {
+  int  (*fn)(struct Ddb *, void *); /**< Function to call */
+  void  *data;                      /**< Extra argument for the function */
+};
+
+/** Call the function of a ddb_walk_ip() for the registers of a prefix.
+ * @param[in] node Prefix of the index.
+ * @param[in] data Walk state.
+ * @return Non-zero to stop the walk.
+ */
+static int
+ddb_walk_ip_node(struct RadixNode *node, void *data)
+{
+  struct DdbIndexWalk *walk = data;
+  struct DdbIndexEntry *entry;
+  int res;
+
+  for (entry = radix_data(node); entry; entry = entry->next)
+    if ((res = walk->fn(entry->ddb, walk->data)))
+      return res;
+  return 0;
+}
+
+/** Call a function for the registers of a table whose IP mask is
+ * inside the mask \a addr / \a bits.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ * @param[in] addr Address of the mask.
+ * @param[in] bits Length of the mask.
+ * @param[in] fn Function to call for each register, non-zero stops.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int
+ddb_walk_ip(unsigned char table, const struct irc_in_addr *addr, unsigned char bits,
+            int (*fn)(struct Ddb *, void *), void *data)
+{
+  struct DdbIndex *index = &ddb_index_table[table];
+  struct DdbIndexWalk walk;
+
+  if (!ddb_resident_table[table] || index->type != DDB_INDEX_IP)
+    return 0;
+
+  walk.fn = fn;
+  walk.data = data;
+  index->lookups++;
+  return radix_walk_within(&index->radix, addr, bits, ddb_walk_ip_node, &walk);
+}
+
 /** Get nick!user@host of the virtual bot.
  * @param[in] bot Key of the register.
  * @return nick!user@host of the virtual bot if exists and
@@ -830,33 +1882,81 @@ ddb_end(void)
 void
 ddb_report_stats(struct Client* to, const struct StatDesc* sd, char* param)
 {
+  struct DLink *lp;
+  struct DdbBurst *burst;
   unsigned char table;
 
   for (table = DDB_INIT; table <= DDB_END; table++)
   {
     if (ddb_table_is_resident(table))
+    {
+      struct DdbArena *arena = &ddb_arena_table[table];
+
       send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
-                 "b :Table '%c' S=%lu R=%u", table,
+                 "b :Table '%c' S=%lu R=%u Arena=%zu Used=%zu Wasted=%zu "
+                 "Interned=%u Shared=%u Compactions=%u Segments=%u", table,
                  ddb_id_table[table],
-                 ddb_count_table[table]);
+                 ddb_count_table[table],
+                 arena->size, arena->used, arena->wasted,
+                 arena->intern_count, arena->intern_hits,
+                 arena->compactions, ddb_segments_table[table].count);
+
+      if (ddb_index_table[table].type)
+      {
+        struct DdbIndex *index = &ddb_index_table[table];
+
+        send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+                   "b :Index '%c' %s Entries=%u Prefixes=%u Nodes=%u "
+                   "Lookups=%lu Hits=%lu", table,
+                   index->type == DDB_INDEX_IP ? "IP" : "Content",
+                   index->entries, index->radix.count, index->radix.nodes,
+                   index->lookups, index->hits);
+      }
+    }
     else
     {
       if (ddb_id_table[table])
         send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
-                   "b :Table '%c' S=%lu NoResident", table,
-                   ddb_id_table[table]);
+                   "b :Table '%c' S=%lu NoResident Segments=%u", table,
+                   ddb_id_table[table], ddb_segments_table[table].count);
+    }
+  }
+
+  /* Bursts of tables in progress */
+  for (lp = cli_serv(&me)->down; lp; lp = lp->next)
+  {
+    if (!(burst = cli_ddbburst(lp->value.cptr)))
+      continue;
+
+    for (table = DDB_INIT; table <= DDB_END; table++)
+    {
+      if (burst->pending & (((unsigned int)1) << (table - DDB_INIT)))
+        send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+                   "b :Burst %s Table '%c' S=%lu/%lu Remaining=%zu",
+                   cli_name(lp->value.cptr), table,
+                   burst->id[table - DDB_INIT], ddb_id_table[table],
+                   burst->remaining[table - DDB_INIT]);
     }
   }
 }
 
 /** Find number of DDB structs allocated and memory used by them.
  * @param[out] count_out Receives number of DDB structs allocated.
- * @param[out] bytes_out Receives number of bytes used by DDB structs.
+ * @param[out] bytes_out Receives number of bytes reserved by the table arenas.
  */
 void ddb_count_memory(size_t* count_out, size_t* bytes_out)
 {
+  unsigned char table;
+
   assert(0 != count_out);
   assert(0 != bytes_out);
-  *count_out = ddbCount;
-  *bytes_out = ddbCount * sizeof(struct Ddb);
+  *count_out = 0;
+  *bytes_out = 0;
+  for (table = DDB_INIT; table <= DDB_END; table++)
+  {
+    *count_out += ddb_count_table[table];
+    *bytes_out += ddb_arena_table[table].size;
+    *bytes_out += ddb_index_table[table].entries * sizeof(struct DdbIndexEntry)
+                  + ddb_index_table[table].radix.nodes * sizeof(struct RadixNode);
+  }
 }
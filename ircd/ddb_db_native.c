@@ -27,6 +27,7 @@
 
 #include "ddb.h"
 #include "ircd.h"
+#include "ircd_alloc.h"
 #include "ircd_features.h"
 #include "ircd_snprintf.h"
 #include "ircd_string.h"
@@ -36,6 +37,7 @@
 #include "send.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -53,6 +55,7 @@ struct ddb_memory_table {
   char *point_r;    /* Lectura */
 };
 
+static int ddb_map_table(unsigned char table, struct ddb_memory_table *map_table);
 static int ddb_read(struct ddb_memory_table *map_table, char *buf);
 static int ddb_seek(struct ddb_memory_table *map_table, char *buf, unsigned long id);
 static void get_ddb_stat(int fd, struct ddb_stat *ddbstat);
@@ -127,44 +130,26 @@ ddb_db_cache(void)
 }
 
 /** Read the table.
+ * It does not log nor die, as it may run in a loading thread.
  * @param[in] cptr %Server if is exists, it sends to server.
  * @param[in] table Table of the %DDB Distributed DataBase.
  * @param[in] id ID number in the table.
  * @param[in] count Number of registers to be read.
- * @return 1 No data pending, 0 have data pending, -1 error.
+ * @return 1 No data pending, 0 have data pending, -1 error,
+ * -2 if the table could not be mapped (with errno set).
  */
 int
 ddb_db_read(struct Client *cptr, unsigned char table, unsigned long id, int count)
 {
   struct ddb_memory_table map_table;
-  char path[1024];
   char buf[1024];
-  int fd, cont;
+  int cont;
   int int_return;
 
   int_return = 1; /* 1 = success */
 
-  ircd_snprintf(0, path, sizeof(path), "%s/table.%c",
-                feature_str(FEAT_DDBPATH), table);
-  alarm(3);
-  fd = open(path, O_RDONLY, S_IRUSR | S_IWUSR);
-  get_ddb_stat(fd, &ddb_stats_table[table]);
-
-  memcpy(&map_table.file_stat, &ddb_stats_table[table],
-         sizeof(ddb_stats_table[table]));
-
-  map_table.position = mmap(NULL, map_table.file_stat.size, PROT_READ,
-                             MAP_SHARED | MAP_NORESERVE, fd, 0);
-
-  if (fd == -1)
-    ddb_die("Error when reading table '%c' (OPEN)", table);
-  if ((map_table.file_stat.size != 0) && (map_table.position == MAP_FAILED))
-    ddb_die("Error when reading table '%c' (MMAP)", table);
-
-  close(fd);
-  alarm(0);
-
-  map_table.point_r = map_table.position;
+  if (ddb_map_table(table, &map_table))
+    return -2;
 
   cont = ddb_seek(&map_table, buf, id);
   if (cont == -1)
@@ -226,6 +211,78 @@ ddb_db_read(struct Client *cptr, unsigned char table, unsigned long id, int coun
   return int_return;
 }
 
+/** Send the registers of a table to a server until its sendQ is full.
+ * @param[in] cptr %Server receiving the burst.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ * @param[in,out] id Last ID number sent, updated with the registers sent.
+ * @param[in] limit Stop when the sendQ of \a cptr is longer than this.
+ * @param[out] remaining Bytes of the table still to send.
+ * @return 1 No data pending, 0 have data pending.
+ */
+int
+ddb_db_burst(struct Client *cptr, unsigned char table, unsigned long *id,
+             unsigned int limit, size_t *remaining)
+{
+  struct ddb_memory_table map_table;
+  char buf[1024];
+  int int_return = 1;
+
+  *remaining = 0;
+  alarm(3);
+  if (ddb_map_table(table, &map_table))
+    ddb_die("Error when reading table '%c' (%s)", table, strerror(errno));
+  alarm(0);
+
+  if (ddb_seek(&map_table, buf, *id + 1) == -1)
+  {
+    munmap(map_table.position, map_table.file_stat.size);
+    return 1;
+  }
+
+  do
+  {
+    char *mask, *key, *content;
+    unsigned long cid;
+
+    cid = strtoul(buf, NULL, 10);
+    if (cid <= *id)
+      continue;
+
+    mask = strchr(buf, ' ');
+    if (!mask)
+      continue;
+    *mask++ = '\0';
+
+    key = strchr(mask, ' ');
+    if (!key)
+      continue;
+    *key++ = '\0';
+
+    content = strchr(key, ' ');
+    if (content)
+      *content++ = '\0';
+
+    if (content)
+      sendcmdto_one(&me, CMD_DB, cptr, "%s %lu %c %s :%s",
+                    mask, cid, table, key, content);
+    else
+      sendcmdto_one(&me, CMD_DB, cptr, "%s %lu %c %s",
+                    mask, cid, table, key);
+    *id = cid;
+
+    if (MsgQLength(&cli_sendQ(cptr)) > limit)
+    {
+      *remaining = map_table.position + map_table.file_stat.size - map_table.point_r;
+      int_return = *remaining ? 0 : 1;
+      break;
+    }
+  } while (ddb_read(&map_table, buf) != -1);
+
+  munmap(map_table.position, map_table.file_stat.size);
+
+  return int_return;
+}
+
 /** Write the table.
  * @param[in] table Table of the %DDB Distributed DataBase.
  * @param[in] id ID number in the table.
@@ -294,6 +351,8 @@ ddb_db_drop(unsigned char table)
 
   close(fd);
   alarm(0);
+
+  ddb_db_segment_write(table, NULL, 0, 0);
 }
 
 /** Pack the table.
@@ -369,6 +428,117 @@ ddb_db_hash_write(unsigned char table)
   alarm(0);
 }
 
+/** Read the hash segments of a table.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ * @param[out] segments Segments read, allocated with MyRealloc() and to
+ * be freed with MyFree(); NULL if there are none.
+ * @return Number of segments read.
+ */
+unsigned int
+ddb_db_segment_read(unsigned char table, struct DdbSegment **segments)
+{
+  char path[1024];
+  char hash[13];
+  struct DdbSegment *seg = NULL;
+  unsigned int count = 0, size = 0;
+  FILE *file;
+
+  *segments = NULL;
+
+  ircd_snprintf(0, path, sizeof(path), "%s/segments.%c",
+                feature_str(FEAT_DDBPATH), table);
+  if (!(file = fopen(path, "r")))
+    return 0;
+
+  while (fgets(path, sizeof(path), file))
+  {
+    if (count == size)
+    {
+      size = size ? size * 2 : 64;
+      seg = MyRealloc(seg, size * sizeof(struct DdbSegment));
+    }
+    if (sscanf(path, "%lu %lu %12s", &seg[count].first, &seg[count].last, hash) != 3
+        || strlen(hash) != 12)
+      break;
+
+    seg[count].lo = base64toint(hash + 6);
+    hash[6] = '\0';
+    seg[count].hi = base64toint(hash);
+    count++;
+  }
+  fclose(file);
+
+  *segments = seg;
+  return count;
+}
+
+/** Write the hash segments of a table.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ * @param[in] segments Segments to write.
+ * @param[in] count Number of segments.
+ * @param[in] append If non-zero, add them at the end; else replace the old ones.
+ */
+void
+ddb_db_segment_write(unsigned char table, struct DdbSegment *segments,
+                     unsigned int count, int append)
+{
+  char path[1024];
+  char hash[20];
+  unsigned int i;
+  int fd;
+
+  ircd_snprintf(0, path, sizeof(path), "%s/segments.%c",
+                feature_str(FEAT_DDBPATH), table);
+  alarm(3);
+  fd = open(path, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC),
+            S_IRUSR | S_IWUSR);
+  if (fd == -1)
+    ddb_die("Error when saving table '%c' segments (OPEN)", table);
+
+  for (i = 0; i < count; i++)
+  {
+    inttobase64(hash, segments[i].hi, 6);
+    inttobase64(hash + 6, segments[i].lo, 6);
+    ircd_snprintf(0, path, sizeof(path), "%lu %lu %s\n",
+                  segments[i].first, segments[i].last, hash);
+    if (write(fd, path, strlen(path)) == -1)
+      ddb_die("Error when saving table '%c' segments (WRITE)", table);
+  }
+  close(fd);
+  alarm(0);
+}
+
+/** Delete the registers of a table after one.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ * @param[in] id Last ID number to keep.
+ * @return 1 on success, 0 if the register \a id is not in the table.
+ */
+int
+ddb_db_truncate(unsigned char table, unsigned long id)
+{
+  struct ddb_memory_table map_table;
+  char path[1024];
+  char buf[1024];
+  off_t offset = -1;
+
+  alarm(3);
+  if (ddb_map_table(table, &map_table))
+    ddb_die("Error when reading table '%c' (%s)", table, strerror(errno));
+  alarm(0);
+  if (ddb_seek(&map_table, buf, id) != -1 && strtoul(buf, NULL, 10) == id)
+    offset = map_table.point_r - map_table.position;
+  munmap(map_table.position, map_table.file_stat.size);
+
+  if (offset < 0)
+    return 0;
+
+  ircd_snprintf(0, path, sizeof(path), "%s/table.%c",
+                feature_str(FEAT_DDBPATH), table);
+  if (truncate(path, offset) == -1)
+    ddb_die("Error when truncating table '%c' (TRUNCATE)", table);
+  return 1;
+}
+
 /** Executes when finalizes the %DDB subsystem.
  */
 void
@@ -377,6 +547,44 @@ ddb_db_end(void)
   /* Backup copy? */
 }
 
+/** Map a table file in memory.
+ * It does not log nor die, as it may run in a loading thread.
+ * @param[in] table Table of the %DDB Distributed DataBase.
+ * @param[out] map_table Structure ddb_memory_table.
+ * @return 0 on success, -1 on error (with errno set).
+ */
+static int
+ddb_map_table(unsigned char table, struct ddb_memory_table *map_table)
+{
+  char path[1024];
+  int fd;
+
+  ircd_snprintf(0, path, sizeof(path), "%s/table.%c",
+                feature_str(FEAT_DDBPATH), table);
+  fd = open(path, O_RDONLY, S_IRUSR | S_IWUSR);
+  if (fd == -1)
+    return -1;
+
+  get_ddb_stat(fd, &ddb_stats_table[table]);
+
+  memcpy(&map_table->file_stat, &ddb_stats_table[table],
+         sizeof(ddb_stats_table[table]));
+
+  map_table->position = mmap(NULL, map_table->file_stat.size, PROT_READ,
+                             MAP_SHARED | MAP_NORESERVE, fd, 0);
+
+  if ((map_table->file_stat.size != 0) && (map_table->position == MAP_FAILED))
+  {
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+
+  map_table->point_r = map_table->position;
+  return 0;
+}
+
 /** Read the table.
  * @param[in,out] map_table Structure ddb_memory_table.
  * @param[in] buf Buffer.
@@ -29,8 +29,10 @@
 #include "gline.h"
 #include "channel.h"
 #include "client.h"
+#include "hash.h"
 #include "ircd.h"
 #include "ircd_alloc.h"
+#include "ircd_events.h"
 #include "ircd_features.h"
 #include "ircd_log.h"
 #include "ircd_reply.h"
@@ -74,6 +76,13 @@ struct Gline* GlobalGlineList  = 0;
 /** List of BadChan G-lines. */
 struct Gline* BadChanGlineList = 0;
 
+/** Index of the host and IP masks of user G-lines. */
+static struct MaskIndex GlineIndex;
+/** Index of the masks of realname G-lines. */
+static struct MaskIndex GlineRealIndex;
+/** Order of creation of the G-lines in both indexes. */
+static unsigned int GlineSeq;
+
 /** Iterate through \a list of G-lines.  Use this like a for loop,
  * i.e., follow it with braces and use whatever you passed as \a gl
  * as a single G-line to be acted upon.
@@ -165,6 +174,7 @@ make_gline(char *user, char *host, char *reason, time_t expire, time_t lastmod,
   if (flags & GLINE_BADCHAN) { /* set a BADCHAN gline */
     DupString(gline->gl_user, user); /* first, remember channel */
     gline->gl_host = NULL;
+    gline->gl_index.prev_p = NULL;
 
     gline->gl_next = BadChanGlineList; /* then link it into list */
     gline->gl_prev_p = &BadChanGlineList;
@@ -181,6 +191,16 @@ make_gline(char *user, char *host, char *reason, time_t expire, time_t lastmod,
     if (*user != '$' && ipmask_parse(host, &gline->gl_addr, &gline->gl_bits))
       gline->gl_flags |= GLINE_IPMASK;
 
+    gline->gl_index.prev_p = NULL;
+    if (GlineIsRealName(gline))
+      maskidx_add(&GlineRealIndex, &gline->gl_index, gline->gl_user + 2,
+                  NULL, 0, gline);
+    else if (gline->gl_host)
+      maskidx_add(&GlineIndex, &gline->gl_index, gline->gl_host,
+                  GlineIsIpMask(gline) ? &gline->gl_addr : NULL,
+                  gline->gl_bits, gline);
+    gline->gl_index.seq = ++GlineSeq;
+
     gline->gl_next = GlobalGlineList; /* then link it into list */
     gline->gl_prev_p = &GlobalGlineList;
     if (GlobalGlineList)
@@ -191,9 +211,89 @@ make_gline(char *user, char *host, char *reason, time_t expire, time_t lastmod,
   return gline;
 }
 
+/** Local users matching a G-line, collected before disconnecting them. */
+struct GlineVictims {
+  struct Gline   *gline;	/**< G-line being applied. */
+  struct Client **list;		/**< Matching local users. */
+  int		  count;	/**< Number of users in \a list. */
+};
+
+/** Timer to apply the G-lines of net.bursts cut by a split. */
+static struct Timer GlineBurstTimer;
+
+static struct Gline *gline_lookup_host(struct Client *cptr, const char *host,
+                                       unsigned int flags);
+
+/** Check whether a local client matches the G-line being applied.
+ * @param[in] acptr Local client, from the user indexes or the fd list.
+ * @param[in] data G-line victims being collected.
+ * @return Zero to continue the walk.
+ */
+static int
+gline_victim(struct Client *acptr, void *data)
+{
+  struct GlineVictims *victims = data;
+  struct Gline *gline = victims->gline;
+
+  if (!cli_user(acptr))
+    return 0;
+
+  if (GlineIsRealName(gline)) { /* Realname Gline */
+    Debug((DEBUG_DEBUG,"Realname Gline: %s %s",(cli_info(acptr)),
+           gline->gl_user+2));
+    if (match(gline->gl_user+2, cli_info(acptr)) != 0)
+      return 0;
+    Debug((DEBUG_DEBUG,"Matched!"));
+  } else { /* Host/IP gline */
+    if (match(gline->gl_user, (cli_user(acptr))->username) != 0)
+      return 0;
+
+    if (GlineIsIpMask(gline)) {
+      if (!ipmask_check(&cli_ip(acptr), &gline->gl_addr, gline->gl_bits))
+        return 0;
+    }
+    else {
+      if (match(gline->gl_host, cli_sockhost(acptr)) != 0)
+        return 0;
+    }
+  }
+
+  victims->list[victims->count++] = acptr;
+  return 0;
+}
+
+/** Disconnect a local user matching a G-line.
+ * @param[in] cptr Peer connect that sent the G-line.
+ * @param[in] acptr Local user matching the G-line.
+ * @param[in] gline Matching G-line.
+ * @return CPTR_KILLED if \a cptr was disconnected, else zero.
+ */
+static int
+gline_exit_client(struct Client *cptr, struct Client *acptr,
+                  struct Gline *gline)
+{
+  /* Check if G:Lined user matches an E:Line */
+  if (find_exception(acptr))
+    return 0;
+
+  /* ok, here's one that got G-lined */
+  send_reply(acptr, SND_EXPLICIT | ERR_YOUREBANNEDCREEP, ":%s",
+             gline->gl_reason);
+
+  /* let the ops know about it */
+  sendto_opmask_butone(0, SNO_GLINE, "G-line active for %s",
+                       get_client_name(acptr, SHOW_IP));
+
+  /* and get rid of him */
+  return exit_client_msg(cptr, acptr, &me, "G-lined (%s)", gline->gl_reason);
+}
+
 /** Check local clients against a new G-line.
  * If the G-line is inactive or a badchan, return immediately.
- * Otherwise, if any users match it, disconnect them.
+ * Otherwise, if any users match it, disconnect them.  IP and host
+ * G-lines only visit the local users the indexes of hash.c find for
+ * them, and G-lines received in a net.burst are applied at its end
+ * by gline_burst_done().
  * @param[in] cptr Peer connect that sent the G-line.
  * @param[in] sptr Client that originated the G-line.
  * @param[in] gline New G-line to check.
@@ -202,8 +302,9 @@ make_gline(char *user, char *host, char *reason, time_t expire, time_t lastmod,
 static int
 do_gline(struct Client *cptr, struct Client *sptr, struct Gline *gline)
 {
+  struct GlineVictims victims;
   struct Client *acptr;
-  int fd, retval = 0, tval;
+  int fd, ii, retval = 0, tval;
 
   if (feature_bool(FEAT_DISABLE_GLINES))
     return 0; /* G-lines are disabled */
@@ -213,53 +314,105 @@ do_gline(struct Client *cptr, struct Client *sptr, struct Gline *gline)
   if (!GlineIsActive(gline)) /* no action taken on inactive glines */
     return 0;
 
+  if (IsServer(cptr) && IsBurst(cptr)) {
+    /* Check the local users once, when the burst is over */
+    cli_serv(cptr)->glines_pending++;
+    return 0;
+  }
+
+  victims.gline = gline;
+  victims.count = 0;
+  victims.list = (struct Client **)MyMalloc(sizeof(struct Client *) *
+                                            (HighestFd + 1));
+
+  if (GlineIsRealName(gline)) {
+    for (fd = HighestFd; fd >= 0; --fd)
+      if ((acptr = LocalClientArray[fd]))
+        gline_victim(acptr, &victims);
+  } else if (GlineIsIpMask(gline))
+    hWalkLocalUsersIP(&gline->gl_addr, gline->gl_bits, gline_victim, &victims);
+  else
+    hWalkLocalUsersHost(gline->gl_host, gline_victim, &victims);
+
+  for (ii = 0; ii < victims.count; ii++)
+    if ((tval = gline_exit_client(cptr, victims.list[ii], gline)))
+      retval = tval; /* retain killed status */
+
+  MyFree(victims.list);
+  return retval;
+}
+
+/** Disconnect the local users matching an active G-line.
+ * Each local user is looked up once in the G-line index, by the host
+ * it connected from as in do_gline().
+ * @param[in] cptr Peer connect that sent the G-lines.
+ */
+static void
+gline_check_local(struct Client *cptr)
+{
+  struct Client *acptr;
+  struct Gline *gline;
+  int fd;
+
+  if (feature_bool(FEAT_DISABLE_GLINES))
+    return;
+
   for (fd = HighestFd; fd >= 0; --fd) {
-    /*
-     * get the users!
-     */
-    if ((acptr = LocalClientArray[fd])) {
-      if (!cli_user(acptr))
-	continue;
+    if (!(acptr = LocalClientArray[fd]) || !IsUser(acptr))
+      continue;
+    if ((gline = gline_lookup_host(acptr, cli_sockhost(acptr), 0)))
+      gline_exit_client(cptr, acptr, gline);
+  }
+}
 
-      if (GlineIsRealName(gline)) { /* Realname Gline */
-	Debug((DEBUG_DEBUG,"Realname Gline: %s %s",(cli_info(acptr)),
-					gline->gl_user+2));
-        if (match(gline->gl_user+2, cli_info(acptr)) != 0)
-            continue;
-        Debug((DEBUG_DEBUG,"Matched!"));
-      } else { /* Host/IP gline */
-        if (match(gline->gl_user, (cli_user(acptr))->username) != 0)
-          continue;
-
-        if (GlineIsIpMask(gline)) {
-          if (!ipmask_check(&cli_ip(acptr), &gline->gl_addr, gline->gl_bits))
-            continue;
-        }
-        else {
-          if (match(gline->gl_host, cli_sockhost(acptr)) != 0)
-            continue;
-        }
-      }
+/** Apply the G-lines received during a net.burst.
+ * Instead of checking every local user against each G-line of the
+ * burst, each local user is looked up once in the G-line index.
+ * @param[in] cptr Server link that finished its burst.
+ */
+void
+gline_burst_done(struct Client *cptr)
+{
+  if (!cli_serv(cptr)->glines_pending)
+    return;
 
-      /* Check if G:Lined user matches an E:Line */
-      if (find_exception(acptr))
-        continue;
+  Debug((DEBUG_INFO, "Applying %u G-lines from the net.burst of %s",
+         cli_serv(cptr)->glines_pending, cli_name(cptr)));
+  cli_serv(cptr)->glines_pending = 0;
 
-      /* ok, here's one that got G-lined */
-      send_reply(acptr, SND_EXPLICIT | ERR_YOUREBANNEDCREEP, ":%s",
-      	   gline->gl_reason);
+  gline_check_local(cptr);
+}
 
-      /* let the ops know about it */
-      sendto_opmask_butone(0, SNO_GLINE, "G-line active for %s",
-                           get_client_name(acptr, SHOW_IP));
+/** Apply the G-lines of a net.burst once the split is over.
+ * @param[in] ev Timer event (ignored).
+ */
+static void
+gline_burst_timer(struct Event *ev)
+{
+  if (ev_type(ev) != ET_EXPIRE)
+    return;
 
-      /* and get rid of him */
-      if ((tval = exit_client_msg(cptr, acptr, &me, "G-lined (%s)",
-          gline->gl_reason)))
-        retval = tval; /* retain killed status */
-    }
-  }
-  return retval;
+  gline_check_local(&me);
+}
+
+/** Handle a server link that exits before the end of its net.burst.
+ * The G-lines it sent stay active, so the local users are checked
+ * against them as soon as the split is over.
+ * @param[in] cptr Server link that is exiting.
+ */
+void
+gline_burst_lost(struct Client *cptr)
+{
+  if (!cli_serv(cptr)->glines_pending)
+    return;
+
+  Debug((DEBUG_INFO, "Applying %u G-lines from the cut net.burst of %s",
+         cli_serv(cptr)->glines_pending, cli_name(cptr)));
+  cli_serv(cptr)->glines_pending = 0;
+
+  if (!t_onqueue(&GlineBurstTimer))
+    timer_add(timer_init(&GlineBurstTimer), gline_burst_timer, NULL,
+              TT_RELATIVE, 0);
 }
 
 /**
@@ -931,6 +1084,117 @@ gline_destroy(struct Client *cptr, struct Client *sptr, struct Gline *gline)
   return 0; /* convenience return */
 }
 
+/** Number of dead G-lines released by a single search. */
+#define GLINE_SEARCH_EXPIRED 16
+
+/** State of a search of the G-line indexes. */
+struct GlineSearch {
+  struct Client *cptr;		/**< Client being checked, if any. */
+  const char   *user;		/**< User name to match. */
+  unsigned int	flags;		/**< GLINE_* flags limiting the search. */
+  struct Gline *found;		/**< Newest G-line found. */
+  struct Gline *expired[GLINE_SEARCH_EXPIRED]; /**< Dead G-lines seen. */
+  unsigned int	nexpired;	/**< Number of entries in \a expired. */
+};
+
+/** Check the expiration of a G-line found in an index.
+ * This does for a single G-line what gliter() does for the lists: dead
+ * records are remembered so the search may release them once the
+ * index is not being walked, and expired G-lines are deactivated.
+ * @param[in] gline G-line to check.
+ * @param[in] search Search finding the G-line.
+ * @return Non-zero if the record is dead.
+ */
+static int
+gline_search_expired(struct Gline *gline, struct GlineSearch *search)
+{
+  if ((gline->gl_lifetime <= TStime()) ||
+      ((gline->gl_expire < TStime() - ONE_MONTH) &&
+       (gline->gl_lastmod < TStime() - ONE_MONTH))) {
+    if (search->nexpired < GLINE_SEARCH_EXPIRED)
+      search->expired[search->nexpired++] = gline;
+    return 1;
+  }
+
+  if (gline->gl_expire <= TStime()) {
+    gline->gl_flags &= ~GLINE_ACTIVE;
+    gline->gl_state = GLOCAL_GLOBAL;
+  }
+  return 0;
+}
+
+/** Keep a G-line as the result of a search if it is the newest.
+ * The lists keep the newest G-lines first, and the searches return
+ * the same G-line a walk of the list would find first.
+ * @param[in] gline G-line found.
+ * @param[in] search Search finding the G-line.
+ */
+static void
+gline_search_found(struct Gline *gline, struct GlineSearch *search)
+{
+  if (!search->found || search->found->gl_index.seq < gline->gl_index.seq)
+    search->found = gline;
+}
+
+/** Release the dead G-lines seen by a search.
+ * @param[in] search Finished search.
+ */
+static void
+gline_search_done(struct GlineSearch *search)
+{
+  while (search->nexpired)
+    gline_free(search->expired[--search->nexpired]);
+}
+
+/** Check a G-line matching the host of a client in gline_lookup().
+ * @param[in] entry Index entry of the G-line.
+ * @param[in] data Search state.
+ * @return Zero to continue the search.
+ */
+static int
+gline_lookup_entry(struct MaskEntry *entry, void *data)
+{
+  struct GlineSearch *search = data;
+  struct Gline *gline = entry->data;
+
+  if (gline_search_expired(gline, search))
+    return 0;
+
+  if ((search->flags & GLINE_GLOBAL && gline->gl_flags & GLINE_LOCAL) ||
+      (search->flags & GLINE_LASTMOD && !gline->gl_lastmod))
+    return 0;
+
+  if (!GlineIsRealName(gline) && match(gline->gl_user, search->user) != 0)
+    return 0;
+
+  if (GlineIsActive(gline))
+    gline_search_found(gline, search);
+  return 0;
+}
+
+/** Check a G-line with the same host mask in gline_find().
+ * @param[in] entry Index entry of the G-line.
+ * @param[in] data Search state.
+ * @return Zero to continue the search.
+ */
+static int
+gline_find_entry(struct MaskEntry *entry, void *data)
+{
+  struct GlineSearch *search = data;
+  struct Gline *gline = entry->data;
+
+  if (gline_search_expired(gline, search))
+    return 0;
+
+  if ((search->flags & (GlineIsLocal(gline) ? GLINE_GLOBAL : GLINE_LOCAL)) ||
+      (search->flags & GLINE_LASTMOD && !gline->gl_lastmod))
+    return 0;
+
+  if (ircd_strcmp(gline->gl_user, search->user) == 0)
+    gline_search_found(gline, search);
+  return 0;
+}
+
 /** Find a G-line for a particular mask, guided by certain flags.
  * Certain bits in \a flags are interpreted specially:
  * <dl>
@@ -971,6 +1235,31 @@ gline_find(char *userhost, unsigned int flags)
   DupString(t_uh, userhost);
   canon_userhost(t_uh, &user, &host, "*");
 
+  if ((flags & GLINE_EXACT) && (host || (user[0] == '$' && user[1] == 'R'))) {
+    struct GlineSearch search;
+    struct irc_in_addr addr;
+    unsigned char bits;
+
+    search.cptr = 0;
+    search.user = user;
+    search.flags = flags;
+    search.found = 0;
+    search.nexpired = 0;
+
+    if (!host)
+      maskidx_exact(&GlineRealIndex, user + 2, NULL, 0,
+                    gline_find_entry, &search);
+    else if (ipmask_parse(host, &addr, &bits))
+      maskidx_exact(&GlineIndex, host, &addr, bits,
+                    gline_find_entry, &search);
+    else
+      maskidx_exact(&GlineIndex, host, NULL, 0, gline_find_entry, &search);
+
+    gline_search_done(&search);
+    MyFree(t_uh);
+    return search.found;
+  }
+
   gliter(GlobalGlineList, gline, sgline) {
     if ((flags & (GlineIsLocal(gline) ? GLINE_GLOBAL : GLINE_LOCAL)) ||
 	(flags & GLINE_LASTMOD && !gline->gl_lastmod))
@@ -993,48 +1282,46 @@ gline_find(char *userhost, unsigned int flags)
   return gline;
 }
 
-/** Find a matching G-line for a user.
+/** Find a matching G-line for a user with a given host.
  * @param[in] cptr Client to compare against.
+ * @param[in] host Host name of \a cptr to match.
  * @param[in] flags Bitwise combination of GLINE_GLOBAL and/or
  * GLINE_LASTMOD to limit matches.
  * @return Matching G-line, or NULL if none are found.
  */
-struct Gline *
-gline_lookup(struct Client *cptr, unsigned int flags)
+static struct Gline *
+gline_lookup_host(struct Client *cptr, const char *host, unsigned int flags)
 {
-  struct Gline *gline;
-  struct Gline *sgline;
+  struct GlineSearch search;
 
-  gliter(GlobalGlineList, gline, sgline) {
-    if ((flags & GLINE_GLOBAL && gline->gl_flags & GLINE_LOCAL) ||
-        (flags & GLINE_LASTMOD && !gline->gl_lastmod))
-      continue;
+  search.cptr = cptr;
+  search.user = cli_user(cptr)->username;
+  search.flags = flags;
+  search.found = 0;
+  search.nexpired = 0;
 
-    if (GlineIsRealName(gline)) {
-      Debug((DEBUG_DEBUG,"realname gline: '%s' '%s'",gline->gl_user,cli_info(cptr)));
-      if (match(gline->gl_user+2, cli_info(cptr)) != 0)
-        continue;
-    }
-    else {
-      if (match(gline->gl_user, (cli_user(cptr))->username) != 0)
-        continue;
+  Debug((DEBUG_DEBUG, "G-line lookup: '%s@%s' '%s'", search.user,
+         host, cli_info(cptr)));
 
-      if (GlineIsIpMask(gline)) {
-        if (!ipmask_check(&cli_ip(cptr), &gline->gl_addr, gline->gl_bits))
-          continue;
-      }
-      else {
-        if (match(gline->gl_host, (cli_user(cptr))->realhost) != 0)
-          continue;
-      }
-    }
-    if (GlineIsActive(gline))
-      return gline;
-  }
-  /*
-   * No Glines matched
-   */
-  return 0;
+  maskidx_match(&GlineIndex, host, &cli_ip(cptr),
+                gline_lookup_entry, &search);
+  maskidx_match(&GlineRealIndex, cli_info(cptr), NULL,
+                gline_lookup_entry, &search);
+
+  gline_search_done(&search);
+  return search.found;
+}
+
+/** Find a matching G-line for a user.
+ * @param[in] cptr Client to compare against.
+ * @param[in] flags Bitwise combination of GLINE_GLOBAL and/or
+ * GLINE_LASTMOD to limit matches.
+ * @return Matching G-line, or NULL if none are found.
+ */
+struct Gline *
+gline_lookup(struct Client *cptr, unsigned int flags)
+{
+  return gline_lookup_host(cptr, cli_user(cptr)->realhost, flags);
 }
 
 /** Delink and free a G-line.
@@ -1049,6 +1336,10 @@ gline_free(struct Gline *gline)
   if (gline->gl_next)
     gline->gl_next->gl_prev_p = gline->gl_prev_p;
 
+  if (gline->gl_index.prev_p)
+    maskidx_del(GlineIsRealName(gline) ? &GlineRealIndex : &GlineIndex,
+                &gline->gl_index);
+
   MyFree(gline->gl_user); /* free up the memory */
   if (gline->gl_host)
     MyFree(gline->gl_host);
@@ -1195,6 +1486,15 @@ gline_stats(struct Client *sptr, const struct StatDesc *sd,
 	       GlineIsRemActive(gline) ? '+' : '-',
 	       gline->gl_reason);
   }
+
+  if (!param)
+    send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
+               "g :Index Masks=%u IP=%u Prefixes=%u Hashed=%u Other=%u "
+               "Realname=%u Lookups=%lu Checks=%lu", GlineIndex.count,
+               GlineIndex.count - GlineIndex.hashed - GlineIndex.others,
+               GlineIndex.ip.count, GlineIndex.hashed, GlineIndex.others,
+               GlineRealIndex.count,
+               GlineIndex.lookups, GlineIndex.checks + GlineRealIndex.checks);
 }
 
 /** Calculate memory used by G-lines.
@@ -1225,3 +1525,69 @@ gline_memory_count(size_t *gl_size)
 
   return gl;
 }
+
+/** Write a G-line list to the state file of a hot upgrade.
+ * @param[in] file State file being written.
+ * @param[in] list List of G-lines to write.
+ */
+static void
+gline_save_list(FILE *file, struct Gline *list)
+{
+  struct Gline *gline;
+  struct Gline *sgline;
+
+  gliter(list, gline, sgline) {
+    fprintf(file, "G %s %s %lu %lu %lu %x %d :%s\n", gline->gl_user,
+            gline->gl_host ? gline->gl_host : "*",
+            (unsigned long) gline->gl_expire,
+            (unsigned long) gline->gl_lastmod,
+            (unsigned long) gline->gl_lifetime,
+            gline->gl_flags & GLINE_MASK, (int) gline->gl_state,
+            gline->gl_reason);
+  }
+}
+
+/** Write all G-lines to the state file of a hot upgrade.
+ * @param[in] file State file being written.
+ */
+void
+gline_save(FILE *file)
+{
+  gline_save_list(file, GlobalGlineList);
+  gline_save_list(file, BadChanGlineList);
+}
+
+/** Recreate a G-line saved by gline_save().
+ *
+ * \a parv has the following elements:
+ * \li \a parv[1] is the user mask (or channel/realname mask)
+ * \li \a parv[2] is the host mask, or "*" when there is none
+ * \li \a parv[3] is the expiration timestamp
+ * \li \a parv[4] is the last modification timestamp
+ * \li \a parv[5] is the record expiration timestamp
+ * \li \a parv[6] is the hexadecimal set of GLINE_* flags
+ * \li \a parv[7] is the local state of the G-line
+ * \li \a parv[8] is the reason
+ *
+ * @param[in] parc Number of arguments.
+ * @param[in] parv Argument vector.
+ * @return Non-zero if the G-line was recreated, zero if the record is
+ * malformed.
+ */
+int
+gline_restore(int parc, char *parv[])
+{
+  struct Gline *gline;
+  unsigned int flags;
+
+  if (parc < 9)
+    return 0;
+
+  flags = strtoul(parv[6], 0, 16);
+  gline = make_gline(parv[1], (flags & GLINE_BADCHAN) ? NULL : parv[2],
+                     parv[8], strtoul(parv[3], 0, 10),
+                     strtoul(parv[4], 0, 10), strtoul(parv[5], 0, 10),
+                     flags);
+  gline->gl_state = (enum GlineLocalState) atoi(parv[7]);
+  return 1;
+}
@@ -34,7 +34,9 @@
 #include "channel.h"
 #include "ircd_alloc.h"
 #include "ircd_chattr.h"
+#include "ircd_features.h"
 #include "ircd_log.h"
+#include "ircd_radix.h"
 #include "ircd_reply.h"
 #include "ircd_string.h"
 #include "ircd.h"
@@ -43,6 +45,7 @@
 #include "msg.h"
 #include "numeric.h"
 #include "random.h"
+#include "s_bsd.h"
 #include "send.h"
 #include "struct.h"
 #include "sys.h"
@@ -58,6 +61,18 @@ static struct Client *clientTable[HASHSIZE];
 static struct Channel *channelTable[HASHSIZE];
 /** Hash table for monitors */
 static struct Monitor *monitorTable[HASHSIZE];
+/** Radix tree of the IP addresses of local users. */
+static struct RadixTree localIPTree;
+/** Hash table of local users by the domain of their host. */
+static struct Client *localHostTable[HASHSIZE];
+/** Radix tree of the IP addresses of all users. */
+static struct RadixTree userIPTree;
+/** Hash table of all users by the domain of their hosts and username. */
+static struct WhoLink *userHostTable[HASHSIZE];
+/** Hash table of all users by their account. */
+static struct WhoLink *userAccountTable[HASHSIZE];
+/** Hash table of all users by the start of their real name. */
+static struct WhoLink *userInfoTable[HASHSIZE];
 
 /** CRC-32 update table. */
 static uint32_t crc32hash[256];
@@ -333,6 +348,415 @@ struct Monitor *hSeekMonitor(const char *nick)
 
 }
 
+/** Find the key of a host in the host indexes.
+ * Hosts are hashed by their last two labels (".example.com" for
+ * "dsl-1.example.com"), or as a whole if they have less labels.
+ * @param[in] host Host name.
+ * @return Key of the host.
+ */
+static const char *host_index_key(const char *host)
+{
+  const char *s, *last = NULL, *prev = NULL;
+
+  for (s = host; *s; s++)
+    if (*s == '.') {
+      prev = last;
+      last = s;
+    }
+  return prev ? prev : host;
+}
+
+/** Find the host index key shared by all the hosts matching a mask.
+ * A host matching a mask ends with the literal part after its last
+ * wildcard; if that part has two dots, it holds the key of the host.
+ * @param[in] mask Host mask.
+ * @return Key of the matching hosts, or NULL if they may have any key.
+ */
+static const char *mask_index_key(const char *mask)
+{
+  const char *s, *tail = NULL, *last = NULL, *prev = NULL;
+
+  for (s = mask; *s; s++)
+    if (*s == '*' || *s == '?' || *s == '\\')
+      tail = s + 1;
+
+  if (!tail)
+    return host_index_key(mask);
+
+  for (s = tail; *s; s++)
+    if (*s == '.') {
+      prev = last;
+      last = s;
+    }
+  return prev;
+}
+
+/** Add a local user to the reverse indexes by IP address and host.
+ * @param[in] cptr Local user, whose IP address and host are final.
+ */
+void hAddLocalUser(struct Client *cptr)
+{
+  struct RadixNode *node;
+  struct Client **head;
+
+  assert(MyConnect(cptr));
+  assert(0 == cli_ipprev_p(cptr));
+
+  node = radix_insert(&localIPTree, &cli_ip(cptr), 128);
+  head = (struct Client **) &radix_data(node);
+  cli_ipnode(cptr) = node;
+  cli_ipnext(cptr) = *head;
+  cli_ipprev_p(cptr) = head;
+  if (*head)
+    cli_ipprev_p(*head) = &cli_ipnext(cptr);
+  *head = cptr;
+
+  head = &localHostTable[strhash(host_index_key(cli_sockhost(cptr)))];
+  cli_hostnext(cptr) = *head;
+  cli_hostprev_p(cptr) = head;
+  if (*head)
+    cli_hostprev_p(*head) = &cli_hostnext(cptr);
+  *head = cptr;
+}
+
+/** Remove a local user from the reverse indexes.
+ * Nothing is done if the client was not indexed.
+ * @param[in] cptr Local client.
+ */
+void hRemLocalUser(struct Client *cptr)
+{
+  if (!cli_ipprev_p(cptr))
+    return;
+
+  *cli_ipprev_p(cptr) = cli_ipnext(cptr);
+  if (cli_ipnext(cptr))
+    cli_ipprev_p(cli_ipnext(cptr)) = cli_ipprev_p(cptr);
+  if (!radix_data(cli_ipnode(cptr)))
+    radix_remove(&localIPTree, cli_ipnode(cptr));
+  cli_ipprev_p(cptr) = 0;
+  cli_ipnext(cptr) = 0;
+  cli_ipnode(cptr) = 0;
+
+  *cli_hostprev_p(cptr) = cli_hostnext(cptr);
+  if (cli_hostnext(cptr))
+    cli_hostprev_p(cli_hostnext(cptr)) = cli_hostprev_p(cptr);
+  cli_hostprev_p(cptr) = 0;
+  cli_hostnext(cptr) = 0;
+}
+
+/** State of a walk of the IP index of local users. */
+struct LocalWalk {
+  int (*fn)(struct Client *, void *); /**< Function to call. */
+  void *data;                         /**< Extra argument for \a fn. */
+};
+
+/** Call the function of a walk for the local users of an IP address.
+ * @param[in] node Address in the IP index.
+ * @param[in] data Walk state.
+ * @return Non-zero to stop the walk.
+ */
+static int local_walk_ip(struct RadixNode *node, void *data)
+{
+  struct LocalWalk *walk = data;
+  struct Client *acptr;
+  int res;
+
+  for (acptr = radix_data(node); acptr; acptr = cli_ipnext(acptr))
+    if ((res = walk->fn(acptr, walk->data)))
+      return res;
+  return 0;
+}
+
+/** Call a function for every local user inside an IP mask.
+ * The function must not exit or re-index local users.
+ * @param[in] addr Address of the mask.
+ * @param[in] bits Length of the mask.
+ * @param[in] fn Function to call for each local user.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int hWalkLocalUsersIP(const struct irc_in_addr *addr, unsigned char bits,
+                      int (*fn)(struct Client *, void *), void *data)
+{
+  struct LocalWalk walk;
+
+  walk.fn = fn;
+  walk.data = data;
+  return radix_walk_within(&localIPTree, addr, bits, local_walk_ip, &walk);
+}
+
+/** Call a function for every local user that may match a host mask.
+ * Only the users sharing the index key of the mask are visited, when
+ * the mask has one; the function must still match their host.  The
+ * function must not exit or re-index local users.
+ * @param[in] mask Host mask.
+ * @param[in] fn Function to call for each candidate.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int hWalkLocalUsersHost(const char *mask,
+                        int (*fn)(struct Client *, void *), void *data)
+{
+  struct Client *acptr;
+  const char *key;
+  int fd, res;
+
+  if ((key = mask_index_key(mask))) {
+    for (acptr = localHostTable[strhash(key)]; acptr; acptr = cli_hostnext(acptr))
+      if ((res = fn(acptr, data)))
+        return res;
+    return 0;
+  }
+
+  for (fd = HighestFd; fd >= 0; --fd)
+    if ((acptr = LocalClientArray[fd]) && cli_hostprev_p(acptr)
+        && (res = fn(acptr, data)))
+      return res;
+  return 0;
+}
+
+/** Number of leading characters of the real name used as its key. */
+#define INFO_KEY_LEN 3
+
+/** Find the key of a real name in the real name index.
+ * @param[out] key Buffer of INFO_KEY_LEN + 1 characters for the key.
+ * @param[in] info Real name, or real name mask.
+ * @return Non-zero if \a info has a key.
+ */
+static int info_index_key(char *key, const char *info)
+{
+  int ii;
+
+  for (ii = 0; ii < INFO_KEY_LEN; ii++) {
+    if (!info[ii] || info[ii] == '*' || info[ii] == '?' || info[ii] == '\\')
+      return 0;
+    key[ii] = info[ii];
+  }
+  key[ii] = '\0';
+  return 1;
+}
+
+/** Link a user into a bucket of one of the WHO indexes.
+ * @param[in] link Link of the user.
+ * @param[in] head Bucket of the index.
+ * @param[in] cptr User.
+ */
+static void who_link(struct WhoLink *link, struct WhoLink **head,
+                     struct Client *cptr)
+{
+  link->client = cptr;
+  link->next = *head;
+  link->prev_p = head;
+  if (*head)
+    (*head)->prev_p = &link->next;
+  *head = link;
+}
+
+/** Unlink a user from one of the WHO indexes, if it was linked.
+ * @param[in] link Link of the user.
+ */
+static void who_unlink(struct WhoLink *link)
+{
+  if (!link->prev_p)
+    return;
+  *link->prev_p = link->next;
+  if (link->next)
+    link->next->prev_p = link->prev_p;
+  link->next = 0;
+  link->prev_p = 0;
+}
+
+/** Add a user to the indexes used by WHO.
+ * The indexes cover the IP address, host, real host, username,
+ * account and real name of every user in the network, so that WHO
+ * only visits the users that may match its mask.
+ * @param[in] cptr Registered user, local or remote.
+ * @return Non-zero if the user was added, zero if already indexed.
+ */
+int hAddUser(struct Client *cptr)
+{
+  struct User *user = cli_user(cptr);
+  char key[INFO_KEY_LEN + 1];
+
+  assert(0 != user);
+  if (user->ip_link.prev_p)
+    return 0;
+
+  user->ip_node = radix_insert(&userIPTree, &cli_ip(cptr), 128);
+  who_link(&user->ip_link, (struct WhoLink **) &radix_data(user->ip_node), cptr);
+  who_link(&user->host_link,
+           &userHostTable[strhash(host_index_key(user->host))], cptr);
+  if (ircd_strcmp(user->host, user->realhost))
+    who_link(&user->realhost_link,
+             &userHostTable[strhash(host_index_key(user->realhost))], cptr);
+  who_link(&user->username_link,
+           &userHostTable[strhash(host_index_key(user->username))], cptr);
+  if (user->account[0])
+    who_link(&user->account_link, &userAccountTable[strhash(user->account)],
+             cptr);
+  if (info_index_key(key, cli_info(cptr)))
+    who_link(&user->info_link, &userInfoTable[strhash(key)], cptr);
+  return 1;
+}
+
+/** Remove a user from the indexes used by WHO.
+ * Callers changing an indexed field remove the user before the change
+ * and add it back after it.
+ * @param[in] cptr User.
+ * @return Non-zero if the user was indexed.
+ */
+int hRemUser(struct Client *cptr)
+{
+  struct User *user = cli_user(cptr);
+
+  if (!user || !user->ip_link.prev_p)
+    return 0;
+
+  who_unlink(&user->ip_link);
+  if (!radix_data(user->ip_node))
+    radix_remove(&userIPTree, user->ip_node);
+  user->ip_node = 0;
+  who_unlink(&user->host_link);
+  who_unlink(&user->realhost_link);
+  who_unlink(&user->username_link);
+  who_unlink(&user->account_link);
+  who_unlink(&user->info_link);
+  return 1;
+}
+
+/** Check whether hWalkUsersHost() can narrow a walk for a mask.
+ * @param[in] mask Host or username mask.
+ * @return Non-zero if only some users may match \a mask.
+ */
+int hUsersHostKeyed(const char *mask)
+{
+  return mask_index_key(mask) != 0;
+}
+
+/** Check whether hWalkUsersInfo() can narrow a walk for a mask.
+ * @param[in] mask Real name mask.
+ * @return Non-zero if only some users may match \a mask.
+ */
+int hUsersInfoKeyed(const char *mask)
+{
+  char key[INFO_KEY_LEN + 1];
+
+  return info_index_key(key, mask);
+}
+
+/** Call a function for every user in a chain of one of the WHO indexes.
+ * @param[in] link First link of the chain.
+ * @param[in] fn Function to call for each user.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+static int who_walk_chain(struct WhoLink *link,
+                          int (*fn)(struct Client *, void *), void *data)
+{
+  int res;
+
+  for (; link; link = link->next)
+    if ((res = fn(link->client, data)))
+      return res;
+  return 0;
+}
+
+/** Call the function of a walk for the users of an IP address.
+ * @param[in] node Address in the IP index.
+ * @param[in] data Walk state.
+ * @return Non-zero to stop the walk.
+ */
+static int user_walk_ip(struct RadixNode *node, void *data)
+{
+  struct LocalWalk *walk = data;
+
+  return who_walk_chain(radix_data(node), walk->fn, walk->data);
+}
+
+/** Call a function for every user inside an IP mask.
+ * The function must not exit or re-index users.
+ * @param[in] addr Address of the mask.
+ * @param[in] bits Length of the mask.
+ * @param[in] fn Function to call for each user.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int hWalkUsersIP(const struct irc_in_addr *addr, unsigned char bits,
+                 int (*fn)(struct Client *, void *), void *data)
+{
+  struct LocalWalk walk;
+
+  walk.fn = fn;
+  walk.data = data;
+  return radix_walk_within(&userIPTree, addr, bits, user_walk_ip, &walk);
+}
+
+/** Call a function for every user once.
+ * @param[in] fn Function to call for each user.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+static int who_walk_all(int (*fn)(struct Client *, void *), void *data)
+{
+  struct irc_in_addr any;
+
+  memset(&any, 0, sizeof(any));
+  return hWalkUsersIP(&any, 0, fn, data);
+}
+
+/** Call a function for every user that may match a host or username mask.
+ * Users are visited once for each of their host, real host and
+ * username sharing the index key of the mask, or every user once if
+ * the mask has no key; the function must match the fields itself and
+ * skip repeated users.  It must not exit or re-index users.
+ * @param[in] mask Host or username mask.
+ * @param[in] fn Function to call for each candidate.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int hWalkUsersHost(const char *mask,
+                   int (*fn)(struct Client *, void *), void *data)
+{
+  const char *key;
+
+  if ((key = mask_index_key(mask)))
+    return who_walk_chain(userHostTable[strhash(key)], fn, data);
+  return who_walk_all(fn, data);
+}
+
+/** Call a function for every user that may be logged in an account.
+ * The function must compare the account itself, and must not exit or
+ * re-index users.
+ * @param[in] account Account name, without wildcards.
+ * @param[in] fn Function to call for each candidate.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int hWalkUsersAccount(const char *account,
+                      int (*fn)(struct Client *, void *), void *data)
+{
+  return who_walk_chain(userAccountTable[strhash(account)], fn, data);
+}
+
+/** Call a function for every user whose real name may match a mask.
+ * Only the users sharing the first characters of the mask are visited
+ * when they are literal, or every user otherwise; the function must
+ * match the real name itself, and must not exit or re-index users.
+ * @param[in] mask Real name mask.
+ * @param[in] fn Function to call for each candidate.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int hWalkUsersInfo(const char *mask,
+                   int (*fn)(struct Client *, void *), void *data)
+{
+  char key[INFO_KEY_LEN + 1];
+
+  if (info_index_key(key, mask))
+    return who_walk_chain(userInfoTable[strhash(key)], fn, data);
+  return who_walk_all(fn, data);
+}
+
 /* I will add some useful(?) statistics here one of these days,
    but not for DEBUGMODE: just to let the admins play with it,
    coders are able to SIGCORE the server and look into what goes
@@ -492,59 +916,207 @@ stats_nickjupes(struct Client* to, const struct StatDesc* sd, char* param)
       send_reply(to, RPL_STATSJLINE, jupeTable[i]);
 }
 
+/** Channel in a snapshot for LIST. */
+struct ListEntry {
+  unsigned int users;           /**< Members when the snapshot was taken. */
+  unsigned int name;            /**< Offset of the name in ListSnapshot::names. */
+};
+
+/** Copy of the channel list, sorted by number of members, shared by
+ * the clients listing channels.
+ * Entries only hold names, so channels can be destroyed while the
+ * snapshot is in use; they are looked up again when listed.
+ */
+struct ListSnapshot {
+  time_t taken;                 /**< When the snapshot was taken. */
+  unsigned int refs;            /**< Listings using the snapshot. */
+  unsigned int count;           /**< Number of entries. */
+  struct ListEntry *entries;    /**< Channels, with most members first. */
+  char *names;                  /**< Names of the channels. */
+};
+
+/** Snapshot given to new listings. */
+static struct ListSnapshot *listSnapshot;
+
+/** Order snapshot entries by decreasing number of members.
+ * @param[in] a First entry.
+ * @param[in] b Second entry.
+ * @return Comparison result for qsort().
+ */
+static int list_entry_cmp(const void *a, const void *b)
+{
+  const struct ListEntry *ea = a, *eb = b;
+
+  if (ea->users != eb->users)
+    return ea->users > eb->users ? -1 : 1;
+  return ea->name < eb->name ? -1 : ea->name > eb->name;
+}
+
+/** Release a snapshot that is no longer given to new listings.
+ * @param[in] snap Snapshot to release.
+ */
+static void list_snapshot_free(struct ListSnapshot *snap)
+{
+  MyFree(snap->entries);
+  MyFree(snap->names);
+  MyFree(snap);
+}
+
+/** Take a reference to the current channel snapshot, taking a new one
+ * if it is older than FEAT_LIST_SNAPSHOT_TIME.
+ * @return Referenced snapshot.
+ */
+static struct ListSnapshot *list_snapshot_get(void)
+{
+  struct ListSnapshot *snap;
+  struct Channel *chptr;
+  unsigned int ii, count = 0, length = 0;
+
+  if ((snap = listSnapshot)
+      && CurrentTime - snap->taken < feature_int(FEAT_LIST_SNAPSHOT_TIME)) {
+    snap->refs++;
+    return snap;
+  }
+
+  if (snap && !snap->refs)
+    list_snapshot_free(snap);
+
+  for (ii = 0; ii < HASHSIZE; ii++)
+    for (chptr = channelTable[ii]; chptr; chptr = chptr->hnext) {
+      count++;
+      length += strlen(chptr->chname) + 1;
+    }
+
+  snap = (struct ListSnapshot *) MyMalloc(sizeof(struct ListSnapshot));
+  snap->taken = CurrentTime;
+  snap->refs = 1;
+  snap->count = 0;
+  snap->entries = (struct ListEntry *) MyMalloc((count + 1) * sizeof(struct ListEntry));
+  snap->names = (char *) MyMalloc(length + 1);
+  length = 0;
+  for (ii = 0; ii < HASHSIZE; ii++)
+    for (chptr = channelTable[ii]; chptr; chptr = chptr->hnext) {
+      struct ListEntry *entry = &snap->entries[snap->count++];
+
+      entry->users = chptr->users;
+      entry->name = length;
+      strcpy(snap->names + length, chptr->chname);
+      length += strlen(chptr->chname) + 1;
+    }
+  qsort(snap->entries, snap->count, sizeof(struct ListEntry), list_entry_cmp);
+
+  listSnapshot = snap;
+  return snap;
+}
+
+/** Drop a reference to a channel snapshot.
+ * @param[in] snap Snapshot no longer used by a listing.
+ */
+static void list_snapshot_put(struct ListSnapshot *snap)
+{
+  assert(snap->refs > 0);
+  if (!--snap->refs && snap != listSnapshot)
+    list_snapshot_free(snap);
+}
+
+/** Start a listing at the first channel of its snapshot with less
+ * members than the maximum asked.
+ * @param[in] args Listing without a snapshot.
+ */
+static void list_start_channels(struct ListingArgs *args)
+{
+  struct ListSnapshot *snap = list_snapshot_get();
+  unsigned int lo = 0, hi = snap->count, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (snap->entries[mid].users >= args->max_users)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  args->snapshot = snap;
+  args->pos = lo;
+}
+
+/** Stop the listing of a client and release its state.
+ * @param[in] cptr Client listing channels.
+ */
+void list_stop_channels(struct Client *cptr)
+{
+  struct ListingArgs *args = cli_listing(cptr);
+
+  if (!args)
+    return;
+  if (args->snapshot)
+    list_snapshot_put(args->snapshot);
+  MyFree(args);
+  cli_listing(cptr) = NULL;
+}
+
 /** Send more channels to a client in mid-LIST.
+ * Channels are visited by decreasing number of members, so the listing
+ * ends as soon as they have too few.
  * @param[in] cptr Client to send the list to.
  */
 void list_next_channels(struct Client *cptr)
 {
-  struct ListingArgs *args;
+  struct ListingArgs *args = cli_listing(cptr);
+  struct ListSnapshot *snap;
+  struct ListEntry *entry;
   struct Channel *chptr;
 
-  /* Walk consecutive buckets until we hit the end. */
-  for (args = cli_listing(cptr); args->bucket < HASHSIZE; args->bucket++)
+  if (!args->snapshot)
+    list_start_channels(args);
+  snap = args->snapshot;
+
+  while (args->pos < snap->count)
   {
-    /* Send all the matching channels in the bucket. */
-    for (chptr = channelTable[args->bucket]; chptr; chptr = chptr->hnext)
+    entry = &snap->entries[args->pos++];
+    if (entry->users <= args->min_users)
     {
-      if (chptr->users > args->min_users
-          && chptr->users < args->max_users
-          && chptr->creationtime > args->min_time
-          && chptr->creationtime < args->max_time
-          && (!args->wildcard[0] || (args->flags & LISTARG_NEGATEWILDCARD) ||
-              (!match(args->wildcard, chptr->chname)))
-          && (!(args->flags & LISTARG_NEGATEWILDCARD) ||
-              match(args->wildcard, chptr->chname))
-          && (!(args->flags & LISTARG_TOPICLIMITS)
-              || (chptr->topic[0]
-                  && chptr->topic_time > args->min_topic_time
-                  && chptr->topic_time < args->max_topic_time))
-          && ((args->flags & LISTARG_SHOWSECRET)
-              || ShowChannel(cptr, chptr)))
-      {
-        if (args->flags & LISTARG_SHOWMODES) {
-          char modebuf[MODEBUFLEN];
-          char parabuf[MODEBUFLEN];
-
-          modebuf[0] = modebuf[1] = parabuf[0] = '\0';
-          channel_modes(cptr, modebuf, parabuf, sizeof(parabuf), chptr, NULL);
-          send_reply(cptr, RPL_LIST | SND_EXPLICIT, "%s %u %s %s :%s",
-                     chptr->chname, chptr->users, modebuf, parabuf, chptr->topic);
-        } else {
-          send_reply(cptr, RPL_LIST, chptr->chname, chptr->users, chptr->topic);
-        }
+      args->pos = snap->count;
+      break;
+    }
+    if ((args->wildcard[0]
+         && (match(args->wildcard, snap->names + entry->name) == 0)
+            == ((args->flags & LISTARG_NEGATEWILDCARD) != 0))
+        || !(chptr = FindChannel(snap->names + entry->name)))
+      continue;
+
+    if (chptr->users > args->min_users
+        && chptr->users < args->max_users
+        && chptr->creationtime > args->min_time
+        && chptr->creationtime < args->max_time
+        && (!(args->flags & LISTARG_TOPICLIMITS)
+            || (chptr->topic[0]
+                && chptr->topic_time > args->min_topic_time
+                && chptr->topic_time < args->max_topic_time))
+        && ((args->flags & LISTARG_SHOWSECRET)
+            || ShowChannel(cptr, chptr)))
+    {
+      if (args->flags & LISTARG_SHOWMODES) {
+        char modebuf[MODEBUFLEN];
+        char parabuf[MODEBUFLEN];
+
+        modebuf[0] = modebuf[1] = parabuf[0] = '\0';
+        channel_modes(cptr, modebuf, parabuf, sizeof(parabuf), chptr, NULL);
+        send_reply(cptr, RPL_LIST | SND_EXPLICIT, "%s %u %s %s :%s",
+                   chptr->chname, chptr->users, modebuf, parabuf, chptr->topic);
+      } else {
+        send_reply(cptr, RPL_LIST, chptr->chname, chptr->users, chptr->topic);
       }
+
+      /* If client sendq is more than half full, stop. */
+      if (MsgQLength(&cli_sendQ(cptr)) > cli_max_sendq(cptr) / 2)
+        break;
     }
-    /* If, at the end of the bucket, client sendq is more than half
-     * full, stop. */
-    if (MsgQLength(&cli_sendQ(cptr)) > cli_max_sendq(cptr) / 2)
-      break;
   }
 
-  /* If we did all buckets, clean the client and send RPL_LISTEND. */
-  if (args->bucket >= HASHSIZE)
+  /* If we did all channels, clean the client and send RPL_LISTEND. */
+  if (args->pos >= snap->count)
   {
-    MyFree(cli_listing(cptr));
-    cli_listing(cptr) = NULL;
+    list_stop_channels(cptr);
     send_reply(cptr, RPL_LISTEND);
   }
 }
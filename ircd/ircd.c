@@ -57,8 +57,10 @@
 #include "s_debug.h"
 #include "s_misc.h"
 #include "s_stats.h"
+#include "s_upgrade.h"
 #include "send.h"
 #include "sys.h"
+#include "throttle.h"
 #include "uping.h"
 #include "userload.h"
 #include "version.h"
@@ -96,7 +98,8 @@ extern void mem_dbg_initialise(void);
 enum {
   BOOT_DEBUG = 1,  /**< Enable debug output. */
   BOOT_TTY   = 2,  /**< Stay connected to TTY. */
-  BOOT_CHKCONF = 4 /**< Exit after reading configuration file. */
+  BOOT_CHKCONF = 4, /**< Exit after reading configuration file. */
+  BOOT_UPGRADE = 8  /**< Take over the state of an upgraded server. */
 };
 
 
@@ -115,6 +118,7 @@ int            debuglevel        = -1;    /**< Server debug level  */
 char          *debugmode         = "";    /**< Server debug level */
 static char   *dpath             = DPATH; /**< Working directory for daemon */
 static char   *dbg_client;                /**< Client specifier for chkconf */
+static char   *upgrade_file;              /**< State file of a hot upgrade */
 
 static struct Timer connect_timer; /**< timer structure for try_connections() */
 static struct Timer ping_timer; /**< timer structure for check_pings() */
@@ -197,6 +201,55 @@ void server_restart(const char *message)
   exit(8);
 }
 
+/*----------------------------------------------------------------------------
+ * API: server_upgrade
+ *--------------------------------------------------------------------------*/
+/** Restart the server keeping its connections and state.
+ * If the state cannot be saved or the new binary cannot be started,
+ * the server keeps running.
+ * @param[in] message Message to log and send to operators.
+ */
+void server_upgrade(const char *message)
+{
+  const char *path = feature_str(FEAT_UPGRADE_PATH);
+  char **argv;
+  int argc = 0;
+  int i;
+
+  log_write(LS_SYSTEM, L_WARNING, LOG_NOSNOTICE, "Upgrading Server: %s",
+	    message);
+  sendto_opmask_butone(0, SNO_OLDSNO, "Upgrading server: %s", message);
+  Debug((DEBUG_NOTICE, "Upgrading server..."));
+
+  if (!upgrade_save(path)) {
+    sendto_opmask_butone(0, SNO_OLDSNO, "Unable to save the server state; "
+                         "upgrade cancelled");
+    return;
+  }
+
+  /* Pass the state file to the new process. */
+  argv = (char **) MyMalloc((thisServer.argc + 3) * sizeof(char *));
+  for (i = 0; i < thisServer.argc; i++)
+    argv[argc++] = thisServer.argv[i];
+  argv[argc++] = "-u";
+  argv[argc++] = (char *) path;
+  argv[argc] = NULL;
+
+  log_close();
+
+  reap_children();
+
+  execv(SPATH, argv);
+
+  /* Have to reopen since it has been closed above */
+  log_reopen();
+
+  log_write(LS_SYSTEM, L_CRIT, 0, "execv(%s,%s) failed: %m", SPATH,
+	    *thisServer.argv);
+  MyFree(argv);
+  unlink(path);
+}
+
 
 /*----------------------------------------------------------------------------
  * outofmemory:  Handler for out of memory conditions...
@@ -319,144 +372,225 @@ static void try_connections(struct Event* ev) {
 }
 
 
-/** Check for clients that have not sent a ping response recently.
- * Reschedules itself to run again at the appropriate time.
- * @param[in] ev Timer event (ignored).
+/** Number of one second slots in the ping wheel (a power of 2). */
+#define PING_WHEEL_SIZE 512
+
+/** Local connections by the second of their next ping check.
+ * Connections due more than PING_WHEEL_SIZE seconds later share the
+ * slot and are skipped until their time comes.
  */
-static void check_pings(struct Event* ev) {
-  int expire     = 0;
-  int next_check = CurrentTime;
-  int max_ping   = 0;
-  int i;
+static struct Connection *pingWheel[PING_WHEEL_SIZE];
+/** Last second whose slot of #pingWheel was checked. */
+static time_t pingWheelTime;
+
+/** Schedule the next ping check of a local connection.
+ * @param[in] cptr Local client.
+ * @param[in] when Time of the check; checks in the past are done in
+ * the next second.
+ */
+void ping_schedule(struct Client *cptr, time_t when)
+{
+  struct Connection *con = cli_connect(cptr);
+  struct Connection **head;
 
-  assert(ET_EXPIRE == ev_type(ev));
-  assert(0 != ev_timer(ev));
+  ping_unschedule(cptr);
+  if (cli_fd(cptr) < 0)
+    return;
+  if (when <= pingWheelTime)
+    when = pingWheelTime + 1;
+  head = &pingWheel[when & (PING_WHEEL_SIZE - 1)];
+  con_pingdue(con) = when;
+  con_pingnext(con) = *head;
+  con_pingprev_p(con) = head;
+  if (*head)
+    con_pingprev_p(*head) = &con_pingnext(con);
+  *head = con;
+}
 
-  next_check += feature_int(FEAT_PINGFREQUENCY);
-  
-  /* Scan through the client table */
-  for (i=0; i <= HighestFd; i++) {
-    struct Client *cptr = LocalClientArray[i];
-   
-    if (!cptr)
-      continue;
-     
-    assert(&me != cptr);  /* I should never be in the local client array! */
-   
+/** Remove a local connection from the ping wheel, if it is there.
+ * @param[in] cptr Local client.
+ */
+void ping_unschedule(struct Client *cptr)
+{
+  struct Connection *con = cli_connect(cptr);
 
-    /* Remove dead clients. */
-    if (IsDead(cptr)) {
-      exit_client(cptr, cptr, &me, cli_info(cptr));
-      continue;
-    }
+  if (!con_pingprev_p(con))
+    return;
+  *con_pingprev_p(con) = con_pingnext(con);
+  if (con_pingnext(con))
+    con_pingprev_p(con_pingnext(con)) = con_pingprev_p(con);
+  con_pingnext(con) = 0;
+  con_pingprev_p(con) = 0;
+}
 
-    Debug((DEBUG_DEBUG, "check_pings(%s)=status:%s current: %d",
-	   cli_name(cptr),
-	   IsPingSent(cptr) ? "[Ping Sent]" : "[]", 
-	   (int)(CurrentTime - cli_lasttime(cptr))));
+/** Check whether a local client has not sent a ping response recently.
+ * @param[in] cptr Local client due for a check.
+ * @return Time of the next check, or zero if the client exited.
+ */
+static time_t check_ping(struct Client *cptr)
+{
+  int    max_ping;
+  time_t expire;
+  time_t next_check = CurrentTime + feature_int(FEAT_PINGFREQUENCY);
 
-    /* Unregistered clients pingout after max_ping seconds, they don't
-     * get given a second chance - if they were then people could not quite
-     * finish registration and hold resources without being subject to k/g
-     * lines
-     */
+  assert(&me != cptr);  /* I should never be in the local client array! */
+
+  /* Remove dead clients. */
+  if (IsDead(cptr)) {
+    exit_client(cptr, cptr, &me, cli_info(cptr));
+    return 0;
+  }
+
+  Debug((DEBUG_DEBUG, "check_ping(%s)=status:%s current: %d",
+         cli_name(cptr),
+         IsPingSent(cptr) ? "[Ping Sent]" : "[]",
+         (int)(CurrentTime - cli_lasttime(cptr))));
+
+  /* Unregistered clients pingout after max_ping seconds, they don't
+   * get given a second chance - if they were then people could not quite
+   * finish registration and hold resources without being subject to k/g
+   * lines
+   */
+  if (!IsRegistered(cptr)) {
+    assert(!IsServer(cptr));
+    max_ping = feature_int(FEAT_CONNECTTIMEOUT);
+    /* If client authorization time has expired, ask auth whether they
+     * should be checked again later. */
+    if ((CurrentTime-cli_firsttime(cptr) >= max_ping)
+        && auth_ping_timeout(cptr))
+      return 0;
     if (!IsRegistered(cptr)) {
-      assert(!IsServer(cptr));
-      max_ping = feature_int(FEAT_CONNECTTIMEOUT);
-      /* If client authorization time has expired, ask auth whether they
-       * should be checked again later. */
-      if ((CurrentTime-cli_firsttime(cptr) >= max_ping)
-          && auth_ping_timeout(cptr))
-        continue;
-      if (!IsRegistered(cptr)) {
-	/* OK, they still have enough time left, so we'll just skip to the
-	 * next client.  Set the next check to be when their time is up, if
-	 * that's before the currently scheduled next check -- hikari */
-	expire = cli_firsttime(cptr) + max_ping;
-	if (expire < next_check)
-	  next_check = expire;
-	continue;
-      }
+      /* OK, they still have enough time left, so we'll just check them
+       * again when their time is up, if that's before the usual next
+       * check -- hikari */
+      expire = cli_firsttime(cptr) + max_ping;
+      return expire < next_check ? expire : next_check;
     }
+  }
 
-    max_ping = client_get_ping(cptr);
-
-    /* If it's a server and we have not sent an AsLL lately, do so. */
-    if (IsServer(cptr)) {
-      if (CurrentTime - cli_serv(cptr)->asll_last >= max_ping) {
-        char *asll_ts;
+  max_ping = client_get_ping(cptr);
 
-        SetPingSent(cptr);
-        cli_serv(cptr)->asll_last = CurrentTime;
-        expire = cli_serv(cptr)->asll_last + max_ping;
-        asll_ts = militime_float(NULL);
-        sendcmdto_prio_one(&me, CMD_PING, cptr, "!%s %s %s", asll_ts,
-                           cli_name(cptr), asll_ts);
-      }
+  /* If it's a server and we have not sent an AsLL lately, do so. */
+  if (IsServer(cptr)) {
+    if (CurrentTime - cli_serv(cptr)->asll_last >= max_ping) {
+      char *asll_ts;
 
-      expire = cli_serv(cptr)->asll_last + max_ping;
-      if (expire < next_check)
-        next_check = expire;
+      SetPingSent(cptr);
+      cli_serv(cptr)->asll_last = CurrentTime;
+      asll_ts = militime_float(NULL);
+      sendcmdto_prio_one(&me, CMD_PING, cptr, "!%s %s %s", asll_ts,
+                         cli_name(cptr), asll_ts);
     }
 
-    /* Ok, the thing that will happen most frequently, is that someone will
-     * have sent something recently.  Cover this first for speed.
-     * -- 
-     * If it's an unregistered client and hasn't managed to register within
-     * max_ping then it's obviously having problems (broken client) or it's
-     * just up to no good, so we won't skip it, even if its been sending
-     * data to us. 
-     * -- hikari
+    expire = cli_serv(cptr)->asll_last + max_ping;
+    if (expire < next_check)
+      next_check = expire;
+  }
+
+  /* Ok, the thing that will happen most frequently, is that someone will
+   * have sent something recently.  Cover this first for speed.
+   * --
+   * If it's an unregistered client and hasn't managed to register within
+   * max_ping then it's obviously having problems (broken client) or it's
+   * just up to no good, so we won't skip it, even if its been sending
+   * data to us.
+   * -- hikari
+   */
+  if ((CurrentTime-cli_lasttime(cptr) < max_ping) && IsRegistered(cptr)) {
+    expire = cli_lasttime(cptr) + max_ping;
+    return expire < next_check ? expire : next_check;
+  }
+
+  /* Quit the client after max_ping*2 - they should have answered by now */
+  if (CurrentTime-cli_lasttime(cptr) >= (max_ping*2) )
+  {
+    /* If it was a server, then tell ops about it. */
+    if (IsServer(cptr) || IsConnecting(cptr) || IsHandshake(cptr))
+      sendto_opmask_butone(0, SNO_OLDSNO,
+                           "No response from %s, closing link",
+                           cli_name(cptr));
+    exit_client_msg(cptr, cptr, &me, "Ping timeout");
+    return 0;
+  }
+
+  if (!IsPingSent(cptr))
+  {
+    /* If we haven't PINGed the connection and we haven't heard from it in a
+     * while, PING it to make sure it is still alive.
      */
-    if ((CurrentTime-cli_lasttime(cptr) < max_ping) && IsRegistered(cptr)) {
-      expire = cli_lasttime(cptr) + max_ping;
-      if (expire < next_check) 
-	next_check = expire;
-      continue;
-    }
+    SetPingSent(cptr);
 
-    /* Quit the client after max_ping*2 - they should have answered by now */
-    if (CurrentTime-cli_lasttime(cptr) >= (max_ping*2) )
-    {
-      /* If it was a server, then tell ops about it. */
-      if (IsServer(cptr) || IsConnecting(cptr) || IsHandshake(cptr))
-        sendto_opmask_butone(0, SNO_OLDSNO,
-                             "No response from %s, closing link",
-                             cli_name(cptr));
-      exit_client_msg(cptr, cptr, &me, "Ping timeout");
-      continue;
-    }
-    
-    if (!IsPingSent(cptr))
-    {
-      /* If we haven't PINGed the connection and we haven't heard from it in a
-       * while, PING it to make sure it is still alive.
-       */
-      SetPingSent(cptr);
+    /* If we're late in noticing don't hold it against them :) */
+    cli_lasttime(cptr) = CurrentTime - max_ping;
 
-      /* If we're late in noticing don't hold it against them :) */
-      cli_lasttime(cptr) = CurrentTime - max_ping;
-      
-      if (IsUser(cptr))
-        sendrawto_one(cptr, MSG_PING " :%s", cli_name(&me));
-      else
-        sendcmdto_prio_one(&me, CMD_PING, cptr, ":%s", cli_name(&me));
+    if (IsUser(cptr))
+      sendrawto_one(cptr, MSG_PING " :%s", cli_name(&me));
+    else
+      sendcmdto_prio_one(&me, CMD_PING, cptr, ":%s", cli_name(&me));
+  }
+
+  expire = cli_lasttime(cptr) + max_ping * 2;
+  return expire < next_check ? expire : next_check;
+}
+
+/** Check the pings of the connections due since the last call.
+ * Each connection is only visited when its next check is due, instead
+ * of walking all of them; a connection that sent data meanwhile is
+ * just checked again later.
+ * @param[in] ev Timer event (ignored).
+ */
+static void check_pings(struct Event* ev) {
+  struct Connection *list, *con;
+  struct Client *cptr;
+  time_t next;
+  int slots = 0;
+
+  assert(ET_EXPIRE == ev_type(ev));
+  assert(0 != ev_timer(ev));
+
+  /* If the clock went back, carry on from the new time. */
+  if (CurrentTime < pingWheelTime)
+    pingWheelTime = CurrentTime;
+
+  while (pingWheelTime < CurrentTime && slots++ < PING_WHEEL_SIZE) {
+    /* Take the whole slot, so exiting clients may unlink themselves
+     * from it, and put back the connections due later. */
+    pingWheelTime++;
+    list = pingWheel[pingWheelTime & (PING_WHEEL_SIZE - 1)];
+    pingWheel[pingWheelTime & (PING_WHEEL_SIZE - 1)] = 0;
+    if (list)
+      con_pingprev_p(list) = &list;
+
+    while ((con = list)) {
+      cptr = con_client(con);
+      ping_unschedule(cptr);
+      if (con_pingdue(con) > CurrentTime)
+        ping_schedule(cptr, con_pingdue(con));
+      else if ((next = check_ping(cptr)))
+        ping_schedule(cptr, next);
     }
-    
-    expire = cli_lasttime(cptr) + max_ping * 2;
-    if (expire < next_check)
-      next_check=expire;
   }
-  
-  assert(next_check >= CurrentTime);
-  
-  Debug((DEBUG_DEBUG, "[%i] check_pings() again in %is",
-	 CurrentTime, next_check-CurrentTime));
-  
-  timer_add(&ping_timer, check_pings, 0, TT_ABSOLUTE, next_check);
+  pingWheelTime = CurrentTime;
 }
 
 
+/** Remove the "-u <file>" options from the arguments used to restart.
+ * The state file is loaded only once, so a later RESTART must not
+ * pass it to the new process.
+ */
+static void strip_upgrade_option(void) {
+  int i, j;
+
+  for (i = j = 0; i < thisServer.argc; i++) {
+    if (!strcmp(thisServer.argv[i], "-u") && i + 1 < thisServer.argc)
+      i++;
+    else
+      thisServer.argv[j++] = thisServer.argv[i];
+  }
+  thisServer.argv[j] = NULL;
+  thisServer.argc = j;
+}
+
 /** Parse command line arguments.
  * Global variables are updated to reflect the arguments.
  * As a side effect, makes sure the process's effective user id is the
@@ -465,7 +599,7 @@ static void check_pings(struct Event* ev) {
  * @param[in,out] argv Command-lne arguments.
  */
 static void parse_command_line(int argc, char** argv) {
-  const char *options = "d:f:h:nktvx:c:";
+  const char *options = "d:f:h:nktu:vx:c:";
   int opt;
 
   if (thisServer.euid != thisServer.uid)
@@ -483,6 +617,7 @@ static void parse_command_line(int argc, char** argv) {
     case 'd':  dpath      = optarg;                    break;
     case 'f':  configfile = optarg;                    break;
     case 'h':  ircd_strncpy(cli_name(&me), optarg, HOSTLEN); break;
+    case 'u':  upgrade_file = optarg;                  break;
     case 'v':
       printf("ircd %s\n", version);
       printf("Event engines: ");
@@ -527,6 +662,7 @@ static void parse_command_line(int argc, char** argv) {
              "\n -c clispec\t search for client/kill blocks matching client"
              "\n\t\t clispec is comma-separated list of user@host,"
              "\n\t\t user@ip, $Rrealname, and port number"
+             "\n -u file\t take over the state saved by RESTART UPGRADE"
              "\n\nServer not started.\n");
       exit(1);
     }
@@ -663,12 +799,23 @@ int main(int argc, char **argv) {
   if (!init_connection_limits())
     return 9;
 
-  close_connections(!(thisServer.bootopt & (BOOT_DEBUG | BOOT_TTY | BOOT_CHKCONF)));
-
-  /* daemon_init() must be before event_init() because kqueue() FDs
-   * are, perversely, not inherited across fork().
+  /* An upgraded server keeps the sockets and the process of the old one;
+   * the listening sockets are taken over later by init_conf().
    */
-  daemon_init(thisServer.bootopt & BOOT_TTY);
+  if (upgrade_file) {
+    if (upgrade_init(upgrade_file))
+      thisServer.bootopt |= BOOT_UPGRADE;
+    strip_upgrade_option();
+  }
+
+  if (!(thisServer.bootopt & BOOT_UPGRADE)) {
+    close_connections(!(thisServer.bootopt & (BOOT_DEBUG | BOOT_TTY | BOOT_CHKCONF)));
+
+    /* daemon_init() must be before event_init() because kqueue() FDs
+     * are, perversely, not inherited across fork().
+     */
+    daemon_init(thisServer.bootopt & BOOT_TTY);
+  }
 
 #ifdef DEBUGMODE
   /* Must reserve fd 2... */
@@ -741,8 +888,10 @@ int main(int argc, char **argv) {
   stats_init();
 
   IPcheck_init();
+  throttle_init();
   timer_add(timer_init(&connect_timer), try_connections, 0, TT_RELATIVE, 1);
-  timer_add(timer_init(&ping_timer), check_pings, 0, TT_RELATIVE, 1);
+  pingWheelTime = CurrentTime;
+  timer_add(timer_init(&ping_timer), check_pings, 0, TT_PERIODIC, 1);
   timer_add(timer_init(&destruct_event_timer), exec_expired_destruct_events, 0, TT_PERIODIC, 60);
 
   CurrentTime = time(NULL);
@@ -772,6 +921,8 @@ int main(int argc, char **argv) {
   ddb_init();
 #endif
 
+  upgrade_restore();
+
   Debug((DEBUG_NOTICE, "Server ready..."));
   log_write(LS_SYSTEM, L_NOTICE, 0, "Server Ready");
 
@@ -40,10 +40,12 @@
 #include "numeric.h"
 #include "numnicks.h"
 #include "random.h"	/* random_seed_set */
+#include "res.h"	/* resolver_cache_trim */
 #include "s_bsd.h"
 #include "s_debug.h"
 #include "s_misc.h"
 #include "s_stats.h"
+#include "s_user.h"	/* supported_recache */
 #include "send.h"
 #include "struct.h"
 #include "sys.h"    /* FALSE bleah */
@@ -322,25 +324,26 @@ static struct FeatureDesc {
   F_B(NOIDENT, 0, 0, 0),
   F_N(RANDOM_SEED, FEAT_NODISP, random_seed_set, 0, 0, 0, 0, 0, 0),
   F_S(DEFAULT_LIST_PARAM, FEAT_NULL, 0, list_set_default),
+  F_I(LIST_SNAPSHOT_TIME, 0, 15, 0),
   F_I(NICKNAMEHISTORYLENGTH, 0, 800, whowas_realloc),
   F_B(HOST_HIDING, 0, 1, 0),
   F_S(HIDDEN_HOST, FEAT_CASE, "users.irc-hispano.org", 0),
   F_S(HIDDEN_IP, 0, "127.0.0.1", 0),
   F_B(CONNEXIT_NOTICES, 0, 0, 0),
-  F_B(OPLEVELS, 0, 1, 0),
+  F_B(OPLEVELS, 0, 1, supported_recache),
   F_B(ZANNELS, 0, 1, 0),
-  F_B(LOCAL_CHANNELS, 0, 1, 0),
+  F_B(LOCAL_CHANNELS, 0, 1, supported_recache),
   F_B(TOPIC_BURST, 0, 0, 0),
   F_B(DISABLE_GLINES, 0, 0, 0),
 
   /* features that probably should not be touched */
   F_I(KILLCHASETIMELIMIT, 0, 30, 0),
-  F_I(MAXCHANNELSPERUSER, 0, 10, 0),
-  F_I(NICKLEN, 0, 12, 0),
+  F_I(MAXCHANNELSPERUSER, 0, 10, supported_recache),
+  F_I(NICKLEN, 0, 12, supported_recache),
   F_I(AVBANLEN, 0, 40, 0),
-  F_I(MAXBANS, 0, 100, 0),
-  F_I(MAXSILES, 0, 25, 0),
-  F_I(MAXMONITOR, 0, 100, 0),
+  F_I(MAXBANS, 0, 100, supported_recache),
+  F_I(MAXSILES, 0, 25, supported_recache),
+  F_I(MAXMONITOR, 0, 100, supported_recache),
   F_I(HANGONGOODLINK, 0, 300, 0),
   F_I(HANGONRETRYDELAY, 0, 10, 0),
   F_I(CONNECTTIMEOUT, 0, 90, 0),
@@ -356,14 +359,20 @@ static struct FeatureDesc {
   F_I(IPCHECK_48_CLONE_LIMIT, 0, 50, 0),
   F_I(IPCHECK_48_CLONE_PERIOD, 0, 10, 0),
   F_I(IPCHECK_CLONE_DELAY, 0, 600, 0),
-  F_I(CHANNELLEN, 0, 200, 0),
+  F_I(ACCEPT_THROTTLE_32, 0, 8, 0),
+  F_I(ACCEPT_THROTTLE_24, 0, 32, 0),
+  F_I(ACCEPT_THROTTLE_64, 0, 16, 0),
+  F_I(ACCEPT_THROTTLE_PERIOD, 0, 10, 0),
+  F_I(CHANNELLEN, 0, 200, supported_recache),
 
   /* Some misc. default paths */
   F_S(MPATH, FEAT_CASE | FEAT_MYOPER, "ircd.motd", motd_init),
   F_S(RPATH, FEAT_CASE | FEAT_MYOPER, "remote.motd", motd_init),
   F_S(PPATH, FEAT_CASE | FEAT_MYOPER | FEAT_READ, "ircd.pid", 0),
+  F_S(UPGRADE_PATH, FEAT_CASE | FEAT_MYOPER, "ircd.upgrade", 0),
 #if defined(DDB)
   F_S(DDBPATH, FEAT_CASE | FEAT_MYOPER, "database", 0),
+  F_I(DDB_LOAD_THREADS, 0, 4, 0),
 #endif
 
   /* Networking features */
@@ -372,6 +381,10 @@ static struct FeatureDesc {
   F_I(POLLS_PER_LOOP, 0, 200, 0),
   F_I(IRCD_RES_RETRIES, 0, 2, 0),
   F_I(IRCD_RES_TIMEOUT, 0, 4, 0),
+  F_I(IRCD_RES_CACHE_SIZE, 0, 4096, resolver_cache_trim),
+  F_I(IRCD_RES_CACHE_MINTTL, 0, 60, 0),
+  F_I(IRCD_RES_CACHE_MAXTTL, 0, 3600, 0),
+  F_I(IRCD_RES_CACHE_NEGTTL, 0, 30, 0),
   F_I(AUTH_TIMEOUT, 0, 9, 0),
   F_B(ANNOUNCE_INVITES, 0, 0, 0),
 
@@ -419,6 +432,7 @@ static struct FeatureDesc {
   F_B(HIS_STATS_y, 0, 1, 0),
   F_B(HIS_STATS_z, 0, 1, 0),
   F_B(HIS_STATS_IAUTH, 0, 1, 0),
+  F_B(HIS_STATS_LOGS, 0, 1, 0),
   F_B(HIS_WEBIRC, 0, 1, 0),
   F_B(HIS_WHOIS_SERVERNAME, 0, 1, 0),
   F_B(HIS_WHOIS_IDLETIME, 0, 1, 0),
@@ -437,7 +451,7 @@ static struct FeatureDesc {
   F_S(HIS_URLSERVERS, 0, "https://www.irc-hispano.org/servidores", 0),
 
   /* Misc. random stuff */
-  F_S(NETWORK, 0, "IRC-Hispano", 0),
+  F_S(NETWORK, 0, "IRC-Hispano", supported_recache),
   F_S(URL_CLIENTS, 0, "ftp://ftp.undernet.org/pub/irc/clients", 0),
   F_S(URLREG, 0, "https://www.irc-hispano.org/regnick", 0),
   F_B(ALLOW_RANDOM_NICKS, 0, 1, 0),
@@ -53,6 +53,13 @@
 #include <time.h>
 #include <unistd.h>
 
+/* The debug log must reach the terminal before a crash. */
+#if defined(USE_PTHREADS) && !defined(DEBUGMODE)
+#define LOG_THREADED
+#include <pthread.h>
+#include <signal.h>
+#endif
+
 int log_inassert = 0;
 
 #define LOG_BUFSIZE 2048 /**< Maximum length for a log message. */
@@ -193,6 +200,44 @@ static struct {
   struct LogFile *dbfile;   /**< debug file */
 } logInfo = { 0, 0, LOG_USER, "ircd", 0 };
 
+#ifdef LOG_THREADED
+
+#define LOG_QUEUE_SIZE 1024 /**< Records in the log writer queue (a power of two). */
+#define LOG_BATCH      64   /**< Most records written by one writev(). */
+
+/** A log file line waiting for the log writer. */
+struct LogRecord {
+  unsigned long	  seq;	   /**< Queue position the record is ready for. */
+  struct LogFile *file;	   /**< File to write to. */
+  size_t	  len;	   /**< Length of \a text. */
+  char		  text[LOG_BUFSIZE + 24]; /**< Time stamp, message and newline. */
+};
+
+/** Queue of lines for the log writer thread.
+ * Writers of log lines claim a record with a compare-and-swap on \a head
+ * and publish it by setting its sequence number; the writer thread takes
+ * the published records in order and releases them the same way, so the
+ * event loop never waits for the disk.  When the queue is full, lines
+ * are dropped and counted.
+ */
+static struct {
+  struct LogRecord *ring;     /**< The records of the queue. */
+  unsigned long	    head;     /**< Next position to claim. */
+  unsigned long	    tail;     /**< Next position to write (writer only). */
+  unsigned long	    written;  /**< Records written out, under \a lock. */
+  unsigned long	    dropped;  /**< Lines dropped because the queue was full. */
+  unsigned long	    batches;  /**< Calls to writev(), under \a lock. */
+  unsigned long	    maxdepth; /**< Most records ever waiting. */
+  int		    running;  /**< Non-zero once the writer thread runs. */
+  int		    sleeping; /**< Non-zero while the writer waits for lines. */
+  pthread_mutex_t   lock;     /**< Protects the sleeps of the writer. */
+  pthread_cond_t    wakeup;   /**< Signalled when lines are queued. */
+  pthread_cond_t    done;     /**< Signalled when lines are written. */
+} logQueue = { 0, 0, 0, 0, 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER,
+	       PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+#endif /* LOG_THREADED */
+
 /** Helper routine to open a log file if needed.
  * If the log file is already open, do nothing.
  * @param[in,out] lf Log file to open.
@@ -207,6 +252,191 @@ log_open(struct LogFile *lf)
   }
 }
 
+#ifdef LOG_THREADED
+
+/** Write out a run of queued lines for the same file.
+ * @param[in] lf Log file to write to.
+ * @param[in] vector Lines to write.
+ * @param[in] count Number of lines in \a vector.
+ */
+static void
+log_write_batch(struct LogFile *lf, struct iovec *vector, int count)
+{
+  log_open(lf);
+  if (lf->fd >= 0)
+    writev(lf->fd, vector, count);
+}
+
+/** Body of the log writer thread.
+ * @param[in] arg Unused.
+ * @return Never returns.
+ */
+static void *
+log_writer(void *arg)
+{
+  struct iovec vector[LOG_BATCH];
+  struct LogRecord *rec;
+  struct LogFile *lf;
+  unsigned long pos;
+  int ii, count, start;
+
+  for (;;) {
+    /* collect the records published after the last batch */
+    pos = logQueue.tail;
+    for (count = 0; count < LOG_BATCH; count++) {
+      rec = &logQueue.ring[(pos + count) & (LOG_QUEUE_SIZE - 1)];
+      if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != pos + count + 1)
+	break;
+      vector[count].iov_base = rec->text;
+      vector[count].iov_len = rec->len;
+    }
+
+    if (!count) {
+      pthread_mutex_lock(&logQueue.lock);
+      logQueue.sleeping = 1;
+      /* pairs with the fence in log_queue(), so no wakeup is lost */
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      rec = &logQueue.ring[pos & (LOG_QUEUE_SIZE - 1)];
+      if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != pos + 1)
+	pthread_cond_wait(&logQueue.wakeup, &logQueue.lock);
+      logQueue.sleeping = 0;
+      pthread_mutex_unlock(&logQueue.lock);
+      continue;
+    }
+
+    /* one writev() for each run of lines to the same file */
+    lf = logQueue.ring[pos & (LOG_QUEUE_SIZE - 1)].file;
+    for (ii = start = 0; ii < count; ii++) {
+      rec = &logQueue.ring[(pos + ii) & (LOG_QUEUE_SIZE - 1)];
+      if (rec->file != lf) {
+	log_write_batch(lf, vector + start, ii - start);
+	lf = rec->file;
+	start = ii;
+      }
+    }
+    log_write_batch(lf, vector + start, count - start);
+
+    /* hand the records back to the writers of log lines */
+    for (ii = 0; ii < count; ii++) {
+      rec = &logQueue.ring[(pos + ii) & (LOG_QUEUE_SIZE - 1)];
+      __atomic_store_n(&rec->seq, pos + ii + LOG_QUEUE_SIZE, __ATOMIC_RELEASE);
+    }
+    logQueue.tail = pos + count;
+
+    pthread_mutex_lock(&logQueue.lock);
+    logQueue.written = logQueue.tail;
+    logQueue.batches++;
+    pthread_cond_broadcast(&logQueue.done);
+    pthread_mutex_unlock(&logQueue.lock);
+  }
+
+  return NULL;
+}
+
+/** Start the log writer thread.
+ * Until it runs, log files are written directly.
+ */
+static void
+log_writer_start(void)
+{
+  pthread_t thread;
+  sigset_t sigs, oldsigs;
+  unsigned long ii;
+
+  logQueue.ring = (struct LogRecord*) MyMalloc(LOG_QUEUE_SIZE *
+					       sizeof(struct LogRecord));
+  for (ii = 0; ii < LOG_QUEUE_SIZE; ii++)
+    logQueue.ring[ii].seq = ii;
+
+  /* The signals must be delivered to the main thread */
+  sigfillset(&sigs);
+  pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+  if (!pthread_create(&thread, NULL, log_writer, NULL)) {
+    pthread_detach(thread);
+    logQueue.running = 1;
+  } else {
+    MyFree(logQueue.ring);
+  }
+  pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+}
+
+/** Queue a line for the log writer thread.
+ * @param[in] lf Log file to write to.
+ * @param[in] vector Time stamp, message and newline of the line.
+ * @return Zero if the writer thread does not run, non-zero if the
+ *   line was queued or dropped.
+ */
+static int
+log_queue(struct LogFile *lf, const struct iovec *vector)
+{
+  struct LogRecord *rec;
+  unsigned long pos, seq, depth;
+  size_t len;
+
+  if (!logQueue.running)
+    return 0;
+
+  pos = __atomic_load_n(&logQueue.head, __ATOMIC_RELAXED);
+  for (;;) {
+    rec = &logQueue.ring[pos & (LOG_QUEUE_SIZE - 1)];
+    seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+    if (seq == pos) {
+      if (__atomic_compare_exchange_n(&logQueue.head, &pos, pos + 1, 1,
+				      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	break;
+    } else if ((long) (seq - pos) < 0) { /* still waiting for the writer */
+      __atomic_fetch_add(&logQueue.dropped, 1, __ATOMIC_RELAXED);
+      return 1;
+    } else
+      pos = __atomic_load_n(&logQueue.head, __ATOMIC_RELAXED);
+  }
+
+  rec->file = lf;
+  memcpy(rec->text, vector[0].iov_base, vector[0].iov_len);
+  len = vector[0].iov_len;
+  memcpy(rec->text + len, vector[1].iov_base, vector[1].iov_len);
+  len += vector[1].iov_len;
+  rec->text[len++] = '\n';
+  rec->len = len;
+  __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+
+  depth = pos + 1 - __atomic_load_n(&logQueue.written, __ATOMIC_RELAXED);
+  if (depth > __atomic_load_n(&logQueue.maxdepth, __ATOMIC_RELAXED))
+    __atomic_store_n(&logQueue.maxdepth, depth, __ATOMIC_RELAXED);
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&logQueue.sleeping, __ATOMIC_RELAXED)) {
+    pthread_mutex_lock(&logQueue.lock);
+    pthread_cond_signal(&logQueue.wakeup);
+    pthread_mutex_unlock(&logQueue.lock);
+  }
+  return 1;
+}
+
+#endif /* LOG_THREADED */
+
+/** Wait until the log writer thread has written every queued line.
+ * Log files may only be closed, or written directly, after this.
+ */
+static void
+log_flush(void)
+{
+#ifdef LOG_THREADED
+  unsigned long target;
+
+  if (!logQueue.running)
+    return;
+
+  target = __atomic_load_n(&logQueue.head, __ATOMIC_ACQUIRE);
+  pthread_mutex_lock(&logQueue.lock);
+  while (logQueue.written < target) {
+    pthread_cond_signal(&logQueue.wakeup);
+    pthread_cond_wait(&logQueue.done, &logQueue.lock);
+  }
+  pthread_mutex_unlock(&logQueue.lock);
+#endif
+}
+
 #ifdef DEBUGMODE
 
 /** Reopen debug log file. */
@@ -305,6 +535,11 @@ log_init(const char *process_name)
 
   /* ok, open syslog; default facility: LOG_USER */
   openlog(logInfo.procname, LOG_PID | LOG_NDELAY, logInfo.facility);
+
+#ifdef LOG_THREADED
+  /* we are past the fork() in daemon_init() */
+  log_writer_start();
+#endif
 }
 
 /** Reopen log files (so admins can do things like rotate log files). */
@@ -327,6 +562,7 @@ log_close(void)
 {
   struct LogFile *ptr;
 
+  log_flush(); /* the files must be idle */
   closelog(); /* close syslog */
 
   for (ptr = logInfo.filelist; ptr; ptr = ptr->next) {
@@ -403,12 +639,9 @@ log_vwrite(enum LogSys subsys, enum LogLevel severity, unsigned int flags,
   if (severity > desc->level)
     return;
 
-  /* figure out where all we need to log */
-  if (!(flags & LOG_NOFILELOG) && desc->file) {
-    log_open(desc->file);
-    if (desc->file->fd >= 0) /* don't log to file if we can't open the file */
-      flags |= LOG_DOFILELOG;
-  }
+  /* figure out where all we need to log; files are opened on write */
+  if (!(flags & LOG_NOFILELOG) && desc->file)
+    flags |= LOG_DOFILELOG;
 
   if (!(flags & LOG_NOSYSLOG) && desc->facility >= 0)
     flags |= LOG_DOSYSLOG; /* will syslog */
@@ -432,6 +665,9 @@ log_vwrite(enum LogSys subsys, enum LogLevel severity, unsigned int flags,
   vector[1].iov_len =
     ircd_snprintf(0, buf, sizeof(buf), "%s [%s]: %v", desc->name,
 		  ldata->string, &vd);
+  /* ircd_snprintf() returns the untruncated length */
+  if (vector[1].iov_len > sizeof(buf) - 1)
+    vector[1].iov_len = sizeof(buf) - 1;
 
   /* if we have something to write to... */
   if (flags & LOG_DOFILELOG) {
@@ -451,8 +687,17 @@ log_vwrite(enum LogSys subsys, enum LogLevel severity, unsigned int flags,
     vector[2].iov_base = (void*) "\n"; /* terminate lines with a \n */
     vector[2].iov_len = 1;
 
-    /* write it out to the log file */
-    writev(desc->file->fd, vector, 3);
+    /* queue it for the log writer; critical messages (assertion failures)
+     * are written out before going on */
+#ifdef LOG_THREADED
+    if (severity == L_CRIT || !log_queue(desc->file, vector))
+#endif
+    {
+      log_flush();
+      log_open(desc->file);
+      if (desc->file->fd >= 0) /* don't log to file if we can't open the file */
+	writev(desc->file->fd, vector, 3);
+    }
   }
 
   /* oh yeah, syslog it too... */
@@ -542,6 +787,8 @@ log_file_destroy(struct LogFile *lf)
   assert(0 != lf);
 
   if (--lf->ref == 0) {
+    log_flush(); /* no queued line may refer to it */
+
     if (lf->next) /* clip it out of the list */
       lf->next->prev_p = lf->prev_p;
     *lf->prev_p = lf->next;
@@ -1069,3 +1316,33 @@ log_feature_report(struct Client *to, int flag)
     send_reply(to, SND_EXPLICIT | RPL_STATSFLINE, "F LOG %s",
 	       log_fac_name(logInfo.facility));
 }
+
+/** Report the queue of the log writer thread.
+ * @param[in] to Client requesting statistics.
+ * @param[in] sd Stats descriptor for request (ignored).
+ * @param[in] param Extra parameter from user (ignored).
+ */
+void
+log_report(struct Client *to, const struct StatDesc *sd, char *param)
+{
+#ifdef LOG_THREADED
+  unsigned long head, written, batches;
+
+  if (logQueue.running) {
+    head = __atomic_load_n(&logQueue.head, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&logQueue.lock);
+    written = logQueue.written;
+    batches = logQueue.batches;
+    pthread_mutex_unlock(&logQueue.lock);
+
+    send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+	       ":Log queue Depth=%lu/%d MaxDepth=%lu Written=%lu Writes=%lu "
+	       "Dropped=%lu", head - written, LOG_QUEUE_SIZE,
+	       __atomic_load_n(&logQueue.maxdepth, __ATOMIC_RELAXED), written,
+	       batches, __atomic_load_n(&logQueue.dropped, __ATOMIC_RELAXED));
+    return;
+  }
+#endif
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+	     ":Log files are written without a log writer thread");
+}
@@ -0,0 +1,401 @@
+/*
+ * IRC-Hispano IRC Daemon, ircd/ircd_maskidx.c
+ *
+ * Copyright (C) 1997-2019 IRC-Hispano Development Team <toni@tonigarcia.es>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/** @file
+ * @brief Index of host masks.
+ *
+ * A host mask whose last wildcard is followed by a literal part
+ * containing a dot, such as "*.example.com" or "dsl*.isp.net", can
+ * only match hosts ending in that part.  These masks are hashed by the
+ * literal part from its first dot (".example.com" and ".isp.net"), so
+ * a lookup hashes each domain suffix of the host and only compares the
+ * masks of those buckets.
+ */
+#include "config.h"
+
+#include "ircd_maskidx.h"
+#include "ircd_alloc.h"
+#include "ircd_chattr.h"
+#include "ircd_string.h"
+#include "match.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include "ircd_log.h"
+#include <string.h>
+
+/** Initial length of the hash of an index. */
+#define MASKIDX_HASH_MIN  256
+/** Maximum number of domain suffixes hashed in a lookup; longer
+ * hosts are compared with every hashed mask. */
+#define MASKIDX_PROBES    32
+
+/** Hash a string ignoring case.
+ * @param[in] str String to hash.
+ * @return Hash value.
+ */
+static unsigned int
+maskidx_hash(const char *str)
+{
+  unsigned int hashv = 2166136261u;
+
+  while (*str)
+    hashv = (hashv ^ (unsigned char)ToLower(*str++)) * 16777619u;
+  return hashv;
+}
+
+/** Find the key of a host mask.
+ * @param[in] mask Host mask.
+ * @param[out] kind MASK_KIND_EXACT, MASK_KIND_SUFFIX or MASK_KIND_OTHER.
+ * @return Key of the mask, or NULL for MASK_KIND_OTHER.
+ */
+static const char *
+maskidx_key(const char *mask, enum MaskKind *kind)
+{
+  const char *tail = NULL, *s;
+
+  for (s = mask; *s; s++)
+    if (*s == '*' || *s == '?' || *s == '\\')
+      tail = s + 1;
+
+  if (!tail) {
+    *kind = MASK_KIND_EXACT;
+    return mask;
+  }
+
+  if ((s = strchr(tail, '.')) && s[1]) {
+    *kind = MASK_KIND_SUFFIX;
+    return s;
+  }
+
+  *kind = MASK_KIND_OTHER;
+  return NULL;
+}
+
+/** Link an entry at the head of a list.
+ * @param[in] head Head of the list.
+ * @param[in] entry Entry to link.
+ */
+static void
+maskidx_link(struct MaskEntry **head, struct MaskEntry *entry)
+{
+  entry->next = *head;
+  entry->prev_p = head;
+  if (*head)
+    (*head)->prev_p = &entry->next;
+  *head = entry;
+}
+
+/** Double the length of the hash of an index.
+ * @param[in] idx Index to grow.
+ */
+static void
+maskidx_grow(struct MaskIndex *idx)
+{
+  struct MaskEntry **old = idx->hash, *entry, *next;
+  unsigned int old_len = idx->hash_len, i;
+
+  idx->hash_len = old_len ? old_len * 2 : MASKIDX_HASH_MIN;
+  idx->hash = (struct MaskEntry **) MyCalloc(idx->hash_len, sizeof(struct MaskEntry *));
+
+  for (i = 0; i < old_len; i++) {
+    for (entry = old[i]; entry; entry = next) {
+      next = entry->next;
+      maskidx_link(&idx->hash[entry->hashv & (idx->hash_len - 1)], entry);
+    }
+  }
+  MyFree(old);
+}
+
+/** Add a mask to an index.
+ * @param[in] idx Index to add to.
+ * @param[in] entry Entry for the mask, owned by the caller.
+ * @param[in] mask Host mask; it must live while it is indexed.
+ * @param[in] addr Address of the mask if it is an IP mask, else NULL.
+ * @param[in] bits Length of the IP mask.
+ * @param[in] data Value for the data field of the entry.
+ */
+void
+maskidx_add(struct MaskIndex *idx, struct MaskEntry *entry, const char *mask,
+            const struct irc_in_addr *addr, unsigned char bits, void *data)
+{
+  const char *key;
+
+  assert(0 != mask);
+
+  entry->mask = mask;
+  entry->data = data;
+  entry->seq = ++idx->seq;
+  entry->node = NULL;
+  entry->hashv = 0;
+  idx->count++;
+
+  if (addr) {
+    entry->kind = MASK_KIND_IP;
+    entry->node = radix_insert(&idx->ip, addr, bits);
+    maskidx_link((struct MaskEntry **) &radix_data(entry->node), entry);
+    return;
+  }
+
+  if (!(key = maskidx_key(mask, &entry->kind))) {
+    maskidx_link(&idx->other, entry);
+    idx->others++;
+    return;
+  }
+
+  if (idx->hashed >= idx->hash_len * 2)
+    maskidx_grow(idx);
+
+  entry->hashv = maskidx_hash(key);
+  maskidx_link(&idx->hash[entry->hashv & (idx->hash_len - 1)], entry);
+  idx->hashed++;
+}
+
+/** Remove a mask from an index.
+ * @param[in] idx Index holding the entry.
+ * @param[in] entry Entry of the mask.
+ */
+void
+maskidx_del(struct MaskIndex *idx, struct MaskEntry *entry)
+{
+  assert(0 != entry->prev_p);
+
+  *entry->prev_p = entry->next;
+  if (entry->next)
+    entry->next->prev_p = entry->prev_p;
+  entry->prev_p = NULL;
+  entry->next = NULL;
+  idx->count--;
+
+  switch (entry->kind) {
+  case MASK_KIND_IP:
+    if (!radix_data(entry->node))
+      radix_remove(&idx->ip, entry->node);
+    entry->node = NULL;
+    break;
+  case MASK_KIND_OTHER:
+    idx->others--;
+    break;
+  default:
+    idx->hashed--;
+    break;
+  }
+}
+
+/** State of a walk of the IP masks of an index. */
+struct MaskWalk {
+  struct MaskIndex *idx;   /**< Index being searched. */
+  maskidx_f         fn;    /**< Function to call. */
+  void             *data;  /**< Extra argument for \a fn. */
+};
+
+/** Call the function of a lookup for the entries of a prefix.
+ * @param[in] node Prefix containing the address.
+ * @param[in] data Walk state.
+ * @return Non-zero to stop the lookup.
+ */
+static int
+maskidx_walk_ip(struct RadixNode *node, void *data)
+{
+  struct MaskWalk *walk = data;
+  struct MaskEntry *entry, *next;
+  int res;
+
+  for (entry = radix_data(node); entry; entry = next) {
+    next = entry->next;
+    walk->idx->checks++;
+    if ((res = walk->fn(entry, walk->data)))
+      return res;
+  }
+  return 0;
+}
+
+/** Call a function for the masks of a list matching a host.
+ * @param[in] idx Index being searched.
+ * @param[in] entry First entry of the list.
+ * @param[in] host Host to match.
+ * @param[in] fn Function to call.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+static int
+maskidx_match_list(struct MaskIndex *idx, struct MaskEntry *entry,
+                   const char *host, maskidx_f fn, void *data)
+{
+  struct MaskEntry *next;
+  int res;
+
+  for (; entry; entry = next) {
+    next = entry->next;
+    idx->checks++;
+    if (!match(entry->mask, host) && (res = fn(entry, data)))
+      return res;
+  }
+  return 0;
+}
+
+/** Call a function for every mask of an index matching a client.
+ * IP masks are compared with \a addr only, and the other masks with
+ * \a host only.
+ * @param[in] idx Index to search.
+ * @param[in] host Host name of the client, or NULL.
+ * @param[in] addr IP address of the client, or NULL.
+ * @param[in] fn Function to call for each matching mask.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int
+maskidx_match(struct MaskIndex *idx, const char *host,
+              const struct irc_in_addr *addr, maskidx_f fn, void *data)
+{
+  unsigned int probes[MASKIDX_PROBES];
+  unsigned int nprobes = 0, bucket, i;
+  const char *s;
+  int res;
+
+  idx->lookups++;
+
+  if (addr && idx->ip.head) {
+    struct MaskWalk walk;
+
+    walk.idx = idx;
+    walk.fn = fn;
+    walk.data = data;
+    if ((res = radix_walk_covering(&idx->ip, addr, maskidx_walk_ip, &walk)))
+      return res;
+  }
+
+  if (!host)
+    return 0;
+
+  for (s = host, i = 1; (s = strchr(s, '.')); s++)
+    i++;
+
+  if (idx->hashed && i > MASKIDX_PROBES) {
+    /* Too many suffixes to remember them, compare every hashed mask */
+    for (bucket = 0; bucket < idx->hash_len; bucket++)
+      if ((res = maskidx_match_list(idx, idx->hash[bucket], host, fn, data)))
+        return res;
+  } else if (idx->hashed) {
+    /* The host itself, then each suffix starting with a dot */
+    for (s = host; s; s = strchr(s + 1, '.')) {
+      bucket = maskidx_hash(s) & (idx->hash_len - 1);
+      for (i = 0; i < nprobes; i++)
+        if (probes[i] == bucket)
+          break;
+      if (i < nprobes)
+        continue;
+      probes[nprobes++] = bucket;
+
+      if ((res = maskidx_match_list(idx, idx->hash[bucket], host, fn, data)))
+        return res;
+    }
+  }
+
+  return maskidx_match_list(idx, idx->other, host, fn, data);
+}
+
+/** Call a function for the entries of an index with a given mask.
+ * @param[in] idx Index to search.
+ * @param[in] mask Mask to look up, compared without case.
+ * @param[in] addr Address of the mask if it is an IP mask, else NULL.
+ * @param[in] bits Length of the IP mask.
+ * @param[in] fn Function to call for each entry.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int
+maskidx_exact(struct MaskIndex *idx, const char *mask,
+              const struct irc_in_addr *addr, unsigned char bits,
+              maskidx_f fn, void *data)
+{
+  struct MaskEntry *entry, *next;
+  struct RadixNode *node;
+  enum MaskKind kind;
+  const char *key;
+  int res;
+
+  idx->lookups++;
+
+  if (addr) {
+    if (!(node = radix_find(&idx->ip, addr, bits)))
+      return 0;
+    entry = radix_data(node);
+  } else if (!(key = maskidx_key(mask, &kind)))
+    entry = idx->other;
+  else if (!idx->hashed)
+    return 0;
+  else
+    entry = idx->hash[maskidx_hash(key) & (idx->hash_len - 1)];
+
+  for (; entry; entry = next) {
+    next = entry->next;
+    idx->checks++;
+    if (!ircd_strcmp(entry->mask, mask) && (res = fn(entry, data)))
+      return res;
+  }
+  return 0;
+}
+
+/** Mark the entries of a prefix as not indexed.
+ * @param[in] node Prefix of the index.
+ * @param[in] data Not used.
+ * @return Zero to continue the walk.
+ */
+static int
+maskidx_clear_node(struct RadixNode *node, void *data)
+{
+  struct MaskEntry *entry;
+
+  for (entry = radix_data(node); entry; entry = entry->next)
+    entry->prev_p = NULL;
+  return 0;
+}
+
+/** Forget all the entries of an index.
+ * The entries are marked as not indexed; their memory belongs to the
+ * caller.
+ * @param[in] idx Index to clear.
+ */
+void
+maskidx_clear(struct MaskIndex *idx)
+{
+  struct MaskEntry *entry, *next;
+  unsigned int i;
+
+  for (i = 0; i < idx->hash_len; i++)
+    for (entry = idx->hash[i]; entry; entry = next) {
+      next = entry->next;
+      entry->prev_p = NULL;
+    }
+  for (entry = idx->other; entry; entry = next) {
+    next = entry->next;
+    entry->prev_p = NULL;
+  }
+  if (idx->ip.head)
+    radix_walk_within(&idx->ip, &idx->ip.head->prefix, 0,
+                      maskidx_clear_node, NULL);
+
+  MyFree(idx->hash);
+  radix_clear(&idx->ip);
+  idx->hash = NULL;
+  idx->hash_len = 0;
+  idx->other = NULL;
+  idx->count = idx->hashed = idx->others = 0;
+}
@@ -0,0 +1,400 @@
+/*
+ * IRC-Hispano IRC Daemon, ircd/ircd_radix.c
+ *
+ * Copyright (C) 1997-2019 IRC-Hispano Development Team <toni@tonigarcia.es>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/** @file
+ * @brief Radix tree of IP address prefixes.
+ *
+ * The tree is path compressed: a node tests the bit of the address
+ * just after its prefix, and the bits between a node and its children
+ * are skipped.  Lookups therefore cost at most one node per distinct
+ * prefix length on the path instead of one node per bit.
+ */
+#include "config.h"
+
+#include "ircd_radix.h"
+#include "ircd_alloc.h"
+#include "match.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include "ircd_log.h"
+#include <string.h>
+
+/** Get bit \a n (0 is the most significant) of an address. */
+#define radix_bit(addr, n) \
+  ((ntohs((addr)->in6_16[(n) >> 4]) >> (15 - ((n) & 15))) & 1)
+
+/** Copy an address clearing the bits past the prefix length.
+ * @param[out] out Masked address.
+ * @param[in] addr Address to mask.
+ * @param[in] bits Length of the prefix.
+ */
+static void
+radix_mask(struct irc_in_addr *out, const struct irc_in_addr *addr,
+           unsigned char bits)
+{
+  int k;
+
+  for (k = 0; k < 8; k++) {
+    if (bits >= 16) {
+      out->in6_16[k] = addr->in6_16[k];
+      bits -= 16;
+    } else if (bits) {
+      out->in6_16[k] = htons(ntohs(addr->in6_16[k]) & (0xffff << (16 - bits)));
+      bits = 0;
+    } else
+      out->in6_16[k] = 0;
+  }
+}
+
+/** Check whether the first \a bits bits of two addresses are equal.
+ * @param[in] addr First address.
+ * @param[in] prefix Second address.
+ * @param[in] bits Number of bits to compare.
+ * @return Non-zero if they are equal.
+ */
+static int
+radix_match(const struct irc_in_addr *addr, const struct irc_in_addr *prefix,
+            unsigned char bits)
+{
+  return !bits || ipmask_check(addr, prefix, bits);
+}
+
+/** Allocate a node for a prefix.
+ * @param[in] tree Tree that will hold the node.
+ * @param[in] addr Address of the prefix.
+ * @param[in] bits Length of the prefix.
+ * @return New node, not linked to the tree.
+ */
+static struct RadixNode *
+radix_node_new(struct RadixTree *tree, const struct irc_in_addr *addr,
+               unsigned char bits)
+{
+  struct RadixNode *node;
+
+  node = (struct RadixNode *) MyCalloc(1, sizeof(struct RadixNode));
+  radix_mask(&node->prefix, addr, bits);
+  node->bits = bits;
+  tree->nodes++;
+  return node;
+}
+
+/** Put \a node in the place of \a old below the parent of \a old.
+ * @param[in] tree Tree holding the nodes.
+ * @param[in] old Node being replaced.
+ * @param[in] node Replacement.
+ */
+static void
+radix_replace(struct RadixTree *tree, struct RadixNode *old,
+              struct RadixNode *node)
+{
+  struct RadixNode *parent = old->parent;
+
+  node->parent = parent;
+  if (!parent)
+    tree->head = node;
+  else if (parent->child[1] == old)
+    parent->child[1] = node;
+  else
+    parent->child[0] = node;
+}
+
+/** Insert a prefix in a tree.
+ * If the prefix is already in the tree, its node is returned; the
+ * caller may tell the cases apart by radix_data() of the node.
+ * @param[in] tree Tree to insert into.
+ * @param[in] addr Address of the prefix.
+ * @param[in] bits Length of the prefix (0 to 128).
+ * @return Node of the prefix.
+ */
+struct RadixNode *
+radix_insert(struct RadixTree *tree, const struct irc_in_addr *addr,
+             unsigned char bits)
+{
+  struct RadixNode *node, *fresh, *glue;
+  unsigned char check, differ;
+
+  assert(bits <= 128);
+
+  if (!(node = tree->head)) {
+    node = tree->head = radix_node_new(tree, addr, bits);
+    node->flags |= RADIX_USED;
+    tree->count++;
+    return node;
+  }
+
+  /* Go down to the node sharing the longest path with the prefix */
+  while (node->bits < bits || !(node->flags & RADIX_USED)) {
+    struct RadixNode *next;
+
+    if (node->bits >= 128)
+      break;
+    next = node->child[radix_bit(addr, node->bits)];
+    if (!next)
+      break;
+    node = next;
+  }
+
+  /* First bit where the prefix and that node differ */
+  check = node->bits < bits ? node->bits : bits;
+  for (differ = 0; differ < check; differ++)
+    if (radix_bit(addr, differ) != radix_bit(&node->prefix, differ))
+      break;
+
+  /* The new node goes below the deepest ancestor not past that bit */
+  while (node->parent && node->parent->bits >= differ)
+    node = node->parent;
+
+  if (differ == bits && node->bits == bits) {
+    if (!(node->flags & RADIX_USED)) {
+      node->flags |= RADIX_USED;
+      tree->count++;
+    }
+    return node;
+  }
+
+  fresh = radix_node_new(tree, addr, bits);
+  fresh->flags |= RADIX_USED;
+  tree->count++;
+
+  if (node->bits == differ) {
+    /* Child of node */
+    fresh->parent = node;
+    node->child[radix_bit(addr, node->bits)] = fresh;
+  } else if (bits == differ) {
+    /* Parent of node */
+    radix_replace(tree, node, fresh);
+    fresh->child[radix_bit(&node->prefix, bits)] = node;
+    node->parent = fresh;
+  } else {
+    /* Sibling of node below a new branch point */
+    glue = radix_node_new(tree, addr, differ);
+    radix_replace(tree, node, glue);
+    glue->child[radix_bit(addr, differ)] = fresh;
+    glue->child[!radix_bit(addr, differ)] = node;
+    fresh->parent = glue;
+    node->parent = glue;
+  }
+
+  return fresh;
+}
+
+/** Find the node of a prefix.
+ * @param[in] tree Tree to search.
+ * @param[in] addr Address of the prefix.
+ * @param[in] bits Length of the prefix.
+ * @return Node of the prefix, or NULL if it is not in the tree.
+ */
+struct RadixNode *
+radix_find(struct RadixTree *tree, const struct irc_in_addr *addr,
+           unsigned char bits)
+{
+  struct RadixNode *node = tree->head;
+
+  while (node && node->bits < bits)
+    node = node->child[radix_bit(addr, node->bits)];
+
+  if (!node || node->bits != bits || !(node->flags & RADIX_USED)
+      || !radix_match(addr, &node->prefix, bits))
+    return NULL;
+  return node;
+}
+
+/** Find the longest prefix of a tree containing an address.
+ * @param[in] tree Tree to search.
+ * @param[in] addr Address to look up.
+ * @return Most specific node containing \a addr, or NULL.
+ */
+struct RadixNode *
+radix_best(struct RadixTree *tree, const struct irc_in_addr *addr)
+{
+  struct RadixNode *node, *best = NULL;
+
+  for (node = tree->head; node; node = node->child[radix_bit(addr, node->bits)]) {
+    if (!radix_match(addr, &node->prefix, node->bits))
+      break;
+    if (node->flags & RADIX_USED)
+      best = node;
+    if (node->bits >= 128)
+      break;
+  }
+  return best;
+}
+
+/** Call a function for every prefix containing an address.
+ * The prefixes are visited from the shortest to the longest.
+ * @param[in] tree Tree to search.
+ * @param[in] addr Address to look up.
+ * @param[in] fn Function to call for each prefix.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int
+radix_walk_covering(struct RadixTree *tree, const struct irc_in_addr *addr,
+                    radix_walk_f fn, void *data)
+{
+  struct RadixNode *node;
+  int res;
+
+  for (node = tree->head; node; node = node->child[radix_bit(addr, node->bits)]) {
+    if (!radix_match(addr, &node->prefix, node->bits))
+      break;
+    if ((node->flags & RADIX_USED) && (res = fn(node, data)))
+      return res;
+    if (node->bits >= 128)
+      break;
+  }
+  return 0;
+}
+
+/** Call a function for every prefix of a subtree.
+ * @param[in] node Root of the subtree.
+ * @param[in] fn Function to call for each prefix.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+static int
+radix_walk_subtree(struct RadixNode *node, radix_walk_f fn, void *data)
+{
+  int res;
+
+  while (node) {
+    if ((node->flags & RADIX_USED) && (res = fn(node, data)))
+      return res;
+    if (node->child[0] && node->child[1]) {
+      if ((res = radix_walk_subtree(node->child[0], fn, data)))
+        return res;
+      node = node->child[1];
+    } else
+      node = node->child[0] ? node->child[0] : node->child[1];
+  }
+  return 0;
+}
+
+/** Call a function for every prefix inside another one.
+ * This is the reverse of radix_walk_covering(): it visits the
+ * prefixes (and addresses, if they were inserted with 128 bits)
+ * matched by the mask \a addr / \a bits.
+ * @param[in] tree Tree to search.
+ * @param[in] addr Address of the mask.
+ * @param[in] bits Length of the mask.
+ * @param[in] fn Function to call for each prefix.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int
+radix_walk_within(struct RadixTree *tree, const struct irc_in_addr *addr,
+                  unsigned char bits, radix_walk_f fn, void *data)
+{
+  struct RadixNode *node = tree->head;
+
+  while (node && node->bits < bits)
+    node = node->child[radix_bit(addr, node->bits)];
+
+  if (!node || !radix_match(addr, &node->prefix, bits))
+    return 0;
+  return radix_walk_subtree(node, fn, data);
+}
+
+/** Remove a prefix from a tree.
+ * Nodes left without purpose are released; the data of the node is
+ * not touched, the caller must release it first.
+ * @param[in] tree Tree holding the node.
+ * @param[in] node Node returned by radix_insert() or a lookup.
+ */
+void
+radix_remove(struct RadixTree *tree, struct RadixNode *node)
+{
+  struct RadixNode *parent, *child;
+
+  assert(node->flags & RADIX_USED);
+
+  node->flags &= ~RADIX_USED;
+  node->data = NULL;
+  tree->count--;
+
+  /* Still a branch point */
+  if (node->child[0] && node->child[1])
+    return;
+
+  parent = node->parent;
+
+  if (node->child[0] || node->child[1]) {
+    child = node->child[0] ? node->child[0] : node->child[1];
+    radix_replace(tree, node, child);
+    MyFree(node);
+    tree->nodes--;
+    return;
+  }
+
+  if (!parent) {
+    tree->head = NULL;
+    MyFree(node);
+    tree->nodes--;
+    return;
+  }
+
+  if (parent->child[1] == node) {
+    parent->child[1] = NULL;
+    child = parent->child[0];
+  } else {
+    parent->child[0] = NULL;
+    child = parent->child[1];
+  }
+  MyFree(node);
+  tree->nodes--;
+
+  /* A branch point with only one child is useless */
+  if ((parent->flags & RADIX_USED) || !child)
+    return;
+
+  radix_replace(tree, parent, child);
+  MyFree(parent);
+  tree->nodes--;
+}
+
+/** Release all the nodes of a subtree.
+ * @param[in] node Root of the subtree.
+ */
+static void
+radix_free_subtree(struct RadixNode *node)
+{
+  struct RadixNode *next;
+
+  while (node) {
+    if (node->child[0] && node->child[1])
+      radix_free_subtree(node->child[0]);
+    next = node->child[1] ? node->child[1] : node->child[0];
+    MyFree(node);
+    node = next;
+  }
+}
+
+/** Remove all the prefixes of a tree.
+ * The data of the nodes is not touched.
+ * @param[in] tree Tree to empty.
+ */
+void
+radix_clear(struct RadixTree *tree)
+{
+  radix_free_subtree(tree->head);
+  tree->head = NULL;
+  tree->count = 0;
+  tree->nodes = 0;
+}
@@ -112,5 +112,71 @@ int send_reply(struct Client *to, int reply, ...)
   return 0; /* convenience return */
 }
 
+/** Format the text of a numeric reply once, to be sent to many clients.
+ * The text is cut so the reply fits in a line for any nick.
+ * @param[in] reply Numeric of the reply.
+ * @return MsgBuf for send_reply_shared(), released with msgq_clean().
+ */
+struct MsgBuf *reply_body(int reply, ...)
+{
+  struct VarData vd;
+  const struct Numeric *num;
+  char body[BUFSIZE];
+  size_t len;
+
+  assert(0 != reply);
+
+  num = get_error_numeric(reply & ~SND_EXPLICIT);
+
+  va_start(vd.vd_args, reply);
+
+  if (reply & SND_EXPLICIT)
+    vd.vd_format = (const char *) va_arg(vd.vd_args, char *);
+  else
+    vd.vd_format = num->format;
+
+  assert(0 != vd.vd_format);
+
+  /* leave room for ":<server> <numeric> <nick>" and \r\n */
+  len = BUFSIZE - 2 - (strlen(cli_name(&me)) + 6 + NICKLEN);
+  ircd_snprintf(0, body, len + 1, " %v", &vd);
+
+  va_end(vd.vd_args);
 
+  return msgq_make(0, "%s", body);
+}
 
+/** Send numeric replies whose texts were made by reply_body().
+ * The result is the same as calling send_reply() for each text, but
+ * only the start of the replies is formatted for \a to.  Each reply
+ * is queued as one buffer, so no other message can be written in the
+ * middle of it.
+ * @param[in] to Client that wants the replies.
+ * @param[in] reply Numeric of the replies.
+ * @param[in] bodies Texts of the replies.
+ * @param[in] count Number of entries in \a bodies.
+ * @return Zero.
+ */
+int send_reply_shared(struct Client *to, int reply,
+                      struct MsgBuf * const *bodies, int count)
+{
+  struct MsgBuf *mb;
+  const struct Numeric *num;
+  int i;
+
+  assert(0 != to);
+  assert(0 != reply);
+
+  num = get_error_numeric(reply & ~SND_EXPLICIT);
+
+  for (i = 0; i < count; i++) {
+    mb = msgq_make_body(cli_from(to), bodies[i], "%:#C %s %C", &me,
+                        num->str, to);
+
+    send_buffer(to, mb, 0);
+
+    msgq_clean(mb);
+  }
+
+  return 0; /* convenience return */
+}
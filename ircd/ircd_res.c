@@ -44,6 +44,7 @@
  */
 #include "client.h"
 #include "ircd_alloc.h"
+#include "ircd_chattr.h"
 #include "ircd_log.h"
 #include "ircd_osdep.h"
 #include "ircd_reply.h"
@@ -77,6 +78,8 @@ static struct Socket res_socket_v4;
 static struct Socket res_socket_v6;
 /** Next DNS lookup timeout. */
 static struct Timer res_timeout;
+/** Delivery of the answers found in the cache. */
+static struct Timer res_answer;
 /** Local address for IPv4 DNS lookups. */
 struct irc_sockaddr VirtualHost_dns_v4;
 /** Local address for IPv6 DNS lookups. */
@@ -89,6 +92,10 @@ struct irc_sockaddr VirtualHost_dns_v6;
  */
 #define MAXPACKET      1024
 #define AR_TTL         600   /**< TTL in seconds for dns cache entries */
+/** Number of buckets of the DNS cache hash table (a power of two). */
+#define CACHE_HASH_SIZE 4096
+/** Number of buckets of the pending request hash tables (a power of two). */
+#define RES_HASH_SIZE   1024
 
 /* RFC 1104/1105 wasn't very helpful about what these fields
  * should be named, so for now, we'll just name them this way.
@@ -123,13 +130,24 @@ struct dlink
     struct dlink *next; /**< Next element in list. */
 };
 
+/** Another lookup waiting for the answer of a request. */
+struct res_waiter
+{
+  struct res_waiter *next; /**< Next waiter of the request. */
+  dns_callback_f callback; /**< Callback function on completion. */
+  void *callback_ctx;      /**< Context pointer for callback. */
+};
+
 /** A single resolver request.
  * (Do not be fooled by the "list" in the name.)
  */
 struct reslist
 {
   struct dlink node;       /**< Doubly linked list node. */
-  int id;                  /**< Request ID (from request header). */
+  struct reslist *idnext;  /**< Next request in the ID hash chain. */
+  struct reslist *knext;   /**< Next request in the lookup hash chain. */
+  unsigned int hashv;      /**< Hash of the name or address looked up. */
+  int id;                  /**< Request ID (from request header), or -1. */
   int sent;                /**< Number of requests sent. */
   request_state state;     /**< State the resolver machine is in. */
   char type;               /**< Current request type. */
@@ -140,12 +158,53 @@ struct reslist
   time_t timeout;          /**< When this request times out. */
   struct irc_in_addr addr; /**< Address for this request. */
   char *name;              /**< Hostname for this request. */
+  char qtype;              /**< Type of the first query, for the cache. */
+  unsigned long ttl;       /**< Lowest TTL of the records in the answer. */
   dns_callback_f callback; /**< Callback function on completion. */
   void *callback_ctx;      /**< Context pointer for callback. */
+  struct res_waiter *waiters; /**< Identical lookups made meanwhile. */
+};
+
+/** A DNS answer kept in the cache.
+ * PTR answers are found by address, forward answers by name and by the
+ * type of the first query made for them.
+ */
+struct cache_entry
+{
+  struct dlink lru;          /**< Node in the LRU list (must be first). */
+  struct cache_entry *hnext; /**< Next entry in the hash chain. */
+  unsigned int hashv;        /**< Hash of the key of the entry. */
+  time_t expire;             /**< When the answer is too old to use. */
+  char type;                 /**< T_PTR, T_A or T_AAAA. */
+  char negative;             /**< Non-zero if the lookup failed. */
+  struct irc_in_addr addr;   /**< Address looked up (PTR) or found. */
+  char name[HOSTLEN + 1];    /**< Name found (PTR) or looked up. */
 };
 
 /** Base of request list. */
 static struct dlink request_list;
+/** Answers from the cache waiting to be delivered. */
+static struct dlink answer_list;
+/** Entries of the DNS cache, most recently used first. */
+static struct dlink cache_lru;
+/** Hash table of the DNS cache. */
+static struct cache_entry *cache_table[CACHE_HASH_SIZE];
+/** Number of entries in the DNS cache. */
+static unsigned int cache_count;
+/** Lookups answered by the DNS cache. */
+static unsigned long cache_hits;
+/** Lookups answered by a failure in the DNS cache. */
+static unsigned long cache_neghits;
+/** Lookups not found in the DNS cache. */
+static unsigned long cache_misses;
+/** Pending requests by request ID. */
+static struct reslist *id_table[RES_HASH_SIZE];
+/** Pending requests by name or address looked up. */
+static struct reslist *pending_table[RES_HASH_SIZE];
+/** Queries sent to the nameservers. */
+static unsigned long res_sent;
+/** Lookups that joined an identical pending request. */
+static unsigned long res_coalesced;
 
 static void rem_request(struct reslist *request);
 static struct reslist *make_request(dns_callback_f callback, void *ctx);
@@ -160,6 +219,8 @@ static int send_res_msg(const char *buf, int len, int count);
 static void resend_query(struct reslist *request);
 static int proc_answer(struct reslist *request, HEADER *header, char *, char *);
 static struct reslist *find_id(int id);
+static void id_del(struct reslist *request);
+static void pending_del(struct reslist *request);
 static void res_readreply(struct Event *ev);
 static void timeout_resolver(struct Event *notused);
 
@@ -209,6 +270,10 @@ restart_resolver(void)
 
   if (!request_list.next)
     request_list.next = request_list.prev = &request_list;
+  if (!answer_list.next)
+    answer_list.next = answer_list.prev = &answer_list;
+  if (!cache_lru.next)
+    cache_lru.next = cache_lru.prev = &cache_lru;
 
   /* Check which address family (or families) our nameservers use. */
   for (need_v4 = need_v6 = ns = 0; ns < irc_nscount; ns++)
@@ -238,9 +303,6 @@ restart_resolver(void)
                  SS_DATAGRAM, SOCK_EVENT_READABLE, fd);
   }
 #endif
-
-  if (s_active(&res_socket_v4) || s_active(&res_socket_v6))
-    timer_init(&res_timeout);
 }
 
 /** Append local domain to hostname if needed.
@@ -281,16 +343,34 @@ add_dlink(struct dlink *node, struct dlink *next)
     node->next->prev = node;
 }
 
+/** Remove a node from a doubly linked list.
+ * @param[in,out] node Node to remove.
+ */
+static void
+rem_dlink(struct dlink *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+}
+
 /** Remove a request from the list and free it.
  * @param[in] request Node to free.
  */
 static void
 rem_request(struct reslist *request)
 {
-  /* remove from dlist */
-  request->node.prev->next = request->node.next;
-  request->node.next->prev = request->node.prev;
+  struct res_waiter *waiter;
+
+  /* remove from dlist and hash tables */
+  rem_dlink(&request->node);
+  id_del(request);
+  pending_del(request);
   /* free memory */
+  while ((waiter = request->waiters))
+  {
+    request->waiters = waiter->next;
+    MyFree(waiter);
+  }
   MyFree(request->name);
   MyFree(request);
 }
@@ -310,11 +390,13 @@ make_request(dns_callback_f callback, void *ctx)
   request = (struct reslist *)MyMalloc(sizeof(struct reslist));
   memset(request, 0, sizeof(struct reslist));
 
+  request->id      = -1;
   request->state   = REQ_IDLE;
   request->sentat  = CurrentTime;
   request->retries = feature_int(FEAT_IRCD_RES_RETRIES);
   request->resend  = 1;
   request->timeout = feature_int(FEAT_IRCD_RES_TIMEOUT);
+  request->ttl     = ~0UL;
   memset(&request->addr, 0, sizeof(request->addr));
   request->callback = callback;
   request->callback_ctx = ctx;
@@ -323,6 +405,330 @@ make_request(dns_callback_f callback, void *ctx)
   return(request);
 }
 
+/** Hash the key of a PTR answer.
+ * @param[in] addr Address looked up.
+ * @return Hash value of the key.
+ */
+static unsigned int
+cache_hash_addr(const struct irc_in_addr *addr)
+{
+  unsigned int hashv = T_PTR, ii;
+
+  for (ii = 0; ii < 8; ii++)
+    hashv = (hashv * 31) ^ addr->in6_16[ii];
+  return hashv ^ (hashv >> 13);
+}
+
+/** Hash the key of a forward answer.
+ * @param[in] name Name looked up.
+ * @param[in] type Type of the first query for \a name.
+ * @return Hash value of the key.
+ */
+static unsigned int
+cache_hash_name(const char *name, int type)
+{
+  unsigned int hashv = type;
+
+  for (; *name; name++)
+    hashv = (hashv * 31) ^ ToLower(*name);
+  return hashv ^ (hashv >> 13);
+}
+
+/** Add a request to the hash table of pending lookups.
+ * Its qtype and name (or address for T_PTR) must be set.
+ * @param[in] request Request to add.
+ */
+static void
+pending_add(struct reslist *request)
+{
+  struct reslist **bucket;
+
+  if (request->qtype == T_PTR)
+    request->hashv = cache_hash_addr(&request->addr);
+  else
+    request->hashv = cache_hash_name(request->name, request->qtype);
+  bucket = &pending_table[request->hashv & (RES_HASH_SIZE - 1)];
+  request->knext = *bucket;
+  *bucket = request;
+}
+
+/** Remove a request from the hash table of pending lookups, if there.
+ * @param[in] request Request to remove.
+ */
+static void
+pending_del(struct reslist *request)
+{
+  struct reslist **prev_p;
+
+  for (prev_p = &pending_table[request->hashv & (RES_HASH_SIZE - 1)];
+       *prev_p; prev_p = &(*prev_p)->knext)
+    if (*prev_p == request)
+    {
+      *prev_p = request->knext;
+      break;
+    }
+}
+
+/** Find a pending request for the same lookup.
+ * @param[in] type T_PTR to find \a addr, otherwise the type of the
+ *   first query for \a name.
+ * @param[in] addr Address looked up, for T_PTR.
+ * @param[in] name Name looked up, for T_A or T_AAAA.
+ * @return Pending request, or NULL if there is none.
+ */
+static struct reslist *
+pending_find(int type, const struct irc_in_addr *addr, const char *name)
+{
+  struct reslist *request;
+  unsigned int hashv;
+
+  hashv = (type == T_PTR) ? cache_hash_addr(addr) : cache_hash_name(name, type);
+  for (request = pending_table[hashv & (RES_HASH_SIZE - 1)]; request;
+       request = request->knext)
+    if (request->hashv == hashv && request->qtype == type
+        && ((type == T_PTR) ? !irc_in_addr_cmp(&request->addr, addr)
+            : !ircd_strcmp(request->name, name)))
+      return request;
+  return NULL;
+}
+
+/** Make a lookup wait for the answer of an identical pending request.
+ * @param[in] request Pending request.
+ * @param[in] callback Callback function of the lookup.
+ * @param[in] ctx Context pointer for callback.
+ */
+static void
+pending_join(struct reslist *request, dns_callback_f callback, void *ctx)
+{
+  struct res_waiter *waiter;
+
+  res_coalesced++;
+  Debug((DEBUG_DNS, "Lookup for %p joins request %p", ctx, request));
+  if (!request->callback)
+  {
+    /* the first lookup went away, take its place */
+    request->callback = callback;
+    request->callback_ctx = ctx;
+    return;
+  }
+  waiter = (struct res_waiter *)MyMalloc(sizeof(struct res_waiter));
+  waiter->callback = callback;
+  waiter->callback_ctx = ctx;
+  waiter->next = request->waiters;
+  request->waiters = waiter;
+}
+
+/** Pass the answer of a request to every lookup waiting for it.
+ * The request leaves the pending lookups first, so the lookups made by
+ * the callbacks do not join it.
+ * @param[in] request Finished request.
+ * @param[in] addr Address found, or NULL.
+ * @param[in] name Name found, or NULL.
+ */
+static void
+res_notify(struct reslist *request, const struct irc_in_addr *addr,
+           const char *name)
+{
+  struct res_waiter *waiter;
+  dns_callback_f callback;
+
+  pending_del(request);
+  if ((callback = request->callback))
+  {
+    request->callback = NULL;
+    (*callback)(request->callback_ctx, addr, name);
+  }
+  while ((waiter = request->waiters))
+  {
+    request->waiters = waiter->next;
+    (*waiter->callback)(waiter->callback_ctx, addr, name);
+    MyFree(waiter);
+  }
+}
+
+/** Remove an entry from the DNS cache and free it.
+ * @param[in] entry Entry to free.
+ */
+static void
+cache_del(struct cache_entry *entry)
+{
+  struct cache_entry **prev_p;
+
+  for (prev_p = &cache_table[entry->hashv & (CACHE_HASH_SIZE - 1)];
+       *prev_p != entry; prev_p = &(*prev_p)->hnext)
+    assert(*prev_p != NULL);
+  *prev_p = entry->hnext;
+  rem_dlink(&entry->lru);
+  cache_count--;
+  MyFree(entry);
+}
+
+/** Drop the least recently used entries over IRCD_RES_CACHE_SIZE. */
+void
+resolver_cache_trim(void)
+{
+  while (cache_count > 0
+         && cache_count > (unsigned int)feature_int(FEAT_IRCD_RES_CACHE_SIZE))
+    cache_del((struct cache_entry *)cache_lru.prev);
+}
+
+/** Find an answer in the DNS cache.
+ * Stale entries are dropped, the one found becomes the most recently used.
+ * @param[in] type T_PTR to find \a addr, otherwise the type of the
+ *   first query for \a name.
+ * @param[in] addr Address looked up, for T_PTR.
+ * @param[in] name Name looked up, for T_A or T_AAAA.
+ * @return Cached answer, or NULL if there is none.
+ */
+static struct cache_entry *
+cache_find(int type, const struct irc_in_addr *addr, const char *name)
+{
+  struct cache_entry *entry, *next;
+  unsigned int hashv;
+
+  if (feature_int(FEAT_IRCD_RES_CACHE_SIZE) <= 0)
+    return NULL;
+
+  hashv = (type == T_PTR) ? cache_hash_addr(addr) : cache_hash_name(name, type);
+  for (entry = cache_table[hashv & (CACHE_HASH_SIZE - 1)]; entry; entry = next)
+  {
+    next = entry->hnext;
+    if (entry->hashv != hashv || entry->type != type)
+      continue;
+    if ((type == T_PTR) ? irc_in_addr_cmp(&entry->addr, addr)
+        : ircd_strcmp(entry->name, name))
+      continue;
+    if (entry->expire <= CurrentTime)
+    {
+      cache_del(entry);
+      break;
+    }
+    /* move it to the head of the LRU list */
+    rem_dlink(&entry->lru);
+    add_dlink(&entry->lru, cache_lru.next);
+    if (entry->negative)
+      cache_neghits++;
+    else
+      cache_hits++;
+    return entry;
+  }
+
+  cache_misses++;
+  return NULL;
+}
+
+/** Keep the result of a lookup in the DNS cache.
+ * @param[in] request Finished request.
+ * @param[in] negative Non-zero if the lookup failed.
+ */
+static void
+cache_add(struct reslist *request, int negative)
+{
+  struct cache_entry *entry;
+  unsigned long ttl;
+  unsigned int hashv;
+
+  if (feature_int(FEAT_IRCD_RES_CACHE_SIZE) <= 0 || !request->name)
+    return;
+
+  if (negative)
+    ttl = feature_int(FEAT_IRCD_RES_CACHE_NEGTTL);
+  else if (request->ttl < (unsigned long)feature_int(FEAT_IRCD_RES_CACHE_MINTTL))
+    ttl = feature_int(FEAT_IRCD_RES_CACHE_MINTTL);
+  else if (request->ttl > (unsigned long)feature_int(FEAT_IRCD_RES_CACHE_MAXTTL))
+    ttl = feature_int(FEAT_IRCD_RES_CACHE_MAXTTL);
+  else
+    ttl = request->ttl;
+  if (ttl == 0)
+    return;
+
+  if (request->qtype == T_PTR)
+    hashv = cache_hash_addr(&request->addr);
+  else
+    hashv = cache_hash_name(request->name, request->qtype);
+
+  /* replace an answer for the same key, as for an expired one */
+  for (entry = cache_table[hashv & (CACHE_HASH_SIZE - 1)]; entry; entry = entry->hnext)
+    if (entry->hashv == hashv && entry->type == request->qtype
+        && ((request->qtype == T_PTR) ? !irc_in_addr_cmp(&entry->addr, &request->addr)
+            : !ircd_strcmp(entry->name, request->name)))
+      break;
+  if (entry)
+    cache_del(entry);
+
+  entry = (struct cache_entry *)MyMalloc(sizeof(struct cache_entry));
+  entry->hashv = hashv;
+  entry->expire = CurrentTime + ttl;
+  entry->type = request->qtype;
+  entry->negative = negative;
+  memcpy(&entry->addr, &request->addr, sizeof(entry->addr));
+  if (negative && request->qtype == T_PTR)
+    entry->name[0] = '\0'; /* the PTR request has no name */
+  else
+    ircd_strncpy(entry->name, request->name, HOSTLEN);
+  entry->hnext = cache_table[hashv & (CACHE_HASH_SIZE - 1)];
+  cache_table[hashv & (CACHE_HASH_SIZE - 1)] = entry;
+  add_dlink(&entry->lru, cache_lru.next);
+  cache_count++;
+
+  resolver_cache_trim();
+}
+
+/** Deliver the answers found in the DNS cache.
+ * Callers do not expect their callback to run before gethost_byname()
+ * or gethost_byaddr() returns, so the answers wait for this timer.
+ * @param[in] ev Timer event data (ignored).
+ */
+static void
+answer_resolver(struct Event *ev)
+{
+  struct reslist *request;
+
+  if (ev_type(ev) != ET_EXPIRE)
+    return;
+
+  /* callbacks may add more answers; they are delivered in this loop */
+  while (answer_list.next != &answer_list)
+  {
+    request = (struct reslist *)answer_list.next;
+    rem_dlink(&request->node);
+    Debug((DEBUG_DNS, "Request %p answered from cache", request));
+    (*request->callback)(request->callback_ctx,
+                         request->name ? &request->addr : NULL, request->name);
+    MyFree(request->name);
+    MyFree(request);
+  }
+}
+
+/** Queue the answer of a lookup found in the DNS cache.
+ * @param[in] callback Callback function of the lookup.
+ * @param[in] ctx Context pointer for callback.
+ * @param[in] entry Cached answer; the address and name given to the
+ *   callback are those of \a entry, or NULL if it is negative.
+ */
+static void
+cache_answer(dns_callback_f callback, void *ctx, struct cache_entry *entry)
+{
+  struct reslist *request;
+
+  if (!resolver_started())
+    restart_resolver();
+
+  request = (struct reslist *)MyMalloc(sizeof(struct reslist));
+  memset(request, 0, sizeof(struct reslist));
+  request->callback = callback;
+  request->callback_ctx = ctx;
+  if (!entry->negative)
+  {
+    memcpy(&request->addr, &entry->addr, sizeof(request->addr));
+    DupString(request->name, entry->name);
+  }
+  add_dlink(&request->node, &answer_list);
+
+  if (!t_onqueue(&res_answer) && !(res_answer.t_header.gh_flags & GEN_MARKED))
+    timer_add(timer_init(&res_answer), answer_resolver, NULL, TT_RELATIVE, 0);
+}
+
 /** Make sure that a timeout event will happen by the given time.
  * @param[in] when Latest time for timeout to run.
  */
@@ -333,9 +739,12 @@ check_resolver_timeout(time_t when)
     when = CurrentTime + AR_TTL;
   /* TODO after 2.10.12: Rewrite the timer API because there should be
    * no need for clients to know this kind of implementation detail. */
-  if (when > t_expire(&res_timeout))
+  /* A queued timer, or one to be queued again after its callback, may
+   * already expire early enough. */
+  if ((t_onqueue(&res_timeout) || (res_timeout.t_header.gh_flags & GEN_READD))
+      && when >= t_value(&res_timeout))
     /* do nothing */;
-  else if (t_onqueue(&res_timeout) && !(res_timeout.t_header.gh_flags & GEN_MARKED))
+  else if (t_onqueue(&res_timeout))
     timer_chg(&res_timeout, TT_ABSOLUTE, when);
   else
     timer_add(&res_timeout, timeout_resolver, NULL, TT_ABSOLUTE, when);
@@ -366,7 +775,8 @@ timeout_resolver(struct Event *ev)
       if (--request->retries <= 0)
       {
         Debug((DEBUG_DNS, "Request %p out of retries; destroying", request));
-        (*request->callback)(request->callback_ctx, NULL, NULL);
+        cache_add(request, 1);
+        res_notify(request, NULL, NULL);
         rem_request(request);
         continue;
       }
@@ -375,6 +785,7 @@ timeout_resolver(struct Event *ev)
         request->sentat = CurrentTime;
         request->timeout += request->timeout;
         resend_query(request);
+        timeout = request->sentat + request->timeout;
       }
     }
 
@@ -399,6 +810,7 @@ delete_resolver_queries(const void *vptr)
 {
   struct dlink *ptr, *next_ptr;
   struct reslist *request;
+  struct res_waiter **wprev_p, *waiter;
 
   if (request_list.next) {
     for (ptr = request_list.next; ptr != &request_list; ptr = next_ptr)
@@ -406,8 +818,29 @@ delete_resolver_queries(const void *vptr)
       next_ptr = ptr->next;
       request = (struct reslist*)ptr;
       if (vptr == request->callback_ctx) {
-        Debug((DEBUG_DNS, "Removing request %p with vptr %p", request, vptr));
-        rem_request(request);
+        /* Let the query go on, so its answer is cached anyway. */
+        Debug((DEBUG_DNS, "Detaching request %p with vptr %p", request, vptr));
+        request->callback = NULL;
+        request->callback_ctx = NULL;
+      }
+      for (wprev_p = &request->waiters; (waiter = *wprev_p); )
+      {
+        if (vptr == waiter->callback_ctx) {
+          *wprev_p = waiter->next;
+          MyFree(waiter);
+        } else
+          wprev_p = &waiter->next;
+      }
+    }
+    for (ptr = answer_list.next; ptr != &answer_list; ptr = next_ptr)
+    {
+      next_ptr = ptr->next;
+      request = (struct reslist*)ptr;
+      if (vptr == request->callback_ctx) {
+        Debug((DEBUG_DNS, "Removing answer %p with vptr %p", request, vptr));
+        rem_dlink(&request->node);
+        MyFree(request->name);
+        MyFree(request);
       }
     }
   }
@@ -448,13 +881,11 @@ send_res_msg(const char *msg, int len, int rcount)
 static struct reslist *
 find_id(int id)
 {
-  struct dlink *ptr;
   struct reslist *request;
 
-  for (ptr = request_list.next; ptr != &request_list; ptr = ptr->next)
+  for (request = id_table[id & (RES_HASH_SIZE - 1)]; request;
+       request = request->idnext)
   {
-    request = (struct reslist*)ptr;
-
     if (request->id == id) {
       Debug((DEBUG_DNS, "find_id(%d) -> %p", id, request));
       return(request);
@@ -465,6 +896,23 @@ find_id(int id)
   return(NULL);
 }
 
+/** Remove a request from the ID hash table, if it has an ID.
+ * @param[in] request Request to remove.
+ */
+static void
+id_del(struct reslist *request)
+{
+  struct reslist **prev_p;
+
+  if (request->id < 0)
+    return;
+  for (prev_p = &id_table[request->id & (RES_HASH_SIZE - 1)];
+       *prev_p != request; prev_p = &(*prev_p)->idnext)
+    assert(*prev_p != NULL);
+  *prev_p = request->idnext;
+  request->id = -1;
+}
+
 /** Try to look up address for a hostname, trying IPv6 (T_AAAA) first.
  * @param[in] name Hostname to look up.
  * @param[in] query Callback information.
@@ -482,7 +930,22 @@ gethost_byname(const char *name, dns_callback_f callback, void *ctx)
 void
 gethost_byaddr(const struct irc_in_addr *addr, dns_callback_f callback, void *ctx)
 {
-  do_query_number(callback, ctx, addr, NULL);
+  struct cache_entry *entry;
+
+  if (!(entry = cache_find(T_PTR, addr, NULL)))
+    do_query_number(callback, ctx, addr, NULL);
+  else if (entry->negative)
+    cache_answer(callback, ctx, entry);
+  else
+  {
+    /* Confirm the cached name as done for a PTR answer. */
+#ifdef IPV6
+    if (!irc_in_addr_is_ipv4(addr))
+      do_query_name(callback, ctx, entry->name, NULL, T_AAAA);
+    else
+#endif
+    do_query_name(callback, ctx, entry->name, NULL, T_A);
+  }
 }
 
 /** Send a query to look up the address for a name.
@@ -502,8 +965,23 @@ do_query_name(dns_callback_f callback, void *ctx, const char *name,
 
   if (request == NULL)
   {
+    struct cache_entry *entry;
+
+    if ((entry = cache_find(type, NULL, host_name)))
+    {
+      cache_answer(callback, ctx, entry);
+      return;
+    }
+    if ((request = pending_find(type, NULL, host_name)))
+    {
+      pending_join(request, callback, ctx);
+      return;
+    }
+
     request       = make_request(callback, ctx);
+    request->qtype = type;
     DupString(request->name, host_name);
+    pending_add(request);
 #ifdef IPV6
     if (type != T_A)
       request->state = REQ_AAAA;
@@ -568,11 +1046,18 @@ do_query_number(dns_callback_f callback, void *ctx, const struct irc_in_addr *ad
   }
   if (request == NULL)
   {
+    if ((request = pending_find(T_PTR, addr, NULL)))
+    {
+      pending_join(request, callback, ctx);
+      return;
+    }
     request       = make_request(callback, ctx);
     request->state= REQ_PTR;
     request->type = T_PTR;
+    request->qtype = T_PTR;
     memcpy(&request->addr, addr, sizeof(request->addr));
     request->name = (char *)MyMalloc(HOSTLEN + 1);
+    pending_add(request);
   }
   Debug((DEBUG_DNS, "Requesting DNS PTR %s as %p", ipbuf, request));
   query_name(ipbuf, C_IN, T_PTR, request);
@@ -604,12 +1089,16 @@ query_name(const char *name, int query_class, int type,
      * network byte order, the nameserver does not interpret this value
      * and returns it unchanged
      */
+    id_del(request); /* a resent query gets a new id */
     do
     {
       header->id = (header->id + ircrandom()) & 0xffff;
     } while (find_id(header->id));
     request->id = header->id;
+    request->idnext = id_table[request->id & (RES_HASH_SIZE - 1)];
+    id_table[request->id & (RES_HASH_SIZE - 1)] = request;
     ++request->sends;
+    ++res_sent;
 
     request->sent += send_res_msg(buf, request_len, request->sends);
     check_resolver_timeout(request->sentat + request->timeout);
@@ -707,8 +1196,10 @@ proc_answer(struct reslist *request, HEADER* header, char* buf, char* eob)
     type = irc_ns_get16(current);
     current += TYPE_SIZE;
 
-    /* We do not use the class or TTL values. */
+    /* We do not use the class value; the lowest TTL is kept for the cache. */
     current += CLASS_SIZE;
+    if (irc_ns_get32(current) < request->ttl)
+      request->ttl = irc_ns_get32(current);
     current += TTL_SIZE;
 
     rd_length = irc_ns_get16(current);
@@ -789,6 +1280,22 @@ proc_answer(struct reslist *request, HEADER* header, char* buf, char* eob)
   return(1);
 }
 
+/** Look up the address of the name found for an address.
+ * @param[in] callback Callback function of the lookup.
+ * @param[in] ctx Context pointer for callback.
+ * @param[in] request PTR request that found the name.
+ */
+static void
+forward_query(dns_callback_f callback, void *ctx, struct reslist *request)
+{
+#ifdef IPV6
+  if (!irc_in_addr_is_ipv4(&request->addr))
+    do_query_name(callback, ctx, request->name, NULL, T_AAAA);
+  else
+#endif
+  do_query_name(callback, ctx, request->name, NULL, T_A);
+}
+
 /** Read a DNS reply from the nameserver and process it.
  * @param[in] ev I/O activity event for resolver socket.
  */
@@ -800,6 +1307,7 @@ res_readreply(struct Event *ev)
   char buf[sizeof(HEADER) + MAXPACKET];
   HEADER *header;
   struct reslist *request = NULL;
+  struct res_waiter *waiter;
   unsigned int rc;
   int answer_count;
 
@@ -841,7 +1349,8 @@ res_readreply(struct Event *ev)
          * send any more (no retries granted).
          */
         Debug((DEBUG_DNS, "Request %p has bad response (state %d type %d rcode %d)", request, request->state, request->type, header->rcode));
-        (*request->callback)(request->callback_ctx, NULL, NULL);
+        cache_add(request, 1);
+        res_notify(request, NULL, NULL);
 	rem_request(request);
     }
     else
@@ -884,7 +1393,7 @@ res_readreply(struct Event *ev)
          * don't bother trying again, the client address doesn't resolve
          */
         Debug((DEBUG_DNS, "Request %p PTR had empty name", request));
-        (*request->callback)(request->callback_ctx, NULL, NULL);
+        res_notify(request, NULL, NULL);
         rem_request(request);
         return;
       }
@@ -893,12 +1402,18 @@ res_readreply(struct Event *ev)
        * Lookup the 'authoritative' name that we were given for the
        * ip#.
        */
-#ifdef IPV6
-      if (!irc_in_addr_is_ipv4(&request->addr))
-        do_query_name(request->callback, request->callback_ctx, request->name, NULL, T_AAAA);
-      else
-#endif
-      do_query_name(request->callback, request->callback_ctx, request->name, NULL, T_A);
+      cache_add(request, 0);
+      pending_del(request);
+      /* Nobody waits for the forward lookup of a detached request; the
+       * lookups of the waiters join the first one. */
+      if (request->callback)
+        forward_query(request->callback, request->callback_ctx, request);
+      while ((waiter = request->waiters))
+      {
+        request->waiters = waiter->next;
+        forward_query(waiter->callback, waiter->callback_ctx, request);
+        MyFree(waiter);
+      }
       Debug((DEBUG_DNS, "Request %p switching to forward resolution", request));
       rem_request(request);
     }
@@ -907,7 +1422,8 @@ res_readreply(struct Event *ev)
       /*
        * got a name and address response, client resolved
        */
-      (*request->callback)(request->callback_ctx, &request->addr, request->name);
+      cache_add(request, 0);
+      res_notify(request, &request->addr, request->name);
       Debug((DEBUG_DNS, "Request %p got forward resolution", request));
       rem_request(request);
     }
@@ -935,12 +1451,23 @@ report_dns_servers(struct Client *source_p, const struct StatDesc *sd, char *par
 {
   int i;
   char ipaddr[128];
+  unsigned long lookups;
 
   for (i = 0; i < irc_nscount; i++)
   {
     ircd_ntoa_r(ipaddr, &irc_nsaddr_list[i].addr);
     send_reply(source_p, RPL_STATSALINE, ipaddr);
   }
+
+  lookups = cache_hits + cache_neghits + cache_misses;
+  send_reply(source_p, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":DNS cache Entries=%u/%d Hits=%lu Negative=%lu Misses=%lu "
+             "HitRate=%lu%%", cache_count,
+             feature_int(FEAT_IRCD_RES_CACHE_SIZE), cache_hits, cache_neghits,
+             cache_misses,
+             lookups ? (cache_hits + cache_neghits) * 100 / lookups : 0);
+  send_reply(source_p, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":DNS queries Sent=%lu Coalesced=%lu", res_sent, res_coalesced);
 }
 
 /** Report memory usage to a client.
@@ -952,6 +1479,7 @@ cres_mem(struct Client* sptr)
 {
   struct dlink *dlink;
   struct reslist *request;
+  struct res_waiter *waiter;
   size_t request_mem   = 0;
   int    request_count = 0;
 
@@ -961,11 +1489,14 @@ cres_mem(struct Client* sptr)
       request_mem += sizeof(*request);
       if (request->name)
         request_mem += strlen(request->name) + 1;
+      for (waiter = request->waiters; waiter; waiter = waiter->next)
+        request_mem += sizeof(*waiter);
       ++request_count;
     }
   }
 
   send_reply(sptr, SND_EXPLICIT | RPL_STATSDEBUG,
-	     ":Resolver: requests %d(%d)", request_count, request_mem);
-  return request_mem;
+	     ":Resolver: requests %d(%d) cache %u(%zu)", request_count,
+	     request_mem, cache_count, cache_count * sizeof(struct cache_entry));
+  return request_mem + cache_count * sizeof(struct cache_entry);
 }
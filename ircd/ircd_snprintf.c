@@ -1515,6 +1515,48 @@ my_strnlen(const char *str, int maxlen)
   return len;
 }
 
+/** Append a string of known length to an output buffer.
+ * The string is copied at once when it fits in the buffer and the
+ * limit; otherwise adds() handles the overflow.
+ * @param[in,out] buf_p Buffer to append to.
+ * @param[in] s_len Length of string to append, without any NUL in it.
+ * @param[in] s String to append.
+ */
+static void
+addn(struct BufData *buf_p, int s_len, const char *s)
+{
+  if ((buf_p->limit < 0 || buf_p->limit >= s_len)
+      && buf_p->buf_loc + s_len <= buf_p->buf_size) {
+    memcpy(buf_p->buf + buf_p->buf_loc, s, s_len);
+    buf_p->buf_loc += s_len;
+    if (buf_p->limit > 0)
+      buf_p->limit -= s_len;
+  } else
+    adds(buf_p, s_len, s);
+}
+
+/** Build the nick!user@host prefix of a user, if it is not cached.
+ * @param[in] user User to build the prefix of.
+ * @param[in] name Nickname of the user.
+ */
+static void
+build_prefix(struct User *user, const char *name)
+{
+  int nlen, ulen, hlen;
+
+  if (user->prefix_len)
+    return;
+  nlen = my_strnlen(name, NICKLEN);
+  ulen = my_strnlen(user->username, USERLEN);
+  hlen = my_strnlen(user->host, HOSTLEN);
+  memcpy(user->prefix, name, nlen);
+  user->prefix[nlen] = '!';
+  memcpy(user->prefix + nlen + 1, user->username, ulen);
+  user->prefix[nlen + 1 + ulen] = '@';
+  memcpy(user->prefix + nlen + ulen + 2, user->host, hlen);
+  user->prefix_len = nlen + ulen + hlen + 2;
+}
+
 /** Workhorse printing function.
  * @param[in] dest Client to format the message.
  * @param[in,out] buf_p Description of output buffer.
@@ -1537,13 +1579,23 @@ doprintf(struct Client *dest, struct BufData *buf_p, const char *fmt,
   const char *fstart = 0;
 
   for (; *fmt; fmt++) {
-    /* If it's not %, or if it's %%, append it to the string */
-    if (*fmt != '%' || (*fmt == '%' && *++fmt == '%')) {
-      addc(buf_p, *fmt); /* add the character to the string */
+    /* If it's not %, append it and the text up to the next % at once */
+    if (*fmt != '%') {
+      fstart = fmt;
+      while (fmt[1] && fmt[1] != '%')
+	fmt++;
+      addn(buf_p, fmt - fstart + 1, fstart);
 
       continue; /* go to the next character */
     }
 
+    /* If it's %%, append a % */
+    if (*++fmt == '%') {
+      addc(buf_p, '%');
+
+      continue;
+    }
+
     state = FLAG; /* initialize our field data */
     fld_s.flags = 0;
     fld_s.base = BASE_DECIMAL;
@@ -1987,7 +2039,7 @@ doprintf(struct Client *dest, struct BufData *buf_p, const char *fmt,
       if (plen > 0 && !(fld_s.flags & FLAG_MINUS))
 	do_pad(buf_p, plen, spaces); /* pre-padding */
 
-      adds(buf_p, slen, str); /* add the string */
+      addn(buf_p, slen, str); /* add the string */
 
       if (plen > 0 &&  (fld_s.flags & FLAG_MINUS))
 	do_pad(buf_p, plen, spaces); /* post-padding */
@@ -2045,6 +2097,19 @@ doprintf(struct Client *dest, struct BufData *buf_p, const char *fmt,
       const char *str1 = 0, *str2 = 0, *str3 = 0;
       int slen1 = 0, slen2 = 0, slen3 = 0, elen = 0, plen = 0;
 
+      /* The usual nick!user@host of a user comes from its cache */
+      if (!(dest && (IsServer(dest) || IsMe(dest)))
+          && (fld_s.flags & FLAG_ALT) && fld_s.prec < 0 && fld_s.width <= 0
+          && !IsServer(cptr) && !IsMe(cptr)) {
+	assert(0 != cli_user(cptr));
+	assert(0 != *(cli_name(cptr)));
+	build_prefix(cli_user(cptr), cli_name(cptr));
+	if (fld_s.flags & FLAG_COLON)
+	  addc(buf_p, ':');
+	addn(buf_p, cli_user(cptr)->prefix_len, cli_user(cptr)->prefix);
+	continue;
+      }
+
       /* &me is used if it's not a definite server */
       if (dest && (IsServer(dest) || IsMe(dest))) {
 	if (IsServer(cptr) || IsMe(cptr))
@@ -2087,15 +2152,15 @@ doprintf(struct Client *dest, struct BufData *buf_p, const char *fmt,
 
       if (fld_s.flags & FLAG_COLON)
 	addc(buf_p, ':');
-      adds(buf_p, slen1, str1);
+      addn(buf_p, slen1, str1);
       if (fld_s.flags & FLAG_ALT)
 	addc(buf_p, '!');
       if (str2)
-	adds(buf_p, slen2, str2);
+	addn(buf_p, slen2, str2);
       if (fld_s.flags & FLAG_ALT)
 	addc(buf_p, '@');
       if (str3)
-	adds(buf_p, slen3, str3);
+	addn(buf_p, slen3, str3);
 
       if (plen > 0 &&  (fld_s.flags & FLAG_MINUS))
 	do_pad(buf_p, plen, spaces); /* post-padding */
@@ -2110,7 +2175,7 @@ doprintf(struct Client *dest, struct BufData *buf_p, const char *fmt,
       if (plen > 0 && !(fld_s.flags & FLAG_MINUS))
 	do_pad(buf_p, plen, spaces); /* pre-padding */
 
-      adds(buf_p, slen, str); /* add the string */
+      addn(buf_p, slen, str); /* add the string */
 
       if (plen > 0 &&  (fld_s.flags & FLAG_MINUS))
 	do_pad(buf_p, plen, spaces); /* post-padding */
@@ -44,6 +44,7 @@
 #include "sys.h"    /* FALSE bleah */
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <stdlib.h>
 #include <string.h>
 
 /** List of jupes. */
@@ -418,3 +419,48 @@ jupe_memory_count(size_t *ju_size)
   }
   return ju;
 }
+
+/** Write all jupes to the state file of a hot upgrade.
+ * @param[in] file State file being written.
+ */
+void
+jupe_save(FILE *file)
+{
+  struct Jupe *jupe;
+
+  for (jupe = GlobalJupeList; jupe; jupe = jupe->ju_next)
+    fprintf(file, "J %s %lu %lu %x :%s\n", jupe->ju_server,
+            (unsigned long) jupe->ju_expire,
+            (unsigned long) jupe->ju_lastmod,
+            jupe->ju_flags & (JUPE_MASK | JUPE_LDEACT), jupe->ju_reason);
+}
+
+/** Recreate a jupe saved by jupe_save().
+ *
+ * \a parv has the following elements:
+ * \li \a parv[1] is the server name
+ * \li \a parv[2] is the expiration timestamp
+ * \li \a parv[3] is the last modification timestamp
+ * \li \a parv[4] is the hexadecimal set of JUPE_* flags
+ * \li \a parv[5] is the reason
+ *
+ * @param[in] parc Number of arguments.
+ * @param[in] parv Argument vector.
+ * @return Non-zero if the jupe was recreated, zero if the record is
+ * malformed.
+ */
+int
+jupe_restore(int parc, char *parv[])
+{
+  struct Jupe *jupe;
+  unsigned int flags;
+
+  if (parc < 6)
+    return 0;
+
+  flags = strtoul(parv[4], 0, 16);
+  jupe = make_jupe(parv[1], parv[5], strtoul(parv[2], 0, 10),
+                   strtoul(parv[3], 0, 10), flags);
+  jupe->ju_flags |= flags & JUPE_LDEACT;
+  return 1;
+}
@@ -278,6 +278,7 @@ void free_client(struct Client* cptr)
 
   if (cli_from(cptr) == cptr) { /* in other words, we're local */
     cli_from(cptr) = 0;
+    ping_unschedule(cptr);
     /* timer must be marked as not active */
     if (!cli_freeflag(cptr) && !t_active(&(cli_proc(cptr))))
       dealloc_connection(cli_connect(cptr)); /* connection not open anymore */
@@ -41,8 +41,10 @@
 #include "s_conf.h"
 #include "s_misc.h"
 #include "s_stats.h"
+#include "s_upgrade.h"
 #include "send.h"
 #include "sys.h"         /* MAXCLIENTS */
+#include "throttle.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <stdio.h>
@@ -250,15 +252,19 @@ static int inetport(struct Listener* listener, int family)
   int fd;
 
   /*
-   * At first, open a new socket
+   * Take over the socket of the process we were upgraded from, if any;
+   * otherwise, open a new socket
    */
-  fd = os_socket(&listener->addr, SOCK_STREAM, get_listener_name(listener), family);
-  if (fd < 0)
-    return -1;
-  if (!os_set_listen(fd, HYBRID_SOMAXCONN)) {
-    report_error(LISTEN_ERROR_MSG, get_listener_name(listener), errno);
-    close(fd);
-    return -1;
+  fd = upgrade_listener(&listener->addr, family);
+  if (fd < 0) {
+    fd = os_socket(&listener->addr, SOCK_STREAM, get_listener_name(listener), family);
+    if (fd < 0)
+      return -1;
+    if (!os_set_listen(fd, HYBRID_SOMAXCONN)) {
+      report_error(LISTEN_ERROR_MSG, get_listener_name(listener), errno);
+      close(fd);
+      return -1;
+    }
   }
   if (!set_listener_options(listener, fd, family))
     return -1;
@@ -278,7 +284,7 @@ static int inetport(struct Listener* listener, int family)
  * @param[in] addr Local address to search for.
  * @return Listener that matches (or NULL if none match).
  */
-static struct Listener* find_listener(int port, const struct irc_in_addr *addr)
+struct Listener* find_listener(int port, const struct irc_in_addr *addr)
 {
   struct Listener* listener;
   for (listener = ListenerPollList; listener; listener = listener->next) {
@@ -441,6 +447,24 @@ void release_listener(struct Listener* listener)
     close_listener(listener);
 }
 
+/** Write the listening sockets to the state file of a hot upgrade and
+ * keep them open for the new server process.
+ * @param[in] file State file being written.
+ */
+void listener_save(FILE *file)
+{
+  struct Listener* listener;
+  char ip[UPGRADE_IPLEN + 1];
+
+  for (listener = ListenerPollList; listener; listener = listener->next) {
+    upgrade_iptohex(ip, &listener->addr.addr);
+    if (listener->fd_v4 >= 0 && upgrade_keep_fd(listener->fd_v4))
+      fprintf(file, "L %d 4 %u %s\n", listener->fd_v4, listener->addr.port, ip);
+    if (listener->fd_v6 >= 0 && upgrade_keep_fd(listener->fd_v6))
+      fprintf(file, "L %d 6 %u %s\n", listener->fd_v6, listener->addr.port, ip);
+  }
+}
+
 /** Accept a connection on a listener.
  * @param[in] ev Socket callback structure.
  */
@@ -532,6 +556,18 @@ static void accept_connection(struct Event* ev)
         close(fd);
         continue;
       }
+      /*
+       * check the connection rate of the network, before allocating
+       * anything for the client
+       */
+      if (!listener_server(listener) && !listener_webirc(listener)
+          && !listener_proxy(listener) && !throttle_accept(&addr.addr))
+      {
+        ++ServerStats->is_ref;
+        send(fd, "ERROR :Your host is trying to (re)connect too fast -- throttled\r\n", 65, 0);
+        close(fd);
+        continue;
+      }
       ++ServerStats->is_ac;
       /* nextping = CurrentTime; */
 #if defined(USE_SSL)
@@ -25,6 +25,7 @@
 #include "config.h"
 
 #include "client.h"
+#include "hash.h"
 #include "ircd.h"
 #include "ircd_log.h"
 #include "ircd_reply.h"
@@ -50,6 +51,7 @@ int ms_account(struct Client* cptr, struct Client* sptr, int parc,
 	       char* parv[])
 {
   struct Client *acptr;
+  int indexed;
 
   if (parc < 3)
     return need_more_params(sptr, "ACCOUNT");
@@ -80,7 +82,10 @@ int ms_account(struct Client* cptr, struct Client* sptr, int parc,
            "timestamp %Tu", parv[2], cli_user(acptr)->acc_create));
   }
 
+  indexed = hRemUser(acptr);
   ircd_strncpy(cli_user(acptr)->account, parv[2], ACCOUNTLEN);
+  if (indexed)
+    hAddUser(acptr);
   hide_hostmask(acptr, 0, FLAG_ACCOUNT);
 
   sendcmdto_common_channels_capab_butone(acptr, CMD_ACCOUNT, acptr, CAP_ACCNOTIFY, CAP_NONE,
@@ -224,9 +224,6 @@ int ms_db(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
       /* Join */
       case 'J':
       {
-  /* TODO */
-        int end_burst;
-
         if (id >= ddb_id_table[table])
         {
           /* Individual registers*/
@@ -248,28 +245,12 @@ int ms_db(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
           return 0;
         }
 
-        /* In the burst of table, bursts become of 1000 registers, is send
-         * one in each JOIN request. This function gives back 1 if all the
-         * data is sent and 0 if still there are pending data.
-         * The automatic HASH verification is due to do to leafs, NEVER to
-         * HUBS, since if a HUB has the corrupt DB, all the network is down
-         * by wind with a massive erasure.
+        /* The registers newer than id are streamed to cptr while its
+         * sendQ has room, and the rest when the sendQ drains.  When the
+         * table is complete the faucet is opened and leafs receive the
+         * automatic HASH verification.
          */
-        end_burst = ddb_db_read(cptr, table, (id + 1), 1000);
-        if (end_burst == 1)
-        {
-          cli_serv(cptr)->ddb_open |= ((unsigned int)1) << (table - DDB_INIT);
-          if (IsHub(cptr))
-            break;
-
-          inttobase64(ddb_buf, ddb_hashtable_hi[table], 6);
-          inttobase64(ddb_buf + 6, ddb_hashtable_lo[table], 6);
-
-          sendcmdto_one(&me, CMD_DB, cptr, "%s 0 H %s %c", cli_name(cptr), ddb_buf, table);
-        }
-        else if (end_burst == 0)
-          sendcmdto_one(&me, CMD_DB, cptr, "%s 0 B %u %c",
-                         cli_name(cptr), ddb_id_table[table], table);
+        ddb_table_burst(cptr, table, id);
         return 0;
       }
 
@@ -35,6 +35,8 @@
 #include "ircd_chattr.h"
 #include "ircd_log.h"
 #include "ircd_reply.h"
+#include "ircd_string.h"
+#include "match.h"
 #include "msg.h"
 #include "numeric.h"
 #include "numnicks.h"
@@ -44,10 +46,20 @@
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <string.h>
 
+/** Maximum number of registers sent for a DBQ matching several. */
+#define DBQ_MAX_REPLIES 50
+
+/** State of a DBQ matching several registers. */
+struct DbqSearch {
+  struct Client *sptr;  /**< Client asking */
+  char           table; /**< Table being searched */
+  int            count; /**< Registers matched */
+};
+
 /**
  *
  */
-static int checkpriv_dbq(struct Client* sptr, unsigned char table, char *key)
+static int checkpriv_dbq(struct Client* sptr, unsigned char table, const char *key)
 {
   if (IsAdmin(sptr) || IsCoder(sptr))
     return 1;
@@ -59,12 +71,82 @@ static int checkpriv_dbq(struct Client* sptr, unsigned char table, char *key)
       return 0;
 
     case DDB_FEATUREDB:
-      if (!strcmp(key, "KEYCIFRADO"))
+      if (!ircd_strcmp(key, "KEYCIFRADO"))
         return 0;
   }
   return 1;
 }
 
+/** Send a register found by a DBQ search.
+ * @param[in] ddb Register found.
+ * @param[in] data Search state.
+ * @return Non-zero when the limit of registers is reached.
+ */
+static int dbq_reply(struct Ddb *ddb, void *data)
+{
+  struct DbqSearch *search = data;
+
+  /* Searches can match registers the client may not read by name. */
+  if (!checkpriv_dbq(search->sptr, search->table, ddb_key(ddb)))
+    return 0;
+
+  if (search->count++ >= DBQ_MAX_REPLIES)
+    return 1;
+
+  sendcmdto_one(&me, CMD_NOTICE, search->sptr, "%C :DBQ OK Table='%c' Key='%s' Content='%s'",
+                search->sptr, search->table, ddb_key(ddb), ddb_content(ddb));
+  return 0;
+}
+
+/** Answer a DBQ matching several registers.
+ * A key "=word" looks up the content index of the table, and a key
+ * with wildcards uses the IP index of the table when it is an IP
+ * mask; otherwise the table is scanned.
+ * @param[in] sptr Client asking.
+ * @param[in] table Table of the %DDB Distributed DataBases.
+ * @param[in] key Key in lowercase.
+ * @return Non-zero if the key was a search and it has been answered.
+ */
+static int dbq_search(struct Client *sptr, char table, char *key)
+{
+  struct DbqSearch search;
+  struct irc_in_addr addr;
+  unsigned char bits;
+  struct Ddb *ddb;
+  int len;
+
+  search.sptr = sptr;
+  search.table = table;
+  search.count = 0;
+
+  if (*key == '=' && ddb_index_type(table) == DDB_INDEX_CONTENT)
+  {
+    for (ddb = ddb_index_first(table, key + 1); ddb; ddb = ddb_index_next())
+      if (dbq_reply(ddb, &search))
+        break;
+  }
+  else if (strchr(key, '*') || strchr(key, '?'))
+  {
+    if (ddb_index_type(table) == DDB_INDEX_IP
+        && (len = ipmask_parse(key, &addr, &bits)) && !key[len])
+      ddb_walk_ip(table, &addr, bits, dbq_reply, &search);
+    else
+    {
+      for (ddb = ddb_iterator_first(table); ddb; ddb = ddb_iterator_next())
+        if (!match(key, ddb_key(ddb)) && dbq_reply(ddb, &search))
+          break;
+    }
+  }
+  else
+    return 0;
+
+  sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :DBQ END Table='%c' Key='%s' Matches=%d%s",
+                sptr, table, key,
+                search.count > DBQ_MAX_REPLIES ? DBQ_MAX_REPLIES : search.count,
+                search.count > DBQ_MAX_REPLIES ? " TRUNCATED" : "");
+  return 1;
+}
+
 /** Handle a DBQ (DataBase Query) command from a server.
  * See @ref m_functions for general discussion of parameters.
  *
@@ -154,13 +236,16 @@ int ms_dbq(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
   }
 
   /* Check privilegies */
-  if (!checkpriv_dbq(cptr, table, key))
+  if (!checkpriv_dbq(sptr, table, key))
   {
-    sendcmdto_one(&me, CMD_NOTICE, cptr, "%C :DBQ ERROR You do not have permission to access Table='%c' Key='%s'",
-                  cptr, table, key);
+    sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :DBQ ERROR You do not have permission to access Table='%c' Key='%s'",
+                  sptr, table, key);
     return 0;
   }
 
+  if (dbq_search(sptr, table, kn))
+    return 0;
+
   ddb = ddb_find_key(table, key);
   if (!ddb)
   {
@@ -275,6 +360,9 @@ int mo_dbq(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
     return 0;
   }
 
+  if (dbq_search(cptr, table, kn))
+    return 0;
+
   ddb = ddb_find_key(table, key);
   if (!ddb)
   {
@@ -26,11 +26,13 @@
 
 #include "channel.h"
 #include "client.h"
+#include "gline.h"
 #include "hash.h"
 #include "ircd.h"
 #include "ircd_log.h"
 #include "ircd_reply.h"
 #include "ircd_string.h"
+#include "monitor.h"
 #include "msg.h"
 #include "numeric.h"
 #include "numnicks.h"
@@ -66,6 +68,12 @@ int ms_end_of_burst(struct Client* cptr, struct Client* sptr, int parc, char* pa
   if (MyConnect(sptr))
     sendcmdto_one(&me, CMD_END_OF_BURST_ACK, sptr, "");
 
+  /* Disconnect the local users matching G-lines of the burst */
+  gline_burst_done(cptr);
+
+  /* Send the MONITOR notifications of the users in the burst */
+  monitor_flush();
+
   /* Count through channels... */
   for (chan = GlobalChannelList; chan; chan = next_chan) {
     next_chan = chan->next;
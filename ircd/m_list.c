@@ -55,7 +55,8 @@ static struct ListingArgs la_init = {
   0,                          /* flags */
   2147483647,                 /* max_topic_time */
   0,                          /* min_topic_time */
-  0,                          /* bucket */
+  0,                          /* snapshot */
+  0,                          /* pos */
   {0}                         /* wildcard */
 };
 
@@ -67,7 +68,8 @@ static struct ListingArgs la_default = {
   0,                          /* flags */
   2147483647,                 /* max_topic_time */
   0,                          /* min_topic_time */
-  0,                          /* bucket */
+  0,                          /* snapshot */
+  0,                          /* pos */
   {0}                         /* wildcard */
 };
 
@@ -301,9 +303,7 @@ int m_list(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
 
   if (cli_listing(sptr))            /* Already listing ? */
   {
-    if (cli_listing(sptr))
-    MyFree(cli_listing(sptr));
-    cli_listing(sptr) = 0;
+    list_stop_channels(sptr);
     send_reply(sptr, RPL_LISTEND);
     update_write(sptr);
     if (parc < 2 || 0 == ircd_strcmp("STOP", parv[1]))
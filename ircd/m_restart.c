@@ -29,20 +29,38 @@
 #include "ircd_log.h"
 #include "ircd_reply.h"
 #include "ircd_string.h"
+#include "msg.h"
 #include "numeric.h"
 #include "numnicks.h"
+#include "s_upgrade.h"
 #include "send.h"
 
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 
 /*
  * mo_restart - oper message handler
+ *
+ * parv[0] = sender prefix
+ * parv[1] = "UPGRADE" to restart keeping the connections (optional)
  */
 int mo_restart(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
 {
+  const char *reason;
+
   if (!HasPriv(sptr, PRIV_RESTART))
     return send_reply(sptr, ERR_NOPRIVILEGES);
 
+  if (parc > 1 && !ircd_strcmp(parv[1], "UPGRADE")) {
+    if ((reason = upgrade_check()))
+      sendcmdto_one(&me, CMD_NOTICE, sptr, "%C :Cannot upgrade now: %s", sptr,
+                    reason);
+    else {
+      log_write(LS_SYSTEM, L_NOTICE, 0, "Server RESTART UPGRADE by %#C", sptr);
+      server_upgrade("received RESTART UPGRADE");
+    }
+    return 0;
+  }
+
   log_write(LS_SYSTEM, L_NOTICE, 0, "Server RESTART by %#C", sptr);
   server_restart("received RESTART");
 
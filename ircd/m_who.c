@@ -65,6 +65,126 @@ static void move_marker(void)
 #define CheckMark(x, y) ((x == y) ? 0 : (x = y))
 #define Process(cptr) CheckMark(cli_marker(cptr), who_marker)
 
+/** State of a WHO query matching a mask against all the users. */
+struct WhoQuery {
+  struct Client *sptr;          /**< Client asking */
+  int bitsel;                   /**< Mask of selectors to apply */
+  int matchsel;                 /**< Which fields the match should apply on */
+  int fields;                   /**< Mask of fields to show */
+  char *qrt;                    /**< Query type */
+  char *mask;                   /**< Mask, or NULL to show everybody */
+  char *mymask;                 /**< Compiled \a mask */
+  int minlen;                   /**< Minimum length of \a mymask */
+  struct irc_in_addr imask;     /**< Address of \a mask, for WHO_FIELD_NIP */
+  unsigned char ibits;          /**< Length of \a imask */
+  int counter;                  /**< Query size counter */
+};
+
+/** Check whether a user matches the mask of a WHO query in any of the
+ * fields selected.
+ * @param[in] q WHO query.
+ * @param[in] acptr User to check.
+ * @return Non-zero if \a acptr matches.
+ */
+static int who_matches(struct WhoQuery *q, struct Client *acptr)
+{
+  int matchsel = q->matchsel, minlen = q->minlen;
+  char *mymask = q->mymask;
+
+  return !((q->mask) &&
+           ((!(matchsel & WHO_FIELD_NIC))
+           || matchexec(cli_name(acptr), mymask, minlen))
+           && ((!(matchsel & WHO_FIELD_UID))
+           || matchexec(cli_user(acptr)->username, mymask, minlen))
+           && ((!(matchsel & WHO_FIELD_SER))
+           || (!(HasFlag(cli_user(acptr)->server, FLAG_MAP))))
+           && ((!(matchsel & WHO_FIELD_HOS))
+           || matchexec(cli_user(acptr)->host, mymask, minlen))
+           && ((!(matchsel & WHO_FIELD_HOS))
+           || !HasHiddenHost(acptr)
+           || !IsAnOper(q->sptr)
+           || matchexec(cli_user(acptr)->realhost, mymask, minlen))
+           && ((!(matchsel & WHO_FIELD_REN))
+           || matchexec(cli_info(acptr), mymask, minlen))
+           && ((!(matchsel & WHO_FIELD_NIP))
+           || (HasHiddenHost(acptr) && !IsAnOper(q->sptr))
+           || !ipmask_check(&cli_ip(acptr), &q->imask, q->ibits))
+           && ((!(matchsel & WHO_FIELD_ACC))
+           || matchexec(cli_user(acptr)->account, mymask, minlen)));
+}
+
+/** Show a user to a WHO query if it matches and was not shown yet.
+ * @param[in] acptr Candidate user.
+ * @param[in] data WHO query.
+ * @return Non-zero to stop the query, when it is too long.
+ */
+static int who_candidate(struct Client *acptr, void *data)
+{
+  struct WhoQuery *q = data;
+
+  if (!(IsUser(acptr) && Process(acptr)))
+    return 0;
+  if ((q->bitsel & WHOSELECT_OPER) && !SeeOper(q->sptr, acptr))
+    return 0;
+  if (!(SEE_USER(q->sptr, acptr, q->bitsel)))
+    return 0;
+  if (!who_matches(q, acptr))
+    return 0;
+  if (!SHOW_MORE(q->sptr, (q->counter)))
+    return 1;
+  do_who(q->sptr, acptr, 0, q->fields, q->qrt);
+  return 0;
+}
+
+/** Check whether a mask has no wildcards.
+ * @param[in] mask Mask to check.
+ * @return Non-zero if \a mask only matches itself.
+ */
+static int who_literal(const char *mask)
+{
+  return !strpbrk(mask, "*?\\");
+}
+
+/** Look for the users matching a WHO query in the indexes of hash.c.
+ * The indexes are only used when every selected field can be looked
+ * up in one of them; otherwise all the users must be checked.
+ * @param[in] q WHO query.
+ * @return Non-zero if the query was answered from the indexes.
+ */
+static int who_indexed(struct WhoQuery *q)
+{
+  int matchsel = q->matchsel;
+  struct Client *acptr;
+
+  if (!q->mask)
+    return 0;
+  if (((matchsel & WHO_FIELD_NIC) && !who_literal(q->mask))
+      || ((matchsel & (WHO_FIELD_UID | WHO_FIELD_HOS))
+          && !hUsersHostKeyed(q->mask))
+      || ((matchsel & WHO_FIELD_ACC) && !who_literal(q->mask))
+      || ((matchsel & WHO_FIELD_REN) && !hUsersInfoKeyed(q->mask)))
+    return 0;
+
+  if ((matchsel & WHO_FIELD_NIC) && (acptr = FindUser(q->mask))
+      && who_candidate(acptr, q))
+    return 1;
+  if ((matchsel & (WHO_FIELD_UID | WHO_FIELD_HOS))
+      && hWalkUsersHost(q->mask, who_candidate, q))
+    return 1;
+  if ((matchsel & WHO_FIELD_SER)
+      && walkMarkedServerClients(who_candidate, q))
+    return 1;
+  if ((matchsel & WHO_FIELD_NIP)
+      && hWalkUsersIP(&q->imask, q->ibits, who_candidate, q))
+    return 1;
+  if ((matchsel & WHO_FIELD_ACC)
+      && hWalkUsersAccount(q->mask, who_candidate, q))
+    return 1;
+  if (matchsel & WHO_FIELD_REN)
+    hWalkUsersInfo(q->mask, who_candidate, q);
+  return 1;
+}
+
 /*
  * m_who - generic message handler
  *
@@ -305,28 +425,36 @@ int m_who(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
      real mask and try to match all relevant fields */
   if (!(commas || (counter < 1)))
   {
-    struct irc_in_addr imask;
-    int minlen, cset;
-    unsigned char ibits;
+    struct WhoQuery q;
+    int cset;
 
+    q.sptr = sptr;
+    q.bitsel = bitsel;
+    q.fields = fields;
+    q.qrt = qrt;
+    q.mask = mask;
+    q.mymask = mymask;
+    q.minlen = 0;
+    q.ibits = 0;
     if (mask)
     {
-      matchcomp(mymask, &minlen, &cset, mask);
-      if (!ipmask_parse(mask, &imask, &ibits))
+      matchcomp(mymask, &q.minlen, &cset, mask);
+      if (!ipmask_parse(mask, &q.imask, &q.ibits))
         matchsel &= ~WHO_FIELD_NIP;
-      if ((minlen > NICKLEN) || !(cset & NTL_IRCNK))
+      if ((q.minlen > NICKLEN) || !(cset & NTL_IRCNK))
         matchsel &= ~WHO_FIELD_NIC;
       if ((matchsel & WHO_FIELD_SER) &&
-          ((minlen > HOSTLEN) || (!(cset & NTL_IRCHN))
-          || (!markMatchexServer(mymask, minlen))))
+          ((q.minlen > HOSTLEN) || (!(cset & NTL_IRCHN))
+          || (!markMatchexServer(mymask, q.minlen))))
         matchsel &= ~WHO_FIELD_SER;
-      if ((minlen > USERLEN) || !(cset & NTL_IRCUI))
+      if ((q.minlen > USERLEN) || !(cset & NTL_IRCUI))
         matchsel &= ~WHO_FIELD_UID;
-      if ((minlen > HOSTLEN) || !(cset & NTL_IRCHN))
+      if ((q.minlen > HOSTLEN) || !(cset & NTL_IRCHN))
         matchsel &= ~WHO_FIELD_HOS;
-      if ((minlen > ACCOUNTLEN))
+      if ((q.minlen > ACCOUNTLEN))
         matchsel &= ~WHO_FIELD_ACC;
     }
+    q.matchsel = matchsel;
 
     /* First of all loop through the clients in common channels */
     if ((!(counter < 1)) && matchsel) {
@@ -342,26 +470,7 @@ int m_who(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
                                    we'll never have to show this acptr in this query */
  	  if ((bitsel & WHOSELECT_OPER) && !SeeOper(sptr,acptr))
 	    continue;
-          if ((mask) &&
-              ((!(matchsel & WHO_FIELD_NIC))
-              || matchexec(cli_name(acptr), mymask, minlen))
-              && ((!(matchsel & WHO_FIELD_UID))
-              || matchexec(cli_user(acptr)->username, mymask, minlen))
-              && ((!(matchsel & WHO_FIELD_SER))
-              || (!(HasFlag(cli_user(acptr)->server, FLAG_MAP))))
-              && ((!(matchsel & WHO_FIELD_HOS))
-              || matchexec(cli_user(acptr)->host, mymask, minlen))
-              && ((!(matchsel & WHO_FIELD_HOS))
-	      || !HasHiddenHost(acptr)
-	      || !IsAnOper(sptr)
-              || matchexec(cli_user(acptr)->realhost, mymask, minlen))
-              && ((!(matchsel & WHO_FIELD_REN))
-              || matchexec(cli_info(acptr), mymask, minlen))
-              && ((!(matchsel & WHO_FIELD_NIP))
-	      || (HasHiddenHost(acptr) && !IsAnOper(sptr))
-              || !ipmask_check(&cli_ip(acptr), &imask, ibits))
-              && ((!(matchsel & WHO_FIELD_ACC))
-              || matchexec(cli_user(acptr)->account, mymask, minlen)))
+          if (!who_matches(&q, acptr))
             continue;
           if (!SHOW_MORE(sptr, counter))
             break;
@@ -369,42 +478,15 @@ int m_who(struct Client* cptr, struct Client* sptr, int parc, char* parv[])
         }
       }
     }
-    /* Loop through all clients :-\, if we still have something to match to 
-       and we can show more clients */
-    if ((!(counter < 1)) && matchsel)
+    /* Look up the rest in the user indexes or, if the mask cannot use
+       them, loop through all clients :-\, if we still have something
+       to match to and we can show more clients */
+    q.counter = counter;
+    if ((!(counter < 1)) && matchsel && !who_indexed(&q))
       for (acptr = cli_prev(&me); acptr; acptr = cli_prev(acptr))
-      {
-        if (!(IsUser(acptr) && Process(acptr)))
-          continue;
-	if ((bitsel & WHOSELECT_OPER) && !SeeOper(sptr,acptr))
-	  continue;
-        if (!(SEE_USER(sptr, acptr, bitsel)))
-          continue;
-        if ((mask) &&
-            ((!(matchsel & WHO_FIELD_NIC))
-            || matchexec(cli_name(acptr), mymask, minlen))
-            && ((!(matchsel & WHO_FIELD_UID))
-            || matchexec(cli_user(acptr)->username, mymask, minlen))
-            && ((!(matchsel & WHO_FIELD_SER))
-                || (!(HasFlag(cli_user(acptr)->server, FLAG_MAP))))
-            && ((!(matchsel & WHO_FIELD_HOS))
-            || matchexec(cli_user(acptr)->host, mymask, minlen))
-            && ((!(matchsel & WHO_FIELD_HOS))
-	    || !HasHiddenHost(acptr)
-	    || !IsAnOper(sptr)
-            || matchexec(cli_user(acptr)->realhost, mymask, minlen))
-            && ((!(matchsel & WHO_FIELD_REN))
-            || matchexec(cli_info(acptr), mymask, minlen))
-            && ((!(matchsel & WHO_FIELD_NIP))
-	    || (HasHiddenHost(acptr) && !IsAnOper(sptr))
-            || !ipmask_check(&cli_ip(acptr), &imask, ibits))
-            && ((!(matchsel & WHO_FIELD_ACC))
-            || matchexec(cli_user(acptr)->account, mymask, minlen)))
-          continue;
-        if (!SHOW_MORE(sptr, counter))
+        if (who_candidate(acptr, &q))
           break;
-        do_who(sptr, acptr, 0, fields, qrt);
-      }
+    counter = q.counter;
   }
 
   /* Make a clean mask suitable to be sent in the "end of" */
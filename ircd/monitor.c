@@ -68,6 +68,26 @@
 /** Count of allocated Monitor structures. */
 static int monitorCount = 0;
 
+/** Room for the targets of a MONITOR numeric, after the server name,
+ * numeric and target nick. */
+#define MONITOR_TARGETS_LEN (BUFSIZE - HOSTLEN - 12)
+
+/** MONITOR notifications queued for a watcher during a net.burst or
+ * a net.split.
+ */
+struct MonitorBatch {
+  struct MonitorBatch *next;    /**< Next watcher with queued notifications */
+  struct Client       *cptr;    /**< Watcher, NULL if it is gone */
+  int                  raw;     /**< Numeric of the targets in \a buf */
+  unsigned int         len;     /**< Length of \a buf */
+  char                 buf[MONITOR_TARGETS_LEN + 1]; /**< Comma separated targets */
+};
+
+/** Watchers with queued notifications. */
+static struct MonitorBatch *monitorBatches;
+/** Nesting level of monitor_batch_start(). */
+static unsigned int monitorBatchDepth;
+
 /** Reserve an entrance in the Monitor list.
  * @param[in] nick Nick to monitor.
  */
@@ -120,7 +140,96 @@ monitor_count_memory(int* count_out, size_t* bytes_out)
   *bytes_out = monitorCount * sizeof(struct Monitor);
 }
 
+/** Send a MONITOR numeric to a watcher.
+ * @param[in] cptr Watcher.
+ * @param[in] raw RPL_MONONLINE or RPL_MONOFFLINE.
+ * @param[in] targets Comma separated list of targets.
+ */
+static void
+monitor_send(struct Client *cptr, int raw, const char *targets)
+{
+  struct MsgBuf *mb;
+
+  mb = msgq_make(0, rpl_str(raw), cli_name(&me), "*", targets);
+  send_buffer(cptr, mb, 0);
+  msgq_clean(mb);
+}
+
+/** Queue a MONITOR notification for a watcher.
+ * Consecutive notifications of the same kind are joined in one numeric
+ * until it is full; a change of kind sends the numeric so far, to keep
+ * the order of the notifications.
+ * @param[in] cptr Watcher.
+ * @param[in] raw RPL_MONONLINE or RPL_MONOFFLINE.
+ * @param[in] target Target of the notification.
+ */
+static void
+monitor_queue(struct Client *cptr, int raw, const char *target)
+{
+  struct MonitorBatch *batch = cli_user(cptr)->monitor_batch;
+  unsigned int len = strlen(target);
+
+  if (!batch) {
+    batch = (struct MonitorBatch *) MyMalloc(sizeof(struct MonitorBatch));
+    batch->cptr = cptr;
+    batch->len = 0;
+    batch->raw = raw;
+    batch->next = monitorBatches;
+    monitorBatches = batch;
+    cli_user(cptr)->monitor_batch = batch;
+  } else if (batch->raw != raw || batch->len + 1 + len > MONITOR_TARGETS_LEN) {
+    monitor_send(cptr, batch->raw, batch->buf);
+    batch->len = 0;
+    batch->raw = raw;
+  }
+
+  if (batch->len)
+    batch->buf[batch->len++] = ',';
+  memcpy(batch->buf + batch->len, target, len + 1);
+  batch->len += len;
+}
+
+/** Send all the queued MONITOR notifications. */
+void
+monitor_flush(void)
+{
+  struct MonitorBatch *batch;
+
+  while ((batch = monitorBatches)) {
+    monitorBatches = batch->next;
+    if (batch->cptr) {
+      cli_user(batch->cptr)->monitor_batch = 0;
+      if (batch->len)
+        monitor_send(batch->cptr, batch->raw, batch->buf);
+    }
+    MyFree(batch);
+  }
+}
+
+/** Start queueing MONITOR notifications, for instance while the users
+ * behind a net.split exit.  Calls may be nested.
+ */
+void
+monitor_batch_start(void)
+{
+  monitorBatchDepth++;
+}
+
+/** Stop queueing MONITOR notifications, sending them when the outermost
+ * monitor_batch_start() ends.
+ */
+void
+monitor_batch_end(void)
+{
+  assert(monitorBatchDepth > 0);
+  if (!--monitorBatchDepth)
+    monitor_flush();
+}
+
 /** Notifies any clients monitoring the nick that it has connected to the network.
+ * The notifications of users introduced by a bursting server are queued
+ * until its END_OF_BURST, and those inside monitor_batch_start() until
+ * monitor_batch_end().
  * @param[in] cptr Client who has just connected.
  */
 void
@@ -142,6 +251,15 @@ monitor_notify(struct Client *cptr, int raw)
   else
     ircd_snprintf(0, monbuf, sizeof(monbuf), "%s", cli_name(cptr));
 
+  if (monitorBatchDepth
+      || (cli_user(cptr) && cli_user(cptr)->server
+          && IsBurst(cli_user(cptr)->server)))
+  {
+    for (lp = mo_monitor(mptr); lp; lp = lp->next)
+      monitor_queue(lp->value.cptr, raw, monbuf);
+    return;
+  }
+
   /* build buffer */
   mb = msgq_make(0, rpl_str(raw), cli_name(&me), "*", monbuf);
 
@@ -303,6 +421,12 @@ monitor_list_clean(struct Client *cptr)
   struct SLink *lp, *lp2, *lptmp;
   struct Monitor *mptr;
 
+  /* Forget the notifications queued for the client */
+  if (cli_user(cptr)->monitor_batch) {
+    cli_user(cptr)->monitor_batch->cptr = 0;
+    cli_user(cptr)->monitor_batch = 0;
+  }
+
   if (!(lp = cli_user(cptr)->monitor))
     return 0;			/* Id had the empty list */
 
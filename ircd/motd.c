@@ -38,6 +38,7 @@
 #include "ircd_string.h"
 #include "match.h"
 #include "msg.h"
+#include "msgq.h"
 #include "numeric.h"
 #include "numnicks.h"
 #include "s_conf.h"
@@ -62,6 +63,14 @@ static struct {
   struct MotdCache* cachelist; /**< List of MotdCache entries. */
 } MotdList = { 0, 0, 0, 0, 0 };
 
+#if defined(DDB)
+/** Last update of the MOTD table of %DDB, to know when it changes. */
+#define MOTD_SERIAL ddb_id_in_table(DDB_MOTDDB)
+#else
+/** Without %DDB the MOTDs only change when they are read again. */
+#define MOTD_SERIAL 0
+#endif
+
 /** Create a struct Motd and initialize it.
  * @param[in] hostmask Hostmask (or connection class name) to filter on.
  * @param[in] path Path to MOTD file.
@@ -158,6 +167,9 @@ motd_cache(struct Motd *motd)
   cache->maxcount = motd->maxcount;
 
   cache->modtime = *localtime((time_t *) &sb.st_mtime); /* store modtime */
+  cache->lines = 0;
+  cache->nlines = 0;
+  cache->serial = 0;
 
   cache->count = 0;
   while (cache->count < cache->maxcount && fbgets(line, sizeof(line), file)) {
@@ -190,6 +202,18 @@ motd_cache(struct Motd *motd)
   return motd->cache;
 }
 
+/** Release the lines of a MOTD made by motd_render().
+ * @param[in] cache MOTD body to release.
+ */
+static void
+motd_unrender(struct MotdCache *cache)
+{
+  while (cache->nlines > 0)
+    msgq_clean(cache->lines[--cache->nlines]);
+  MyFree(cache->lines);
+  cache->lines = 0;
+}
+
 /** Clear and dereference the Motd::cache element of \a motd.
  * If the MotdCache::ref count goes to zero, free it.
  * @param[in] motd MOTD to uncache.
@@ -211,6 +235,7 @@ motd_decache(struct Motd *motd)
       cache->next->prev_p = cache->prev_p;
     *cache->prev_p = cache->next;
 
+    motd_unrender(cache); /* release the lines as sent... */
     MyFree(cache->path); /* free path info... */
 
     MyFree(cache); /* very simple for a reason... */
@@ -274,6 +299,70 @@ motd_lookup(struct Client *cptr)
   return MotdList.local; /* Ok, return the default motd */
 }
 
+#if defined(DDB)
+/** Find a line of the MOTD table of %DDB.
+ * @param[in] num Number of the line, starting at zero.
+ * @return Registry of the line, or NULL past the last line.
+ */
+static struct Ddb *
+motd_ddb_line(int num)
+{
+  char tmpddb[16];
+
+  sprintf(tmpddb, "%d", num);
+  return ddb_find_key(DDB_MOTDDB, tmpddb);
+}
+#endif
+
+/** Format the lines of a MOTD as they are sent to users.
+ * The lines of the MOTD table of %DDB, if any, replace those of the
+ * file, which are then sent in place of a "%LOCALMOTD" line.  The
+ * lines are made once and shared by every user they are sent to.
+ * @param[in] cache MOTD body to format.
+ */
+static void
+motd_render(struct MotdCache *cache)
+{
+#if defined(DDB)
+  struct Ddb *ddb;
+#endif
+  int i = 0, j, count = 1;
+
+  motd_unrender(cache);
+
+#if defined(DDB)
+  for (; (ddb = motd_ddb_line(i)); i++)
+    count += strcmp(ddb_content(ddb), "%LOCALMOTD") ? 1 : cache->count;
+#endif
+  if (!i)
+    count += cache->count;
+
+  cache->lines = (struct MsgBuf **)MyMalloc(count * sizeof(struct MsgBuf *));
+  cache->lines[cache->nlines++] =
+    reply_body(SND_EXPLICIT | RPL_MOTD, ":- %d-%d-%d %d:%02d",
+               cache->modtime.tm_year + 1900, cache->modtime.tm_mon + 1,
+               cache->modtime.tm_mday, cache->modtime.tm_hour,
+               cache->modtime.tm_min);
+
+#if defined(DDB)
+  for (i = 0; (ddb = motd_ddb_line(i)); i++) {
+    if (!strcmp(ddb_content(ddb), "%LOCALMOTD")) {
+      for (j = 0; j < cache->count; j++)
+        cache->lines[cache->nlines++] = reply_body(RPL_MOTD, cache->motd[j]);
+    } else
+      cache->lines[cache->nlines++] = reply_body(RPL_MOTD, ddb_content(ddb));
+  }
+#endif
+
+  if (!i) {
+    for (j = 0; j < cache->count; j++)
+      cache->lines[cache->nlines++] = reply_body(RPL_MOTD, cache->motd[j]);
+  }
+
+  assert(cache->nlines == count);
+  cache->serial = MOTD_SERIAL;
+}
+
 /** Send the content of a MotdCache to a user.
  * If \a cache is NULL, simply send ERR_NOMOTD to the client.
  * @param[in] cptr Client to send MOTD to.
@@ -284,9 +373,7 @@ motd_forward(struct Client *cptr, struct MotdCache *cache)
 {
 #if defined(DDB)
   struct Ddb *ddb;
-  char tmpddb[16];
 #endif
-  int i = 0;
 
   assert(0 != cptr);
 
@@ -300,31 +387,12 @@ motd_forward(struct Client *cptr, struct MotdCache *cache)
     return send_reply(cptr, ERR_NOMOTD);
 #endif
 
+  if (!cache->lines || cache->serial != MOTD_SERIAL)
+    motd_render(cache);
+
   /* send the motd */
   send_reply(cptr, RPL_MOTDSTART, cli_name(&me));
-  send_reply(cptr, SND_EXPLICIT | RPL_MOTD, ":- %d-%d-%d %d:%02d",
-	     cache->modtime.tm_year + 1900, cache->modtime.tm_mon + 1,
-	     cache->modtime.tm_mday, cache->modtime.tm_hour,
-	     cache->modtime.tm_min);
-
-#if defined(DDB)
-  while (ddb)
-  {
-    if (!strcmp(ddb_content(ddb), "%LOCALMOTD")) {
-      for (int j = 0; j < cache->count; j++)
-        send_reply(cptr, RPL_MOTD, cache->motd[j]);
-    } else
-      send_reply(cptr, RPL_MOTD, ddb_content(ddb));
-
-    sprintf(tmpddb, "%d", ++i);
-    ddb = ddb_find_key(DDB_MOTDDB, tmpddb);
-  }
-#endif
-
-  if (!i) {
-    for (i = 0; i < cache->count; i++)
-      send_reply(cptr, RPL_MOTD, cache->motd[i]);
-  }
+  send_reply_shared(cptr, RPL_MOTD, cache->lines, cache->nlines);
 
   return send_reply(cptr, RPL_ENDOFMOTD); /* end */
 }
@@ -503,6 +571,7 @@ motd_memory_count(struct Client *cptr)
   {
     mtc++;
     mtcm += sizeof(struct MotdCache) + (MOTD_LINESIZE * (cache->count - 1));
+    mtcm += cache->nlines * sizeof(struct MsgBuf *);
   }
 
   if (MotdList.freelist)
@@ -413,6 +413,33 @@ msgq_make(struct Client *dest, const char *format, ...)
   return mb;
 }
 
+/** Format a message whose body was made in advance.
+ * Only the start of the message is formatted for \a dest; the text of
+ * \a body is copied after it, so a body formatted once can be used in
+ * the messages of every recipient.
+ * @param[in] dest %Client that receives the data (may be NULL).
+ * @param[in] body Rest of the message, from msgq_make().
+ * @param[in] format Format string for the start of the message.
+ * @return Allocated MsgBuf.
+ */
+struct MsgBuf *
+msgq_make_body(struct Client *dest, const struct MsgBuf *body,
+	       const char *format, ...)
+{
+  struct VarData vd;
+  struct MsgBuf *mb;
+
+  assert(0 != body);
+  assert(2 <= body->length);
+
+  vd.vd_format = format;
+  va_start(vd.vd_args, format);
+  mb = msgq_make(dest, "%v%.*s", &vd, (int)(body->length - 2), body->msg);
+  va_end(vd.vd_args);
+
+  return mb;
+}
+
 /** Append text to an existing message buffer.
  * @param[in] dest %Client for whom to format the message.
  * @param[in] mb Message buffer to append to.
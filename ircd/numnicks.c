@@ -411,6 +411,29 @@ int markMatchexServer(const char *cmask, int minlen)
   return cnt;
 }
 
+/** Call a function for every client of the servers marked by
+ * markMatchexServer().
+ * @param[in] fn Function to call for each client.
+ * @param[in] data Extra argument for \a fn.
+ * @return Non-zero value returned by \a fn, or 0.
+ */
+int walkMarkedServerClients(int (*fn)(struct Client *, void *), void *data)
+{
+  struct Client *server, *acptr;
+  unsigned int ii;
+  int i, res;
+
+  for (i = 0; i < lastNNServer; i++) {
+    if (!(server = server_list[i]) || !HasFlag(server, FLAG_MAP))
+      continue;
+    for (ii = 0; ii <= cli_serv(server)->nn_mask; ii++)
+      if ((acptr = cli_serv(server)->client_list[ii])
+          && (res = fn(acptr, data)))
+        return res;
+  }
+  return 0;
+}
+
 /** Find first server whose name matches the given mask.
  * @param[in,out] mask %Server name mask (collapse()d in-place).
  * @return Matching server with lowest numnick value (or NULL).
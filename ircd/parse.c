@@ -57,6 +57,8 @@
 /* #include <assert.h> -- Now using assert in ircd_log.h */
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
 
 /*
  * Message Tree stuff mostly written by orabidoo, with changes by Dianora.
@@ -755,9 +757,83 @@ struct Message msgtab[] = {
   { 0 }
 };
 
+/** Number of entries in msgtab, including the terminating one. */
+#define MSGTAB_SIZE (sizeof(msgtab) / sizeof(msgtab[0]))
+
+/** Time spent in the handlers of each entry of msgtab. */
+static struct MessageTiming msgtab_timing[MSGTAB_SIZE][LAST_HANDLER_TYPE];
+
 /** Array of command parameters. */
 static char *para[MAXPARA + 2]; /* leave room for prefix and null */
 
+/** Find the timings of the handlers of a message.
+ * @param[in] mptr Message to look up.
+ * @return Timings indexed by handler type, or NULL if \a mptr is not
+ * in msgtab (such as a service mapping).
+ */
+struct MessageTiming *msg_timing(const struct Message *mptr)
+{
+  if (mptr < msgtab || mptr >= msgtab + MSGTAB_SIZE)
+    return NULL;
+  return msgtab_timing[mptr - msgtab];
+}
+
+/** Read a monotonic clock for the timing of message handlers.
+ * @return Current time in nanoseconds.
+ */
+static unsigned long long msg_clock(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+#endif
+}
+
+/** Call the handler of a message, accounting the time spent in it.
+ * @param[in] mptr Message being handled.
+ * @param[in] type Handler to call.
+ * @param[in] cptr Client that sent us the message.
+ * @param[in] sptr Original source of the message.
+ * @param[in] parc Number of arguments.
+ * @param[in] parv Argument vector.
+ * @return Return value of the handler.
+ */
+static int msg_call(struct Message *mptr, HandlerType type,
+                    struct Client *cptr, struct Client *sptr,
+                    int parc, char *parv[])
+{
+  struct MessageTiming *mt = msg_timing(mptr);
+  unsigned long long start, nsec;
+  unsigned long usec;
+  unsigned int bucket;
+  int ret;
+
+  if (!mt)
+    return (*mptr->handlers[type]) (cptr, sptr, parc, parv);
+
+  mt += type;
+  start = msg_clock();
+  ret = (*mptr->handlers[type]) (cptr, sptr, parc, parv);
+  nsec = msg_clock() - start;
+
+  mt->calls++;
+  mt->nsec += nsec;
+  usec = nsec / 1000;
+  if (usec > mt->max)
+    mt->max = usec;
+  for (bucket = 0; usec && bucket < MSG_TIMING_BUCKETS - 1; bucket++)
+    usec >>= 1;
+  mt->hist[bucket]++;
+  return ret;
+}
+
 
 /** Add a message to the lookup trie.
  * @param[in,out] mtree_p Trie node to insert under.
@@ -1046,7 +1122,7 @@ parse_client(struct Client *cptr, char *buffer, char *bufend)
       handler != m_ping && handler != m_ignore)
     cli_user(from)->last = CurrentTime;
 
-  return (*handler) (cptr, from, i, para);
+  return msg_call(mptr, cli_handler(cptr), cptr, from, i, para);
 }
 
 /** Parse a line of data from a server.
@@ -1338,5 +1414,5 @@ int parse_server(struct Client *cptr, char *buffer, char *bufend)
     return (do_numeric(numeric, (*buffer != ':'), cptr, from, i, para));
   mptr->count++;
 
-  return (*mptr->handlers[cli_handler(cptr)]) (cptr, from, i, para);
+  return msg_call(mptr, cli_handler(cptr), cptr, from, i, para);
 }
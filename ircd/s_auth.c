@@ -1128,6 +1128,7 @@ void start_auth(struct Client* client)
   if (cli_fd(client) > HighestFd)
     HighestFd = cli_fd(client);
   LocalClientArray[cli_fd(client)] = client;
+  ping_schedule(client, CurrentTime + 1);
   socket_events(&(cli_socket(client)), SOCK_ACTION_SET | SOCK_EVENT_READABLE);
 
   /* Allocate the AuthRequest. */
@@ -323,6 +323,7 @@ unsigned int deliver_it(struct Client *cptr, struct MsgQ *buf)
   case IO_FAILURE:
     cli_error(cptr) = errno;
     SetFlag(cptr, FLAG_DEADSOCKET);
+    ping_schedule(cptr, CurrentTime); /* exit it in the next check */
     break;
   }
   return bytes_written;
@@ -469,6 +470,7 @@ void close_connection(struct Client *cptr)
   if (-1 < cli_fd(cptr)) {
     flush_connections(cptr);
     LocalClientArray[cli_fd(cptr)] = 0;
+    ping_unschedule(cptr);
     close(cli_fd(cptr));
     socket_del(&(cli_socket(cptr))); /* queue a socket delete */
     cli_fd(cptr) = -1;
@@ -663,6 +665,55 @@ void add_connection(struct Listener* listener, int fd) {
   start_auth(new_client);
 }
 
+/** Attach a connection inherited from the process that did a hot
+ * upgrade to a client restored from its state file.
+ * @param cptr Local client being restored.
+ * @param fd File descriptor of the connection.
+ * @return Non-zero on success, zero if the socket could not be added
+ * to the event engine.
+ */
+int adopt_connection(struct Client *cptr, int fd)
+{
+  assert(0 != cptr);
+  assert(-1 == cli_fd(cptr));
+
+  if (!os_set_nonblocking(fd))
+    return 0;
+  cli_fd(cptr) = fd;
+  if (!socket_add(&(cli_socket(cptr)), client_sock_callback,
+		  (void*) cli_connect(cptr), SS_CONNECTED, 0, fd)) {
+    cli_fd(cptr) = -1;
+    return 0;
+  }
+  cli_freeflag(cptr) |= FREEFLAG_SOCKET;
+
+  if (fd > HighestFd)
+    HighestFd = fd;
+  LocalClientArray[fd] = cptr;
+  ping_schedule(cptr, CurrentTime + 1);
+  socket_events(&(cli_socket(cptr)), SOCK_ACTION_SET | SOCK_EVENT_READABLE);
+  return 1;
+}
+
+/** Queue data received by the process that did a hot upgrade but not
+ * parsed yet, to be processed as if it had just been read.
+ * @param cptr Local client that sent the data.
+ * @param buf Data to queue.
+ * @param length Length of \a buf.
+ * @return Non-zero on success, zero if the data could not be queued.
+ */
+int restore_recvq(struct Client *cptr, const char *buf, unsigned int length)
+{
+  if (!dbuf_put(&(cli_recvQ(cptr)), buf, length))
+    return 0;
+  if (!t_onqueue(&(cli_proc(cptr)))) {
+    cli_freeflag(cptr) |= FREEFLAG_TIMER;
+    timer_add(&(cli_proc(cptr)), client_timer_callback, cli_connect(cptr),
+	      TT_RELATIVE, 1);
+  }
+  return 1;
+}
+
 /** Determines whether to tell the events engine we're interested in
  * writable events.
  * @param cptr Client for which to decide this.
@@ -674,9 +725,15 @@ void update_write(struct Client* cptr)
    * we're interested in writable events--otherwise, we need to drop
    * that interest.
    */
+  int pending = MsgQLength(&cli_sendQ(cptr)) || cli_listing(cptr);
+
+#if defined(DDB)
+  /* A burst of DDB tables also waits for the sendQ to drain. */
+  pending = pending || cli_ddbburst(cptr);
+#endif
+
   socket_events(&(cli_socket(cptr)),
-		((MsgQLength(&cli_sendQ(cptr)) || cli_listing(cptr)) ?
-		 SOCK_ACTION_ADD : SOCK_ACTION_DEL) | SOCK_EVENT_WRITABLE);
+		(pending ? SOCK_ACTION_ADD : SOCK_ACTION_DEL) | SOCK_EVENT_WRITABLE);
 }
 
 /** Read a 'packet' of data from a connection and process it.  Read in
@@ -922,6 +979,7 @@ int connect_server(struct ConfItem* aconf, struct Client* by)
     HighestFd = cli_fd(cptr);
 
   LocalClientArray[cli_fd(cptr)] = cptr;
+  ping_schedule(cptr, CurrentTime + 1);
 
   Count_newunknown(UserStats);
   /* Actually we lie, the connect hasn't succeeded yet, but we have a valid
@@ -1043,6 +1101,10 @@ static void client_sock_callback(struct Event* ev)
     ClrFlag(cptr, FLAG_BLOCKED);
     if (cli_listing(cptr) && MsgQLength(&(cli_sendQ(cptr))) < 2048)
       list_next_channels(cptr);
+#if defined(DDB)
+    if (cli_ddbburst(cptr) && MsgQLength(&(cli_sendQ(cptr))) < cli_max_sendq(cptr) / 4)
+      ddb_burst_next(cptr);
+#endif
     Debug((DEBUG_SEND, "Sending queued data to %C", cptr));
     send_queued(cptr);
     break;
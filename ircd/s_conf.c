@@ -65,6 +65,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 /** Global list of all ConfItem structures. */
@@ -92,6 +93,15 @@ struct ExceptConf* exceptConfList;
 /** Global list of Proxys. */
 struct ProxyConf* proxyConfList;
 
+/** Compiled Kill blocks. */
+static struct MaskIndex denyIndex;
+/** Compiled Except blocks. */
+static struct MaskIndex exceptIndex;
+/** Compiled Client blocks. */
+static struct MaskIndex clientIndex;
+/** Microseconds taken by the last compilation of the access lists. */
+static unsigned long accessCompileTime;
+
 /** Tell a user that they are banned, dumping the message from a file.
  * @param sptr Client being rejected
  * @param filename Send this file's contents to \a sptr
@@ -153,6 +163,8 @@ void free_conf(struct ConfItem *aconf)
          aconf->address.port));
   if (aconf->dns_pending)
     delete_resolver_queries(aconf);
+  if (aconf->index.prev_p)
+    maskidx_del(&clientIndex, &aconf->index);
   MyFree(aconf->username);
   MyFree(aconf->host);
   MyFree(aconf->origin_name);
@@ -351,38 +363,159 @@ void det_confs_butmask(struct Client* cptr, int mask)
   }
 }
 
+/** State of a search of the compiled access lists. */
+struct AccessSearch {
+  struct Client *cptr;		/**< Client being checked. */
+  struct MaskEntry *found;	/**< First matching block so far. */
+};
+
+/** Keep a matching block if it comes before the one already found.
+ * The blocks are compiled in the order of their list, so keeping the
+ * lowest sequence number gives the first match of a walk of the list.
+ * @param[in] search Search state.
+ * @param[in] entry Matching block.
+ */
+static void access_found(struct AccessSearch *search, struct MaskEntry *entry)
+{
+  if (!search->found || entry->seq < search->found->seq)
+    search->found = entry;
+}
+
+/** Check a Client block matching the host or IP of a client.
+ * @param[in] entry Compiled Client block.
+ * @param[in] data Search state.
+ * @return Zero to continue the search.
+ */
+static int client_candidate(struct MaskEntry *entry, void *data)
+{
+  struct AccessSearch *search = data;
+  struct ConfItem *aconf = entry->data;
+  struct Client *cptr = search->cptr;
+
+  if (search->found && entry->seq > search->found->seq)
+    return 0;
+  /* If you change any of this logic, please make corresponding
+   * changes in conf_debug_iline() below.
+   */
+  if (aconf->address.port && aconf->address.port != cli_listener(cptr)->addr.port)
+    return 0;
+  if (aconf->username && match(aconf->username, cli_username(cptr)))
+    return 0;
+  /* Blocks with an IP mask are compiled by it, check the host too */
+  if (entry->kind == MASK_KIND_IP && aconf->host
+      && match(aconf->host, cli_sockhost(cptr)))
+    return 0;
+  access_found(search, entry);
+  return 0;
+}
+
+/** Forget the compiled access lists.
+ * This must be done before the blocks they point to are released.
+ */
+static void conf_clear_access(void)
+{
+  maskidx_clear(&denyIndex);
+  maskidx_clear(&exceptIndex);
+  maskidx_clear(&clientIndex);
+}
+
+/** Compile the Kill, Except and Client blocks into indexes by host
+ * and IP mask, so a client is only checked against the blocks that
+ * may match its address.  Each list is added in order; lookups keep
+ * the block added first, so the result is the same as a walk of the
+ * list.
+ */
+static void conf_compile_access(void)
+{
+  struct DenyConf *deny;
+  struct ExceptConf *except;
+  struct ConfItem *aconf;
+  struct timeval start, end;
+
+  conf_clear_access();
+  gettimeofday(&start, NULL);
+
+  /* A mask with an IP address only checks the address */
+  for (deny = denyConfList; deny; deny = deny->next)
+    maskidx_add(&denyIndex, &deny->index,
+                deny->hostmask ? deny->hostmask : "*",
+                deny->bits > 0 ? &deny->address : NULL, deny->bits, deny);
+
+  for (except = exceptConfList; except; except = except->next)
+    maskidx_add(&exceptIndex, &except->index,
+                except->hostmask ? except->hostmask : "*",
+                except->bits > 0 ? &except->address : NULL, except->bits, except);
+
+  /* Client blocks with an IP are indexed by it, the host is checked later */
+  for (aconf = GlobalConfList; aconf; aconf = aconf->next) {
+    if (aconf->status != CONF_CLIENT)
+      continue;
+    maskidx_add(&clientIndex, &aconf->index, aconf->host ? aconf->host : "*",
+                aconf->addrbits > 0 ? &aconf->address.addr : NULL,
+                aconf->addrbits > 0 ? aconf->addrbits : 0, aconf);
+  }
+
+  gettimeofday(&end, NULL);
+  accessCompileTime = (end.tv_sec - start.tv_sec) * 1000000
+    + end.tv_usec - start.tv_usec;
+}
+
+/** Report the state of a compiled access list.
+ * @param[in] to Client requesting statistics.
+ * @param[in] name Name of the blocks.
+ * @param[in] idx Index of the blocks.
+ */
+static void report_access_index(struct Client *to, const char *name,
+                                struct MaskIndex *idx)
+{
+  unsigned long avg = idx->lookups ? idx->checks * 100 / idx->lookups : 0;
+
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":%s Blocks=%u IP=%u Hashed=%u Other=%u Lookups=%lu "
+             "Checks/lookup=%lu.%02lu", name, idx->count,
+             idx->count - idx->hashed - idx->others, idx->hashed, idx->others,
+             idx->lookups, avg / 100, avg % 100);
+}
+
+/** Report the compiled Kill, Except and Client blocks.
+ * @param[in] to Client requesting statistics.
+ * @param[in] sd Stats descriptor for request (ignored).
+ * @param[in] param Extra parameter from user (ignored).
+ */
+void conf_report_access_index(struct Client *to, const struct StatDesc *sd,
+                              char *param)
+{
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Compiled in %lu us", accessCompileTime);
+  report_access_index(to, "Kill", &denyIndex);
+  report_access_index(to, "Except", &exceptIndex);
+  report_access_index(to, "Client", &clientIndex);
+}
+
 /** Find the first (best) Client block to attach.
  * @param cptr Client for whom to check rules.
  * @return Authorization check result.
  */
 enum AuthorizationCheckResult attach_iline(struct Client* cptr)
 {
+  struct AccessSearch search;
   struct ConfItem* aconf;
 
   assert(0 != cptr);
 
-  for (aconf = GlobalConfList; aconf; aconf = aconf->next) {
-    if (aconf->status != CONF_CLIENT)
-      continue;
-    /* If you change any of this logic, please make corresponding
-     * changes in conf_debug_iline() below.
-     */
-    if (aconf->address.port && aconf->address.port != cli_listener(cptr)->addr.port)
-      continue;
-    if (aconf->username && match(aconf->username, cli_username(cptr)))
-      continue;
-    if (aconf->host && match(aconf->host, cli_sockhost(cptr)))
-      continue;
-    if ((aconf->addrbits >= 0)
-        && !ipmask_check(&cli_ip(cptr), &aconf->address.addr, aconf->addrbits))
-      continue;
-    if (IPcheck_nr(cptr) > aconf->maximum)
-      return ACR_TOO_MANY_FROM_IP;
-    if (aconf->username)
-      SetFlag(cptr, FLAG_DOID);
-    return attach_conf(cptr, aconf);
-  }
-  return ACR_NO_AUTHORIZATION;
+  search.cptr = cptr;
+  search.found = NULL;
+  maskidx_match(&clientIndex, cli_sockhost(cptr), &cli_ip(cptr),
+                client_candidate, &search);
+  if (!search.found)
+    return ACR_NO_AUTHORIZATION;
+
+  aconf = search.found->data;
+  if (IPcheck_nr(cptr) > aconf->maximum)
+    return ACR_TOO_MANY_FROM_IP;
+  if (aconf->username)
+    SetFlag(cptr, FLAG_DOID);
+  return attach_conf(cptr, aconf);
 }
 
 /** Interpret \a client as a client specifier and show which Client
@@ -770,6 +903,8 @@ void conf_erase_deny_list(void)
 {
   struct DenyConf* next;
   struct DenyConf* p = denyConfList;
+
+  maskidx_clear(&denyIndex);
   for ( ; p; p = next) {
     next = p->next;
     MyFree(p->hostmask);
@@ -794,6 +929,8 @@ static void conf_erase_except_list(void)
 {
  struct ExceptConf* next;
  struct ExceptConf* p = exceptConfList;
+
+ maskidx_clear(&exceptIndex);
  for ( ; p; p = next) {
    next = p->next;
    MyFree(p->hostmask);
@@ -1002,6 +1139,7 @@ int rehash(struct Client *cptr, int sig)
     sendto_opmask_butone(0, SNO_OLDSNO,
                          "Got signal SIGHUP, reloading ircd conf. file");
 
+  conf_clear_access();
   while ((tmp2 = *tmp)) {
     if (tmp2->clients) {
       /*
@@ -1067,6 +1205,8 @@ int rehash(struct Client *cptr, int sig)
       tmp = &tmp2->next;
   }
 
+  conf_compile_access();
+
   for (i = 0; i <= HighestFd; i++) {
     if ((acptr = LocalClientArray[i])) {
       const struct wline *wline;
@@ -1125,11 +1265,51 @@ int init_conf(void)
     if (0 == localConf.contact)
       DupString(localConf.contact, "");
 
+    conf_compile_access();
     return 1;
   }
   return 0;
 }
 
+/** Check a Kill block matching the host or IP of a client.
+ * @param[in] entry Compiled Kill block.
+ * @param[in] data Search state.
+ * @return Zero to continue the search.
+ */
+static int deny_candidate(struct MaskEntry *entry, void *data)
+{
+  struct AccessSearch *search = data;
+  struct DenyConf *deny = entry->data;
+
+  if (search->found && entry->seq > search->found->seq)
+    return 0;
+  if (deny->usermask && match(deny->usermask, cli_user(search->cptr)->username))
+    return 0;
+  if (deny->realmask && match(deny->realmask, cli_info(search->cptr)))
+    return 0;
+  access_found(search, entry);
+  return 0;
+}
+
+/** Check an Except block matching the host or IP of a client.
+ * @param[in] entry Compiled Except block.
+ * @param[in] data Search state.
+ * @return Non-zero to stop the search.
+ */
+static int except_candidate(struct MaskEntry *entry, void *data)
+{
+  struct AccessSearch *search = data;
+  struct ExceptConf *except = entry->data;
+
+  if (except->usermask && match(except->usermask, cli_user(search->cptr)->username))
+    return 0;
+  if (except->password && match(except->password, cli_passwd(search->cptr)))
+    return 0;
+  /* Any matching block will do */
+  search->found = entry;
+  return 1;
+}
+
 /** Searches for a K/G-line for a client.  If one is found, notify the
  * user and disconnect them.
  * @param cptr Client to search for.
@@ -1143,6 +1323,7 @@ int find_kill(struct Client *cptr)
   const char*      realname;
   struct DenyConf* deny;
   struct Gline*    agline = NULL;
+  struct AccessSearch search;
 
   assert(0 != cptr);
 
@@ -1163,20 +1344,13 @@ int find_kill(struct Client *cptr)
   if (find_exception(cptr))
     return 0;
 
-  /* 2000-07-14: Rewrote this loop for massive speed increases.
-   *             -- Isomer
-   */
-  for (deny = denyConfList; deny; deny = deny->next) {
-    if (deny->usermask && match(deny->usermask, name))
-      continue;
-    if (deny->realmask && match(deny->realmask, realname))
-      continue;
-    if (deny->bits > 0) {
-      if (!ipmask_check(&cli_ip(cptr), &deny->address, deny->bits))
-        continue;
-    } else if (deny->hostmask && match(deny->hostmask, host))
-      continue;
+  /* Only the Kill blocks matching the host or IP address are checked */
+  search.cptr = cptr;
+  search.found = NULL;
+  maskidx_match(&denyIndex, host, &cli_ip(cptr), deny_candidate, &search);
 
+  if (search.found) {
+    deny = search.found->data;
     if (EmptyString(deny->message))
       send_reply(cptr, SND_EXPLICIT | ERR_YOUREBANNEDCREEP,
                  ":Connection from your host is refused on this server.");
@@ -1210,7 +1384,7 @@ int find_exception(struct Client *cptr)
  const char*      host;
  const char*      name;
  const char*      password;
- struct ExceptConf* except;
+ struct AccessSearch search;
 
  assert(0 != cptr);
 
@@ -1225,21 +1399,11 @@ int find_exception(struct Client *cptr)
  assert((name ? strlen(name) : 0) <= HOSTLEN);
  assert((password ? strlen(password) : 0) <= PASSWDLEN);
 
- for (except = exceptConfList; except; except = except->next) {
-   if (except->usermask && match(except->usermask, name))
-     continue;
-   if (except->password && match(except->password, password))
-     continue;
-   if (except->bits > 0) {
-     if (!ipmask_check(&cli_ip(cptr), &except->address, except->bits))
-       continue;
-   } else if (except->hostmask && match(except->hostmask, host))
-     continue;
-
-   return 1;
- }
+ search.cptr = cptr;
+ search.found = NULL;
+ maskidx_match(&exceptIndex, host, &cli_ip(cptr), except_candidate, &search);
 
- return 0;
+ return search.found != NULL;
 }
 
 /** Find a Proxy authorization for the given client.
@@ -28,6 +28,8 @@
 #include "IPcheck.h"
 #include "channel.h"
 #include "client.h"
+#include "ddb.h"
+#include "gline.h"
 #include "hash.h"
 #include "ircd.h"
 #include "ircd_alloc.h"
@@ -63,6 +65,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 /** Array of English month names (0 = January). */
@@ -195,8 +198,7 @@ static void exit_one_client(struct Client* bcptr, const char* comment)
      * Stop a running /LIST clean
      */
     if (MyUser(bcptr) && cli_listing(bcptr)) {
-      MyFree(cli_listing(bcptr));
-      cli_listing(bcptr) = NULL;
+      list_stop_channels(bcptr);
     }
     /*
      * If a person is on a channel, send a QUIT notice
@@ -237,9 +239,11 @@ static void exit_one_client(struct Client* bcptr, const char* comment)
       assert(UserStats.opers > 0);
       --UserStats.opers;
     }
-    if (MyConnect(bcptr))
+    hRemUser(bcptr);
+    if (MyConnect(bcptr)) {
       Count_clientdisconnects(bcptr, UserStats);
-    else
+      hRemLocalUser(bcptr);
+    } else
       Count_remoteclientquits(UserStats, bcptr);
 
     if (IsService(cli_user(bcptr)->server))
@@ -252,7 +256,13 @@ static void exit_one_client(struct Client* bcptr, const char* comment)
     cli_serv(bcptr)->updown = 0;
 
     if (MyConnect(bcptr))
+    {
+#if defined(DDB)
+      /* Stop a running burst of DDB tables */
+      ddb_burst_free(bcptr);
+#endif
       Count_serverdisconnects(UserStats);
+    }
     else
       Count_remoteserverquits(UserStats);
 
@@ -375,6 +385,9 @@ int exit_client(struct Client *cptr,
   struct Client* acptr = 0;
   struct DLink *dlp;
   time_t on_for;
+  struct timeval start, end;
+  unsigned int clients, servers;
+  char split[HOSTLEN + HOSTLEN + 2];
 
   char comment1[HOSTLEN + HOSTLEN + 2];
   assert(killer);
@@ -502,9 +515,28 @@ int exit_client(struct Client *cptr,
     }
   }
   /* Then remove the client structures */
-  if (IsServer(victim))
+  if (IsServer(victim)) {
+    ircd_snprintf(0, split, sizeof(split), "%s %s",
+                  cli_name(cli_serv(victim)->up), cli_name(victim));
+    gettimeofday(&start, NULL);
+    clients = UserStats.clients;
+    servers = UserStats.servers;
+    if (MyConnect(victim))
+      gline_burst_lost(victim);
+    monitor_batch_start();
+    split_start();
     exit_downlinks(victim, killer, comment1);
-  exit_one_client(victim, comment);
+    exit_one_client(victim, comment);
+    split_end();
+    monitor_batch_end();
+    gettimeofday(&end, NULL);
+    log_write(LS_NETWORK, L_INFO, 0, "Net break %s: %u clients and %u "
+              "servers exited in %lu ms", split, clients - UserStats.clients,
+              servers - UserStats.servers,
+              (unsigned long) ((end.tv_sec - start.tv_sec) * 1000
+                               + (end.tv_usec - start.tv_usec) / 1000));
+  } else
+    exit_one_client(victim, comment);
 
   /*
    *  cptr can only have been killed if it was cptr itself that got killed here,
@@ -28,6 +28,7 @@
  */
 #include "config.h"
 
+#include "IPcheck.h"
 #include "ddb.h"
 #include "class.h"
 #include "client.h"
@@ -40,6 +41,7 @@
 #include "ircd_crypt.h"
 #include "ircd_log.h"
 #include "ircd_reply.h"
+#include "ircd_snprintf.h"
 #include "ircd_string.h"
 #include "listener.h"
 #include "list.h"
@@ -49,6 +51,7 @@
 #include "msgq.h"
 #include "numeric.h"
 #include "numnicks.h"
+#include "parse.h"
 #include "querycmds.h"
 #include "res.h"
 #include "s_auth.h"
@@ -61,6 +64,7 @@
 #include "s_user.h"
 #include "send.h"
 #include "struct.h"
+#include "throttle.h"
 #include "userload.h"
 
 #include <stdio.h>
@@ -472,16 +476,77 @@ crypt_mechs_t* mechs;
 
 }
 
+/** Report the time spent in the handlers of each command.
+ * A line is sent for every kind of client that used the command, with
+ * the calls in each bucket of the latency histogram, up to the last
+ * non-empty one.
+ * @param[in] to Client requesting statistics.
+ */
+static void
+stats_command_times(struct Client* to)
+{
+  static const char *names[LAST_HANDLER_TYPE] = {
+    "unreg", "client", "server", "oper", "service"
+  };
+  struct Message *mptr;
+  struct MessageTiming *mt;
+  char hist[MSG_TIMING_BUCKETS * 11];
+  int type, bucket, last, len;
+
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Command Handler Calls Total(ms) Avg(us) Max(us) "
+             "Hist(<1us <2us <4us ... <16ms >=16ms)");
+  for (mptr = msgtab; mptr->cmd; mptr++) {
+    for (type = 0; type < LAST_HANDLER_TYPE; type++) {
+      mt = &msg_timing(mptr)[type];
+      if (!mt->calls)
+        continue;
+      for (last = MSG_TIMING_BUCKETS - 1; last > 0 && !mt->hist[last]; last--)
+        ;
+      for (bucket = 0, len = 0; bucket <= last; bucket++)
+        len += ircd_snprintf(0, hist + len, sizeof(hist) - len, "%s%lu",
+                             bucket ? " " : "", mt->hist[bucket]);
+      send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+                 ":%s %s %lu %Lu %Lu %lu %s", mptr->cmd, names[type],
+                 mt->calls, mt->nsec / 1000000, mt->nsec / 1000 / mt->calls,
+                 mt->max, hist);
+    }
+  }
+}
+
 /** Report how many times each command has been used.
+ * With "time" as parameter, report the time spent in their handlers
+ * instead; with "reset", clear both.
  * @param[in] to Client requesting statistics.
  * @param[in] sd Stats descriptor for request (ignored).
- * @param[in] param Extra parameter from user (ignored).
+ * @param[in] param Extra parameter from user.
  */
 static void
 stats_commands(struct Client* to, const struct StatDesc* sd, char* param)
 {
   struct Message *mptr;
 
+  if (param && !ircd_strcmp(param, "time")) {
+    stats_command_times(to);
+    return;
+  }
+
+  if (param && !ircd_strcmp(param, "reset")) {
+    if (!IsAnOper(to)) {
+      send_reply(to, ERR_NOPRIVILEGES);
+      return;
+    }
+    for (mptr = msgtab; mptr->cmd; mptr++) {
+      mptr->count = 0;
+      mptr->bytes = 0;
+      memset(msg_timing(mptr), 0,
+             LAST_HANDLER_TYPE * sizeof(struct MessageTiming));
+    }
+    send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":Command statistics reset");
+    return;
+  }
+
   for (mptr = msgtab; mptr->cmd; mptr++)
     if (mptr->count)
       send_reply(to, RPL_STATSCOMMANDS, mptr->cmd, mptr->count, mptr->bytes);
@@ -709,7 +774,7 @@ struct StatDesc statsinfo[] = {
     FEAT_HIS_STATS_L,
     stats_modules, 0,
     "Dynamically loaded modules." },
-  { 'm', "commands", (STAT_FLAG_OPERFEAT | STAT_FLAG_CASESENS), FEAT_HIS_STATS_m,
+  { 'm', "commands", (STAT_FLAG_OPERFEAT | STAT_FLAG_VARPARAM | STAT_FLAG_CASESENS), FEAT_HIS_STATS_m,
     stats_commands, 0,
     "Message usage information." },
   { 'o', "operators", STAT_FLAG_OPERFEAT, FEAT_HIS_STATS_o,
@@ -765,6 +830,18 @@ struct StatDesc statsinfo[] = {
   { 'z', "memory", STAT_FLAG_OPERFEAT, FEAT_HIS_STATS_z,
     count_memory, 0,
     "Memory/Structure allocation information." },
+  { ' ', "accessindex", STAT_FLAG_OPERFEAT, FEAT_HIS_STATS_i,
+    conf_report_access_index, 0,
+    "Compiled Kill, Except and Client blocks." },
+  { ' ', "ipcheck", STAT_FLAG_OPERFEAT, FEAT_HIS_STATS_t,
+    IPcheck_report, 0,
+    "IP registry hash tables." },
+  { ' ', "throttle", STAT_FLAG_OPERFEAT, FEAT_HIS_STATS_t,
+    throttle_report, 0,
+    "Connections refused by the accept throttle." },
+  { ' ', "logs", STAT_FLAG_OPERFEAT, FEAT_HIS_STATS_LOGS,
+    log_report, 0,
+    "Queue of the log writer thread." },
   { ' ', "iauth", STAT_FLAG_OPERFEAT, FEAT_HIS_STATS_IAUTH,
     report_iauth_stats, 0,
     "IAuth statistics." },
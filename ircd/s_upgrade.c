@@ -0,0 +1,1174 @@
+/*
+ * IRC-Hispano IRC Daemon, ircd/s_upgrade.c
+ *
+ * Copyright (C) 1997-2019 IRC-Hispano Development Team <toni@tonigarcia.es>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/** @file
+ * @brief Restart the server keeping its connections (hot upgrade).
+ *
+ * RESTART UPGRADE writes the servers, users, channels, G-lines and
+ * jupes of the server to a state file, keeps the listening sockets and
+ * the sockets of the local clients open across execv() and starts the
+ * new binary with -u.  The new process takes over the listening
+ * sockets while reading its configuration and recreates everything
+ * else from the file before entering the event loop, so neither the
+ * users nor the other servers see the restart.
+ *
+ * The state file has one record per line: a record type followed by
+ * parameters separated by spaces, the last of which may be prefixed
+ * by ':' and contain spaces, as in IRC messages.  Records that refer
+ * to a client or channel without naming it apply to the last one
+ * written.
+ *
+ * TLS sessions cannot be handed over, so TLS connections are closed
+ * before saving.  Unregistered connections, invitations, pending LIST
+ * replies, WHOWAS history and the IPcheck history are not kept either.
+ * The DDB tables are loaded again from disk; only the tables each link
+ * has open are kept.
+ */
+#include "config.h"
+
+#include "s_upgrade.h"
+#include "IPcheck.h"
+#include "channel.h"
+#include "client.h"
+#include "destruct_event.h"
+#include "gline.h"
+#include "hash.h"
+#include "ircd.h"
+#include "ircd_alloc.h"
+#include "ircd_features.h"
+#include "ircd_log.h"
+#include "ircd_reply.h"
+#include "ircd_snprintf.h"
+#include "ircd_string.h"
+#include "jupe.h"
+#include "list.h"
+#include "listener.h"
+#include "match.h"
+#include "monitor.h"
+#include "msgq.h"
+#include "numeric.h"
+#include "numnicks.h"
+#include "querycmds.h"
+#include "s_bsd.h"
+#include "s_conf.h"
+#include "s_debug.h"
+#include "s_misc.h"
+#include "s_serv.h"
+#include "s_user.h"
+#include "send.h"
+#include "struct.h"
+#include "userload.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/** Version of the state file format. */
+#define UPGRADE_VERSION 1
+/** Maximum number of parameters in a record of the state file. */
+#define UPGRADE_MAXPARA 24
+/** Size of the buffer to read a record of the state file. */
+#define UPGRADE_LINELEN 4096
+
+/** Name of a client flag kept across the upgrade. */
+struct UpgradeFlag {
+  int         flag;   /**< FLAG_* or CAP_* value. */
+  const char *name;   /**< Name in the state file. */
+};
+
+#define F(x) { FLAG_ ## x, #x }
+/** Client flags kept across the upgrade. */
+static const struct UpgradeFlag upgradeFlags[] = {
+  F(PINGSENT), F(HUB), F(IPV6), F(SERVICE), F(GOTID), F(DOID), F(TS8),
+  F(MAP), F(JUNCTION), F(BURST), F(BURST_ACK), F(OPER_BY_CMD),
+  F(LOCOP), F(SERVNOTICE), F(OPER), F(INVISIBLE), F(WALLOP), F(DEAF),
+  F(CHSERV), F(DEBUG), F(ACCOUNT), F(NICKSUSPEND), F(ADMIN), F(CODER),
+  F(HELPER), F(SERVICESBOT), F(USERBOT), F(HIDDENHOST), F(MSGONLYREG),
+  F(STRIPCOLOUR), F(NOCHAN), F(COMMONCHANSONLY), F(VIEWHIDDENHOST),
+  F(SSL), F(NOIDLE), F(WHOIS_NOTICE),
+  { 0, 0 }
+};
+#undef F
+
+#define C(x) { CAP_ ## x, #x }
+/** Client capabilities kept across the upgrade. */
+static const struct UpgradeFlag upgradeCaps[] = {
+  C(NAMESX), C(UHNAMES), C(EXTJOIN), C(AWAYNOTIFY), C(ACCNOTIFY),
+  C(INVITENOTIFY),
+#if defined(USE_SSL)
+  C(TLS),
+#endif
+  { 0, 0 }
+};
+#undef C
+
+/** Listening socket inherited from the process we were upgraded from. */
+struct UpgradeListener {
+  int                fd;       /**< File descriptor, -1 once taken. */
+  int                family;   /**< AF_INET or AF_INET6. */
+  unsigned short     port;     /**< Local port. */
+  struct irc_in_addr addr;     /**< Local address. */
+};
+
+/** Path of the state file being loaded, NULL if not upgrading. */
+static char *upgradeFile;
+/** Listening sockets inherited from the old process. */
+static struct UpgradeListener *upgradeListeners;
+/** Number of entries in #upgradeListeners. */
+static int upgradeListenerCount;
+
+/** Local clients to disconnect once everything has been restored. */
+static struct Client **upgradeDrops;
+/** Number of entries in #upgradeDrops. */
+static int upgradeDropCount;
+/** Allocated size of #upgradeDrops. */
+static int upgradeDropSize;
+
+/** Return the milliseconds elapsed since \a start.
+ * @param[in] start Starting time.
+ * @return Elapsed time in milliseconds.
+ */
+static unsigned long upgrade_elapsed(const struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - start->tv_sec) * 1000
+    + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/** Write an IP address as 32 hexadecimal digits.
+ * @param[out] buf Output buffer, at least UPGRADE_IPLEN + 1 bytes.
+ * @param[in] addr Address to write.
+ * @return \a buf.
+ */
+char *upgrade_iptohex(char *buf, const struct irc_in_addr *addr)
+{
+  const unsigned char *bytes = (const unsigned char *) addr;
+  unsigned int ii;
+
+  for (ii = 0; ii < UPGRADE_IPLEN / 2; ii++)
+    sprintf(buf + ii * 2, "%02x", bytes[ii]);
+  return buf;
+}
+
+/** Read an IP address written by upgrade_iptohex().
+ * @param[in] hex Hexadecimal digits.
+ * @param[out] addr Address read.
+ * @return Non-zero on success, zero if \a hex is malformed.
+ */
+int upgrade_hextoip(const char *hex, struct irc_in_addr *addr)
+{
+  unsigned char *bytes = (unsigned char *) addr;
+  unsigned int ii, byte;
+
+  memset(addr, 0, sizeof(*addr));
+  if (strlen(hex) != UPGRADE_IPLEN)
+    return 0;
+  for (ii = 0; ii < UPGRADE_IPLEN / 2; ii++) {
+    if (sscanf(hex + ii * 2, "%2x", &byte) != 1)
+      return 0;
+    bytes[ii] = byte;
+  }
+  return 1;
+}
+
+/** Keep a file descriptor open in the new server process.
+ * @param[in] fd File descriptor.
+ * @return Non-zero on success, zero on failure.
+ */
+int upgrade_keep_fd(int fd)
+{
+  int flags = fcntl(fd, F_GETFD);
+
+  return flags != -1 && fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC) != -1;
+}
+
+/** Write a set of flags as a list of names separated by commas.
+ * @param[in] file State file being written.
+ * @param[in] table Names of the flags.
+ * @param[in] has Function telling whether a flag is set.
+ * @param[in] data Argument for \a has.
+ */
+static void upgrade_put_flags(FILE *file, const struct UpgradeFlag *table,
+                              int (*has)(const void *data, int flag),
+                              const void *data)
+{
+  int count = 0;
+
+  for (; table->name; table++)
+    if (has(data, table->flag))
+      fprintf(file, "%s%s", count++ ? "," : " ", table->name);
+  if (!count)
+    fputs(" -", file);
+}
+
+/** Tell whether a client flag is set, for upgrade_put_flags(). */
+static int upgrade_has_flag(const void *data, int flag)
+{
+  return FlagHas(&cli_flags((const struct Client *) data), flag);
+}
+
+/** Tell whether a capability is set, for upgrade_put_flags(). */
+static int upgrade_has_cap(const void *data, int flag)
+{
+  return CapHas((const struct CapSet *) data, flag);
+}
+
+/** Read a list of flag names written by upgrade_put_flags().
+ * @param[in] table Names of the flags.
+ * @param[in] list List of names separated by commas.
+ * @param[in] set Function setting a flag.
+ * @param[in] data Argument for \a set.
+ */
+static void upgrade_get_flags(const struct UpgradeFlag *table, char *list,
+                              void (*set)(void *data, int flag), void *data)
+{
+  const struct UpgradeFlag *entry;
+  char *name;
+  char *next;
+
+  for (name = ircd_strtok(&next, list, ","); name;
+       name = ircd_strtok(&next, 0, ",")) {
+    for (entry = table; entry->name; entry++)
+      if (!strcmp(entry->name, name)) {
+        set(data, entry->flag);
+        break;
+      }
+  }
+}
+
+/** Set a client flag, for upgrade_get_flags(). */
+static void upgrade_set_flag(void *data, int flag)
+{
+  FlagSet(&cli_flags((struct Client *) data), flag);
+}
+
+/** Set a capability, for upgrade_get_flags(). */
+static void upgrade_set_cap(void *data, int flag)
+{
+  CapSet((struct CapSet *) data, flag);
+}
+
+/** Check whether the server can do a hot upgrade now.
+ * @return NULL if it can, or the reason why it cannot.
+ */
+const char *upgrade_check(void)
+{
+  struct Client *cptr;
+  int i;
+
+  for (i = 0; i <= HighestFd; i++) {
+    if (!(cptr = LocalClientArray[i]) || !IsServer(cptr))
+      continue;
+    if (IsBurstOrBurstAck(cptr))
+      return "a server link is in a net.burst";
+#if defined(DDB)
+    if (cli_ddbburst(cptr))
+      return "a server link is receiving the DDB tables";
+#endif
+  }
+  return NULL;
+}
+
+/** Write the messages still queued for a local client.
+ * @param[in] file State file being written.
+ * @param[in] cptr Local client.
+ */
+static void upgrade_save_sendq(FILE *file, struct Client *cptr)
+{
+  struct iovec *iov;
+  unsigned int len = 0;
+  unsigned int pos = 0;
+  char line[UPGRADE_LINELEN];
+  int count;
+  int i;
+  size_t jj;
+
+  if (!MsgQLength(&cli_sendQ(cptr)))
+    return;
+
+  count = MsgQCount(&cli_sendQ(cptr)) + 2;
+  iov = (struct iovec *) MyMalloc(count * sizeof(struct iovec));
+  count = msgq_mapiov(&cli_sendQ(cptr), iov, count, &len);
+  for (i = 0; i < count; i++) {
+    const char *data = iov[i].iov_base;
+
+    for (jj = 0; jj < iov[i].iov_len; jj++) {
+      if (data[jj] != '\n') {
+        if (pos < sizeof(line) - 1)
+          line[pos++] = data[jj];
+        continue;
+      }
+      if (pos && line[pos - 1] == '\r')
+        pos--;
+      line[pos] = '\0';
+      fprintf(file, "Q :%s\n", line);
+      pos = 0;
+    }
+  }
+  if (pos) {
+    line[pos] = '\0';
+    fprintf(file, "Q :%s\n", line);
+  }
+  MyFree(iov);
+}
+
+/** Write the data received from a local user and not parsed yet.
+ * The receive queue is left as it was.
+ * @param[in] file State file being written.
+ * @param[in] cptr Local user.
+ */
+static void upgrade_save_recvq(FILE *file, struct Client *cptr)
+{
+  unsigned int length = DBufLength(&cli_recvQ(cptr));
+  char *data;
+  char *line;
+  char *end;
+
+  if (!length)
+    return;
+
+  data = (char *) MyMalloc(length + 1);
+  length = dbuf_get(&cli_recvQ(cptr), data, length);
+  dbuf_put(&cli_recvQ(cptr), data, length);
+  data[length] = '\0';
+
+  for (line = data; (end = strchr(line, '\n')); line = end + 1) {
+    *end = '\0';
+    if (end > line && end[-1] == '\r')
+      end[-1] = '\0';
+    fprintf(file, "R :%s\n", line);
+  }
+  if (*line)
+    fprintf(file, "r :%s\n", line);
+  MyFree(data);
+}
+
+/** Write the connection of a local client.
+ * @param[in] file State file being written.
+ * @param[in] cptr Local client.
+ */
+static void upgrade_save_connection(FILE *file, struct Client *cptr)
+{
+  struct Listener *listener = cli_listener(cptr);
+  char ip[UPGRADE_IPLEN + 1];
+  char targets[MAXTARGETS * 2 + 1];
+  struct SLink *lp;
+  int i;
+
+  for (i = 0; i < MAXTARGETS; i++)
+    sprintf(targets + i * 2, "%02x", cli_targets(cptr)[i]);
+  if (listener)
+    upgrade_iptohex(ip, &listener->addr.addr);
+  else
+    upgrade_iptohex(ip, &cli_ip(&me));
+
+  fprintf(file, "C %u %s %u %lu %lu %lu %lu %u %u %llu %llu %s %s %s",
+          listener ? listener->addr.port : 0, ip, cli_snomask(cptr),
+          (unsigned long) cli_nextnick(cptr),
+          (unsigned long) cli_nexttarget(cptr),
+          (unsigned long) cli_lasttime(cptr),
+          (unsigned long) cli_since(cptr), cli_sendM(cptr),
+          cli_receiveM(cptr), (unsigned long long) cli_sendB(cptr),
+          (unsigned long long) cli_receiveB(cptr), cli_sock_ip(cptr),
+          cli_sockhost(cptr), targets);
+  upgrade_put_flags(file, upgradeCaps, upgrade_has_cap, cli_capab(cptr));
+  upgrade_put_flags(file, upgradeCaps, upgrade_has_cap, cli_active(cptr));
+  fprintf(file, " :%s\n", cli_username(cptr));
+
+  for (lp = cli_confs(cptr); lp; lp = lp->next)
+    if (lp->value.aconf->status & CONF_OPERATOR)
+      fprintf(file, "O %s\n", lp->value.aconf->name);
+
+  upgrade_save_sendq(file, cptr);
+  if (IsServer(cptr)) {
+    if (cli_count(cptr))
+      fprintf(file, "r :%.*s\n", (int) cli_count(cptr), cli_buffer(cptr));
+  } else
+    upgrade_save_recvq(file, cptr);
+}
+
+/** Write a server and, after it, the servers behind it.
+ * @param[in] file State file being written.
+ * @param[in] cptr Server to write.
+ */
+static void upgrade_save_server(FILE *file, struct Client *cptr)
+{
+  struct DLink *lp;
+
+  if (cptr != &me) {
+    fprintf(file, "S %d %s%s %s %u %lu %u %lu %lu",
+            MyConnect(cptr) ? cli_fd(cptr) : -1, NumServCap(cptr),
+            cli_yxx(cli_serv(cptr)->up), cli_hopcount(cptr),
+            (unsigned long) cli_serv(cptr)->timestamp, cli_serv(cptr)->prot,
+            (unsigned long) cli_firsttime(cptr),
+#if defined(DDB)
+            cli_serv(cptr)->ddb_open
+#else
+            0UL
+#endif
+            );
+    upgrade_put_flags(file, upgradeFlags, upgrade_has_flag, cptr);
+    fprintf(file, " %s :%s\n", cli_name(cptr), cli_info(cptr));
+    if (MyConnect(cptr)) {
+      upgrade_keep_fd(cli_fd(cptr));
+      upgrade_save_connection(file, cptr);
+    }
+  }
+
+  /* Keep the order of the downlinks, add_dlink() prepends them. */
+  for (lp = cli_serv(cptr)->down; lp && lp->next; lp = lp->next)
+    ;
+  for (; lp; lp = lp->prev)
+    upgrade_save_server(file, lp->value.cptr);
+}
+
+/** Write a user.
+ * @param[in] file State file being written.
+ * @param[in] cptr User to write.
+ */
+static void upgrade_save_user(FILE *file, struct Client *cptr)
+{
+  struct User *user = cli_user(cptr);
+  struct Ban *ban;
+  struct SLink *lp;
+  char ip[UPGRADE_IPLEN + 1];
+
+  fprintf(file, "U %d %s%s %u %lu %lu %lu %s %s %s %s",
+          MyConnect(cptr) ? cli_fd(cptr) : -1, NumNick(cptr),
+          cli_hopcount(cptr), (unsigned long) cli_lastnick(cptr),
+          (unsigned long) cli_firsttime(cptr), (unsigned long) user->last,
+          upgrade_iptohex(ip, &cli_ip(cptr)), user->username, user->host,
+          user->realhost);
+  upgrade_put_flags(file, upgradeFlags, upgrade_has_flag, cptr);
+  fprintf(file, " %s :%s\n", cli_name(cptr), cli_info(cptr));
+
+  if (user->account[0])
+    fprintf(file, "AC %s %lu\n", user->account,
+            (unsigned long) user->acc_create);
+  if (user->away)
+    fprintf(file, "A :%s\n", user->away);
+  if (MyConnect(cptr)) {
+    upgrade_keep_fd(cli_fd(cptr));
+    upgrade_save_connection(file, cptr);
+  }
+  for (ban = user->silence; ban; ban = ban->next)
+    fprintf(file, "SIL %x %s\n", ban->flags & BAN_EXCEPTION, ban->banstr);
+  for (lp = user->monitor; lp; lp = lp->next)
+    fprintf(file, "MON %s\n", mo_nick(lp->value.mptr));
+}
+
+/** Write a channel with its members and bans.
+ * @param[in] file State file being written.
+ * @param[in] chptr Channel to write.
+ */
+static void upgrade_save_channel(FILE *file, struct Channel *chptr)
+{
+  struct Membership *member;
+  struct Ban *ban;
+
+  fprintf(file, "CH %lu %x %u %lu %s\n", (unsigned long) chptr->creationtime,
+          chptr->mode.mode, chptr->mode.limit,
+          (unsigned long) chptr->topic_time, chptr->chname);
+  if (chptr->mode.key[0])
+    fprintf(file, "CK %s\n", chptr->mode.key);
+  if (chptr->mode.upass[0])
+    fprintf(file, "CU %s\n", chptr->mode.upass);
+  if (chptr->mode.apass[0])
+    fprintf(file, "CA %s\n", chptr->mode.apass);
+  if (chptr->topic[0])
+    fprintf(file, "CT %s :%s\n", chptr->topic_nick[0] ? chptr->topic_nick : "*",
+            chptr->topic);
+
+  /* Members are prepended when restored: write them backwards. */
+  for (member = chptr->members; member && member->next_member;
+       member = member->next_member)
+    ;
+  for (; member; member = member->prev_member)
+    fprintf(file, "M %s%s %x %u\n", NumNick(member->user),
+            member->status & (CHFL_CHANOP | CHFL_VOICE | CHFL_DEOPPED |
+                              CHFL_SERVOPOK | CHFL_ZOMBIE |
+                              CHFL_CHANNEL_MANAGER | CHFL_DELAYED),
+            OpLevel(member));
+  for (ban = chptr->banlist; ban; ban = ban->next)
+    fprintf(file, "B %lu %x %s %s\n", (unsigned long) ban->when,
+            ban->flags & BAN_EXCEPTION, ban->who[0] ? ban->who : "*",
+            ban->banstr);
+}
+
+/** Save the state of the server for a hot upgrade.
+ * Connections that cannot be handed over to the new process are
+ * closed first; everything else is left untouched, so the server can
+ * go on if the upgrade fails later.
+ * @param[in] path Name of the state file.
+ * @return Non-zero on success, zero on failure.
+ */
+int upgrade_save(const char *path)
+{
+  struct timeval start;
+  struct Client *cptr;
+  struct Channel *chptr;
+  FILE *file;
+  int i;
+
+  gettimeofday(&start, NULL);
+
+  /* Drop the connections that the new process could not take over. */
+  for (i = 0; i <= HighestFd; i++) {
+    if (!(cptr = LocalClientArray[i]))
+      continue;
+    if (IsDead(cptr))
+      exit_client(cptr, cptr, &me, cli_info(cptr));
+    else if (!IsUser(cptr) && !IsServer(cptr))
+      exit_client(cptr, cptr, &me, "Server upgrading");
+#if defined(USE_SSL)
+    else if (cli_socket(cptr).ssl)
+      exit_client_msg(cptr, cptr, &me, "Server upgrading, please reconnect");
+#endif
+    else if (cli_listing(cptr)) {
+      list_stop_channels(cptr);
+      send_reply(cptr, RPL_LISTEND);
+    }
+  }
+  monitor_flush();
+  flush_connections(0);
+
+  if (!(file = fopen(path, "w"))) {
+    log_write(LS_SYSTEM, L_ERROR, 0, "Unable to write upgrade file %s: %m",
+              path);
+    return 0;
+  }
+
+  /* Close everything on execv() but what the new process takes over. */
+  for (i = 3; i < MAXCONNECTIONS; i++) {
+    int flags = fcntl(i, F_GETFD);
+    if (flags != -1)
+      fcntl(i, F_SETFD, flags | FD_CLOEXEC);
+  }
+
+  fprintf(file, "V %d %s %s %d %lu %lu %ld\n", UPGRADE_VERSION, cli_name(&me),
+          cli_yxx(&me), (int) getpid(),
+          (unsigned long) cli_serv(&me)->timestamp,
+          (unsigned long) cli_firsttime(&me), (long) TSoffset);
+  fprintf(file, "MAX %u %u %u %lu %lu\n", max_connection_count,
+          max_client_count, max_global_count,
+          (unsigned long) max_client_count_TS,
+          (unsigned long) max_global_count_TS);
+  listener_save(file);
+  upgrade_save_server(file, &me);
+
+  /* Users are prepended when restored: write them backwards. */
+  for (cptr = GlobalClientList; cptr && cli_next(cptr); cptr = cli_next(cptr))
+    ;
+  for (; cptr; cptr = cli_prev(cptr))
+    if (IsUser(cptr))
+      upgrade_save_user(file, cptr);
+
+  for (chptr = GlobalChannelList; chptr && chptr->next; chptr = chptr->next)
+    ;
+  for (; chptr; chptr = chptr->prev)
+    upgrade_save_channel(file, chptr);
+
+  gline_save(file);
+  jupe_save(file);
+  fputs("E\n", file);
+
+  if (ferror(file) | (fclose(file) == EOF)) {
+    log_write(LS_SYSTEM, L_ERROR, 0, "Unable to write upgrade file %s: %m",
+              path);
+    unlink(path);
+    return 0;
+  }
+
+  log_write(LS_SYSTEM, L_NOTICE, 0, "Upgrade state saved to %s in %lu ms: "
+            "%u servers, %u clients, %u channels", path,
+            upgrade_elapsed(&start), UserStats.servers, UserStats.clients,
+            UserStats.channels);
+  return 1;
+}
+
+/** Split a record of the state file in parameters.
+ * @param[in,out] line Record, modified in place.
+ * @param[out] parv Parameters, followed by a NULL pointer.
+ * @return Number of parameters.
+ */
+static int upgrade_parse(char *line, char *parv[])
+{
+  int parc = 0;
+
+  while (*line && parc < UPGRADE_MAXPARA - 1) {
+    if (*line == ':') {
+      parv[parc++] = line + 1;
+      break;
+    }
+    parv[parc++] = line;
+    while (*line && *line != ' ')
+      line++;
+    if (*line)
+      *line++ = '\0';
+  }
+  parv[parc] = NULL;
+  return parc;
+}
+
+/** Read a record of the state file.
+ * @param[in] file State file.
+ * @param[out] line Buffer of UPGRADE_LINELEN bytes for the record.
+ * @param[out] parv Parameters of the record.
+ * @return Number of parameters, or -1 at the end of the file.
+ */
+static int upgrade_read(FILE *file, char *line, char *parv[])
+{
+  char *end;
+
+  if (!fgets(line, UPGRADE_LINELEN, file))
+    return -1;
+  if ((end = strchr(line, '\n')))
+    *end = '\0';
+  return upgrade_parse(line, parv);
+}
+
+/** Close the sockets listed in a state file that cannot be loaded.
+ * @param[in] file State file.
+ */
+static void upgrade_abort(FILE *file)
+{
+  char line[UPGRADE_LINELEN];
+  char *parv[UPGRADE_MAXPARA];
+  int parc;
+  int i;
+
+  rewind(file);
+  while ((parc = upgrade_read(file, line, parv)) >= 0)
+    if (parc > 1 && (!strcmp(parv[0], "L") || !strcmp(parv[0], "S")
+                     || !strcmp(parv[0], "U")) && atoi(parv[1]) > 2)
+      close(atoi(parv[1]));
+  for (i = 0; i < upgradeListenerCount; i++)
+    upgradeListeners[i].fd = -1;
+}
+
+/** Start loading the state file written by upgrade_save() in the old
+ * server process.  Only the listening sockets are read here so that
+ * they can be taken over while the configuration is read; the rest of
+ * the file is loaded by upgrade_restore().
+ * @param[in] path Name of the state file.
+ * @return Non-zero if the state file will be loaded, zero if not.
+ */
+int upgrade_init(const char *path)
+{
+  char line[UPGRADE_LINELEN];
+  char *parv[UPGRADE_MAXPARA];
+  struct UpgradeListener *ul;
+  FILE *file;
+  int parc;
+
+  if (!(file = fopen(path, "r"))) {
+    log_write(LS_SYSTEM, L_ERROR, 0, "Unable to read upgrade file %s: %m",
+              path);
+    return 0;
+  }
+
+  parc = upgrade_read(file, line, parv);
+  if (parc < 8 || strcmp(parv[0], "V") || atoi(parv[1]) != UPGRADE_VERSION
+      || atoi(parv[4]) != (int) getpid()) {
+    log_write(LS_SYSTEM, L_ERROR, 0, "Upgrade file %s is not for this "
+              "process; ignoring it", path);
+    fclose(file);
+    return 0;
+  }
+
+  while ((parc = upgrade_read(file, line, parv)) >= 0) {
+    if (parc < 5 || strcmp(parv[0], "L"))
+      continue;
+    upgradeListeners = (struct UpgradeListener *)
+      MyRealloc(upgradeListeners,
+                (upgradeListenerCount + 1) * sizeof(struct UpgradeListener));
+    ul = &upgradeListeners[upgradeListenerCount++];
+    ul->fd = atoi(parv[1]);
+    ul->family = atoi(parv[2]) == 6 ? AF_INET6 : AF_INET;
+    ul->port = atoi(parv[3]);
+    upgrade_hextoip(parv[4], &ul->addr);
+  }
+  fclose(file);
+
+  DupString(upgradeFile, path);
+  return 1;
+}
+
+/** Take over a listening socket of the old server process.
+ * @param[in] addr Local address and port of the listener.
+ * @param[in] family Address family of the socket.
+ * @return File descriptor of the socket, or -1 if there is none.
+ */
+int upgrade_listener(const struct irc_sockaddr *addr, int family)
+{
+  int i;
+  int fd;
+
+  for (i = 0; i < upgradeListenerCount; i++) {
+    struct UpgradeListener *ul = &upgradeListeners[i];
+
+    if (ul->fd < 0 || ul->family != family || ul->port != addr->port
+        || memcmp(&ul->addr, &addr->addr, sizeof(ul->addr)))
+      continue;
+    fd = ul->fd;
+    ul->fd = -1;
+    return fd;
+  }
+  return -1;
+}
+
+/** Disconnect a restored client once everything has been loaded.
+ * @param[in] cptr Local client.
+ */
+static void upgrade_drop(struct Client *cptr)
+{
+  int i;
+
+  for (i = 0; i < upgradeDropCount; i++)
+    if (upgradeDrops[i] == cptr)
+      return;
+  if (upgradeDropCount == upgradeDropSize) {
+    upgradeDropSize = upgradeDropSize ? upgradeDropSize * 2 : 16;
+    upgradeDrops = (struct Client **)
+      MyRealloc(upgradeDrops, upgradeDropSize * sizeof(struct Client *));
+  }
+  upgradeDrops[upgradeDropCount++] = cptr;
+}
+
+/** Recreate a server from an S record.
+ * @param[in] parc Number of parameters.
+ * @param[in] parv Parameters.
+ * @return Restored server, or NULL if the record is malformed.
+ */
+static struct Client *upgrade_restore_server(int parc, char *parv[])
+{
+  struct Client *cptr;
+  struct Client *up;
+  int fd = atoi(parv[1]);
+
+  if (parc < 12 || !(up = FindNServer(parv[3])) || FindServer(parv[10]))
+    return NULL;
+
+  if (fd >= 0) {
+    cptr = make_client(0, STAT_UNKNOWN_SERVER);
+    Count_newunknown(UserStats);
+  } else
+    cptr = make_client(cli_from(up), STAT_SERVER);
+  make_server(cptr);
+  ircd_strncpy(cli_name(cptr), parv[10], HOSTLEN);
+  ircd_strncpy(cli_info(cptr), parv[11], REALLEN);
+  cli_hopcount(cptr) = atoi(parv[4]);
+  cli_serv(cptr)->timestamp = strtoul(parv[5], 0, 10);
+  cli_serv(cptr)->prot = atoi(parv[6]);
+  cli_firsttime(cptr) = strtoul(parv[7], 0, 10);
+#if defined(DDB)
+  cli_serv(cptr)->ddb_open = strtoul(parv[8], 0, 10);
+#endif
+  upgrade_get_flags(upgradeFlags, parv[9], upgrade_set_flag, cptr);
+  cli_serv(cptr)->up = up;
+  cli_serv(cptr)->updown = add_dlink(&cli_serv(up)->down, cptr);
+  SetServerYXX(cli_from(cptr), cptr, parv[2]);
+  attach_confs_byhost(cli_from(cptr), cli_name(cptr), CONF_UWORLD);
+
+  if (fd >= 0) {
+    struct ConfItem *aconf;
+
+    Count_unknownbecomesserver(UserStats);
+    SetServer(cptr);
+    cli_handler(cptr) = SERVER_HANDLER;
+    memset(cli_privs(cptr), 255, sizeof(struct Privs));
+    ClrPriv(cptr, PRIV_SET);
+    if ((aconf = conf_find_server(cli_name(cptr))))
+      attach_conf(cptr, aconf);
+    else
+      upgrade_drop(cptr);
+  } else
+    Count_newremoteserver(UserStats);
+  if (IsService(cptr))
+    ++UserStats.pservers;
+
+  add_client_to_list(cptr);
+  hAddClient(cptr);
+  return cptr;
+}
+
+/** Recreate a user from a U record.
+ * @param[in] parc Number of parameters.
+ * @param[in] parv Parameters.
+ * @return Restored user, or NULL if the record is malformed.
+ */
+static struct Client *upgrade_restore_user(int parc, char *parv[])
+{
+  struct Client *cptr;
+  struct Client *server;
+  struct User *user;
+
+  if (parc < 14 || !(server = FindNServer(parv[2])) || (!IsServer(server)
+      && server != &me) || FindUser(parv[12]))
+    return NULL;
+
+  if (server == &me)
+    cptr = make_client(0, STAT_UNKNOWN_USER);
+  else
+    cptr = make_client(cli_from(server), STAT_UNKNOWN);
+  user = make_user(cptr);
+  user->server = server;
+  ircd_strncpy(cli_name(cptr), parv[12], NICKLEN);
+  ircd_strncpy(cli_info(cptr), parv[13], REALLEN);
+  SetRemoteNumNick(cptr, parv[2]);
+  cli_hopcount(cptr) = atoi(parv[3]);
+  cli_lastnick(cptr) = strtoul(parv[4], 0, 10);
+  cli_firsttime(cptr) = strtoul(parv[5], 0, 10);
+  user->last = strtoul(parv[6], 0, 10);
+  upgrade_hextoip(parv[7], &cli_ip(cptr));
+  ircd_strncpy(user->username, parv[8], USERLEN);
+  ircd_strncpy(cli_username(cptr), parv[8], USERLEN);
+  ircd_strncpy(user->host, parv[9], HOSTLEN);
+  ircd_strncpy(user->realhost, parv[10], HOSTLEN);
+  upgrade_get_flags(upgradeFlags, parv[11], upgrade_set_flag, cptr);
+
+  add_client_to_list(cptr);
+  hAddClient(cptr);
+  if (server != &me) {
+    Count_newremoteclient(UserStats, server);
+    if (IsService(server))
+      ++UserStats.services;
+  }
+  IPcheck_remote_connect(cptr, 1);
+  SetUser(cptr);
+  if (IsInvisible(cptr))
+    ++UserStats.inv_clients;
+  if (IsOper(cptr))
+    ++UserStats.opers;
+  return cptr;
+}
+
+/** Attach the inherited connection of a local client from a C record.
+ * @param[in] cptr Local client of the previous S or U record.
+ * @param[in] fd File descriptor of the connection.
+ * @param[in] parc Number of parameters.
+ * @param[in] parv Parameters.
+ * @return Non-zero on success, zero if the client must be discarded.
+ */
+static int upgrade_restore_connection(struct Client *cptr, int fd, int parc,
+                                      char *parv[])
+{
+  struct irc_in_addr addr;
+  unsigned int byte;
+  int i;
+
+  if (parc < 18 || !upgrade_hextoip(parv[2], &addr))
+    return 0;
+
+  cli_nextnick(cptr) = strtoul(parv[4], 0, 10);
+  cli_nexttarget(cptr) = strtoul(parv[5], 0, 10);
+  cli_lasttime(cptr) = strtoul(parv[6], 0, 10);
+  cli_since(cptr) = strtoul(parv[7], 0, 10);
+  cli_sendM(cptr) = strtoul(parv[8], 0, 10);
+  cli_receiveM(cptr) = strtoul(parv[9], 0, 10);
+  cli_sendB(cptr) = strtoull(parv[10], 0, 10);
+  cli_receiveB(cptr) = strtoull(parv[11], 0, 10);
+  ircd_strncpy(cli_sock_ip(cptr), parv[12], SOCKIPLEN);
+  ircd_strncpy(cli_sockhost(cptr), parv[13], HOSTLEN);
+  for (i = 0; i < MAXTARGETS && sscanf(parv[14] + i * 2, "%2x", &byte) == 1;
+       i++)
+    cli_targets(cptr)[i] = byte;
+  upgrade_get_flags(upgradeCaps, parv[15], upgrade_set_cap, cli_capab(cptr));
+  upgrade_get_flags(upgradeCaps, parv[16], upgrade_set_cap, cli_active(cptr));
+  ircd_strncpy(cli_username(cptr), parv[17], USERLEN);
+  if ((cli_listener(cptr) = find_listener(atoi(parv[1]), &addr)))
+    ++cli_listener(cptr)->ref_count;
+
+  if (!adopt_connection(cptr, fd))
+    return 0;
+
+  if (IsUser(cptr)) {
+    Count_newunknown(UserStats);
+    Count_unknownbecomesclient(cptr, UserStats);
+    hAddLocalUser(cptr);
+    cli_handler(cptr) = IsAnOper(cptr) ? OPER_HANDLER : CLIENT_HANDLER;
+    if (ACR_OK != attach_iline(cptr))
+      upgrade_drop(cptr);
+    client_set_privs(cptr, NULL, 1);
+    set_snomask(cptr, strtoul(parv[3], 0, 10), SNO_SET);
+  }
+  return 1;
+}
+
+/** Recreate the data queued in a connection from a Q, R or r record.
+ * @param[in] cptr Local client.
+ * @param[in] type Record type.
+ * @param[in] data Queued data.
+ */
+static void upgrade_restore_queue(struct Client *cptr, const char *type,
+                                  const char *data)
+{
+  char buf[BUFSIZE + 1];
+  unsigned int len;
+
+  if (*type == 'Q') {
+    send_buffer(cptr, msgq_make(cptr, "%s", data), 0);
+    /* Those were counted when they were first queued. */
+    --cli_sendM(cptr);
+    --cli_sendM(&me);
+  } else if (IsServer(cptr)) {
+    if (*type == 'r' && (len = strlen(data)) < BUFSIZE) {
+      memcpy(cli_buffer(cptr), data, len);
+      cli_count(cptr) = len;
+    }
+  } else if (*type == 'R') {
+    len = ircd_snprintf(0, buf, sizeof(buf), "%s\n", data);
+    restore_recvq(cptr, buf, len);
+  } else
+    restore_recvq(cptr, data, strlen(data));
+}
+
+/** Apply a record that follows an S or U record.
+ * @param[in] cptr Client of the previous S or U record.
+ * @param[in] fd File descriptor of its connection, -1 if not local.
+ * @param[in,out] silence Where to append the next silence mask.
+ * @param[in] parc Number of parameters.
+ * @param[in] parv Parameters.
+ */
+static void upgrade_restore_client(struct Client *cptr, int fd,
+                                   struct Ban ***silence, int parc,
+                                   char *parv[])
+{
+  struct ConfItem *aconf;
+  struct Ban *ban;
+
+  if (!strcmp(parv[0], "C") && fd >= 0 && MyConnect(cptr)) {
+    if (!upgrade_restore_connection(cptr, fd, parc, parv)) {
+      log_write(LS_SYSTEM, L_ERROR, 0, "Unable to restore the connection "
+                "of %s", cli_name(cptr));
+      if (cli_fd(cptr) < 0)
+        close(fd);
+      upgrade_drop(cptr);
+    }
+  } else if (!strcmp(parv[0], "AC") && parc > 2 && IsUser(cptr)) {
+    ircd_strncpy(cli_user(cptr)->account, parv[1], ACCOUNTLEN);
+    cli_user(cptr)->acc_create = strtoul(parv[2], 0, 10);
+  } else if (!strcmp(parv[0], "A") && parc > 1 && IsUser(cptr))
+    DupString(cli_user(cptr)->away, parv[1]);
+  else if (!strcmp(parv[0], "O") && parc > 1 && MyUser(cptr)) {
+    if ((aconf = find_conf_exact(parv[1], cptr, CONF_OPERATOR))
+        && ACR_OK == attach_conf(cptr, aconf))
+      client_set_privs(cptr, aconf, 1);
+  } else if ((!strcmp(parv[0], "Q") || !strcmp(parv[0], "R")
+              || !strcmp(parv[0], "r")) && parc > 1 && MyConnect(cptr)
+             && cli_fd(cptr) >= 0)
+    upgrade_restore_queue(cptr, parv[0], parv[1]);
+  else if (!strcmp(parv[0], "SIL") && parc > 2 && *silence) {
+    if ((ban = make_ban(parv[2]))) {
+      ban->flags |= strtoul(parv[1], 0, 16);
+      **silence = ban;
+      *silence = &ban->next;
+    }
+  } else if (!strcmp(parv[0], "MON") && parc > 1 && IsUser(cptr))
+    monitor_add_nick(cptr, parv[1]);
+}
+
+/** Apply a record that follows a CH record.
+ * @param[in] chptr Channel of the previous CH record.
+ * @param[in,out] bans Where to append the next ban.
+ * @param[in] parc Number of parameters.
+ * @param[in] parv Parameters.
+ */
+static void upgrade_restore_channel(struct Channel *chptr, struct Ban ***bans,
+                                    int parc, char *parv[])
+{
+  struct Client *cptr;
+  struct Ban *ban;
+
+  if (!strcmp(parv[0], "CK") && parc > 1)
+    ircd_strncpy(chptr->mode.key, parv[1], KEYLEN);
+  else if (!strcmp(parv[0], "CU") && parc > 1)
+    ircd_strncpy(chptr->mode.upass, parv[1], KEYLEN);
+  else if (!strcmp(parv[0], "CA") && parc > 1)
+    ircd_strncpy(chptr->mode.apass, parv[1], KEYLEN);
+  else if (!strcmp(parv[0], "CT") && parc > 2) {
+    ircd_strncpy(chptr->topic_nick, parv[1], NICKLEN);
+    ircd_strncpy(chptr->topic, parv[2], TOPICLEN);
+  } else if (!strcmp(parv[0], "M") && parc > 3) {
+    if ((cptr = findNUser(parv[1])) && IsUser(cptr))
+      add_user_to_channel(chptr, cptr, strtoul(parv[2], 0, 16),
+                          atoi(parv[3]));
+  } else if (!strcmp(parv[0], "B") && parc > 4) {
+    if ((ban = make_ban(parv[4]))) {
+      ban->when = strtoul(parv[1], 0, 10);
+      ban->flags |= strtoul(parv[2], 0, 16);
+      ircd_strncpy(ban->who, parv[3], NICKLEN);
+      **bans = ban;
+      *bans = &ban->next;
+    }
+  }
+}
+
+/** Load the state file written by upgrade_save() in the old server
+ * process.  Must be called once the configuration has been read and
+ * the server identity is known.
+ */
+void upgrade_restore(void)
+{
+  char line[UPGRADE_LINELEN];
+  char *parv[UPGRADE_MAXPARA];
+  struct timeval start;
+  struct Client *cptr = NULL;
+  struct Channel *chptr = NULL;
+  struct Ban **bans = NULL;
+  struct Ban **silence = NULL;
+  FILE *file;
+  int parc;
+  int fd = -1;
+  int indexed = 0;
+  int done = 0;
+  int i;
+
+  if (!upgradeFile)
+    return;
+
+  gettimeofday(&start, NULL);
+  if (!(file = fopen(upgradeFile, "r"))) {
+    log_write(LS_SYSTEM, L_ERROR, 0, "Unable to read upgrade file %s: %m",
+              upgradeFile);
+    goto out;
+  }
+
+  parc = upgrade_read(file, line, parv);
+  if (parc < 8 || ircd_strcmp(parv[2], cli_name(&me))
+      || strcmp(parv[3], cli_yxx(&me))) {
+    log_write(LS_SYSTEM, L_CRIT, 0, "Upgrade file %s is for another server "
+              "name or numeric; dropping its connections", upgradeFile);
+    upgrade_abort(file);
+    fclose(file);
+    goto out;
+  }
+  cli_serv(&me)->timestamp = strtoul(parv[5], 0, 10);
+  cli_firsttime(&me) = strtoul(parv[6], 0, 10);
+  TSoffset = strtol(parv[7], 0, 10);
+
+  while (!done && (parc = upgrade_read(file, line, parv)) >= 0) {
+    if (parc < 1)
+      continue;
+
+    /* Channels, G-lines and jupes follow the clients.  Users must be
+     * indexed once their account has been read and before joining.
+     */
+    if (!indexed && (!strcmp(parv[0], "CH") || !strcmp(parv[0], "G")
+                     || !strcmp(parv[0], "J") || !strcmp(parv[0], "E"))) {
+      for (cptr = GlobalClientList; cptr; cptr = cli_next(cptr))
+        if (IsUser(cptr)) {
+          cli_clearprefix(cptr);
+          hAddUser(cptr);
+        }
+      indexed = 1;
+      cptr = NULL;
+    }
+
+    if (!strcmp(parv[0], "E"))
+      done = 1;
+    else if (!strcmp(parv[0], "MAX") && parc > 5) {
+      max_connection_count = strtoul(parv[1], 0, 10);
+      max_client_count = strtoul(parv[2], 0, 10);
+      max_global_count = strtoul(parv[3], 0, 10);
+      max_client_count_TS = strtoul(parv[4], 0, 10);
+      max_global_count_TS = strtoul(parv[5], 0, 10);
+    } else if (!indexed && (!strcmp(parv[0], "S") || !strcmp(parv[0], "U"))) {
+      fd = atoi(parv[1]);
+      cptr = (*parv[0] == 'S') ? upgrade_restore_server(parc, parv)
+        : upgrade_restore_user(parc, parv);
+      if (!cptr) {
+        log_write(LS_SYSTEM, L_ERROR, 0, "Bad %s record in upgrade file "
+                  "for %s", parv[0], parc > 12 ? parv[parc - 2] : "?");
+        if (fd > 2)
+          close(fd);
+      }
+      silence = (cptr && !IsServer(cptr)) ? &cli_user(cptr)->silence : NULL;
+    } else if (cptr)
+      upgrade_restore_client(cptr, fd, &silence, parc, parv);
+    else if (!strcmp(parv[0], "CH") && parc > 5) {
+      if ((chptr = get_channel(&me, parv[5], CGT_CREATE))) {
+        chptr->creationtime = strtoul(parv[1], 0, 10);
+        chptr->mode.mode = strtoul(parv[2], 0, 16);
+        chptr->mode.limit = strtoul(parv[3], 0, 10);
+        chptr->topic_time = strtoul(parv[4], 0, 10);
+        bans = &chptr->banlist;
+      }
+    } else if (!strcmp(parv[0], "G"))
+      gline_restore(parc, parv);
+    else if (!strcmp(parv[0], "J"))
+      jupe_restore(parc, parv);
+    else if (chptr)
+      upgrade_restore_channel(chptr, &bans, parc, parv);
+  }
+  fclose(file);
+
+  if (!done)
+    log_write(LS_SYSTEM, L_ERROR, 0, "Upgrade file %s is truncated",
+              upgradeFile);
+
+  /* Empty channels wait for their destruction as they did before. */
+  for (chptr = GlobalChannelList; chptr; chptr = chptr->next) {
+    if (chptr->users || chptr->destruct_event)
+      continue;
+    if (TStime() - chptr->creationtime < 172800)
+      schedule_destruct_event_1m(chptr);
+    else
+      schedule_destruct_event_48h(chptr);
+  }
+
+  log_write(LS_SYSTEM, L_NOTICE, 0, "Upgrade state restored from %s in "
+            "%lu ms: %u servers, %u clients, %u channels", upgradeFile,
+            upgrade_elapsed(&start), UserStats.servers, UserStats.clients,
+            UserStats.channels);
+  sendto_opmask_butone(0, SNO_OLDSNO, "Server upgraded: %u servers, %u "
+                       "clients, %u channels restored in %lu ms",
+                       UserStats.servers, UserStats.clients,
+                       UserStats.channels, upgrade_elapsed(&start));
+
+out:
+  /* Close the sockets that the configuration does not use any more. */
+  for (i = 0; i < upgradeListenerCount; i++)
+    if (upgradeListeners[i].fd >= 0)
+      close(upgradeListeners[i].fd);
+  MyFree(upgradeListeners);
+  upgradeListenerCount = 0;
+
+  for (i = 0; i < upgradeDropCount; i++)
+    if (!IsServer(upgradeDrops[i]))
+      exit_client(upgradeDrops[i], upgradeDrops[i], &me,
+                  "No Authorization - use another server");
+    else
+      exit_client(upgradeDrops[i], upgradeDrops[i], &me,
+                  "Lost Connect block");
+  MyFree(upgradeDrops);
+  upgradeDropCount = upgradeDropSize = 0;
+
+  unlink(upgradeFile);
+  MyFree(upgradeFile);
+}
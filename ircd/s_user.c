@@ -377,6 +377,7 @@ int register_user(struct Client *cptr, struct Client *sptr)
     }
 
     SetUser(sptr);
+    hAddLocalUser(sptr);
     cli_handler(sptr) = CLIENT_HANDLER;
     SetLocalNumNick(sptr);
     send_reply(sptr,
@@ -463,6 +464,8 @@ int register_user(struct Client *cptr, struct Client *sptr)
    */
   if (HasHiddenHost(sptr))
     hide_hostmask(sptr, 0, FLAG_HIDDENHOST);
+  cli_clearprefix(sptr);
+  hAddUser(sptr);
   if (IsInvisible(sptr))
     ++UserStats.inv_clients;
   if (IsOper(sptr))
@@ -1002,11 +1005,13 @@ int set_nick_name(struct Client* cptr, struct Client* sptr,
     if ((cli_name(sptr))[0])
       hRemClient(sptr);
     strcpy(cli_name(sptr), nick);
+    cli_clearprefix(sptr);
     hAddClient(sptr);
   }
   else {
     /* Local client setting NICK the first time */
     strcpy(cli_name(sptr), nick);
+    cli_clearprefix(sptr);
     hAddClient(sptr);
     return auth_set_nick(cli_auth(sptr), nick);
   }
@@ -1258,6 +1263,7 @@ int
 hide_hostmask(struct Client *cptr, const char *vhost, unsigned int flag)
 {
   struct Membership *chan;
+  int indexed;
 
   switch (flag) {
   case FLAG_HIDDENHOST:
@@ -1280,8 +1286,12 @@ hide_hostmask(struct Client *cptr, const char *vhost, unsigned int flag)
     return 0;
 
   sendcmdto_common_channels_butone(cptr, CMD_QUIT, cptr, ":Registered");
+  indexed = hRemUser(cptr);
   ircd_snprintf(0, cli_user(cptr)->host, HOSTLEN, "%s.%s",
                 cli_user(cptr)->account, feature_str(FEAT_HIDDEN_HOST));
+  cli_clearprefix(cptr);
+  if (indexed)
+    hAddUser(cptr);
 
   /* ok, the client is now fully hidden, so let them know -- hikari */
   if (MyConnect(cptr))
@@ -1655,7 +1665,7 @@ int set_user_mode(struct Client *cptr, struct Client *sptr, int parc,
    */
 #if !defined(DDB)
   if (!FlagHas(&setflags, FLAG_ACCOUNT) && IsAccount(sptr)) {
-      int len = ACCOUNTLEN;
+      int len = ACCOUNTLEN, indexed;
       char *ts;
       if ((ts = strchr(account, ':'))) {
 	len = (ts++) - account;
@@ -1664,7 +1674,10 @@ int set_user_mode(struct Client *cptr, struct Client *sptr, int parc,
 	      "account \"%s\", timestamp %Tu", account,
 	      cli_user(sptr)->acc_create));
       }
+      indexed = hRemUser(sptr);
       ircd_strncpy(cli_user(sptr)->account, account, len);
+      if (indexed)
+        hAddUser(sptr);
   }
 #endif
   if (!FlagHas(&setflags, FLAG_HIDDENHOST) && do_host_hiding && allow_modes != ALLOWMODES_DEFAULT)
@@ -1992,6 +2005,24 @@ int is_silenced(struct Client *sptr, struct Client *acptr)
   return 1;
 }
 
+/** Texts of the RPL_ISUPPORT lines, made when first sent. */
+static struct MsgBuf *supported[2];
+
+/** Forget the texts of the RPL_ISUPPORT lines.
+ * Called when a feature they report changes.
+ */
+void
+supported_recache(void)
+{
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    if (supported[i])
+      msgq_clean(supported[i]);
+    supported[i] = 0;
+  }
+}
+
 /** Send RPL_ISUPPORT lines to \a cptr.
  * @param[in] cptr Client to send ISUPPORT to.
  * @return Zero.
@@ -2001,10 +2032,13 @@ send_supported(struct Client *cptr)
 {
   char featurebuf[512];
 
-  ircd_snprintf(0, featurebuf, sizeof(featurebuf), FEATURES1, FEATURESVALUES1);
-  send_reply(cptr, RPL_ISUPPORT, featurebuf);
-  ircd_snprintf(0, featurebuf, sizeof(featurebuf), FEATURES2, FEATURESVALUES2);
-  send_reply(cptr, RPL_ISUPPORT, featurebuf);
+  if (!supported[0]) {
+    ircd_snprintf(0, featurebuf, sizeof(featurebuf), FEATURES1, FEATURESVALUES1);
+    supported[0] = reply_body(RPL_ISUPPORT, featurebuf);
+    ircd_snprintf(0, featurebuf, sizeof(featurebuf), FEATURES2, FEATURESVALUES2);
+    supported[1] = reply_body(RPL_ISUPPORT, featurebuf);
+  }
+  send_reply_shared(cptr, RPL_ISUPPORT, supported, 2);
 
   return 0; /* convenience return, if it's ever needed */
 }
@@ -82,6 +82,7 @@ static struct Connection *send_queues;
 static void dead_link(struct Client *to, char *notice)
 {
   SetFlag(to, FLAG_DEADSOCKET);
+  ping_schedule(to, CurrentTime); /* exit it in the next check */
   /*
    * If because of BUFFERPOOL problem then clean dbuf's now so that
    * notices don't hurt operators below.
@@ -509,6 +510,9 @@ void sendcmdto_common_channels_butone(struct Client *from, const char *cmd,
   struct MsgBuf *mb;
   struct Membership *chan;
   struct Membership *member;
+  struct SplitLocals *locals;
+  struct Client *acptr;
+  unsigned int ii;
 
   assert(0 != from);
   assert(0 != cli_from(from));
@@ -530,6 +534,18 @@ void sendcmdto_common_channels_butone(struct Client *from, const char *cmd,
   for (chan = cli_user(from)->channel; chan; chan = chan->next_channel) {
     if (IsZombie(chan) || IsDelayedJoin(chan))
       continue;
+    /* During a net.split, only look at the local members. */
+    if ((locals = split_locals(chan->channel))) {
+      for (ii = 0; ii < locals->count; ii++) {
+        acptr = locals->members[ii];
+        if (-1 < cli_fd(acptr) && acptr != one
+            && cli_sentalong(acptr) != sentalong_marker) {
+          cli_sentalong(acptr) = sentalong_marker;
+          send_buffer(acptr, mb, 0);
+        }
+      }
+      continue;
+    }
     for (member = chan->channel->members; member;
 	 member = member->next_member)
       if (MyConnect(member->user)
@@ -0,0 +1,53 @@
+/* bench_stub.c - support stubs for benchmarks linked with the ircd
+ *
+ * The benchmarks link every object of the ircd except ircd.c, whose
+ * main() they replace; this file stands in for the rest of ircd.c.
+ */
+
+#include "client.h"
+#include "ircd.h"
+#include <stdlib.h>
+
+struct Client me;
+struct Connection me_con;
+struct Client *GlobalClientList = &me;
+time_t TSoffset;
+time_t CurrentTime;
+char *configfile = "ircd.conf";
+int debuglevel = -1;
+char *debugmode = "";
+int running = 1;
+
+void
+server_die(const char *message)
+{
+    abort();
+}
+
+void
+server_panic(const char *message)
+{
+    abort();
+}
+
+void
+server_restart(const char *message)
+{
+    abort();
+}
+
+void
+server_upgrade(const char *message)
+{
+    abort();
+}
+
+void
+ping_schedule(struct Client *cptr, time_t when)
+{
+}
+
+void
+ping_unschedule(struct Client *cptr)
+{
+}
@@ -0,0 +1,411 @@
+/* ircd_bench.c - Microbenchmarks of the hot paths of the daemon
+ *
+ * Run with "make bench", or "./ircd_bench [-t msec] [name...]" to run
+ * only the benchmarks whose names start with one of the arguments.
+ * Each benchmark runs for at least msec milliseconds (200 by default)
+ * and reports its time and its calls to malloc() per operation.
+ */
+
+#include "config.h"
+#include "channel.h"
+#include "client.h"
+#include "dbuf.h"
+#include "hash.h"
+#include "ircd.h"
+#include "ircd_alloc.h"
+#include "ircd_features.h"
+#include "ircd_snprintf.h"
+#include "ircd_string.h"
+#include "match.h"
+#include "msgq.h"
+#include "struct.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+
+/** Calls to malloc(), calloc() and realloc() so far. */
+static unsigned long allocs;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+/* Count the allocations of the whole program. */
+void *
+malloc(size_t size)
+{
+    allocs++;
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    allocs++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    allocs++;
+    return __libc_realloc(ptr, size);
+}
+#define HAVE_ALLOC_COUNT 1
+#endif
+
+#define NCLIENTS 50000 /**< Clients in the hash table. */
+#define NBANS    50    /**< Bans on the test channel. */
+
+/** Keeps results alive so the compiler cannot drop the calls. */
+static volatile unsigned long sink;
+
+static struct Client user_cli, server_cli, *clients;
+static struct User user_data;
+static struct Channel *channel;
+static struct Ban *bans, *bans_hit;
+static char (*names)[NICKLEN + 1];
+static char (*absent)[NICKLEN + 1];
+static char cmask[256];
+static int cminlen;
+static struct MsgQ mq;
+static struct MsgBuf *shared_mb;
+static struct DBuf dbuf;
+static char lines[4096];
+static unsigned int lines_len;
+static struct irc_in_addr ip4, ip6, net4, net6;
+static unsigned char bits4, bits6;
+
+/** Set up the clients, channel, bans and buffers of the benchmarks. */
+static void
+setup(void)
+{
+    static const char *ban_masks[] = {
+        "*!*@*.dialup.example.net", "*!*@10.%d.0.0/16", "bad%d!*@*",
+        "*!~spam%d@*", "*!*@2001:db8:%x::/48", "*!*@host%d.example.org",
+        "*!*@192.0.2.%d", "*!*bot%d@*.example.com", "guest*!*@*.isp%d.es",
+        "*!*@*.%d.cloud.example"
+    };
+    struct Ban **tail;
+    char mask[NICKLEN + USERLEN + HOSTLEN + 3];
+    int ii;
+
+    feature_init();
+    init_hash();
+
+    ircd_strncpy(cli_name(&server_cli), "leaf.example.net", HOSTLEN);
+    ircd_strncpy(cli_yxx(&server_cli), "AB", 3);
+    cli_status(&server_cli) = STAT_SERVER;
+
+    ircd_strncpy(cli_name(&user_cli), "Someone", NICKLEN);
+    ircd_strncpy(cli_yxx(&user_cli), "AAB", 4);
+    cli_status(&user_cli) = STAT_USER;
+    cli_user(&user_cli) = &user_data;
+    user_data.server = &server_cli;
+    ircd_strncpy(user_data.username, "~someone", USERLEN);
+    ircd_strncpy(user_data.host, "dsl-21-143.madrid.isp.example.com", HOSTLEN);
+    ircd_strncpy(user_data.realhost, user_data.host, HOSTLEN);
+    ircd_aton(&cli_ip(&user_cli), "198.51.100.23");
+
+    clients = MyCalloc(NCLIENTS, sizeof(*clients));
+    names = MyCalloc(NCLIENTS, sizeof(*names));
+    absent = MyCalloc(NCLIENTS, sizeof(*absent));
+    for (ii = 0; ii < NCLIENTS; ii++) {
+        ircd_snprintf(0, names[ii], sizeof(names[ii]), "Nick%d|%x", ii, ii * 7);
+        ircd_snprintf(0, absent[ii], sizeof(absent[ii]), "Gone%d", ii);
+        ircd_strncpy(cli_name(&clients[ii]), names[ii], NICKLEN);
+        cli_status(&clients[ii]) = STAT_USER;
+        hAddClient(&clients[ii]);
+    }
+
+    channel = MyCalloc(1, sizeof(*channel) + sizeof("#benchmark"));
+    strcpy(channel->chname, "#benchmark");
+
+    /* none of these match the user; bans_hit ends with one that does */
+    for (tail = &bans, ii = 0; ii < NBANS; ii++) {
+        ircd_snprintf(0, mask, sizeof(mask), ban_masks[ii % 10], ii);
+        *tail = make_ban(mask);
+        tail = &(*tail)->next;
+    }
+    for (tail = &bans_hit, ii = 0; ii < NBANS; ii++) {
+        ircd_snprintf(0, mask, sizeof(mask), ii == NBANS - 1 ?
+                      "*!*@*.madrid.isp.example.com" : ban_masks[ii % 10], ii);
+        *tail = make_ban(mask);
+        tail = &(*tail)->next;
+    }
+
+    matchcomp(cmask, &cminlen, NULL, "*!*@*.isp.example.com");
+
+    msgq_init(&mq);
+    shared_mb = msgq_make(0, ":%C PRIVMSG %H :Hello, world", &user_cli, channel);
+
+    for (lines_len = 0; lines_len + 100 < sizeof(lines); )
+        lines_len += ircd_snprintf(0, lines + lines_len, sizeof(lines) - lines_len,
+                                   "AB P #benchmark :line %u of a burst\r\n",
+                                   lines_len);
+
+    ircd_aton(&ip4, "198.51.100.23");
+    ipmask_parse("198.51.100.0/24", &net4, &bits4);
+    ircd_aton(&ip6, "2001:db8:1234::5");
+    ipmask_parse("2001:db8:4321::/48", &net6, &bits6);
+}
+
+static void
+bench_match_hit(unsigned long n)
+{
+    while (n--)
+        sink += match("*!*@*.isp.example.com",
+                      "Someone!~someone@dsl-21-143.madrid.isp.example.com");
+}
+
+static void
+bench_match_miss(unsigned long n)
+{
+    while (n--)
+        sink += match("*!*@*.isp.example.net",
+                      "Someone!~someone@dsl-21-143.madrid.isp.example.com");
+}
+
+static void
+bench_matchexec(unsigned long n)
+{
+    while (n--)
+        sink += matchexec("Someone!~someone@dsl-21-143.madrid.isp.example.com",
+                          cmask, cminlen);
+}
+
+static void
+bench_hash_hit(unsigned long n)
+{
+    unsigned long ii;
+
+    for (ii = 0; ii < n; ii++)
+        sink += (unsigned long) hSeekClient(names[ii % NCLIENTS], ~0);
+}
+
+static void
+bench_hash_miss(unsigned long n)
+{
+    unsigned long ii;
+
+    for (ii = 0; ii < n; ii++)
+        sink += (unsigned long) hSeekClient(absent[ii % NCLIENTS], ~0);
+}
+
+static void
+bench_snprintf_name(unsigned long n)
+{
+    char buf[BUFSIZE];
+
+    while (n--)
+        sink += ircd_snprintf(0, buf, sizeof(buf), ":%C PRIVMSG %H :%s",
+                              &user_cli, channel, "Hello, world");
+}
+
+static void
+bench_snprintf_prefix(unsigned long n)
+{
+    char buf[BUFSIZE];
+
+    while (n--)
+        sink += ircd_snprintf(0, buf, sizeof(buf), ":%#C PRIVMSG %H :%s",
+                              &user_cli, channel, "Hello, world");
+}
+
+static void
+bench_snprintf_numeric(unsigned long n)
+{
+    char buf[BUFSIZE];
+
+    while (n--)
+        sink += ircd_snprintf(&server_cli, buf, sizeof(buf), "%C P %H :%s",
+                              &user_cli, channel, "Hello, world");
+}
+
+static void
+bench_msgq_make(unsigned long n)
+{
+    struct MsgBuf *mb;
+
+    while (n--) {
+        mb = msgq_make(0, ":%#C PRIVMSG %H :%s", &user_cli, channel,
+                       "Hello, world");
+        sink += (unsigned long) mb;
+        msgq_clean(mb);
+    }
+}
+
+/* Queue a shared message and send it, 16 at a time. */
+static void
+bench_msgq_add(unsigned long n)
+{
+    unsigned long ii;
+
+    for (ii = 1; ii <= n; ii++) {
+        msgq_add(&mq, shared_mb, 0);
+        if (!(ii % 16))
+            msgq_delete(&mq, MsgQLength(&mq));
+    }
+    msgq_delete(&mq, MsgQLength(&mq));
+}
+
+/* Map a queue of 64 messages, as send_queued() does before writev(). */
+static void
+bench_msgq_mapiov(unsigned long n)
+{
+    struct iovec iov[128];
+    unsigned int len;
+    int ii;
+
+    for (ii = 0; ii < 64; ii++)
+        msgq_add(&mq, shared_mb, ii % 8 == 0);
+    while (n--)
+        sink += msgq_mapiov(&mq, iov, 128, &len) + len;
+    msgq_delete(&mq, MsgQLength(&mq));
+}
+
+/* Append one line, emptying the buffer every 64 lines. */
+static void
+bench_dbuf_put(unsigned long n)
+{
+    static const char line[] = "AB P #benchmark :a line of a burst\r\n";
+    unsigned long ii;
+
+    for (ii = 1; ii <= n; ii++) {
+        dbuf_put(&dbuf, line, sizeof(line) - 1);
+        if (!(ii % 64))
+            dbuf_delete(&dbuf, DBufLength(&dbuf));
+    }
+    dbuf_delete(&dbuf, DBufLength(&dbuf));
+}
+
+/* Extract one line, refilling the buffer with 4 kB at a time. */
+static void
+bench_dbuf_getmsg(unsigned long n)
+{
+    char buf[BUFSIZE];
+
+    while (n--) {
+        if (!DBufLength(&dbuf))
+            dbuf_put(&dbuf, lines, lines_len);
+        sink += dbuf_getmsg(&dbuf, buf, sizeof(buf));
+    }
+    dbuf_delete(&dbuf, DBufLength(&dbuf));
+}
+
+static void
+bench_find_ban_miss(unsigned long n)
+{
+    while (n--)
+        sink += (unsigned long) find_ban(&user_cli, bans);
+}
+
+static void
+bench_find_ban_hit(unsigned long n)
+{
+    while (n--)
+        sink += (unsigned long) find_ban(&user_cli, bans_hit);
+}
+
+static void
+bench_ipmask_ipv4(unsigned long n)
+{
+    while (n--)
+        sink += ipmask_check(&ip4, &net4, bits4);
+}
+
+static void
+bench_ipmask_ipv6(unsigned long n)
+{
+    while (n--)
+        sink += ipmask_check(&ip6, &net6, bits6);
+}
+
+/** A benchmark. */
+static const struct {
+    const char *name;              /**< Name to select it and report it. */
+    void (*run)(unsigned long n);  /**< Run \a n operations. */
+} benchmarks[] = {
+    { "match/hit", bench_match_hit },
+    { "match/miss", bench_match_miss },
+    { "matchexec/hit", bench_matchexec },
+    { "hSeekClient/hit", bench_hash_hit },
+    { "hSeekClient/miss", bench_hash_miss },
+    { "ircd_snprintf/%C-name", bench_snprintf_name },
+    { "ircd_snprintf/%#C-prefix", bench_snprintf_prefix },
+    { "ircd_snprintf/%C-numeric", bench_snprintf_numeric },
+    { "msgq_make", bench_msgq_make },
+    { "msgq_add", bench_msgq_add },
+    { "msgq_mapiov/64", bench_msgq_mapiov },
+    { "dbuf_put", bench_dbuf_put },
+    { "dbuf_getmsg", bench_dbuf_getmsg },
+    { "find_ban/50-miss", bench_find_ban_miss },
+    { "find_ban/50-hit", bench_find_ban_hit },
+    { "ipmask_check/ipv4", bench_ipmask_ipv4 },
+    { "ipmask_check/ipv6", bench_ipmask_ipv6 },
+    { NULL, NULL }
+};
+
+/** Get a monotonic time in nanoseconds. */
+static double
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/** Run a benchmark for at least \a msec milliseconds and report it. */
+static void
+run_bench(const char *name, void (*run)(unsigned long), int msec)
+{
+    unsigned long n = 1, before;
+    double start, elapsed;
+
+    run(1000); /* warm up free lists and caches */
+    for (;;) {
+        before = allocs;
+        start = now_ns();
+        run(n);
+        elapsed = now_ns() - start;
+        if (elapsed >= msec * 1e6)
+            break;
+        /* aim 20% over the target, growing at most a hundred times */
+        if (elapsed < msec * 1e4)
+            n *= 100;
+        else
+            n = n * (msec * 1.2e6 / elapsed);
+    }
+#ifdef HAVE_ALLOC_COUNT
+    printf("%-26s %12lu %10.1f ns/op %8.3f allocs/op\n", name, n,
+           elapsed / n, (double) (allocs - before) / n);
+#else
+    printf("%-26s %12lu %10.1f ns/op %8s allocs/op\n", name, n,
+           elapsed / n, "-");
+#endif
+    fflush(stdout);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int msec = 200, first = 1, ii, jj;
+
+    if (argc > 2 && !strcmp(argv[1], "-t")) {
+        msec = atoi(argv[2]);
+        first = 3;
+    }
+    setup();
+    for (ii = 0; benchmarks[ii].name; ii++) {
+        for (jj = first; jj < argc; jj++)
+            if (!strncmp(benchmarks[ii].name, argv[jj], strlen(argv[jj])))
+                break;
+        if (first == argc || jj < argc)
+            run_bench(benchmarks[ii].name, benchmarks[ii].run, msec);
+    }
+    return 0;
+}
@@ -0,0 +1,258 @@
+/* ircd_maskidx_t.c - Test file for the index of host masks
+ *
+ * Run with "bench [masks]" to time the index against a linear scan
+ * of G-line like masks (100000 by default).
+ */
+
+#include "ircd_log.h"
+#include "ircd_maskidx.h"
+#include "ircd_string.h"
+#include "match.h"
+#include "res.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/** A mask of the test, like a G-line. */
+struct TestMask {
+    char mask[64];
+    struct irc_in_addr addr;
+    unsigned char bits;
+    int is_ip;
+    int found;
+    struct MaskEntry entry;
+};
+
+/** A client to look up. */
+struct TestClient {
+    char host[64];
+    struct irc_in_addr addr;
+};
+
+static struct TestMask *masks;
+static int nmasks;
+
+/** Make a random mask of one of the kinds seen in G-lines. */
+static void
+make_mask(struct TestMask *tm, int ii)
+{
+    int a = rand() & 255, b = rand() & 255, c = rand() & 255;
+
+    switch (ii % 8) {
+    case 0: snprintf(tm->mask, sizeof(tm->mask), "10.%d.%d.%d", a, b, c); break;
+    case 1: snprintf(tm->mask, sizeof(tm->mask), "10.%d.%d.0/24", a, b); break;
+    case 2: snprintf(tm->mask, sizeof(tm->mask), "172.%d.*", a & 31); break;
+    case 3: snprintf(tm->mask, sizeof(tm->mask), "host%d.Dom%d.com", ii, a); break;
+    case 4: snprintf(tm->mask, sizeof(tm->mask), "*.dom%d.net", ii % 5000); break;
+    case 5: snprintf(tm->mask, sizeof(tm->mask), "dsl-%d-*.isp%d.es", a, b); break;
+    case 6: snprintf(tm->mask, sizeof(tm->mask), "2001:db8:%x::/48", ii & 0xffff); break;
+    default:
+        if (ii % 512 == 7)
+            snprintf(tm->mask, sizeof(tm->mask), "*proxy%d*", a);
+        else
+            snprintf(tm->mask, sizeof(tm->mask), "user%d.isp%d.es", ii, b);
+        break;
+    }
+    tm->is_ip = ipmask_parse(tm->mask, &tm->addr, &tm->bits) != 0;
+}
+
+/** Make a random client, likely to hit some masks. */
+static void
+make_client(struct TestClient *tc, int ii)
+{
+    int a = rand() & 255, b = rand() & 255, c = rand() & 255;
+    char ip[40];
+
+    if (ii & 1)
+        snprintf(ip, sizeof(ip), "10.%d.%d.%d", a, b, c);
+    else if (ii & 2)
+        snprintf(ip, sizeof(ip), "172.%d.%d.%d", a & 63, b, c);
+    else
+        snprintf(ip, sizeof(ip), "2001:db8:%x::%x", rand() & 0xffff, c);
+    ipmask_parse(ip, &tc->addr, NULL);
+
+    switch (ii % 6) {
+    case 0: snprintf(tc->host, sizeof(tc->host), "host%d.dom%d.com", rand() % nmasks, a); break;
+    case 1: snprintf(tc->host, sizeof(tc->host), "a.b.DOM%d.net", rand() % 6000); break;
+    case 2: snprintf(tc->host, sizeof(tc->host), "dsl-%d-%d.isp%d.es", a, c, b); break;
+    case 3: snprintf(tc->host, sizeof(tc->host), "proxy%d.example.org", a); break;
+    case 4: snprintf(tc->host, sizeof(tc->host), "user%d.isp%d.es", rand() % nmasks, b); break;
+    default: strcpy(tc->host, ip); break;
+    }
+}
+
+static int
+mark_found(struct MaskEntry *entry, void *data)
+{
+    struct TestMask *tm = entry->data;
+    assert(tm->entry.prev_p != NULL);
+    tm->found++;
+    (*(int *)data)++;
+    return 0;
+}
+
+static int
+count_found(struct MaskEntry *entry, void *data)
+{
+    (*(int *)data)++;
+    return 0;
+}
+
+/** Check whether a mask matches a client, as gline_lookup() did. */
+static int
+linear_match(struct TestMask *tm, struct TestClient *tc)
+{
+    if (tm->is_ip)
+        return ipmask_check(&tc->addr, &tm->addr, tm->bits);
+    return !match(tm->mask, tc->host);
+}
+
+static void
+index_all(struct MaskIndex *idx, int step)
+{
+    int ii;
+
+    for (ii = 0; ii < nmasks; ii += step)
+        maskidx_add(idx, &masks[ii].entry, masks[ii].mask,
+                    masks[ii].is_ip ? &masks[ii].addr : NULL,
+                    masks[ii].bits, &masks[ii]);
+}
+
+/** Compare lookups in the index against brute force. */
+static void
+check_lookups(struct MaskIndex *idx, int nclients)
+{
+    struct TestClient tc;
+    int ii, jj, count;
+
+    for (ii = 0; ii < nclients; ii++) {
+        make_client(&tc, ii);
+        for (jj = 0; jj < nmasks; jj++)
+            masks[jj].found = 0;
+        count = 0;
+        maskidx_match(idx, tc.host, &tc.addr, mark_found, &count);
+        for (jj = 0; jj < nmasks; jj++) {
+            int expected = masks[jj].entry.prev_p && linear_match(&masks[jj], &tc);
+            if (masks[jj].found != expected) {
+                fprintf(stderr, "Mask %s for %s: found %d expected %d\n",
+                        masks[jj].mask, tc.host, masks[jj].found, expected);
+                abort();
+            }
+        }
+    }
+}
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+static void
+bench(int count)
+{
+    struct MaskIndex idx;
+    struct TestClient *clients;
+    struct timeval start;
+    int ii, jj, nclients = 2000;
+    unsigned long hits = 0, linear_hits = 0;
+    double t_index, t_linear, t_build;
+
+    nmasks = count;
+    masks = calloc(nmasks, sizeof(*masks));
+    clients = calloc(nclients, sizeof(*clients));
+    srand(2);
+    for (ii = 0; ii < nmasks; ii++)
+        make_mask(&masks[ii], ii);
+    for (ii = 0; ii < nclients; ii++)
+        make_client(&clients[ii], ii);
+
+    memset(&idx, 0, sizeof(idx));
+    gettimeofday(&start, NULL);
+    index_all(&idx, 1);
+    t_build = elapsed(&start);
+
+    gettimeofday(&start, NULL);
+    for (ii = 0; ii < nclients; ii++) {
+        int found = 0;
+        maskidx_match(&idx, clients[ii].host, &clients[ii].addr, count_found, &found);
+        hits += found;
+    }
+    t_index = elapsed(&start);
+
+    gettimeofday(&start, NULL);
+    for (ii = 0; ii < nclients; ii++)
+        for (jj = 0; jj < nmasks; jj++)
+            linear_hits += linear_match(&masks[jj], &clients[ii]);
+    t_linear = elapsed(&start);
+
+    assert(hits == linear_hits);
+    printf("%d masks: IP=%u Prefixes=%u Hashed=%u Other=%u, built in %.3f ms\n",
+           nmasks, idx.count - idx.hashed - idx.others, idx.ip.count,
+           idx.hashed, idx.others, t_build * 1e3);
+    printf("Index:  %.2f us/lookup, %.1f masks compared/lookup\n",
+           t_index * 1e6 / nclients, (double)idx.checks / idx.lookups);
+    printf("Linear: %.2f us/lookup, %d masks compared/lookup\n",
+           t_linear * 1e6 / nclients, nmasks);
+    maskidx_clear(&idx);
+    free(clients);
+    free(masks);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct MaskIndex idx;
+    struct irc_in_addr addr;
+    unsigned char bits;
+    int ii, count;
+
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+        bench(argc > 2 ? atoi(argv[2]) : 100000);
+        return 0;
+    }
+
+    nmasks = 4000;
+    masks = calloc(nmasks, sizeof(*masks));
+    srand(1);
+    for (ii = 0; ii < nmasks; ii++)
+        make_mask(&masks[ii], ii);
+    memset(&idx, 0, sizeof(idx));
+
+    printf("Testing lookups.\n");
+    index_all(&idx, 1);
+    assert(idx.count == (unsigned int)nmasks);
+    check_lookups(&idx, 1000);
+
+    printf("Testing exact lookups.\n");
+    count = 0;
+    maskidx_exact(&idx, "*.DOM4.net", NULL, 0, count_found, &count);
+    assert(count == 1);
+    count = 0;
+    maskidx_exact(&idx, "*.dom4.net.org", NULL, 0, count_found, &count);
+    assert(count == 0);
+    count = 0;
+    ipmask_parse(masks[1].mask, &addr, &bits);
+    maskidx_exact(&idx, masks[1].mask, &addr, bits, count_found, &count);
+    assert(count >= 1);
+
+    printf("Testing removal.\n");
+    for (ii = 0; ii < nmasks; ii += 2)
+        maskidx_del(&idx, &masks[ii].entry);
+    assert(idx.count == (unsigned int)nmasks / 2);
+    check_lookups(&idx, 500);
+    index_all(&idx, 2);
+    check_lookups(&idx, 500);
+
+    printf("Testing clear.\n");
+    maskidx_clear(&idx);
+    for (ii = 0; ii < nmasks; ii++)
+        assert(masks[ii].entry.prev_p == NULL);
+    assert(idx.ip.head == NULL && idx.count == 0);
+    free(masks);
+    return 0;
+}
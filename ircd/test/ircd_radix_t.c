@@ -0,0 +1,197 @@
+/* ircd_radix_t.c - Test file for the radix tree of IP prefixes */
+
+#include "ircd_log.h"
+#include "ircd_radix.h"
+#include "ircd_string.h"
+#include "match.h"
+#include "res.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Prefixes inserted in the tree. */
+static const char *test_masks[] = {
+    "10.0.0.0/8",
+    "10.1.0.0/16",
+    "10.1.2.0/24",
+    "10.1.2.3",
+    "192.168.0.0/16",
+    "192.168.1.0/24",
+    "2001:db8::/32",
+    "2001:db8:1::/48",
+    "0.0.0.0/0",
+    NULL
+};
+
+/** Lookups and the prefix expected as most specific match. */
+static const struct {
+    const char *addr;
+    const char *best;
+    int covering;
+} test_lookups[] = {
+    { "10.1.2.3", "10.1.2.3", 5 },
+    { "10.1.2.4", "10.1.2.0/24", 4 },
+    { "10.1.3.1", "10.1.0.0/16", 3 },
+    { "10.2.0.1", "10.0.0.0/8", 2 },
+    { "192.168.1.200", "192.168.1.0/24", 3 },
+    { "192.168.2.1", "192.168.0.0/16", 2 },
+    { "172.16.0.1", "0.0.0.0/0", 1 },
+    { "2001:db8:1::5", "2001:db8:1::/48", 2 },
+    { "2001:db8:2::5", "2001:db8::/32", 1 },
+    { "2001:db9::1", NULL, 0 },
+    { NULL }
+};
+
+static int
+count_node(struct RadixNode *node, void *data)
+{
+    (*(int *)data)++;
+    return 0;
+}
+
+static struct RadixNode *
+insert_mask(struct RadixTree *tree, const char *mask)
+{
+    struct irc_in_addr addr;
+    struct RadixNode *node;
+    unsigned char bits;
+
+    if (!ipmask_parse(mask, &addr, &bits)) {
+        fprintf(stderr, "Unable to parse %s\n", mask);
+        abort();
+    }
+    node = radix_insert(tree, &addr, bits);
+    assert(node->bits == bits);
+    node->data = (void *)mask;
+    return node;
+}
+
+static void
+test_lookup(struct RadixTree *tree, const char *text, const char *best,
+            int covering)
+{
+    struct irc_in_addr addr;
+    struct RadixNode *node;
+    int count = 0;
+
+    printf("Testing lookup of %s.\n", text);
+    ipmask_parse(text, &addr, NULL);
+    node = radix_best(tree, &addr);
+    if (best) {
+        assert(node != NULL);
+        assert(!strcmp(node->data, best));
+    } else
+        assert(node == NULL);
+    radix_walk_covering(tree, &addr, count_node, &count);
+    assert(count == covering);
+}
+
+/** Compare the tree against brute force with random prefixes. */
+static void
+test_random(void)
+{
+    struct RadixTree tree;
+    struct irc_in_addr addrs[500], probe;
+    unsigned char bits[500];
+    struct RadixNode *nodes[500], *node;
+    int ii, jj, count, expected;
+
+    printf("Testing random prefixes.\n");
+    memset(&tree, 0, sizeof(tree));
+    srand(1);
+    for (ii = 0; ii < 500; ii++) {
+        memset(&addrs[ii], 0, sizeof(addrs[ii]));
+        addrs[ii].in6_16[5] = 0xffff;
+        addrs[ii].in6_16[6] = htons(0x0a00 | (rand() & 3));
+        addrs[ii].in6_16[7] = htons(rand() & 0xffff);
+        bits[ii] = 96 + 8 + rand() % 25;
+        nodes[ii] = radix_insert(&tree, &addrs[ii], bits[ii]);
+        nodes[ii]->data = &addrs[ii];
+    }
+    for (ii = 0; ii < 2000; ii++) {
+        memset(&probe, 0, sizeof(probe));
+        probe.in6_16[5] = 0xffff;
+        probe.in6_16[6] = htons(0x0a00 | (rand() & 3));
+        probe.in6_16[7] = htons(rand() & 0xffff);
+        /* Distinct prefixes containing the probe */
+        for (jj = expected = 0; jj < 500; jj++) {
+            int kk;
+            if (!ipmask_check(&probe, &addrs[jj], bits[jj]))
+                continue;
+            for (kk = 0; kk < jj; kk++)
+                if (nodes[kk] == nodes[jj])
+                    break;
+            if (kk == jj)
+                expected++;
+        }
+        count = 0;
+        radix_walk_covering(&tree, &probe, count_node, &count);
+        assert(count == expected);
+    }
+    /* Remove half and check the structure stays consistent */
+    for (ii = 0; ii < 500; ii += 2) {
+        if (!(node = nodes[ii]))
+            continue;
+        radix_remove(&tree, node);
+        for (jj = 0; jj < 500; jj++)
+            if (nodes[jj] == node)
+                nodes[jj] = NULL;
+    }
+    for (ii = 1; ii < 500; ii += 2) {
+        if (!nodes[ii]) {
+            nodes[ii] = radix_insert(&tree, &addrs[ii], bits[ii]);
+            nodes[ii]->data = &addrs[ii];
+        }
+    }
+    for (ii = 1; ii < 500; ii += 2)
+        assert(radix_find(&tree, &addrs[ii], bits[ii]) == nodes[ii]);
+    count = 0;
+    radix_walk_within(&tree, &addrs[1], 0, count_node, &count);
+    assert((unsigned int)count == tree.count);
+    radix_clear(&tree);
+    assert(tree.head == NULL);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct RadixTree tree;
+    struct irc_in_addr addr;
+    struct RadixNode *node;
+    unsigned char bits;
+    int ii, count;
+
+    memset(&tree, 0, sizeof(tree));
+    for (ii = 0; test_masks[ii]; ii++)
+        insert_mask(&tree, test_masks[ii]);
+    assert(tree.count == ii);
+    /* Inserting again returns the same node */
+    assert(insert_mask(&tree, "10.1.0.0/16")->bits == 112);
+    assert(tree.count == ii);
+
+    for (ii = 0; test_lookups[ii].addr; ii++)
+        test_lookup(&tree, test_lookups[ii].addr, test_lookups[ii].best,
+                    test_lookups[ii].covering);
+
+    printf("Testing walk within 10.1.0.0/16.\n");
+    ipmask_parse("10.1.0.0/16", &addr, &bits);
+    count = 0;
+    radix_walk_within(&tree, &addr, bits, count_node, &count);
+    assert(count == 3);
+
+    printf("Testing removal.\n");
+    ipmask_parse("10.1.2.0/24", &addr, &bits);
+    node = radix_find(&tree, &addr, bits);
+    assert(node != NULL);
+    radix_remove(&tree, node);
+    assert(radix_find(&tree, &addr, bits) == NULL);
+    test_lookup(&tree, "10.1.2.4", "10.1.0.0/16", 3);
+    test_lookup(&tree, "10.1.2.3", "10.1.2.3", 4);
+    ipmask_parse("0.0.0.0/0", &addr, &bits);
+    radix_remove(&tree, radix_find(&tree, &addr, bits));
+    test_lookup(&tree, "172.16.0.1", NULL, 0);
+    radix_clear(&tree);
+
+    test_random();
+    return 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * IRC-Hispano IRC Daemon, ircd/throttle.c
+ *
+ * Copyright (C) 1997-2019 IRC-Hispano Development Team <toni@tonigarcia.es>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/** @file
+ * @brief Limit the rate of accepted connections by network.
+ *
+ * Every IPv4 /32 and /24 and every IPv6 /64 seen by accept() gets a
+ * token bucket that refills at ACCEPT_THROTTLE_xx connections each
+ * ACCEPT_THROTTLE_PERIOD seconds.  A connection is refused, before any
+ * Client is allocated for it, when one of the buckets of its address
+ * is empty.  IPcheck still applies its clone limits to the connections
+ * let through.
+ */
+#include "config.h"
+
+#include "throttle.h"
+#include "client.h"
+#include "ircd.h"
+#include "ircd_alloc.h"
+#include "ircd_events.h"
+#include "ircd_features.h"
+#include "ircd_log.h"
+#include "ircd_reply.h"
+#include "ircd_string.h"
+#include "numeric.h"
+#include "res.h"
+#include "s_debug.h"
+#include "send.h"
+
+/* #include <assert.h> -- Now using assert in ircd_log.h */
+#include <string.h>
+
+/** Token bucket of a network. */
+struct ThrottleEntry {
+  struct ThrottleEntry *next;     /**< Next entry in the hash chain. */
+  struct irc_in_addr    addr;     /**< Network address, masked. */
+  unsigned char         level;    /**< Index in #throttleLevels. */
+  unsigned int          credit;   /**< Tokens left, ACCEPT_THROTTLE_PERIOD per connection. */
+  time_t                last;     /**< Last time \a credit was refilled. */
+  time_t                last_refused; /**< Last refused connection. */
+  unsigned int          refused;  /**< Connections refused. */
+};
+
+/** Prefix length checked by the throttle. */
+struct ThrottleLevel {
+  const char    *name;     /**< Name shown in /stats. */
+  unsigned char  bits;     /**< Length of the prefix (IPv6 notation). */
+  int            ipv4;     /**< Non-zero for IPv4 addresses, zero for IPv6. */
+  enum Feature   feat;     /**< Feature with the connections per period. */
+  unsigned long  refused;  /**< Connections refused by this level. */
+};
+
+/** Levels of the throttle. */
+static struct ThrottleLevel throttleLevels[] = {
+  { "/32", 128, 1, FEAT_ACCEPT_THROTTLE_32, 0 },
+  { "/24", 120, 1, FEAT_ACCEPT_THROTTLE_24, 0 },
+  { "/64", 64, 0, FEAT_ACCEPT_THROTTLE_64, 0 }
+};
+
+/** Number of levels in #throttleLevels. */
+#define THROTTLE_LEVELS (sizeof(throttleLevels) / sizeof(throttleLevels[0]))
+/** Size of the hash table (must be a power of two). */
+#define THROTTLE_TABLE_SIZE 0x1000
+/** Seconds an entry is kept after its last refused connection. */
+#define THROTTLE_KEEP 600
+/** Number of offenders shown in /stats. */
+#define THROTTLE_TOP 10
+
+/** Macro for easy access to the refill period. */
+#define THROTTLE_PERIOD feature_int(FEAT_ACCEPT_THROTTLE_PERIOD)
+
+/** Hash table of ThrottleEntry. */
+static struct ThrottleEntry *throttleTable[THROTTLE_TABLE_SIZE];
+/** List of allocated but unused entries. */
+static struct ThrottleEntry *throttleFree;
+/** Number of entries in #throttleTable. */
+static unsigned int throttleCount;
+/** Connections checked. */
+static unsigned long throttleChecked;
+/** Connections refused. */
+static unsigned long throttleRefused;
+/** Periodic timer to release idle entries. */
+static struct Timer throttleTimer;
+
+/** Mask an address to a prefix length.
+ * @param[out] out Masked address.
+ * @param[in] addr Address to mask.
+ * @param[in] bits Length of the prefix, a multiple of 8.
+ */
+static void throttle_mask(struct irc_in_addr *out,
+                          const struct irc_in_addr *addr, unsigned char bits)
+{
+  memcpy(out, addr, sizeof(*out));
+  if (bits < 128)
+    memset((unsigned char *) out + bits / 8, 0, 16 - bits / 8);
+}
+
+/** Hash a masked address.
+ * @param[in] addr Masked address.
+ * @param[in] level Level of the prefix.
+ * @return Bucket of \a throttleTable.
+ */
+static unsigned int throttle_hash(const struct irc_in_addr *addr,
+                                  unsigned int level)
+{
+  unsigned int hash = level, ii;
+
+  for (ii = 0; ii < 8; ii++)
+    hash = (hash * 31) ^ addr->in6_16[ii];
+  hash ^= hash >> 13;
+  return hash & (THROTTLE_TABLE_SIZE - 1);
+}
+
+/** Find or create the bucket of a network.
+ * @param[in] addr Masked address.
+ * @param[in] level Level of the prefix.
+ * @param[in] limit Connections allowed per period.
+ * @return Bucket for the network.
+ */
+static struct ThrottleEntry *throttle_find(const struct irc_in_addr *addr,
+                                           unsigned int level,
+                                           unsigned int limit)
+{
+  struct ThrottleEntry *entry;
+  unsigned int bucket = throttle_hash(addr, level);
+
+  for (entry = throttleTable[bucket]; entry; entry = entry->next)
+    if (entry->level == level && !memcmp(&entry->addr, addr, sizeof(*addr)))
+      return entry;
+
+  if ((entry = throttleFree))
+    throttleFree = entry->next;
+  else
+    entry = (struct ThrottleEntry *) MyMalloc(sizeof(struct ThrottleEntry));
+  memset(entry, 0, sizeof(*entry));
+  memcpy(&entry->addr, addr, sizeof(entry->addr));
+  entry->level = level;
+  entry->credit = limit * THROTTLE_PERIOD;
+  entry->last = CurrentTime;
+  entry->next = throttleTable[bucket];
+  throttleTable[bucket] = entry;
+  throttleCount++;
+  return entry;
+}
+
+/** Refill the bucket of a network up to its burst.
+ * @param[in] entry Bucket to refill.
+ * @param[in] limit Connections allowed per period.
+ * @return Non-zero if the bucket is full.
+ */
+static int throttle_refill(struct ThrottleEntry *entry, unsigned int limit)
+{
+  unsigned int burst = limit * THROTTLE_PERIOD;
+
+  if (CurrentTime > entry->last) {
+    unsigned long credit = entry->credit
+      + (unsigned long) (CurrentTime - entry->last) * limit;
+    entry->credit = credit < burst ? credit : burst;
+    entry->last = CurrentTime;
+  }
+  return entry->credit >= burst;
+}
+
+/** Release the buckets that are full again and refused nothing lately.
+ * @param[in] ev Timer event (ignored).
+ */
+static void throttle_expire(struct Event *ev)
+{
+  struct ThrottleEntry **prev_p, *entry;
+  unsigned int ii;
+
+  for (ii = 0; ii < THROTTLE_TABLE_SIZE; ii++) {
+    for (prev_p = &throttleTable[ii]; (entry = *prev_p); ) {
+      int limit = feature_int(throttleLevels[entry->level].feat);
+
+      if ((limit <= 0 || throttle_refill(entry, limit))
+          && CurrentTime - entry->last_refused > THROTTLE_KEEP) {
+        *prev_p = entry->next;
+        entry->next = throttleFree;
+        throttleFree = entry;
+        throttleCount--;
+      } else
+        prev_p = &entry->next;
+    }
+  }
+}
+
+/** Initialize the connection throttle. */
+void throttle_init(void)
+{
+  timer_add(timer_init(&throttleTimer), throttle_expire, 0, TT_PERIODIC, 60);
+}
+
+/** Check whether a connection just accepted may go on.
+ * The connection takes a token from every bucket of its address, and
+ * only if all of them have one; refused connections take nothing.
+ * @param[in] addr Address of the peer.
+ * @return Non-zero if the connection is permitted, zero if denied.
+ */
+int throttle_accept(const struct irc_in_addr *addr)
+{
+  struct ThrottleEntry *entries[THROTTLE_LEVELS];
+  struct irc_in_addr masked;
+  unsigned int ii, period;
+  int ipv4, limit;
+
+  throttleChecked++;
+  if (CurrentTime - cli_since(&me) <= feature_int(FEAT_IPCHECK_CLONE_DELAY))
+    return 1;
+
+  period = THROTTLE_PERIOD;
+  ipv4 = irc_in_addr_is_ipv4(addr);
+  for (ii = 0; ii < THROTTLE_LEVELS; ii++) {
+    entries[ii] = NULL;
+    if (throttleLevels[ii].ipv4 != ipv4
+        || (limit = feature_int(throttleLevels[ii].feat)) <= 0)
+      continue;
+    throttle_mask(&masked, addr, throttleLevels[ii].bits);
+    entries[ii] = throttle_find(&masked, ii, limit);
+    throttle_refill(entries[ii], limit);
+    if (entries[ii]->credit < period) {
+      entries[ii]->refused++;
+      entries[ii]->last_refused = CurrentTime;
+      throttleLevels[ii].refused++;
+      throttleRefused++;
+      Debug((DEBUG_INFO, "Throttling connection from %s: %s too fast",
+             ircd_ntoa(addr), throttleLevels[ii].name));
+      return 0;
+    }
+  }
+
+  for (ii = 0; ii < THROTTLE_LEVELS; ii++)
+    if (entries[ii])
+      entries[ii]->credit -= period;
+  return 1;
+}
+
+/** Report the connection throttle and its worst offenders.
+ * @param[in] to Client requesting statistics.
+ * @param[in] sd Stats descriptor for request (ignored).
+ * @param[in] param Extra parameter from user (ignored).
+ */
+void throttle_report(struct Client *to, const struct StatDesc *sd,
+                     char *param)
+{
+  struct ThrottleEntry *top[THROTTLE_TOP], *entry;
+  unsigned int ii, jj, ntop = 0;
+
+  send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+             ":Throttle Checked=%lu Refused=%lu (%s=%lu %s=%lu %s=%lu) "
+             "Entries=%u", throttleChecked, throttleRefused,
+             throttleLevels[0].name, throttleLevels[0].refused,
+             throttleLevels[1].name, throttleLevels[1].refused,
+             throttleLevels[2].name, throttleLevels[2].refused,
+             throttleCount);
+
+  /* Keep the entries with most refused connections, sorted */
+  for (ii = 0; ii < THROTTLE_TABLE_SIZE; ii++) {
+    for (entry = throttleTable[ii]; entry; entry = entry->next) {
+      if (!entry->refused)
+        continue;
+      if (ntop == THROTTLE_TOP && entry->refused <= top[ntop - 1]->refused)
+        continue;
+      jj = ntop < THROTTLE_TOP ? ntop++ : ntop - 1;
+      for (; jj > 0 && top[jj - 1]->refused < entry->refused; jj--)
+        top[jj] = top[jj - 1];
+      top[jj] = entry;
+    }
+  }
+
+  for (ii = 0; ii < ntop; ii++) {
+    struct ThrottleLevel *level = &throttleLevels[top[ii]->level];
+
+    send_reply(to, SND_EXPLICIT | RPL_STATSDEBUG,
+               ":Throttled %s/%u Refused=%u Last=%lu", ircd_ntoa(&top[ii]->addr),
+               level->ipv4 ? level->bits - 96 : level->bits, top[ii]->refused,
+               (unsigned long) (CurrentTime - top[ii]->last_refused));
+  }
+}
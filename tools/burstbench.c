@@ -0,0 +1,838 @@
+/*
+ * IRC-Hispano IRC Daemon, tools/burstbench.c
+ *
+ * Copyright (C) 1997-2019 IRC-Hispano Development Team <toni@tonigarcia.es>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/** @file
+ * @brief Record and replay netbursts to measure how fast they are absorbed.
+ *
+ * burstbench has three modes:
+ *
+ *  - "record" sits between a server and its uplink as a TCP proxy and
+ *    saves the P10 lines the uplink sends, from its PASS and SERVER up
+ *    to its END_OF_BURST, to a file (PING and PONG are left out).
+ *  - "generate" writes a synthetic burst file with the given numbers of
+ *    servers, users, channels and G-lines.
+ *  - "replay" connects to a server port of an ircd, pretending to be the
+ *    recorded uplink, and writes the whole burst as fast as the socket
+ *    takes it.  It reports the time until the ircd acknowledges our
+ *    END_OF_BURST, the CPU time and the resident and peak memory of the
+ *    ircd process (with -P, from /proc), and, when an operator login is
+ *    given, the handler time of each server command from "STATS m time".
+ *
+ * The ircd needs a Connect block for the name and password of the
+ * uplink, with hub permission, from the address of burstbench.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LINE_SIZE   512      /**< Longest P10 line, with CR LF. */
+#define IO_SIZE     65536    /**< Size of socket reads and writes. */
+#define TOP_CMDS    15       /**< Commands shown from STATS m time. */
+#define TIMEOUT_MS  120000   /**< Longest wait for the ircd. */
+
+/** Characters of the P10 base64 numerics. */
+static const char b64[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789[]";
+
+/** Buffer of lines read from a socket. */
+struct LineReader {
+  int    fd;           /**< Socket to read from. */
+  size_t len;          /**< Bytes in \a buf. */
+  size_t pos;          /**< Start of the next line in \a buf. */
+  char   buf[IO_SIZE + LINE_SIZE]; /**< Data read. */
+};
+
+/** Handler time of a command, from STATS m time. */
+struct CmdTime {
+  char          cmd[16];  /**< Command name. */
+  unsigned long calls;    /**< Calls of its server handler. */
+  unsigned long total_ms; /**< Total time in the handler. */
+  unsigned long avg_us;   /**< Average time of a call. */
+  unsigned long max_us;   /**< Longest call. */
+};
+
+/** Get the time of a monotonic clock.
+ * @return Microseconds since some arbitrary point.
+ */
+static uint64_t
+now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/** Print an error message and exit.
+ * @param[in] fmt Format of the message.
+ */
+static void
+die(const char *fmt, ...)
+{
+  va_list vl;
+
+  va_start(vl, fmt);
+  vfprintf(stderr, fmt, vl);
+  va_end(vl);
+  fputc('\n', stderr);
+  exit(1);
+}
+
+/** Resolve a "host:port" string.
+ * @param[in] hostport Address to resolve.
+ * @param[in] passive Non-zero to get an address to listen on.
+ * @return Address info list; exits on error.
+ */
+static struct addrinfo *
+resolve(const char *hostport, int passive)
+{
+  struct addrinfo hints, *res;
+  char host[256];
+  const char *colon;
+  int err;
+
+  if (!(colon = strrchr(hostport, ':')) || (size_t) (colon - hostport) >= sizeof(host))
+    die("Bad address %s, expected host:port", hostport);
+  memcpy(host, hostport, colon - hostport);
+  host[colon - hostport] = '\0';
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  if ((err = getaddrinfo(host[0] ? host : NULL, colon + 1, &hints, &res)))
+    die("%s: %s", hostport, gai_strerror(err));
+  return res;
+}
+
+/** Connect to a "host:port".
+ * @param[in] hostport Address to connect to.
+ * @return Connected socket; exits on error.
+ */
+static int
+tcp_connect(const char *hostport)
+{
+  struct addrinfo *ai = resolve(hostport, 0);
+  int fd;
+
+  if ((fd = socket(ai->ai_family, SOCK_STREAM, 0)) < 0
+      || connect(fd, ai->ai_addr, ai->ai_addrlen) < 0)
+    die("Cannot connect to %s: %s", hostport, strerror(errno));
+  freeaddrinfo(ai);
+  return fd;
+}
+
+/** Write a whole buffer to a blocking socket.
+ * @param[in] fd Socket.
+ * @param[in] buf Data to write.
+ * @param[in] len Length of \a buf.
+ */
+static void
+write_all(int fd, const char *buf, size_t len)
+{
+  ssize_t res;
+
+  while (len > 0) {
+    if ((res = write(fd, buf, len)) < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      die("write: %s", strerror(errno));
+    }
+    buf += res;
+    len -= res;
+  }
+}
+
+/** Send a formatted line with CR LF.
+ * @param[in] fd Socket.
+ * @param[in] fmt Format of the line.
+ */
+static void
+send_line(int fd, const char *fmt, ...)
+{
+  char line[LINE_SIZE];
+  va_list vl;
+  int len;
+
+  va_start(vl, fmt);
+  len = vsnprintf(line, sizeof(line) - 2, fmt, vl);
+  va_end(vl);
+  if (len > (int) sizeof(line) - 3)
+    len = sizeof(line) - 3;
+  line[len++] = '\r';
+  line[len++] = '\n';
+  write_all(fd, line, len);
+}
+
+/** Get the next complete line from a reader, without reading.
+ * @param[in,out] lr Line reader.
+ * @return Line without CR LF, or NULL if there is no complete line.
+ */
+static char *
+next_line(struct LineReader *lr)
+{
+  char *line = lr->buf + lr->pos, *end;
+
+  if (!(end = memchr(line, '\n', lr->len - lr->pos)))
+    return NULL;
+  lr->pos = end + 1 - lr->buf;
+  *end = '\0';
+  if (end > line && end[-1] == '\r')
+    end[-1] = '\0';
+  return line;
+}
+
+/** Read more data into a line reader.
+ * @param[in,out] lr Line reader.
+ * @return Bytes read, 0 on end of file, -1 if nothing could be read.
+ */
+static ssize_t
+fill_lines(struct LineReader *lr)
+{
+  ssize_t res;
+
+  memmove(lr->buf, lr->buf + lr->pos, lr->len - lr->pos);
+  lr->len -= lr->pos;
+  lr->pos = 0;
+  if (lr->len >= sizeof(lr->buf) - 1)
+    lr->len = 0; /* line too long, give up on it */
+  if ((res = read(lr->fd, lr->buf + lr->len, sizeof(lr->buf) - 1 - lr->len)) > 0)
+    lr->len += res;
+  else if (res < 0 && (errno == EAGAIN || errno == EINTR))
+    res = -1;
+  else if (res < 0)
+    res = 0;
+  return res;
+}
+
+/** Wait for a line from a blocking socket.
+ * @param[in,out] lr Line reader.
+ * @return Line without CR LF, or NULL on end of file or timeout.
+ */
+static char *
+wait_line(struct LineReader *lr)
+{
+  struct pollfd pfd;
+  char *line;
+
+  while (!(line = next_line(lr))) {
+    pfd.fd = lr->fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, TIMEOUT_MS) <= 0 || fill_lines(lr) == 0)
+      return NULL;
+  }
+  return line;
+}
+
+/** Find the second word (the command) of a P10 line.
+ * @param[in] line Line to look at.
+ * @param[out] cmd Buffer for the command.
+ * @param[in] size Size of \a cmd.
+ */
+static void
+line_command(const char *line, char *cmd, size_t size)
+{
+  const char *start;
+  size_t len;
+
+  cmd[0] = '\0';
+  if (!(start = strchr(line, ' ')))
+    return;
+  start++;
+  len = strcspn(start, " ");
+  if (len >= size)
+    len = size - 1;
+  memcpy(cmd, start, len);
+  cmd[len] = '\0';
+}
+
+/** Find the numeric of a server in its SERVER line.
+ * @param[in] line "SERVER name hop start link J10 numcap +flags :desc".
+ * @param[out] num Buffer of at least 3 bytes for the numeric.
+ * @return Zero on success, -1 if the line has no numeric.
+ */
+static int
+server_numeric(const char *line, char *num)
+{
+  char numcap[16];
+
+  if (sscanf(line, "SERVER %*s %*s %*s %*s %*s %15s", numcap) != 1)
+    return -1;
+  /* two character numerics come with three characters of capacity */
+  if (strlen(numcap) == 5) {
+    memcpy(num, numcap, 2);
+    num[2] = '\0';
+  } else {
+    num[0] = numcap[0];
+    num[1] = '\0';
+  }
+  return 0;
+}
+
+/** Relay a link between a server and its uplink, recording the burst.
+ * @param[in] argc Number of arguments.
+ * @param[in] argv Arguments.
+ * @return Exit code.
+ */
+static int
+do_record(int argc, char *argv[])
+{
+  static struct LineReader up;
+  struct addrinfo *ai;
+  struct pollfd pfd[2];
+  const char *listen_on = NULL, *uplink = NULL, *output = NULL;
+  char down_buf[IO_SIZE], cmd[16], upnum[3] = "", *line;
+  unsigned long lines = 0, bytes = 0, eb = 0;
+  int ch, all = 0, lfd, down, recording = 1, one = 1;
+  FILE *out;
+  ssize_t res;
+
+  while ((ch = getopt(argc, argv, "al:u:o:")) != -1) {
+    switch (ch) {
+    case 'a': all = 1; break;
+    case 'l': listen_on = optarg; break;
+    case 'u': uplink = optarg; break;
+    case 'o': output = optarg; break;
+    default: return 2;
+    }
+  }
+  if (!listen_on || !uplink || !output)
+    die("Usage: burstbench record [-a] -l [host]:port -u host:port -o file");
+  if (!(out = fopen(output, "w")))
+    die("%s: %s", output, strerror(errno));
+
+  ai = resolve(listen_on, 1);
+  if ((lfd = socket(ai->ai_family, SOCK_STREAM, 0)) < 0
+      || setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0
+      || bind(lfd, ai->ai_addr, ai->ai_addrlen) < 0 || listen(lfd, 1) < 0)
+    die("Cannot listen on %s: %s", listen_on, strerror(errno));
+  freeaddrinfo(ai);
+  fprintf(stderr, "Waiting for the server on %s\n", listen_on);
+  if ((down = accept(lfd, NULL, NULL)) < 0)
+    die("accept: %s", strerror(errno));
+  close(lfd);
+  up.fd = tcp_connect(uplink);
+  fprintf(stderr, "Relaying to %s\n", uplink);
+
+  pfd[0].fd = down;
+  pfd[1].fd = up.fd;
+  pfd[0].events = pfd[1].events = POLLIN;
+  for (;;) {
+    if (poll(pfd, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      die("poll: %s", strerror(errno));
+    }
+    if (pfd[0].revents) {
+      if ((res = read(down, down_buf, sizeof(down_buf))) <= 0)
+        break;
+      write_all(up.fd, down_buf, res);
+    }
+    if (pfd[1].revents) {
+      if ((res = fill_lines(&up)) == 0)
+        break;
+      if (res < 0)
+        continue;
+      write_all(down, up.buf + up.len - res, res); /* what was just read */
+
+      while ((line = next_line(&up))) {
+        if (!recording)
+          continue;
+        line_command(line, cmd, sizeof(cmd));
+        if (!upnum[0] && !strncmp(line, "SERVER ", 7))
+          server_numeric(line, upnum);
+        if (!strcmp(cmd, "G") || !strcmp(cmd, "Z") || !strcmp(cmd, "PING")
+            || !strcmp(cmd, "PONG"))
+          continue;
+        fprintf(out, "%s\n", line);
+        lines++;
+        bytes += strlen(line) + 2;
+        /* the burst of the uplink ends with its own END_OF_BURST */
+        if (!all && !strcmp(cmd, "EB") && upnum[0]
+            && !strncmp(line, upnum, strlen(upnum)) && line[strlen(upnum)] == ' ') {
+          recording = 0;
+          eb = lines;
+          fflush(out);
+          fprintf(stderr, "Recorded %lu lines (%lu bytes) up to END_OF_BURST\n",
+                  lines, bytes);
+        }
+      }
+    }
+  }
+
+  fclose(out);
+  if (!eb)
+    fprintf(stderr, "Recorded %lu lines (%lu bytes)\n", lines, bytes);
+  return 0;
+}
+
+/** Write a number in P10 base64.
+ * @param[out] out Buffer of at least \a digits + 1 bytes.
+ * @param[in] value Number to write.
+ * @param[in] digits Number of digits.
+ * @return \a out.
+ */
+static char *
+to_b64(char *out, unsigned long value, int digits)
+{
+  out[digits] = '\0';
+  while (digits-- > 0) {
+    out[digits] = b64[value & 63];
+    value >>= 6;
+  }
+  return out;
+}
+
+/** Write a synthetic burst.
+ * The uplink gets the numeric given with -N, the servers behind it the
+ * following numerics; users are spread over all of them.  Channel
+ * sizes follow 1/rank, like on real networks.
+ * @param[in] argc Number of arguments.
+ * @param[in] argv Arguments.
+ * @return Exit code.
+ */
+static int
+do_generate(int argc, char *argv[])
+{
+  const char *name = "hub.example.net", *pass = "pw", *output = NULL;
+  unsigned long servers = 10, users = 10000, channels = 2000, glines = 100;
+  unsigned long base = 100;
+  unsigned long ii, jj, members, memberships = 0, start;
+  double harmonic = 0.0;
+  char up[4], num[4], unum[4], ip[8];
+  time_t now = time(NULL);
+  FILE *out;
+  int ch, len, sep;
+
+  while ((ch = getopt(argc, argv, "n:p:N:s:u:c:g:o:")) != -1) {
+    switch (ch) {
+    case 'n': name = optarg; break;
+    case 'p': pass = optarg; break;
+    case 'N': base = strtoul(optarg, NULL, 10); break;
+    case 's': servers = strtoul(optarg, NULL, 10); break;
+    case 'u': users = strtoul(optarg, NULL, 10); break;
+    case 'c': channels = strtoul(optarg, NULL, 10); break;
+    case 'g': glines = strtoul(optarg, NULL, 10); break;
+    case 'o': output = optarg; break;
+    default: return 2;
+    }
+  }
+  if (!output || !servers || base + servers > 4096 || users / servers > 262143)
+    die("Usage: burstbench generate [-n name] [-p pass] [-N numeric] "
+        "[-s servers]\n       [-u users] [-c channels] [-g glines] -o file");
+  if (!(out = fopen(output, "w")))
+    die("%s: %s", output, strerror(errno));
+  srand(1);
+  to_b64(up, base, 2);
+
+  fprintf(out, "PASS :%s\n", pass);
+  fprintf(out, "SERVER %s 1 %lu %lu J10 %s]]] +h6 :burstbench uplink\n",
+          name, (unsigned long) now - 86400, (unsigned long) now, up);
+  for (ii = 1; ii < servers; ii++)
+    fprintf(out, "%s S leaf%lu.example.net 2 %lu %lu J10 %s]]] +6 :leaf %lu\n",
+            up, ii, (unsigned long) now - 3600, (unsigned long) now,
+            to_b64(num, base + ii, 2), ii);
+
+  for (ii = 0; ii < users; ii++) {
+    to_b64(num, base + ii % servers, 2);
+    fprintf(out, "%s N u%lu_%s 1 %lu user%lu host%lu.users.example.net %s"
+            "%s %s%s :Synthetic user %lu\n", num, ii, num,
+            (unsigned long) now - (ii % 86400), ii % 1000, ii,
+            (ii % 10) ? "+i " : "+iw ",
+            to_b64(ip, 0x0a000000UL + ii, 6), num,
+            to_b64(unum, ii / servers, 3), ii);
+  }
+
+  /* channel k gets users * 3 / (k * H) members, H the harmonic number */
+  for (ii = 1; ii <= channels; ii++)
+    harmonic += 1.0 / ii;
+  for (ii = 1; ii <= channels; ii++) {
+    members = (unsigned long) (users * 3.0 / (ii * harmonic));
+    if (members < 1)
+      members = 1;
+    if (members > users)
+      members = users;
+    start = (unsigned long) rand() % users;
+    len = fprintf(out, "%s B #chan%lu %lu +nt", up, ii,
+                  (unsigned long) now - 86400 * 30 + ii);
+    sep = ' ';
+    for (jj = 0; jj < members; jj++) {
+      unsigned long user = (start + jj) % users;
+
+      if (len > 400) { /* continue in another B line, like real bursts */
+        fprintf(out, "\n");
+        len = fprintf(out, "%s B #chan%lu %lu", up, ii,
+                      (unsigned long) now - 86400 * 30 + ii);
+        sep = ' ';
+      }
+      /* a member mode holds for the rest of the line, so the op goes last */
+      len += fprintf(out, "%c%s%s%s", sep, to_b64(num, base + user % servers, 2),
+                     to_b64(unum, user / servers, 3),
+                     jj == members - 1 ? ":o" : "");
+      sep = ',';
+      memberships++;
+    }
+    if (ii % 10 == 0)
+      fprintf(out, " :%%*!*@banned%lu.example.net", ii);
+    fprintf(out, "\n");
+  }
+
+  for (ii = 0; ii < glines; ii++)
+    fprintf(out, "%s GL * +*@glined%lu.example.net %lu %lu %lu :Synthetic "
+            "G-line %lu\n", up, ii, 86400UL, (unsigned long) now,
+            (unsigned long) now + 86400, ii);
+  fprintf(out, "%s EB\n", up);
+  fclose(out);
+
+  fprintf(stderr, "Generated %lu servers, %lu users, %lu channels with %lu "
+          "members, %lu G-lines\n", servers, users, channels, memberships,
+          glines);
+  return 0;
+}
+
+/** Read the CPU time and memory use of a process.
+ * @param[in] pid Process to look at.
+ * @param[out] cpu_ms User and system CPU time, in milliseconds.
+ * @param[out] rss_kb Resident memory, in kilobytes.
+ * @param[out] hwm_kb Peak resident memory, in kilobytes.
+ * @return Zero on success, -1 on error.
+ */
+static int
+proc_usage(pid_t pid, unsigned long *cpu_ms, unsigned long *rss_kb,
+           unsigned long *hwm_kb)
+{
+  char path[64], line[1024], *pos;
+  unsigned long utime, stime;
+  FILE *file;
+
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+  if (!(file = fopen(path, "r")))
+    return -1;
+  pos = fgets(line, sizeof(line), file);
+  fclose(file);
+  /* the command name may hold spaces; the fields follow its ')' */
+  if (!pos || !(pos = strrchr(line, ')'))
+      || sscanf(pos + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                &utime, &stime) != 2)
+    return -1;
+  *cpu_ms = (utime + stime) * 1000 / sysconf(_SC_CLK_TCK);
+
+  *rss_kb = *hwm_kb = 0;
+  snprintf(path, sizeof(path), "/proc/%d/status", (int) pid);
+  if (!(file = fopen(path, "r")))
+    return -1;
+  while (fgets(line, sizeof(line), file)) {
+    sscanf(line, "VmRSS: %lu", rss_kb);
+    sscanf(line, "VmHWM: %lu", hwm_kb);
+  }
+  fclose(file);
+  return 0;
+}
+
+/** Reset the peak resident memory of a process, where Linux allows it.
+ * @param[in] pid Process to reset.
+ */
+static void
+proc_reset_peak(pid_t pid)
+{
+  char path[64];
+  FILE *file;
+
+  snprintf(path, sizeof(path), "/proc/%d/clear_refs", (int) pid);
+  if ((file = fopen(path, "w"))) {
+    fputs("5", file);
+    fclose(file);
+  }
+}
+
+/** Compare two commands by handler time, longest first.
+ * @param[in] a First CmdTime.
+ * @param[in] b Second CmdTime.
+ * @return Result of the comparison for qsort().
+ */
+static int
+cmdtime_cmp(const void *a, const void *b)
+{
+  const struct CmdTime *ca = a, *cb = b;
+
+  if (ca->total_ms != cb->total_ms)
+    return ca->total_ms < cb->total_ms ? 1 : -1;
+  return ca->calls < cb->calls ? 1 : ca->calls > cb->calls ? -1 : 0;
+}
+
+/** Log in as operator on a client port of the ircd.
+ * @param[in,out] lr Line reader, whose fd is connected to the ircd.
+ * @param[in] login "name:password" of the Operator block.
+ * @param[out] server Name of the ircd, at least 64 bytes.
+ */
+static void
+oper_login(struct LineReader *lr, const char *login, char *server)
+{
+  char name[64], *line, *colon;
+
+  if (!(colon = strchr(login, ':')) || (size_t) (colon - login) >= sizeof(name))
+    die("Bad operator login %s, expected name:password", login);
+  memcpy(name, login, colon - login);
+  name[colon - login] = '\0';
+
+  send_line(lr->fd, "NICK bb%d", (int) getpid() % 100000);
+  send_line(lr->fd, "USER burstbench 0 * :burstbench");
+  while ((line = wait_line(lr))) {
+    if (!strncmp(line, "PING ", 5))
+      send_line(lr->fd, "PONG %s", line + 5);
+    else if (sscanf(line, ":%63s 001 ", server) == 1)
+      break;
+  }
+  if (!line)
+    die("Cannot register the operator client");
+  send_line(lr->fd, "OPER %s %s", name, colon + 1);
+  while ((line = wait_line(lr)) && !strstr(line, " 381 "))
+    if (strstr(line, " 491 ") || strstr(line, " 464 "))
+      die("OPER %s failed: %s", name, line);
+  if (!line)
+    die("Cannot become operator");
+}
+
+/** Run a STATS m query and wait for its end.
+ * @param[in,out] lr Line reader of the operator client.
+ * @param[in] server Name of the ircd.
+ * @param[in] param "reset" or "time".
+ * @param[out] cmds Server handler times found, or NULL to ignore them.
+ * @param[in] max Size of \a cmds.
+ * @return Number of entries in \a cmds.
+ */
+static int
+stats_commands(struct LineReader *lr, const char *server, const char *param,
+               struct CmdTime *cmds, int max)
+{
+  struct CmdTime ct;
+  char *line, type[16];
+  int count = 0;
+
+  send_line(lr->fd, "STATS m %s %s", server, param);
+  while ((line = wait_line(lr)) && !strstr(line, " 219 ")) {
+    if (!cmds || count >= max || !strstr(line, " 249 "))
+      continue;
+    if (sscanf(line, ":%*s 249 %*s :%15s %15s %lu %lu %lu %lu", ct.cmd, type,
+               &ct.calls, &ct.total_ms, &ct.avg_us, &ct.max_us) == 6
+        && !strcmp(type, "server"))
+      cmds[count++] = ct;
+  }
+  return count;
+}
+
+/** Replay a burst file into an ircd.
+ * @param[in] argc Number of arguments.
+ * @param[in] argv Arguments.
+ * @return Exit code.
+ */
+static int
+do_replay(int argc, char *argv[])
+{
+  static struct LineReader link, oper;
+  struct CmdTime cmds[256];
+  struct pollfd pfd;
+  const char *target = NULL, *input = NULL, *name = NULL, *pass = NULL;
+  const char *client = NULL, *login = NULL;
+  char *burst, *line, *next, *out, cmd[16], num[3] = "", server[64] = "";
+  size_t size, used, sent, hello = 0;
+  unsigned long lines = 0, cpu0 = 0, cpu1, rss0 = 0, rss1, hwm, slowest = 0;
+  uint64_t start, written, acked, best = 0, sum = 0;
+  int ch, runs = 1, run, ii, ncmds, wait_secs = 2, eof;
+  pid_t pid = 0;
+  FILE *in;
+  time_t now;
+
+  while ((ch = getopt(argc, argv, "s:f:n:p:c:O:P:r:w:")) != -1) {
+    switch (ch) {
+    case 's': target = optarg; break;
+    case 'f': input = optarg; break;
+    case 'n': name = optarg; break;
+    case 'p': pass = optarg; break;
+    case 'c': client = optarg; break;
+    case 'O': login = optarg; break;
+    case 'P': pid = (pid_t) atoi(optarg); break;
+    case 'r': runs = atoi(optarg); break;
+    case 'w': wait_secs = atoi(optarg); break;
+    default: return 2;
+    }
+  }
+  if (!target || !input || runs < 1 || (login && !client))
+    die("Usage: burstbench replay -s host:port -f file [-n name] [-p pass]\n"
+        "       [-c host:port -O oper:password] [-P pid] [-r runs] [-w secs]");
+
+  /* read the burst, rewriting the uplink's PASS and SERVER lines */
+  if (!(in = fopen(input, "r")))
+    die("%s: %s", input, strerror(errno));
+  fseek(in, 0, SEEK_END);
+  size = ftell(in) * 2 + 2 * LINE_SIZE;
+  rewind(in);
+  burst = malloc(size);
+  line = malloc(size / 2);
+  now = time(NULL);
+  for (used = 0; fgets(line, LINE_SIZE, in); lines++) {
+    line[strcspn(line, "\r\n")] = '\0';
+    out = burst + used;
+    if (pass && !strncmp(line, "PASS ", 5))
+      used += sprintf(out, "PASS :%s\r\n", pass);
+    else if (!strncmp(line, "SERVER ", 7)) {
+      char sname[64], numcap[16], flags[32], *desc = strstr(line, " :");
+
+      if (sscanf(line, "SERVER %63s %*s %*s %*s %*s %15s %31s", sname,
+                 numcap, flags) != 3)
+        die("Bad SERVER line in %s: %s", input, line);
+      server_numeric(line, num);
+      /* a link timestamp too far from our clock is refused */
+      used += sprintf(out, "SERVER %s 1 %lu %lu J10 %s %s%s\r\n",
+                      name ? name : sname, (unsigned long) now - 3600,
+                      (unsigned long) now, numcap, flags, desc ? desc : " :");
+      hello = used;
+    } else
+      used += sprintf(out, "%s\r\n", line);
+  }
+  fclose(in);
+  free(line);
+  if (!num[0])
+    die("No SERVER line in %s", input);
+  printf("Burst of %lu lines, %lu bytes\n", lines, (unsigned long) used);
+
+  if (client) {
+    oper.fd = tcp_connect(client);
+    oper_login(&oper, login ? login : "", server);
+  }
+
+  for (run = 1; run <= runs; run++) {
+    if (client)
+      stats_commands(&oper, server, "reset", NULL, 0);
+    if (pid) {
+      proc_reset_peak(pid);
+      if (proc_usage(pid, &cpu0, &rss0, &hwm) < 0)
+        die("Cannot read the usage of process %d", (int) pid);
+    }
+
+    /* like a real uplink, burst only once the ircd has introduced itself;
+     * anything sent before is counted against the unregistered flood limit
+     */
+    link.fd = tcp_connect(target);
+    link.len = link.pos = 0;
+    write_all(link.fd, burst, hello);
+    while ((next = wait_line(&link)) && strncmp(next, "SERVER ", 7))
+      if (!strncmp(next, "ERROR", 5))
+        die("%s", next);
+    if (!next)
+      die("The ircd closed the link before introducing itself");
+    fcntl(link.fd, F_SETFL, O_NONBLOCK);
+    start = now_us();
+    written = acked = 0;
+    sent = hello;
+    eof = 0;
+
+    /* write the burst while reading (and mostly ignoring) the ircd's */
+    while (!acked && !eof) {
+      pfd.fd = link.fd;
+      pfd.events = POLLIN | (sent < used ? POLLOUT : 0);
+      if (poll(&pfd, 1, TIMEOUT_MS) <= 0)
+        die("Timeout waiting for the ircd");
+      if ((pfd.revents & POLLOUT) && sent < used) {
+        ssize_t res = write(link.fd, burst + sent, used - sent);
+
+        if (res > 0 && (sent += res) == used)
+          written = now_us();
+        else if (res < 0 && errno != EAGAIN && errno != EINTR)
+          die("write: %s", strerror(errno));
+      }
+      if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+        if (fill_lines(&link) == 0)
+          eof = 1;
+        while ((next = next_line(&link))) {
+          line_command(next, cmd, sizeof(cmd));
+          if (!strncmp(next, "ERROR", 5))
+            fprintf(stderr, "%s\n", next);
+          else if (!strcmp(cmd, "G")) /* answer the ircd's PINGs */
+            send_line(link.fd, "%s Z %s", num, strstr(next, " G ") + 3);
+          else if (!strcmp(cmd, "EB"))
+            send_line(link.fd, "%s EA", num);
+          else if (!strcmp(cmd, "EA") && sent == used)
+            acked = now_us();
+        }
+      }
+    }
+    if (!acked)
+      die("The ircd closed the link before END_OF_BURST_ACK");
+
+    printf("Run %d: written in %.3f s, END_OF_BURST acknowledged in %.3f s "
+           "(%.0f lines/s)\n", run, (written - start) / 1e6,
+           (acked - start) / 1e6, lines / ((acked - start) / 1e6));
+    if (pid && !proc_usage(pid, &cpu1, &rss1, &hwm))
+      printf("  ircd CPU %.3f s, RSS %lu -> %lu MB, peak %lu MB\n",
+             (cpu1 - cpu0) / 1e3, rss0 / 1024, rss1 / 1024, hwm / 1024);
+    if (client) {
+      ncmds = stats_commands(&oper, server, "time", cmds, 256);
+      qsort(cmds, ncmds, sizeof(cmds[0]), cmdtime_cmp);
+      printf("  %-12s %10s %10s %9s %9s\n", "Command", "Calls", "Total(ms)",
+             "Avg(us)", "Max(us)");
+      for (ii = 0; ii < ncmds && ii < TOP_CMDS; ii++)
+        printf("  %-12s %10lu %10lu %9lu %9lu\n", cmds[ii].cmd, cmds[ii].calls,
+               cmds[ii].total_ms, cmds[ii].avg_us, cmds[ii].max_us);
+    }
+    fflush(stdout);
+
+    sum += acked - start;
+    if (!best || acked - start < best)
+      best = acked - start;
+    if (acked - start > slowest)
+      slowest = acked - start;
+
+    /* drop the link and let the ircd forget the burst before the next run */
+    close(link.fd);
+    if (run < runs)
+      sleep(wait_secs);
+  }
+
+  if (runs > 1)
+    printf("%d runs: best %.3f s, mean %.3f s, worst %.3f s\n", runs,
+           best / 1e6, sum / 1e6 / runs, slowest / 1e6);
+  free(burst);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if (argc > 1 && !strcmp(argv[1], "record"))
+    return do_record(argc - 1, argv + 1);
+  if (argc > 1 && !strcmp(argv[1], "generate"))
+    return do_generate(argc - 1, argv + 1);
+  if (argc > 1 && !strcmp(argv[1], "replay"))
+    return do_replay(argc - 1, argv + 1);
+  fprintf(stderr, "Usage: %s record|generate|replay [options]\n", argv[0]);
+  return 2;
+}
@@ -0,0 +1,1060 @@
+/*
+ * IRC-Hispano IRC Daemon, tools/ircload.c
+ *
+ * Copyright (C) 1997-2019 IRC-Hispano Development Team <toni@tonigarcia.es>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/** @file
+ * @brief Synthetic client load generator.
+ *
+ * ircload opens many client connections (optionally over TLS) to a
+ * test server, registers them and joins each one to some channels,
+ * picked with a Zipf distribution so that a few channels get most of
+ * the members.  It then sends a mix of PRIVMSG, JOIN, PART, NICK and
+ * WHO at a fixed rate from random clients, and reports every few
+ * seconds the throughput and the percentiles of:
+ *
+ *  - the delivery latency of the channel messages, measured by every
+ *    member that receives one (the messages carry their send time);
+ *  - the time from the WHO request to the end of its reply;
+ *  - the time from connect() to RPL_WELCOME.
+ *
+ * The ircd limits how fast a single client may talk, so the per-client
+ * rate (actions per second divided by clients) should stay low; give
+ * the test clients a class with a large sendq and raise
+ * IPCHECK_CLONE_LIMIT, or use several source addresses with -b.
+ *
+ * Example: ircload -c 20000 -R 2000 -C 500 -j 3 -r 5000 -d 120
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#ifdef USE_SSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+#define LINE_SIZE   512    /**< Longest IRC line, with CR LF. */
+#define IN_SIZE     8192   /**< Input buffer of a client. */
+#define OUT_SIZE    4096   /**< Output buffer of a client. */
+#define NICK_SIZE   16     /**< Room for a nick. */
+#define MAX_JOINS   16     /**< Most channels a client is kept in. */
+#define TICK_MS     10     /**< Longest wait for events, in milliseconds. */
+#define HIST_SUB    16     /**< Histogram buckets per power of two. */
+#define HIST_SIZE   (64 * HIST_SUB) /**< Buckets in a histogram. */
+
+/** State of a client connection. */
+enum ClientState {
+  CS_FREE,        /**< Not connected. */
+  CS_CONNECTING,  /**< Waiting for connect() to finish. */
+  CS_HANDSHAKE,   /**< TLS handshake in progress. */
+  CS_REGISTERING, /**< NICK and USER sent. */
+  CS_ONLINE       /**< RPL_WELCOME received. */
+};
+
+/** Actions in the traffic mix. */
+enum Action { A_PRIVMSG, A_JOIN, A_PART, A_NICK, A_WHO, A_LAST };
+
+/** Names of the actions, for the reports. */
+static const char *actionNames[A_LAST] = {
+  "privmsg", "join", "part", "nick", "who"
+};
+
+/** A synthetic client. */
+struct LoadClient {
+  int              fd;          /**< Socket, or -1. */
+  enum ClientState state;       /**< State of the connection. */
+  unsigned int     id;          /**< Index in #clients. */
+  unsigned int     online_idx;  /**< Index in #online while online. */
+  unsigned int     nickgen;     /**< Nick changes made. */
+  int              want_write;  /**< Non-zero while waiting to write. */
+#ifdef USE_SSL
+  SSL             *ssl;         /**< TLS session, or NULL. */
+#endif
+  uint64_t         started;     /**< When connect() was called. */
+  uint64_t         who_sent;    /**< When the pending WHO was sent. */
+  unsigned int     nchans;      /**< Number of entries in \a chans. */
+  unsigned int     chans[MAX_JOINS]; /**< Channels joined. */
+  size_t           inlen;       /**< Bytes in \a inbuf. */
+  size_t           outlen;      /**< Bytes in \a outbuf. */
+  char             nick[NICK_SIZE]; /**< Current nick. */
+  char             inbuf[IN_SIZE];   /**< Partial input. */
+  char             outbuf[OUT_SIZE]; /**< Pending output. */
+};
+
+/** Latency histogram, log-linear in microseconds. */
+struct Histogram {
+  unsigned long count;           /**< Samples. */
+  uint64_t      max;             /**< Largest sample. */
+  unsigned long bucket[HIST_SIZE]; /**< Samples per bucket. */
+};
+
+/** Counters of an interval, or of the whole run. */
+struct Counters {
+  unsigned long actions[A_LAST]; /**< Actions sent. */
+  unsigned long received;        /**< Channel messages received. */
+  unsigned long skipped;         /**< Actions dropped by full buffers. */
+  unsigned long connects;        /**< Connections registered. */
+  unsigned long failures;        /**< Connections failed or closed. */
+  unsigned long bytes_in;        /**< Bytes read. */
+  unsigned long bytes_out;       /**< Bytes written. */
+  struct Histogram delivery;     /**< Channel message latency. */
+  struct Histogram who;          /**< WHO reply latency. */
+  struct Histogram reg;          /**< Registration time. */
+};
+
+/** Command line options. */
+static struct {
+  const char   *server;     /**< Server to connect to. */
+  const char   *port;       /**< Port to connect to. */
+  const char   *prefix;     /**< Prefix of nicks and channels. */
+  char         *sources;    /**< Comma separated source addresses. */
+  unsigned int  clients;    /**< Number of clients. */
+  unsigned int  conn_rate;  /**< Connections per second. */
+  unsigned int  channels;   /**< Number of channels. */
+  unsigned int  joins;      /**< Channels joined by each client. */
+  double        zipf;       /**< Exponent of the channel popularity. */
+  double        rate;       /**< Actions per second. */
+  unsigned int  mix[A_LAST]; /**< Weights of the actions. */
+  unsigned int  msglen;     /**< Length of the message texts. */
+  unsigned int  duration;   /**< Seconds to run after connecting. */
+  unsigned int  interval;   /**< Seconds between reports. */
+  int           tls;        /**< Non-zero to use TLS. */
+} opt = {
+  "127.0.0.1", "6667", "ld", NULL, 1000, 500, 100, 2, 1.0, 100.0,
+  { 70, 10, 10, 5, 5 }, 40, 60, 5, 0
+};
+
+static struct LoadClient *clients; /**< All the clients. */
+static unsigned int *online;       /**< Indexes of the online clients. */
+static unsigned int nonline;       /**< Entries in #online. */
+static unsigned int nconnected;    /**< Clients with a socket. */
+static unsigned int nstarted;      /**< Clients connect()ed so far. */
+static double *chanCdf;            /**< Cumulative channel popularity. */
+static struct addrinfo *serverAddr; /**< Address of the server. */
+static struct sockaddr_storage *sourceAddrs; /**< Source addresses. */
+static unsigned int nsources;      /**< Entries in #sourceAddrs. */
+static struct Counters total;      /**< Counters of the whole run. */
+static struct Counters interval;   /**< Counters of this interval. */
+static uint64_t randState = 88172645463325252ULL; /**< xorshift state. */
+#ifdef USE_EPOLL
+static int epollFd;                /**< The epoll descriptor. */
+#else
+static struct pollfd *pollFds;     /**< One entry per client. */
+#endif
+#ifdef USE_SSL
+static SSL_CTX *sslCtx;            /**< TLS context of the clients. */
+#endif
+
+/** Get the time of a monotonic clock.
+ * @return Microseconds since some arbitrary point.
+ */
+static uint64_t
+now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/** Get a pseudo-random number (xorshift64).
+ * @return Next number of the sequence.
+ */
+static uint64_t
+rnd(void)
+{
+  randState ^= randState << 13;
+  randState ^= randState >> 7;
+  randState ^= randState << 17;
+  return randState;
+}
+
+/** Get a pseudo-random number in a range.
+ * @param[in] limit Upper bound (exclusive), not zero.
+ * @return Number from 0 to \a limit - 1.
+ */
+static unsigned int
+rnd_below(unsigned int limit)
+{
+  return (unsigned int) (rnd() % limit);
+}
+
+/** Add a sample to a histogram.
+ * @param[in,out] hist Histogram to update.
+ * @param[in] value Sample, in microseconds.
+ */
+static void
+hist_add(struct Histogram *hist, uint64_t value)
+{
+  unsigned int msb = 0, idx;
+
+  if (value >= HIST_SUB) {
+    for (msb = 63; !(value >> msb); msb--)
+      ;
+    /* HIST_SUB buckets between each power of two and the next */
+    idx = (msb - 3) * HIST_SUB + (unsigned int) ((value >> (msb - 4)) & (HIST_SUB - 1));
+  } else
+    idx = (unsigned int) value;
+  if (idx >= HIST_SIZE)
+    idx = HIST_SIZE - 1;
+  hist->bucket[idx]++;
+  hist->count++;
+  if (value > hist->max)
+    hist->max = value;
+}
+
+/** Get the lowest value of a histogram bucket.
+ * @param[in] idx Bucket index.
+ * @return Lowest sample counted in the bucket.
+ */
+static uint64_t
+hist_value(unsigned int idx)
+{
+  unsigned int msb;
+
+  if (idx < HIST_SUB)
+    return idx;
+  msb = idx / HIST_SUB + 3;
+  return ((uint64_t) 1 << msb) | ((uint64_t) (idx % HIST_SUB) << (msb - 4));
+}
+
+/** Find a percentile of a histogram.
+ * @param[in] hist Histogram.
+ * @param[in] pct Percentile, from 0 to 100.
+ * @return Approximate value of the percentile, in milliseconds.
+ */
+static double
+hist_pct(const struct Histogram *hist, double pct)
+{
+  unsigned long want, seen = 0;
+  unsigned int ii;
+
+  if (!hist->count)
+    return 0.0;
+  want = (unsigned long) (hist->count * pct / 100.0);
+  if (want < 1)
+    want = 1;
+  for (ii = 0; ii < HIST_SIZE; ii++)
+    if ((seen += hist->bucket[ii]) >= want)
+      return hist_value(ii) / 1000.0;
+  return hist->max / 1000.0;
+}
+
+/** Merge a histogram into another.
+ * @param[in,out] to Histogram to update.
+ * @param[in] from Histogram to add.
+ */
+static void
+hist_merge(struct Histogram *to, const struct Histogram *from)
+{
+  unsigned int ii;
+
+  for (ii = 0; ii < HIST_SIZE; ii++)
+    to->bucket[ii] += from->bucket[ii];
+  to->count += from->count;
+  if (from->max > to->max)
+    to->max = from->max;
+}
+
+/** Pick a channel with the configured popularity distribution.
+ * @return Channel number.
+ */
+static unsigned int
+pick_channel(void)
+{
+  double target = (rnd() >> 11) * (1.0 / 9007199254740992.0);
+  unsigned int lo = 0, hi = opt.channels - 1, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (chanCdf[mid] < target)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/** Watch a socket for readability, and writability if requested.
+ * @param[in] cli Client whose socket changed.
+ * @param[in] add Non-zero for a new socket.
+ */
+static void
+ev_update(struct LoadClient *cli, int add)
+{
+#ifdef USE_EPOLL
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | (cli->want_write ? EPOLLOUT : 0);
+  ev.data.u32 = cli->id;
+  epoll_ctl(epollFd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, cli->fd, &ev);
+#else
+  pollFds[cli->id].fd = cli->fd;
+  pollFds[cli->id].events = POLLIN | (cli->want_write ? POLLOUT : 0);
+#endif
+}
+
+/** Close the connection of a client.
+ * @param[in] cli Client to disconnect.
+ * @param[in] failed Non-zero if the connection failed or was closed
+ *   by the server.
+ */
+static void
+client_close(struct LoadClient *cli, int failed)
+{
+  if (cli->state == CS_FREE)
+    return;
+  if (cli->state == CS_ONLINE) {
+    /* swap the last online client into our place */
+    online[cli->online_idx] = online[--nonline];
+    clients[online[cli->online_idx]].online_idx = cli->online_idx;
+  }
+#ifdef USE_SSL
+  if (cli->ssl) {
+    SSL_free(cli->ssl);
+    cli->ssl = NULL;
+  }
+#endif
+#ifndef USE_EPOLL
+  pollFds[cli->id].fd = -1;
+#endif
+  close(cli->fd); /* also removes it from the epoll set */
+  cli->fd = -1;
+  cli->state = CS_FREE;
+  nconnected--;
+  if (failed) {
+    interval.failures++;
+    total.failures++;
+  }
+}
+
+/** Write as much pending output of a client as possible.
+ * @param[in] cli Client to flush.
+ */
+static void
+client_flush(struct LoadClient *cli)
+{
+  ssize_t res;
+  int want_write;
+
+  while (cli->outlen > 0) {
+#ifdef USE_SSL
+    if (cli->ssl) {
+      res = SSL_write(cli->ssl, cli->outbuf, (int) cli->outlen);
+      if (res <= 0) {
+        int err = SSL_get_error(cli->ssl, (int) res);
+        if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
+          break;
+        client_close(cli, 1);
+        return;
+      }
+    } else
+#endif
+    if ((res = write(cli->fd, cli->outbuf, cli->outlen)) < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        break;
+      client_close(cli, 1);
+      return;
+    }
+    interval.bytes_out += res;
+    total.bytes_out += res;
+    memmove(cli->outbuf, cli->outbuf + res, cli->outlen - res);
+    cli->outlen -= res;
+  }
+
+  want_write = cli->outlen > 0;
+  if (want_write != cli->want_write) {
+    cli->want_write = want_write;
+    ev_update(cli, 0);
+  }
+}
+
+/** Queue a line for a client to send.
+ * @param[in] cli Client to send from.
+ * @param[in] fmt Format of the line, without CR LF.
+ * @return Zero if the line was queued, -1 if the buffer is full.
+ */
+static int
+client_send(struct LoadClient *cli, const char *fmt, ...)
+{
+  va_list vl;
+  int len;
+
+  if (OUT_SIZE - cli->outlen < LINE_SIZE)
+    return -1;
+  va_start(vl, fmt);
+  len = vsnprintf(cli->outbuf + cli->outlen, LINE_SIZE - 1, fmt, vl);
+  va_end(vl);
+  if (len > LINE_SIZE - 3)
+    len = LINE_SIZE - 3;
+  cli->outbuf[cli->outlen + len++] = '\r';
+  cli->outbuf[cli->outlen + len++] = '\n';
+  cli->outlen += len;
+  if (!cli->want_write)
+    client_flush(cli);
+  return 0;
+}
+
+/** Send the registration of a client.
+ * @param[in] cli Client connected.
+ */
+static void
+client_register(struct LoadClient *cli)
+{
+  cli->state = CS_REGISTERING;
+  snprintf(cli->nick, sizeof(cli->nick), "%s%u", opt.prefix, cli->id);
+  client_send(cli, "NICK %s", cli->nick);
+  client_send(cli, "USER %s 0 * :ircload client %u", opt.prefix, cli->id);
+}
+
+#ifdef USE_SSL
+/** Continue the TLS handshake of a client.
+ * @param[in] cli Client in CS_HANDSHAKE.
+ */
+static void
+client_handshake(struct LoadClient *cli)
+{
+  int res, err;
+
+  if ((res = SSL_connect(cli->ssl)) == 1) {
+    client_register(cli);
+    return;
+  }
+  err = SSL_get_error(cli->ssl, res);
+  if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+    if ((err == SSL_ERROR_WANT_WRITE) != cli->want_write) {
+      cli->want_write = (err == SSL_ERROR_WANT_WRITE);
+      ev_update(cli, 0);
+    }
+    return;
+  }
+  client_close(cli, 1);
+}
+#endif
+
+/** Start the connection of a client.
+ * @param[in] cli Client to connect.
+ */
+static void
+client_connect(struct LoadClient *cli)
+{
+  int fd, one = 1;
+
+  if ((fd = socket(serverAddr->ai_family, SOCK_STREAM, 0)) < 0) {
+    interval.failures++;
+    total.failures++;
+    return;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (nsources) {
+    struct sockaddr_storage *src = &sourceAddrs[cli->id % nsources];
+    bind(fd, (struct sockaddr *) src, src->ss_family == AF_INET
+         ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+  }
+  if (connect(fd, serverAddr->ai_addr, serverAddr->ai_addrlen) < 0
+      && errno != EINPROGRESS) {
+    close(fd);
+    interval.failures++;
+    total.failures++;
+    return;
+  }
+
+  cli->fd = fd;
+  cli->state = CS_CONNECTING;
+  cli->started = now_us();
+  cli->inlen = cli->outlen = 0;
+  cli->nchans = 0;
+  cli->nickgen = 0;
+  cli->who_sent = 0;
+  cli->want_write = 1;
+  nconnected++;
+  ev_update(cli, 1);
+}
+
+/** Finish the connection of a client.
+ * @param[in] cli Client in CS_CONNECTING whose socket became writable.
+ */
+static void
+client_connected(struct LoadClient *cli)
+{
+  int err = 0;
+  socklen_t len = sizeof(err);
+
+  if (getsockopt(cli->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+    client_close(cli, 1);
+    return;
+  }
+  cli->want_write = 0;
+  ev_update(cli, 0);
+#ifdef USE_SSL
+  if (opt.tls) {
+    cli->state = CS_HANDSHAKE;
+    cli->ssl = SSL_new(sslCtx);
+    SSL_set_fd(cli->ssl, cli->fd);
+    SSL_set_mode(cli->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE
+                 | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    client_handshake(cli);
+    return;
+  }
+#endif
+  client_register(cli);
+}
+
+/** Join a client to a channel.
+ * @param[in] cli Online client.
+ * @param[in] chan Channel number.
+ * @return Zero if the JOIN was sent, -1 if not.
+ */
+static int
+client_join(struct LoadClient *cli, unsigned int chan)
+{
+  unsigned int ii;
+
+  if (cli->nchans >= MAX_JOINS)
+    return -1;
+  for (ii = 0; ii < cli->nchans; ii++)
+    if (cli->chans[ii] == chan)
+      return -1;
+  if (client_send(cli, "JOIN #%s%u", opt.prefix, chan) < 0)
+    return -1;
+  cli->chans[cli->nchans++] = chan;
+  return 0;
+}
+
+/** Handle a line received by a client.
+ * @param[in] cli Client that received the line.
+ * @param[in] line Line, without CR LF.
+ */
+static void
+client_line(struct LoadClient *cli, char *line)
+{
+  char *prefix = NULL, *cmd, *rest;
+  unsigned int ii;
+
+  if (*line == ':') {
+    prefix = line + 1;
+    if (!(line = strchr(line, ' ')))
+      return;
+    *line++ = '\0';
+  }
+  cmd = line;
+  if ((rest = strchr(line, ' ')))
+    *rest++ = '\0';
+  else
+    rest = "";
+
+  if (!strcmp(cmd, "PING")) {
+    client_send(cli, "PONG %s", rest);
+  } else if (!strcmp(cmd, "PRIVMSG")) {
+    char *text = strstr(rest, " :");
+    unsigned long long sent;
+
+    if (text && sscanf(text + 2, "LT %llu", &sent) == 1) {
+      uint64_t now = now_us();
+      uint64_t lat = now > sent ? now - sent : 0;
+      hist_add(&interval.delivery, lat);
+      interval.received++;
+      total.received++;
+    }
+  } else if (!strcmp(cmd, "001")) {
+    cli->state = CS_ONLINE;
+    cli->online_idx = nonline;
+    online[nonline++] = cli->id;
+    interval.connects++;
+    total.connects++;
+    hist_add(&interval.reg, now_us() - cli->started);
+    /* a popular channel may be picked twice; try a few more times */
+    for (ii = 0; ii < 4 * opt.joins && cli->nchans < opt.joins
+           && cli->nchans < opt.channels; ii++)
+      client_join(cli, pick_channel());
+  } else if (!strcmp(cmd, "315")) {
+    if (cli->who_sent) {
+      hist_add(&interval.who, now_us() - cli->who_sent);
+      cli->who_sent = 0;
+    }
+  } else if (!strcmp(cmd, "432") || !strcmp(cmd, "433")) {
+    if (cli->state == CS_REGISTERING) {
+      snprintf(cli->nick, sizeof(cli->nick), "%s%u_%u", opt.prefix,
+               cli->id, ++cli->nickgen);
+      client_send(cli, "NICK %s", cli->nick);
+    }
+  } else if (!strcmp(cmd, "NICK") && prefix) {
+    size_t len = strcspn(prefix, "!");
+
+    if (len == strlen(cli->nick) && !strncmp(prefix, cli->nick, len)) {
+      if (*rest == ':')
+        rest++;
+      snprintf(cli->nick, sizeof(cli->nick), "%s", rest);
+    }
+  } else if (!strcmp(cmd, "ERROR")) {
+    client_close(cli, 1);
+  }
+}
+
+/** Read and handle the input of a client.
+ * @param[in] cli Client with a readable socket.
+ */
+static void
+client_read(struct LoadClient *cli)
+{
+  char *line, *end;
+  ssize_t res;
+
+  for (;;) {
+    if (cli->inlen >= IN_SIZE - 1)
+      cli->inlen = 0; /* line too long, give up on it */
+#ifdef USE_SSL
+    if (cli->ssl) {
+      res = SSL_read(cli->ssl, cli->inbuf + cli->inlen,
+                     (int) (IN_SIZE - 1 - cli->inlen));
+      if (res <= 0) {
+        int err = SSL_get_error(cli->ssl, (int) res);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+          return;
+        client_close(cli, 1);
+        return;
+      }
+    } else
+#endif
+    if ((res = read(cli->fd, cli->inbuf + cli->inlen,
+                    IN_SIZE - 1 - cli->inlen)) <= 0) {
+      if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;
+      client_close(cli, 1);
+      return;
+    }
+    interval.bytes_in += res;
+    total.bytes_in += res;
+    cli->inlen += res;
+    cli->inbuf[cli->inlen] = '\0';
+
+    for (line = cli->inbuf; (end = strchr(line, '\n')); line = end + 1) {
+      *end = '\0';
+      if (end > line && end[-1] == '\r')
+        end[-1] = '\0';
+      client_line(cli, line);
+      if (cli->state == CS_FREE)
+        return;
+    }
+    cli->inlen -= line - cli->inbuf;
+    memmove(cli->inbuf, line, cli->inlen);
+  }
+}
+
+/** Handle the events of a client socket.
+ * @param[in] cli Client.
+ * @param[in] readable Non-zero if the socket is readable.
+ * @param[in] writable Non-zero if the socket is writable.
+ */
+static void
+client_event(struct LoadClient *cli, int readable, int writable)
+{
+  if (cli->state == CS_CONNECTING) {
+    if (readable || writable)
+      client_connected(cli);
+    return;
+  }
+#ifdef USE_SSL
+  if (cli->state == CS_HANDSHAKE) {
+    client_handshake(cli);
+    return;
+  }
+#endif
+  if (writable)
+    client_flush(cli);
+  if (readable && cli->state != CS_FREE)
+    client_read(cli);
+}
+
+/** Wait for socket events and handle them.
+ * @param[in] timeout Longest wait, in milliseconds.
+ */
+static void
+wait_events(int timeout)
+{
+#ifdef USE_EPOLL
+  struct epoll_event events[1024];
+  int ii, nfds;
+
+  nfds = epoll_wait(epollFd, events, 1024, timeout);
+  for (ii = 0; ii < nfds; ii++)
+    client_event(&clients[events[ii].data.u32],
+                 events[ii].events & (EPOLLIN | EPOLLERR | EPOLLHUP),
+                 events[ii].events & EPOLLOUT);
+#else
+  unsigned int ii;
+
+  if (poll(pollFds, opt.clients, timeout) <= 0)
+    return;
+  for (ii = 0; ii < opt.clients; ii++)
+    if (pollFds[ii].fd >= 0 && pollFds[ii].revents)
+      client_event(&clients[ii],
+                   pollFds[ii].revents & (POLLIN | POLLERR | POLLHUP),
+                   pollFds[ii].revents & POLLOUT);
+#endif
+}
+
+/** Make a random online client do one action of the mix.
+ * @param[in] action Action to do.
+ */
+static void
+do_action(enum Action action)
+{
+  struct LoadClient *cli = &clients[online[rnd_below(nonline)]];
+  unsigned int idx;
+  int res = -1;
+
+  switch (action) {
+  case A_PRIVMSG:
+    if (!cli->nchans)
+      break;
+    res = client_send(cli, "PRIVMSG #%s%u :LT %llu %.*s", opt.prefix,
+                      cli->chans[rnd_below(cli->nchans)],
+                      (unsigned long long) now_us(), (int) opt.msglen,
+                      "Lorem ipsum dolor sit amet, consectetur adipiscing "
+                      "elit, sed do eiusmod tempor incididunt ut labore et "
+                      "dolore magna aliqua. Ut enim ad minim veniam, quis "
+                      "nostrud exercitation ullamco laboris nisi ut aliquip "
+                      "ex ea commodo consequat. Duis aute irure dolor in "
+                      "reprehenderit in voluptate velit esse cillum dolore "
+                      "eu fugiat nulla pariatur. Excepteur sint occaecat "
+                      "cupidatat non proident, sunt in culpa qui officia "
+                      "deserunt mollit anim id est laborum.");
+    break;
+  case A_JOIN:
+    res = client_join(cli, pick_channel());
+    break;
+  case A_PART:
+    if (!cli->nchans)
+      break;
+    idx = rnd_below(cli->nchans);
+    if ((res = client_send(cli, "PART #%s%u", opt.prefix, cli->chans[idx])) == 0)
+      cli->chans[idx] = cli->chans[--cli->nchans];
+    break;
+  case A_NICK:
+    res = client_send(cli, "NICK %s%u_%u", opt.prefix, cli->id, ++cli->nickgen);
+    break;
+  case A_WHO:
+    if (!cli->nchans || cli->who_sent)
+      break;
+    if ((res = client_send(cli, "WHO #%s%u", opt.prefix,
+                           cli->chans[rnd_below(cli->nchans)])) == 0)
+      cli->who_sent = now_us();
+    break;
+  default:
+    break;
+  }
+
+  if (res < 0) {
+    interval.skipped++;
+    total.skipped++;
+  } else {
+    interval.actions[action]++;
+    total.actions[action]++;
+  }
+}
+
+/** Pick an action of the mix at random.
+ * @return Action picked.
+ */
+static enum Action
+pick_action(void)
+{
+  unsigned int sum = 0, ii, target;
+
+  for (ii = 0; ii < A_LAST; ii++)
+    sum += opt.mix[ii];
+  target = rnd_below(sum);
+  for (ii = 0; ii < A_LAST - 1; ii++) {
+    if (target < opt.mix[ii])
+      break;
+    target -= opt.mix[ii];
+  }
+  return (enum Action) ii;
+}
+
+/** Print the counters of an interval or of the whole run.
+ * @param[in] cnt Counters to print.
+ * @param[in] secs Length of the period, in seconds.
+ * @param[in] label Label of the line.
+ */
+static void
+report(const struct Counters *cnt, double secs, const char *label)
+{
+  unsigned long actions = 0;
+  unsigned int ii;
+
+  for (ii = 0; ii < A_LAST; ii++)
+    actions += cnt->actions[ii];
+  printf("%-8s conn=%u online=%u new=%lu fail=%lu act=%.0f/s recv=%.0f/s "
+         "skip=%lu in=%.0fKB/s out=%.0fKB/s\n", label, nconnected, nonline,
+         cnt->connects, cnt->failures, actions / secs, cnt->received / secs,
+         cnt->skipped, cnt->bytes_in / secs / 1024, cnt->bytes_out / secs / 1024);
+  if (cnt->delivery.count)
+    printf("         delivery ms p50=%.2f p90=%.2f p99=%.2f p99.9=%.2f max=%.2f\n",
+           hist_pct(&cnt->delivery, 50), hist_pct(&cnt->delivery, 90),
+           hist_pct(&cnt->delivery, 99), hist_pct(&cnt->delivery, 99.9),
+           cnt->delivery.max / 1000.0);
+  if (cnt->who.count)
+    printf("         who ms      p50=%.2f p90=%.2f p99=%.2f max=%.2f\n",
+           hist_pct(&cnt->who, 50), hist_pct(&cnt->who, 90),
+           hist_pct(&cnt->who, 99), cnt->who.max / 1000.0);
+  if (cnt->reg.count)
+    printf("         register ms p50=%.2f p90=%.2f p99=%.2f max=%.2f\n",
+           hist_pct(&cnt->reg, 50), hist_pct(&cnt->reg, 90),
+           hist_pct(&cnt->reg, 99), cnt->reg.max / 1000.0);
+  fflush(stdout);
+}
+
+/** Add the counters of an interval to the totals and reset them. */
+static void
+interval_end(void)
+{
+  hist_merge(&total.delivery, &interval.delivery);
+  hist_merge(&total.who, &interval.who);
+  hist_merge(&total.reg, &interval.reg);
+  memset(&interval, 0, sizeof(interval));
+}
+
+/** Parse the comma separated source addresses of -b.
+ * @return Zero on success, -1 on error.
+ */
+static int
+parse_sources(void)
+{
+  struct addrinfo hints, *res;
+  char *name;
+  unsigned int count = 1;
+
+  for (name = opt.sources; *name; name++)
+    if (*name == ',')
+      count++;
+  sourceAddrs = calloc(count, sizeof(*sourceAddrs));
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = serverAddr->ai_family;
+  hints.ai_flags = AI_NUMERICHOST;
+  for (name = strtok(opt.sources, ","); name; name = strtok(NULL, ",")) {
+    if (getaddrinfo(name, NULL, &hints, &res)) {
+      fprintf(stderr, "Bad source address %s\n", name);
+      return -1;
+    }
+    memcpy(&sourceAddrs[nsources++], res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+  }
+  return 0;
+}
+
+/** Print the usage of the program.
+ * @param[in] name Name of the program.
+ */
+static void
+usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -s host     server (%s)\n"
+          "  -p port     port (%s)\n"
+          "  -S          use TLS\n"
+          "  -b a,b,...  source addresses, used in turn\n"
+          "  -c n        clients (%u)\n"
+          "  -R n        connections per second (%u)\n"
+          "  -C n        channels (%u)\n"
+          "  -j n        channels joined by each client (%u)\n"
+          "  -z s        Zipf exponent of channel popularity, 0 for uniform (%.1f)\n"
+          "  -r n        actions per second (%.0f)\n"
+          "  -m p,j,l,n,w weights of PRIVMSG,JOIN,PART,NICK,WHO (%u,%u,%u,%u,%u)\n"
+          "  -l n        length of the message texts (%u)\n"
+          "  -n prefix   prefix of nicks and channels (%s)\n"
+          "  -d secs     duration after all clients are connected (%u)\n"
+          "  -i secs     report interval (%u)\n",
+          name, opt.server, opt.port, opt.clients, opt.conn_rate, opt.channels,
+          opt.joins, opt.zipf, opt.rate, opt.mix[0], opt.mix[1], opt.mix[2],
+          opt.mix[3], opt.mix[4], opt.msglen, opt.prefix, opt.duration,
+          opt.interval);
+  exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct addrinfo hints;
+  struct rlimit rlim;
+  uint64_t now, last_tick, last_report, ramp_end = 0, run_start;
+  double conn_credit = 0.0, act_credit = 0.0, weight = 0.0;
+  unsigned int ii;
+  int ch, res;
+
+  while ((ch = getopt(argc, argv, "s:p:Sb:c:R:C:j:z:r:m:l:n:d:i:h")) != -1) {
+    switch (ch) {
+    case 's': opt.server = optarg; break;
+    case 'p': opt.port = optarg; break;
+    case 'S': opt.tls = 1; break;
+    case 'b': opt.sources = optarg; break;
+    case 'c': opt.clients = strtoul(optarg, NULL, 10); break;
+    case 'R': opt.conn_rate = strtoul(optarg, NULL, 10); break;
+    case 'C': opt.channels = strtoul(optarg, NULL, 10); break;
+    case 'j': opt.joins = strtoul(optarg, NULL, 10); break;
+    case 'z': opt.zipf = atof(optarg); break;
+    case 'r': opt.rate = atof(optarg); break;
+    case 'm':
+      if (sscanf(optarg, "%u,%u,%u,%u,%u", &opt.mix[0], &opt.mix[1],
+                 &opt.mix[2], &opt.mix[3], &opt.mix[4]) != A_LAST)
+        usage(argv[0]);
+      break;
+    case 'l': opt.msglen = strtoul(optarg, NULL, 10); break;
+    case 'n': opt.prefix = optarg; break;
+    case 'd': opt.duration = strtoul(optarg, NULL, 10); break;
+    case 'i': opt.interval = strtoul(optarg, NULL, 10); break;
+    default: usage(argv[0]);
+    }
+  }
+  if (!opt.clients || !opt.channels || !opt.conn_rate || !opt.interval
+      || opt.joins > MAX_JOINS
+      || !(opt.mix[0] + opt.mix[1] + opt.mix[2] + opt.mix[3] + opt.mix[4]))
+    usage(argv[0]);
+#ifndef USE_SSL
+  if (opt.tls) {
+    fprintf(stderr, "TLS support was not compiled in\n");
+    return 1;
+  }
+#else
+  if (opt.tls) {
+    SSL_library_init();
+    SSL_load_error_strings();
+    if (!(sslCtx = SSL_CTX_new(SSLv23_client_method()))) {
+      fprintf(stderr, "Cannot create the TLS context\n");
+      return 1;
+    }
+    SSL_CTX_set_verify(sslCtx, SSL_VERIFY_NONE, NULL);
+  }
+#endif
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_socktype = SOCK_STREAM;
+  if ((res = getaddrinfo(opt.server, opt.port, &hints, &serverAddr))) {
+    fprintf(stderr, "%s: %s\n", opt.server, gai_strerror(res));
+    return 1;
+  }
+  if (opt.sources && parse_sources() < 0)
+    return 1;
+
+  /* every client needs a descriptor */
+  if (!getrlimit(RLIMIT_NOFILE, &rlim) && rlim.rlim_cur < opt.clients + 32) {
+    rlim.rlim_cur = rlim.rlim_max < opt.clients + 32 ? rlim.rlim_max
+      : opt.clients + 32;
+    setrlimit(RLIMIT_NOFILE, &rlim);
+    if (rlim.rlim_cur < opt.clients + 32)
+      fprintf(stderr, "Warning: only %lu descriptors available\n",
+              (unsigned long) rlim.rlim_cur);
+  }
+
+  /* cumulative popularity of the channels: channel k gets 1/(k+1)^s */
+  chanCdf = calloc(opt.channels, sizeof(*chanCdf));
+  for (ii = 0; ii < opt.channels; ii++)
+    chanCdf[ii] = (weight += 1.0 / pow(ii + 1, opt.zipf));
+  for (ii = 0; ii < opt.channels; ii++)
+    chanCdf[ii] /= weight;
+
+  clients = calloc(opt.clients, sizeof(*clients));
+  online = calloc(opt.clients, sizeof(*online));
+  for (ii = 0; ii < opt.clients; ii++) {
+    clients[ii].id = ii;
+    clients[ii].fd = -1;
+  }
+#ifdef USE_EPOLL
+  if ((epollFd = epoll_create(opt.clients)) < 0) {
+    perror("epoll_create");
+    return 1;
+  }
+#else
+  pollFds = calloc(opt.clients, sizeof(*pollFds));
+  for (ii = 0; ii < opt.clients; ii++)
+    pollFds[ii].fd = -1;
+#endif
+  randState ^= (uint64_t) getpid() << 32 | (uint64_t) time(NULL);
+
+  run_start = last_tick = last_report = now_us();
+  for (;;) {
+    wait_events(TICK_MS);
+    now = now_us();
+
+    /* open new connections at the configured rate */
+    if (nstarted < opt.clients) {
+      conn_credit += (now - last_tick) * opt.conn_rate / 1e6;
+      for (; conn_credit >= 1.0 && nstarted < opt.clients; conn_credit -= 1.0)
+        client_connect(&clients[nstarted++]);
+    } else if (!ramp_end)
+      ramp_end = now;
+
+    /* generate the traffic mix */
+    if (nonline > 0) {
+      act_credit += (now - last_tick) * opt.rate / 1e6;
+      for (; act_credit >= 1.0; act_credit -= 1.0)
+        do_action(pick_action());
+    }
+    last_tick = now;
+
+    if (now - last_report >= (uint64_t) opt.interval * 1000000) {
+      char label[16];
+
+      snprintf(label, sizeof(label), "%.0fs", (now - run_start) / 1e6);
+      report(&interval, (now - last_report) / 1e6, label);
+      interval_end();
+      last_report = now;
+    }
+
+    if (ramp_end && now - ramp_end >= (uint64_t) opt.duration * 1000000)
+      break;
+    if (ramp_end && !nconnected) {
+      fprintf(stderr, "All connections were closed\n");
+      break;
+    }
+  }
+
+  interval_end();
+  report(&total, (now - run_start) / 1e6, "total");
+  printf("actions:");
+  for (ii = 0; ii < A_LAST; ii++)
+    printf(" %s=%lu", actionNames[ii], total.actions[ii]);
+  printf("\n");
+  return 0;
+}